@@ -5,35 +5,97 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-s [-c]] <size in kB> [device]\n"
+		"       %s -i [device]\n", getprogname(), getprogname());
+	exit(1);
+}
+
+static int
+info(int fd, const char *d)
+{
+	struct ramdisk_stat stat;
+
+	if(ioctl(fd, MIOCRAMSTAT, &stat) < 0) {
+		perror("MIOCRAMSTAT");
+		return 1;
+	}
+
+	printf("%s: size %"PRIu64"kB, %s%s\n", d, stat.size / 1024,
+		stat.flags & RAMDISK_COMPRESS ? "compressed " : "",
+		stat.meta_bytes > 0 ? "sparse" : "contiguous");
+	printf("pages in use: %u (%u compressed)\n",
+		stat.pages, stat.comp_pages);
+	printf("memory used: %"PRIu64"kB data, %"PRIu64"kB bookkeeping\n",
+		stat.stored_bytes / 1024, stat.meta_bytes / 1024);
+
+	return 0;
+}
 
 int
 main(int argc, char *argv[])
 {
-	int fd;
+	struct ramdisk_sparse sparse;
+	int fd, ch, sflag, cflag, iflag;
 	signed long size;
 	char *d;
 
-	if(argc < 2 || argc > 3) {
-		fprintf(stderr, "usage: %s <size in kB> [device]\n",
-			argv[0]);
-		return 1;
+	sflag = cflag = iflag = 0;
+	while((ch = getopt(argc, argv, "sci")) != -1) {
+		switch(ch) {
+		case 's': sflag = 1; break;
+		case 'c': cflag = 1; break;
+		case 'i': iflag = 1; break;
+		default: usage();
+		}
 	}
+	argc -= optind;
+	argv += optind;
 
-	d = argc == 2 ? _PATH_RAMDISK : argv[2];
+	if(iflag ? (argc > 1 || sflag || cflag) :
+		(argc < 1 || argc > 2 || (cflag && !sflag)))
+		usage();
+
+	if(iflag)
+		d = argc == 0 ? _PATH_RAMDISK : argv[0];
+	else
+		d = argc == 1 ? _PATH_RAMDISK : argv[1];
 	if((fd=open(d, O_RDONLY)) < 0) {
 		perror(d);
 		return 1;
 	}
 
+	if(iflag)
+		return info(fd, d);
+
 #define KFACTOR 1024
-	size = atol(argv[1])*KFACTOR;
+	size = atol(argv[0])*KFACTOR;
 
 	if(size < 0) {
 		fprintf(stderr, "size should be non-negative.\n");
 		return 1;
 	}
 
-	if(ioctl(fd, MIOCRAMSIZE, &size) < 0) {
+	if(sflag) {
+		/* Pages are allocated only as they are written to. */
+		sparse.size = (uint64_t)atol(argv[0])*KFACTOR;
+		sparse.flags = cflag ? RAMDISK_COMPRESS : 0;
+
+		if(ioctl(fd, MIOCRAMSPARSE, &sparse) < 0) {
+			perror("MIOCRAMSPARSE");
+			return 1;
+		}
+
+		fprintf(stdout, "size on %s set to %"PRIu64"kB (sparse)\n",
+			d, sparse.size/KFACTOR);
+
+		return 0;
+	} else if(ioctl(fd, MIOCRAMSIZE, &size) < 0) {
 		perror("MIOCRAMSIZE");
 		return 1;
 	}
@@ -42,4 +104,3 @@ main(int argc, char *argv[])
 
 	return 0;
 }
-
@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #define SECTOR_SIZE		512
 #define BLK_MAX_SECTORS		(sizeof(int) == 2 ? 32 : 64)
@@ -49,7 +50,8 @@ void fatal(const char *label)
 void usage(void)
 {
 	fprintf(stderr,
-"Usage: rawspeed [-u unit] [-m max] [-t seconds] [-c] [-r limit] device\n");
+"Usage: rawspeed [-u unit] [-m max] [-t seconds] [-c] [-r limit] [-p procs]\n"
+"                device\n");
 	fprintf(stderr,
 "       -u unit = best sector multiple (default 2)\n");
 	fprintf(stderr,
@@ -61,6 +63,8 @@ void usage(void)
 "       -c = cache test: rewind after each read or write of max size\n");
 	fprintf(stderr,
 "       -r limit = random seeks upto sector 'limit' before reading or writing\n");
+	fprintf(stderr,
+"       -p procs = run the test in 'procs' processes at once (default 1)\n");
 	exit(1);
 }
 
@@ -74,7 +78,9 @@ void timeout(int sig)
 int main(int argc, char **argv)
 {
 	int i, fd, n= 0, unit= -1, max= -1, cache= 0;
-	int size, seconds= 10;
+	int size, seconds= 10, nprocs= 1, proc, pfd[2], saved_errno;
+	pid_t pid;
+	off_t counts[2];
 	long tenthsec;
 #if USEC
 	struct timeval start_time, end_time;
@@ -124,6 +130,11 @@ int main(int argc, char **argv)
 				randlimit= atol(argv[++i]);
 				if (randlimit <= 0) usage();
 				break;
+			case 'p':
+				if (i == argc) usage();
+				nprocs= atoi(argv[++i]);
+				if (nprocs <= 0) usage();
+				break;
 			default:
 				usage();
 			}
@@ -133,6 +144,7 @@ int main(int argc, char **argv)
 	if (i != argc - 1) usage();
 
 	if (strcmp(argv[i], "-") == 0) {
+		if (nprocs > 1) usage();
 		fd= wbytes == 0 ? 0 : 1;
 		device= "";
 	} else {
@@ -176,6 +188,25 @@ int main(int argc, char **argv)
 	start_time= time((time_t *) nil);
 	if (randlimit != 0) srand((int) (start_time & INT_MAX));
 #endif
+
+	/* With several processes, each does its own I/O on its own file
+	 * descriptor, so that the device sees that many requests at once.
+	 * The first process reports the total.
+	 */
+	if (nprocs > 1 && pipe(pfd) == -1) fatal("pipe");
+	for (proc= 1; proc < nprocs; proc++) {
+		if ((pid= fork()) == -1) fatal("fork");
+		if (pid == 0) {
+			close(fd);
+			if ((fd= open(device, wbytes == 0 ? O_RDONLY
+							: O_WRONLY, 0)) < 0)
+				fatal(device);
+			if (randlimit != 0) srand(rand() + proc);
+			break;
+		}
+	}
+	if (proc == nprocs) proc= 0;
+
 	alarm(seconds);
 
 	if (wbytes > 0) {
@@ -207,6 +238,29 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (nprocs > 1) {
+		if (proc > 0) {
+			if (n < 0 && errno != EINTR) report(device);
+			counts[0]= nbytes;
+			counts[1]= nseeks;
+			if (write(pfd[1], counts, sizeof(counts))
+							!= sizeof(counts))
+				fatal("pipe");
+			exit(n < 0 && errno != EINTR ? 1 : 0);
+		}
+
+		saved_errno= errno;
+		for (proc= 1; proc < nprocs; proc++) {
+			if (read(pfd[0], counts, sizeof(counts))
+							!= sizeof(counts))
+				fatal("pipe");
+			nbytes+= counts[0];
+			nseeks+= counts[1];
+		}
+		while (wait(nil) > 0) {}
+		errno= saved_errno;
+	}
+
 #if USEC
 	gettimeofday(&end_time, &dummy);
 	tenthsec= (end_time.tv_sec - start_time.tv_sec) * 10
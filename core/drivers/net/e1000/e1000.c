@@ -91,7 +91,9 @@ e1000_init(unsigned int instance, netdriver_addr_t * addr, uint32_t * caps,
 	/* Initialize the hardware, and return its ethernet address. */
 	e1000_init_hw(e, addr);
 
-	*caps = NDEV_CAP_MCAST | NDEV_CAP_BCAST | NDEV_CAP_HWADDR;
+	*caps = NDEV_CAP_MCAST | NDEV_CAP_BCAST | NDEV_CAP_HWADDR |
+	    NDEV_CAP_CS_IP4_RX | NDEV_CAP_CS_UDP_RX | NDEV_CAP_CS_TCP_RX |
+	    NDEV_CAP_CS_TCP_TX;
 	*ticks = sys_hz() / 10; /* update statistics 10x/sec */
 	return OK;
 }
@@ -403,6 +405,10 @@ e1000_init_hw(e1000_t * e, netdriver_addr_t * addr)
 	e1000_init_addr(e, addr);
 	e1000_init_buf(e);
 
+	/* Let the hardware verify IP and TCP/UDP checksums of packets. */
+	e1000_reg_set(e, E1000_REG_RXCSUM,
+	    E1000_REG_RXCSUM_IPOFL | E1000_REG_RXCSUM_TUOFL);
+
 	/* Enable interrupts. */
 	e1000_reg_set(e, E1000_REG_IMS, E1000_REG_IMS_LSC | E1000_REG_IMS_RXO |
 	    E1000_REG_IMS_RXT | E1000_REG_IMS_TXQE | E1000_REG_IMS_TXDW);
@@ -464,6 +470,7 @@ e1000_send(struct netdriver_data * data, size_t size)
 	e1000_tx_desc_t *desc;
 	unsigned int head, tail, next;
 	char *ptr;
+	size_t start, off;
 
 	e = &e1000_state;
 
@@ -494,6 +501,23 @@ e1000_send(struct netdriver_data * data, size_t size)
 	desc->length = size;
 	desc->command = E1000_TX_CMD_EOP | E1000_TX_CMD_FCS | E1000_TX_CMD_RS;
 
+	/*
+	 * Have the hardware fill in the checksum if we were asked to.  The
+	 * legacy descriptor format limits the offsets to eight bits, which is
+	 * enough for any IPv4 or IPv6 header followed by a TCP header.
+	 */
+	if (netdriver_get_csum(data, &start, &off)) {
+		if (start + off > UINT8_MAX)
+			panic("checksum offset out of range");
+
+		desc->checksum_st = start;
+		desc->checksum_off = start + off;
+		desc->command |= E1000_TX_CMD_IC;
+	} else {
+		desc->checksum_st = 0;
+		desc->checksum_off = 0;
+	}
+
 	/* Increment tail.  Start transmission. */
 	e1000_reg_write(e, E1000_REG_TDT, next);
 
@@ -509,6 +533,7 @@ e1000_recv(struct netdriver_data * data, size_t max)
 	e1000_t *e;
 	e1000_rx_desc_t *desc;
 	unsigned int head, tail, cur;
+	uint32_t flags;
 	char *ptr;
 	size_t size;
 
@@ -543,6 +568,18 @@ e1000_recv(struct netdriver_data * data, size_t max)
 	if (!(desc->status & E1000_RX_STATUS_EOP))
 		panic("received packet too large");
 
+	/* Report the checksums that the hardware has verified. */
+	if (!(desc->status & E1000_RX_STATUS_IXSM)) {
+		flags = 0;
+		if ((desc->status & E1000_RX_STATUS_IPCS) &&
+		    !(desc->errors & E1000_RX_ERROR_IPE))
+			flags |= NDEV_RXF_CSUM_IP4;
+		if ((desc->status & E1000_RX_STATUS_TCPCS) &&
+		    !(desc->errors & E1000_RX_ERROR_TCPE))
+			flags |= NDEV_RXF_CSUM_L4;
+		netdriver_set_rxflags(data, flags);
+	}
+
 	/* Copy the packet to the caller. */
 	ptr = e->rx_buffer + cur * E1000_IOBUF_SIZE;
 
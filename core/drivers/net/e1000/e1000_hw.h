@@ -121,6 +121,15 @@ union ich8_hws_flash_regacc
 
 /** Passed In-exact Filter. */
 #define E1000_RX_STATUS_PIF	(1 << 7) 
+
+/** IP Checksum Calculated. */
+#define E1000_RX_STATUS_IPCS	(1 << 6)
+
+/** TCP/UDP Checksum Calculated. */
+#define E1000_RX_STATUS_TCPCS	(1 << 5)
+
+/** Ignore Checksum Indication. */
+#define E1000_RX_STATUS_IXSM	(1 << 2)
  
 /** End of Packet. */
 #define E1000_RX_STATUS_EOP	(1 << 1)
@@ -140,6 +149,12 @@ union ich8_hws_flash_regacc
 /** RX Data Error. */
 #define E1000_RX_ERROR_RXE	(1 << 7)
 
+/** IP Checksum Error. */
+#define E1000_RX_ERROR_IPE	(1 << 6)
+
+/** TCP/UDP Checksum Error. */
+#define E1000_RX_ERROR_TCPE	(1 << 5)
+
 /** Carrier Extension Error. */
 #define E1000_RX_ERROR_CXE	(1 << 4)
 
@@ -164,6 +179,9 @@ union ich8_hws_flash_regacc
 /** Insert FCS/CRC. */
 #define E1000_TX_CMD_FCS	(1 << 1)
 
+/** Insert Checksum. */
+#define E1000_TX_CMD_IC		(1 << 2)
+
 /** Report Status. */
 #define E1000_TX_CMD_RS		(1 << 3)
 
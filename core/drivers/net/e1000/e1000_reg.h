@@ -113,6 +113,9 @@
 /** Multicast Table Array. */
 #define E1000_REG_MTA		0x05200
 
+/** Receive Checksum Control. */
+#define E1000_REG_RXCSUM	0x05000
+
 /**
  * @}
  */
@@ -262,6 +265,21 @@
 /** Receive Buffer Size. */
 #define E1000_REG_RCTL_BSIZE	((1 << 16) | (1 << 17))
 
+/**
+ * @}
+ */
+
+/**
+ * @name Receive Checksum Control Register Bits.
+ * @{
+ */
+
+/** IP Checksum Offload Enable. */
+#define E1000_REG_RXCSUM_IPOFL	(1 << 8)
+
+/** TCP/UDP Checksum Offload Enable. */
+#define E1000_REG_RXCSUM_TUOFL	(1 << 9)
+
 /**
  * @}
  */
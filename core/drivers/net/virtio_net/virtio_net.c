@@ -100,7 +100,8 @@ static const struct netdriver virtio_net_table = {
 
 /* TODO: Features are pretty much ignored */
 static struct virtio_feature netf[] = {
-	{ "partial csum",	VIRTIO_NET_F_CSUM,	0,	0	},
+	{ "partial csum",	VIRTIO_NET_F_CSUM,	0,	1	},
+	{ "guest csum",		VIRTIO_NET_F_GUEST_CSUM, 0,	1	},
 	{ "given mac",		VIRTIO_NET_F_MAC,	0,	1	},
 	{ "status ",		VIRTIO_NET_F_STATUS,	0,	0	},
 	{ "control channel",	VIRTIO_NET_F_CTRL_VQ,	0,	1	},
@@ -311,6 +312,7 @@ virtio_net_send(struct netdriver_data * data, size_t len)
 {
 	struct vumap_phys phys[2];
 	struct packet *p;
+	size_t start, off;
 
 	if (STAILQ_EMPTY(&free_list))
 		return SUSPEND;
@@ -324,6 +326,13 @@ virtio_net_send(struct netdriver_data * data, size_t len)
 
 	netdriver_copyin(data, 0, p->vdata, len);
 
+	/* Let the host fill in the checksum if we were asked to. */
+	if (netdriver_get_csum(data, &start, &off)) {
+		p->vhdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+		p->vhdr->csum_start = start;
+		p->vhdr->csum_offset = off;
+	}
+
 	phys[0].vp_addr = p->phdr;
 	assert(!(phys[0].vp_addr & 1));
 	phys[0].vp_size = sizeof(struct virtio_net_hdr);
@@ -335,6 +344,43 @@ virtio_net_send(struct netdriver_data * data, size_t len)
 	return OK;
 }
 
+/*
+ * Complete the partial checksum of a received packet, as the host may pass
+ * on packets from other guests with only the pseudo-header checksum filled
+ * in.  Return TRUE if the checksum is now valid, or FALSE if the checksum
+ * offsets are out of range.
+ */
+static int
+virtio_net_csum(struct packet * p, size_t len)
+{
+	uint8_t *ptr;
+	size_t start, off, i;
+	uint32_t sum;
+
+	start = p->vhdr->csum_start;
+	off = start + p->vhdr->csum_offset;
+
+	if (start >= len || off + sizeof(uint16_t) > len)
+		return FALSE;
+
+	ptr = (uint8_t *)p->vdata;
+
+	for (sum = 0, i = start; i + 1 < len; i += 2)
+		sum += (ptr[i] << 8) | ptr[i + 1];
+	if (i < len)
+		sum += ptr[i] << 8;
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	sum = ~sum & 0xffff;
+
+	ptr[off] = sum >> 8;
+	ptr[off + 1] = sum & 0xff;
+
+	return TRUE;
+}
+
 /*
  * Put a packet receive from the RX queue into a user buffer, and return the
  * packet length.  If there are no received packets, return SUSPEND.
@@ -356,6 +402,13 @@ virtio_net_recv(struct netdriver_data * data, size_t max)
 	if (p->len < sizeof(struct virtio_net_hdr))
 		panic("received packet does not have virtio header");
 	len = p->len - sizeof(struct virtio_net_hdr);
+
+	/* Tell the TCP/IP service whether it may skip checksum checks. */
+	if (((p->vhdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) &&
+	    virtio_net_csum(p, len)) ||
+	    (p->vhdr->flags & VIRTIO_NET_HDR_F_DATA_VALID))
+		netdriver_set_rxflags(data, NDEV_RXF_CSUM_L4);
+
 	if ((size_t)len > max)
 		len = (ssize_t)max;
 
@@ -409,6 +462,10 @@ virtio_net_init(unsigned int instance, netdriver_addr_t * addr,
 	virtio_irq_enable(net_dev);
 
 	*caps = NDEV_CAP_MCAST | NDEV_CAP_BCAST;
+	if (virtio_host_supports(net_dev, VIRTIO_NET_F_CSUM))
+		*caps |= NDEV_CAP_CS_TCP_TX;
+	if (virtio_host_supports(net_dev, VIRTIO_NET_F_GUEST_CSUM))
+		*caps |= NDEV_CAP_CS_UDP_RX | NDEV_CAP_CS_TCP_RX;
 	return OK;
 }
 
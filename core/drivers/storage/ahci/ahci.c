@@ -176,6 +176,8 @@ static struct port_state {
 
 	int queue_depth;	/* NCQ queue depth */
 	u32_t pend_mask;	/* commands not yet complete */
+	int wait_count;		/* number of threads waiting for the port */
+	thread_id_t wait_tid[NR_CMDS];	/* IDs of those waiting threads */
 	struct {
 		thread_id_t tid;/* ID of the worker thread */
 		minix_timer_t timer;	/* timer associated with each request */
@@ -190,6 +192,8 @@ static int ahci_instance;			/* driver instance number */
 
 static int ahci_verbose;			/* verbosity level (0..4) */
 
+static int ahci_max_qdepth;			/* maximum NCQ queue depth */
+
 /* Timeout-related values. */
 static clock_t ahci_spinup_timeout;
 static clock_t ahci_device_timeout;
@@ -234,6 +238,8 @@ static void port_issue(struct port_state *ps, int cmd, clock_t timeout);
 static int port_exec(struct port_state *ps, int cmd, clock_t timeout);
 static void port_timeout(int arg);
 static void port_disconnect(struct port_state *ps);
+static void port_excl_begin(struct port_state *ps);
+static void port_excl_end(struct port_state *ps);
 
 static char *ahci_portname(struct port_state *ps);
 static int ahci_open(devminor_t minor, int access);
@@ -245,6 +251,7 @@ static void ahci_alarm(clock_t stamp);
 static int ahci_ioctl(devminor_t minor, unsigned long request,
 	endpoint_t endpt, cp_grant_id_t grant, endpoint_t user_endpt);
 static void ahci_intr(unsigned int mask);
+static int ahci_poll(int spin);
 static int ahci_device(devminor_t minor, device_id_t *id);
 static struct port_state *ahci_get_port(devminor_t minor);
 
@@ -258,7 +265,8 @@ static struct blockdriver ahci_dtab = {
 	.bdr_part	= ahci_part,
 	.bdr_intr	= ahci_intr,
 	.bdr_alarm	= ahci_alarm,
-	.bdr_device	= ahci_device
+	.bdr_device	= ahci_device,
+	.bdr_poll	= ahci_poll
 };
 
 /*===========================================================================*
@@ -567,6 +575,8 @@ static int ata_id_check(struct port_state *ps, u16_t *buf)
 			(buf[ATA_ID_QDEPTH] & ATA_ID_QDEPTH_MASK) + 1;
 		if (ps->queue_depth > hba_state.nr_cmds)
 			ps->queue_depth = hba_state.nr_cmds;
+		if (ps->queue_depth > ahci_max_qdepth)
+			ps->queue_depth = ahci_max_qdepth;
 	}
 
 	/* For now, we only support long logical sectors. Long physical sector
@@ -691,6 +701,7 @@ static int gen_flush_wcache(struct port_state *ps)
 	/* Flush the device's write cache.
 	 */
 	cmd_fis_t fis;
+	int r;
 
 	/* The FLUSH CACHE command may not be supported by all (writable ATAPI)
 	 * devices.
@@ -709,11 +720,19 @@ static int gen_flush_wcache(struct port_state *ps)
 
 	/* Start the command, and wait for it to complete or fail.
 	 * The flush command may take longer than regular I/O commands.
+	 * FLUSH CACHE is not a queued command, so any outstanding NCQ
+	 * commands have to complete first.
 	 */
+	port_excl_begin(ps);
+
 	port_set_cmd(ps, 0, &fis, NULL /*packet*/, NULL /*prdt*/, 0,
 		FALSE /*write*/);
 
-	return port_exec(ps, 0, ahci_flush_timeout);
+	r = port_exec(ps, 0, ahci_flush_timeout);
+
+	port_excl_end(ps);
+
+	return r;
 }
 
 /*===========================================================================*
@@ -730,13 +749,17 @@ static int gen_get_wcache(struct port_state *ps, int *val)
 		return EINVAL;
 
 	/* Retrieve information about the device. */
-	if ((r = gen_identify(ps, TRUE /*blocking*/)) != OK)
-		return r;
+	port_excl_begin(ps);
+
+	if ((r = gen_identify(ps, TRUE /*blocking*/)) == OK) {
+		/* Return the current setting. */
+		*val = !!(((u16_t *) ps->tmp_base)[ATA_ID_ENA0] &
+			ATA_ID_ENA0_WCACHE);
+	}
 
-	/* Return the current setting. */
-	*val = !!(((u16_t *) ps->tmp_base)[ATA_ID_ENA0] & ATA_ID_ENA0_WCACHE);
+	port_excl_end(ps);
 
-	return OK;
+	return r;
 }
 
 /*===========================================================================*
@@ -748,6 +771,7 @@ static int gen_set_wcache(struct port_state *ps, int enable)
 	 */
 	cmd_fis_t fis;
 	clock_t timeout;
+	int r;
 
 	/* Write caches are not mandatory. */
 	if (!(ps->flags & FLAG_HAS_WCACHE))
@@ -764,10 +788,16 @@ static int gen_set_wcache(struct port_state *ps, int enable)
 	fis.cf_feat = enable ? ATA_SF_EN_WCACHE : ATA_SF_DI_WCACHE;
 
 	/* Start the command, and wait for it to complete or fail. */
+	port_excl_begin(ps);
+
 	port_set_cmd(ps, 0, &fis, NULL /*packet*/, NULL /*prdt*/, 0,
 		FALSE /*write*/);
 
-	return port_exec(ps, 0, timeout);
+	r = port_exec(ps, 0, timeout);
+
+	port_excl_end(ps);
+
+	return r;
 }
 
 /*===========================================================================*
@@ -894,6 +924,69 @@ static void port_set_cmd(struct port_state *ps, int cmd, cmd_fis_t *fis,
 	cl[2] = ps->ct_phys[cmd];
 }
 
+/*===========================================================================*
+ *				port_sleep				     *
+ *===========================================================================*/
+static void port_sleep(struct port_state *ps)
+{
+	/* Suspend the current worker thread until the set of commands issued
+	 * on the port changes in a way that it may be waiting for.
+	 */
+
+	assert(ps->wait_count < NR_CMDS);
+
+	ps->wait_tid[ps->wait_count++] = blockdriver_mt_get_tid();
+
+	blockdriver_mt_sleep();
+}
+
+/*===========================================================================*
+ *				port_wake_all				     *
+ *===========================================================================*/
+static void port_wake_all(struct port_state *ps)
+{
+	/* Wake up all worker threads waiting for the port.
+	 */
+
+	while (ps->wait_count > 0)
+		blockdriver_mt_wakeup(ps->wait_tid[--ps->wait_count]);
+}
+
+/*===========================================================================*
+ *				port_excl_begin				     *
+ *===========================================================================*/
+static void port_excl_begin(struct port_state *ps)
+{
+	/* Obtain exclusive use of the port for a non-queued command. With NCQ,
+	 * up to the queue depth of commands may be outstanding, and those have
+	 * to complete before a non-queued command may be issued. No new queued
+	 * commands are issued in the meantime, and command tag 0 is free for
+	 * use by the caller afterwards.
+	 */
+
+	while (ps->flags & FLAG_EXCLUSIVE)
+		port_sleep(ps);
+
+	ps->flags |= FLAG_EXCLUSIVE;
+
+	while (ps->pend_mask != 0)
+		port_sleep(ps);
+}
+
+/*===========================================================================*
+ *				port_excl_end				     *
+ *===========================================================================*/
+static void port_excl_end(struct port_state *ps)
+{
+	/* Release exclusive use of the port, and let any waiting threads
+	 * continue.
+	 */
+
+	ps->flags &= ~FLAG_EXCLUSIVE;
+
+	port_wake_all(ps);
+}
+
 /*===========================================================================*
  *				port_finish_cmd				     *
  *===========================================================================*/
@@ -919,6 +1012,12 @@ static void port_finish_cmd(struct port_state *ps, int cmd, int result)
 	 */
 	if (ps->state != STATE_WAIT_ID)
 		blockdriver_mt_wakeup(ps->cmd_info[cmd].tid);
+
+	/* If a non-queued command is waiting for the port to drain, and the
+	 * last queued command just finished, let it go ahead.
+	 */
+	if ((ps->flags & FLAG_EXCLUSIVE) && ps->pend_mask == 0)
+		port_wake_all(ps);
 }
 
 /*===========================================================================*
@@ -968,6 +1067,12 @@ static int port_find_cmd(struct port_state *ps)
 	 */
 	int i;
 
+	/* Queued commands may not be issued while a non-queued command is
+	 * waiting for, or using, the port.
+	 */
+	while (ps->flags & FLAG_EXCLUSIVE)
+		port_sleep(ps);
+
 	for (i = 0; i < ps->queue_depth; i++)
 		if (!(ps->pend_mask & (1 << i)))
 			break;
@@ -1467,9 +1572,11 @@ static void port_connect(struct port_state *ps)
 	/* Clear all state flags except the busy flag, which may be relevant if
 	 * a BDEV_OPEN call is waiting for the device to become ready; the
 	 * barrier flag, which prevents access to the device until it is
-	 * completely closed and (re)opened; and, the thread suspension flag.
+	 * completely closed and (re)opened; the thread suspension flag; and,
+	 * the exclusive use flag, which is owned by a worker thread.
 	 */
-	ps->flags &= (FLAG_BUSY | FLAG_BARRIER | FLAG_SUSPENDED);
+	ps->flags &= (FLAG_BUSY | FLAG_BARRIER | FLAG_SUSPENDED |
+		FLAG_EXCLUSIVE);
 
 	/* Check the port's signature. We only use the signature to speed up
 	 * identification; we will try both ATA and ATAPI if the signature is
@@ -1979,6 +2086,7 @@ static void port_init(struct port_state *ps)
 
 	/* Initialize the port state structure. */
 	ps->queue_depth = 1;
+	ps->wait_count = 0;
 	ps->state = STATE_SPIN_UP;
 	ps->flags = FLAG_BUSY;
 	ps->sector_size = 0;
@@ -2219,6 +2327,47 @@ static void ahci_intr(unsigned int UNUSED(mask))
 		panic("unable to enable IRQ: %d", r);
 }
 
+/*===========================================================================*
+ *				ahci_poll				     *
+ *===========================================================================*/
+static int ahci_poll(int UNUSED(spin))
+{
+	/* Check for completed commands without waiting for an interrupt. Only
+	 * successful completions are picked up this way; errors and device
+	 * changes are left to the interrupt handler. The port interrupts stay
+	 * enabled, so the spin hint is ignored.
+	 */
+	struct port_state *ps;
+	u32_t pending;
+	int port, count;
+
+	count = 0;
+
+	for (port = 0; port < hba_state.nr_ports; port++) {
+		ps = &port_state[port];
+
+		if (ps->state != STATE_GOOD_DEV || ps->pend_mask == 0)
+			continue;
+
+		pending = ps->pend_mask;
+
+		port_check_cmds(ps);
+
+		for (pending &= ~ps->pend_mask; pending != 0;
+				pending &= pending - 1)
+			count++;
+
+		/* As after an interrupt, wake up the device thread if it
+		 * is suspended and now no longer busy.
+		 */
+		if ((ps->flags & (FLAG_SUSPENDED | FLAG_BUSY)) ==
+				FLAG_SUSPENDED)
+			blockdriver_mt_wakeup(ps->cmd_info[0].tid);
+	}
+
+	return count;
+}
+
 /*===========================================================================*
  *				ahci_get_params				     *
  *===========================================================================*/
@@ -2240,6 +2389,13 @@ static void ahci_get_params(void)
 	(void) env_parse("ahci_verbose", "d", 0, &v, V_NONE, V_REQ);
 	ahci_verbose = (int) v;
 
+	/* Initialize the maximum NCQ queue depth. By default, use as many
+	 * outstanding commands per port as both the HBA and the device allow.
+	 */
+	v = NR_CMDS;
+	(void) env_parse("ahci_qdepth", "d", 0, &v, 1, NR_CMDS);
+	ahci_max_qdepth = (int) v;
+
 	/* Initialize timeout-related values. */
 	for (i = 0; i < sizeof(ahci_timevar) / sizeof(ahci_timevar[0]); i++) {
 		v = ahci_timevar[i].default_ms;
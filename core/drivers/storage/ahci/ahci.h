@@ -84,7 +84,7 @@
 #define ATA_ID_DMADIR_DMADIR	0x8000		/* DMADIR required */
 #define ATA_ID_DMADIR_DMA	0x0400		/* DMA supported (DMADIR) */
 #define ATA_ID_QDEPTH		75		/* NCQ queue depth */
-#define ATA_ID_QDEPTH_MASK	0x000F		/* NCQ queue depth mask */
+#define ATA_ID_QDEPTH_MASK	0x001F		/* NCQ queue depth mask */
 #define ATA_ID_SATA_CAP		76		/* SATA capabilities */
 #define ATA_ID_SATA_CAP_NCQ	0x0100		/* NCQ support */
 #define ATA_ID_SUP0		82		/* Features supported (1/3) */
@@ -297,6 +297,7 @@ enum {
 #define FLAG_HAS_FUA		0x00000400	/* is WRITE DMA FUA EX sup.? */
 #define FLAG_HAS_NCQ		0x00000800	/* is NCQ supported? */
 #define FLAG_NCQ_MODE		0x00001000	/* issuing NCQ commands? */
+#define FLAG_EXCLUSIVE		0x00002000	/* non-queued command pending? */
 
 /* Mapping between devices and ports. */
 #define NO_PORT		-1	/* this device maps to no port */
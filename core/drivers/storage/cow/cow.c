@@ -0,0 +1,817 @@
+/* Copy-On-Write block device (overlay proxy) */
+#include <stdlib.h>
+#include <minix/drivers.h>
+#include <minix/blockdriver.h>
+#include <minix/drvlib.h>
+#include <minix/ioctl.h>
+#include <minix/bitmap.h>
+#include <minix/partition.h>
+#include <sys/ioc_disk.h>
+#include <sys/ioc_cow.h>
+#include <minix/ds.h>
+#include <minix/optset.h>
+#include <assert.h>
+
+/* Constants. */
+#define BUF_SIZE (NR_IOREQS * CLICK_SIZE)	/* 256k */
+#define LEAF_BITS (CLICK_SIZE * CHAR_BIT)	/* chunks per bitmap leaf */
+
+/* The two underlying devices. */
+enum {
+	BASE,				/* read-only base device */
+	OVERLAY,			/* overlay device for written chunks */
+	NR_LOWER
+};
+
+/* Function declarations. */
+static int cow_open(devminor_t minor, int access);
+static int cow_close(devminor_t minor);
+static ssize_t cow_transfer(devminor_t minor, int do_write, u64_t position,
+	endpoint_t endpt, iovec_t *iov, unsigned int nr_req, int flags);
+static int cow_ioctl(devminor_t minor, unsigned long request, endpoint_t endpt,
+	cp_grant_id_t grant, endpoint_t user_endpt);
+
+/* Variables. */
+static char *cow_buf;			/* scratch buffer */
+
+static struct {
+	char label[32];			/* driver DS label */
+	devminor_t minor;		/* driver's partition minor to use */
+	endpoint_t endpt;		/* driver endpoint */
+} lower[NR_LOWER];
+
+static int cow_chunk = CLICK_SIZE;	/* allocation chunk size */
+static u64_t cow_size;			/* size of the base device */
+static u64_t cow_chunks;		/* number of chunks on the device */
+static bitchunk_t **cow_map;		/* allocation bitmap, in leaves */
+static size_t cow_leaves;		/* number of bitmap leaf pointers */
+static int cow_opens;			/* number of open requests */
+static struct cow_stat cow_stats;	/* statistics */
+
+/* Entry points to this driver. */
+static struct blockdriver cow_dtab = {
+	.bdr_type	= BLOCKDRIVER_TYPE_OTHER,/* do not handle part. reqs */
+	.bdr_open	= cow_open,	/* open request, initialize device */
+	.bdr_close	= cow_close,	/* release device */
+	.bdr_transfer	= cow_transfer,	/* do the I/O */
+	.bdr_ioctl	= cow_ioctl	/* perform I/O control request */
+};
+
+/* Options supported by this driver. */
+static struct optset optset_table[] = {
+	{ "label",	OPT_STRING,	lower[BASE].label,
+						sizeof(lower[BASE].label)    },
+	{ "minor",	OPT_INT,	&lower[BASE].minor,	10	     },
+	{ "olabel",	OPT_STRING,	lower[OVERLAY].label,
+						sizeof(lower[OVERLAY].label) },
+	{ "ominor",	OPT_INT,	&lower[OVERLAY].minor,	10	     },
+	{ "chunk",	OPT_INT,	&cow_chunk,		10	     },
+	{ NULL,		0,		NULL,			0	     }
+};
+
+/*===========================================================================*
+ *				sef_cb_init_fresh			     *
+ *===========================================================================*/
+static int sef_cb_init_fresh(int type, sef_init_info_t *UNUSED(info))
+{
+	int i;
+
+	lower[BASE].minor = lower[OVERLAY].minor = -1;
+
+	/* Parse the given parameters. */
+	if (env_argc > 1)
+		optset_parse(optset_table, env_argv[1]);
+
+	for (i = 0; i < NR_LOWER; i++) {
+		if (lower[i].label[0] == '\0')
+			panic("no %s driver label given",
+				(i == BASE) ? "base" : "overlay");
+
+		if (ds_retrieve_label_endpt(lower[i].label, &lower[i].endpt))
+			panic("unable to resolve driver label");
+
+		if (lower[i].minor < 0 || lower[i].minor > 255)
+			panic("no or invalid driver minor given");
+	}
+
+	if (lower[BASE].endpt == lower[OVERLAY].endpt &&
+			lower[BASE].minor == lower[OVERLAY].minor)
+		panic("base and overlay must be different devices");
+
+	/* The chunk size must be a power of two, so that a chunk never
+	 * straddles the boundary of a scratch buffer's worth of data.
+	 */
+	if (cow_chunk < SECTOR_SIZE || cow_chunk > BUF_SIZE ||
+			(cow_chunk & (cow_chunk - 1)))
+		panic("invalid chunk size given");
+
+#if DEBUG
+	printf("COW: base '%s' (endpt %d) minor %d, overlay '%s' (endpt %d) "
+		"minor %d, chunk %d\n",
+		lower[BASE].label, lower[BASE].endpt, lower[BASE].minor,
+		lower[OVERLAY].label, lower[OVERLAY].endpt,
+		lower[OVERLAY].minor, cow_chunk);
+#endif
+
+	/* Initialize resources. The bitmap itself is allocated upon the first
+	 * open, once the device size is known. Nothing is copied, so an
+	 * instance is ready for use right away. Since the bitmap lives only
+	 * in memory, a restarted instance starts out with an empty overlay.
+	 */
+	cow_buf = alloc_contig(BUF_SIZE, 0, NULL);
+
+	if (cow_buf == NULL)
+		panic("unable to allocate buffer");
+
+	/* Announce we are up! */
+	blockdriver_announce(type);
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				sef_cb_signal_handler			     *
+ *===========================================================================*/
+static void sef_cb_signal_handler(int signo)
+{
+	/* Terminate immediately upon receiving a SIGTERM. */
+	if (signo != SIGTERM) return;
+
+#if DEBUG
+	printf("COW: shutting down\n");
+#endif
+
+	/* Clean up resources. */
+	free_contig(cow_buf, BUF_SIZE);
+
+	exit(0);
+}
+
+/*===========================================================================*
+ *				sef_local_startup			     *
+ *===========================================================================*/
+static void sef_local_startup(void)
+{
+	/* Register init callbacks. */
+	sef_setcb_init_fresh(sef_cb_init_fresh);
+	sef_setcb_init_restart(sef_cb_init_fresh);
+
+	/* Register signal callback. */
+	sef_setcb_signal_handler(sef_cb_signal_handler);
+
+	/* Let SEF perform startup. */
+	sef_startup();
+}
+
+/*===========================================================================*
+ *				main					     *
+ *===========================================================================*/
+int main(int argc, char **argv)
+{
+	/* SEF local startup. */
+	env_setargs(argc, argv);
+	sef_local_startup();
+
+	/* Call the generic receive loop. */
+	blockdriver_task(&cow_dtab);
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				lower_call				     *
+ *===========================================================================*/
+static int lower_call(int dev, message *m)
+{
+	/* Send a request to one of the underlying drivers, and return the
+	 * status from its reply.
+	 */
+	int r;
+
+	m->m_lbdev_lblockdriver_msg.minor = lower[dev].minor;
+	m->m_lbdev_lblockdriver_msg.id = 0;
+
+	if ((r = ipc_sendrec(lower[dev].endpt, m)) != OK)
+		panic("ipc_sendrec to driver failed (%d)\n", r);
+
+	if (m->m_type != BDEV_REPLY)
+		panic("invalid reply from driver (%d)\n", m->m_type);
+
+	return m->m_lblockdriver_lbdev_reply.status;
+}
+
+/*===========================================================================*
+ *				lower_open				     *
+ *===========================================================================*/
+static int lower_open(int dev, int access)
+{
+	/* Open one of the underlying devices. */
+	message m;
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = BDEV_OPEN;
+	m.m_lbdev_lblockdriver_msg.access = access;
+
+	return lower_call(dev, &m);
+}
+
+/*===========================================================================*
+ *				lower_close				     *
+ *===========================================================================*/
+static int lower_close(int dev)
+{
+	/* Close one of the underlying devices. */
+	message m;
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = BDEV_CLOSE;
+
+	return lower_call(dev, &m);
+}
+
+/*===========================================================================*
+ *				lower_ioctl				     *
+ *===========================================================================*/
+static int lower_ioctl(int dev, unsigned long request, void *ptr, size_t size,
+	int access)
+{
+	/* Perform an I/O control request of our own on an underlying device. */
+	cp_grant_id_t grant;
+	message m;
+	int r;
+
+	if (size > 0) {
+		grant = cpf_grant_direct(lower[dev].endpt, (vir_bytes) ptr,
+			size, access);
+		assert(grant != GRANT_INVALID);
+	}
+	else grant = GRANT_INVALID;
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = BDEV_IOCTL;
+	m.m_lbdev_lblockdriver_msg.request = request;
+	m.m_lbdev_lblockdriver_msg.grant = grant;
+	m.m_lbdev_lblockdriver_msg.user = NONE;
+
+	r = lower_call(dev, &m);
+
+	if (grant != GRANT_INVALID)
+		cpf_revoke(grant);
+
+	return r;
+}
+
+/*===========================================================================*
+ *				lower_io				     *
+ *===========================================================================*/
+static ssize_t lower_io(int dev, int do_write, u64_t position, char *buf,
+	size_t size, int flags)
+{
+	/* Read or write a range of an underlying device from or to a local
+	 * buffer.
+	 */
+	cp_grant_id_t grant;
+	message m;
+	ssize_t r;
+
+	grant = cpf_grant_direct(lower[dev].endpt, (vir_bytes) buf, size,
+		do_write ? CPF_READ : CPF_WRITE);
+	assert(grant != GRANT_INVALID);
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = do_write ? BDEV_WRITE : BDEV_READ;
+	m.m_lbdev_lblockdriver_msg.count = size;
+	m.m_lbdev_lblockdriver_msg.grant = grant;
+	m.m_lbdev_lblockdriver_msg.flags = flags;
+	m.m_lbdev_lblockdriver_msg.pos = position;
+
+	r = lower_call(dev, &m);
+
+	cpf_revoke(grant);
+
+	return r;
+}
+
+/*===========================================================================*
+ *				map_get					     *
+ *===========================================================================*/
+static int map_get(u64_t chunk)
+{
+	/* Return which device holds the current contents of a chunk. */
+	bitchunk_t *leaf;
+
+	leaf = cow_map[chunk / LEAF_BITS];
+
+	if (leaf == NULL || !GET_BIT(leaf, chunk % LEAF_BITS))
+		return BASE;
+
+	return OVERLAY;
+}
+
+/*===========================================================================*
+ *				map_prepare				     *
+ *===========================================================================*/
+static int map_prepare(u64_t first, u64_t last)
+{
+	/* Make sure that the bitmap leaves for the given range of chunks are
+	 * allocated, so that marking the chunks afterwards cannot fail.
+	 */
+	size_t i;
+
+	for (i = first / LEAF_BITS; i <= last / LEAF_BITS; i++) {
+		if (cow_map[i] != NULL)
+			continue;
+
+		if ((cow_map[i] = calloc(1, LEAF_BITS / CHAR_BIT)) == NULL)
+			return ENOMEM;
+	}
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				map_set					     *
+ *===========================================================================*/
+static void map_set(u64_t first, u64_t last)
+{
+	/* Mark a range of chunks as held in the overlay. */
+	bitchunk_t *leaf;
+	u64_t chunk;
+
+	for (chunk = first; chunk <= last; chunk++) {
+		leaf = cow_map[chunk / LEAF_BITS];
+		assert(leaf != NULL);
+
+		if (!GET_BIT(leaf, chunk % LEAF_BITS)) {
+			SET_BIT(leaf, chunk % LEAF_BITS);
+
+			cow_stats.used++;
+		}
+	}
+}
+
+/*===========================================================================*
+ *				map_clear				     *
+ *===========================================================================*/
+static void map_clear(void)
+{
+	/* Mark all chunks as held in the base device again. */
+	size_t i;
+
+	for (i = 0; i < cow_leaves; i++) {
+		free(cow_map[i]);
+
+		cow_map[i] = NULL;
+	}
+
+	cow_stats.used = 0;
+}
+
+/*===========================================================================*
+ *				cow_setup				     *
+ *===========================================================================*/
+static int cow_setup(void)
+{
+	/* Upon the first open, determine the device size and allocate the
+	 * top level of the bitmap. The bitmap survives closing the device.
+	 */
+	struct part_geom base_geom, over_geom;
+	bitchunk_t **map;
+	size_t leaves;
+	int r;
+
+	if ((r = lower_ioctl(BASE, DIOCGETP, &base_geom, sizeof(base_geom),
+			CPF_WRITE)) != OK)
+		return r;
+
+	if ((r = lower_ioctl(OVERLAY, DIOCGETP, &over_geom, sizeof(over_geom),
+			CPF_WRITE)) != OK)
+		return r;
+
+	if (over_geom.size < base_geom.size) {
+		printf("COW: overlay device is smaller than base device\n");
+
+		return EINVAL;
+	}
+
+	if (cow_map != NULL) {
+		if (base_geom.size != cow_size) {
+			printf("COW: base device size has changed\n");
+
+			return EIO;
+		}
+
+		return OK;
+	}
+
+	cow_chunks = (base_geom.size + cow_chunk - 1) / cow_chunk;
+	leaves = (cow_chunks + LEAF_BITS - 1) / LEAF_BITS;
+
+	if ((map = calloc(MAX(leaves, 1), sizeof(map[0]))) == NULL)
+		return ENOMEM;
+
+	cow_map = map;
+	cow_leaves = leaves;
+	cow_size = base_geom.size;
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				cow_open				     *
+ *===========================================================================*/
+static int cow_open(devminor_t UNUSED(minor), int access)
+{
+	/* Open a device. The base device is never written to, except when
+	 * committing, so open it for reading only.
+	 */
+	int r;
+
+	if ((r = lower_open(BASE, BDEV_R_BIT)) != OK)
+		return r;
+
+	if ((r = lower_open(OVERLAY, access | BDEV_R_BIT)) != OK) {
+		lower_close(BASE);
+
+		return r;
+	}
+
+	if (cow_opens == 0 && (r = cow_setup()) != OK) {
+		lower_close(OVERLAY);
+		lower_close(BASE);
+
+		return r;
+	}
+
+	cow_opens++;
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				cow_close				     *
+ *===========================================================================*/
+static int cow_close(devminor_t UNUSED(minor))
+{
+	/* Close a device. */
+	int r;
+
+	assert(cow_opens > 0);
+	cow_opens--;
+
+	r = lower_close(OVERLAY);
+
+	lower_close(BASE);
+
+	return r;
+}
+
+/*===========================================================================*
+ *				cow_commit				     *
+ *===========================================================================*/
+static int cow_commit(void)
+{
+	/* Write back all chunks held in the overlay to the base device, and
+	 * discard the overlay afterwards. The base device is opened for
+	 * writing just for the duration of the commit.
+	 */
+	u64_t chunk, next, pos;
+	size_t len;
+	ssize_t r;
+
+	if ((r = lower_open(BASE, BDEV_R_BIT | BDEV_W_BIT)) != OK)
+		return r;
+
+	for (chunk = 0; chunk < cow_chunks; chunk = next) {
+		/* Skip unused bitmap leaves in one go. */
+		if (cow_map[chunk / LEAF_BITS] == NULL) {
+			next = (chunk / LEAF_BITS + 1) * LEAF_BITS;
+
+			continue;
+		}
+
+		next = chunk + 1;
+
+		if (map_get(chunk) != OVERLAY)
+			continue;
+
+		while (next < cow_chunks && map_get(next) == OVERLAY &&
+				(next + 1 - chunk) * cow_chunk <= BUF_SIZE)
+			next++;
+
+		pos = chunk * cow_chunk;
+		len = MIN(next * cow_chunk, cow_size) - pos;
+
+		if ((r = lower_io(OVERLAY, FALSE, pos, cow_buf, len, 0)) !=
+				(ssize_t) len)
+			break;
+
+		if ((r = lower_io(BASE, TRUE, pos, cow_buf, len, 0)) !=
+				(ssize_t) len)
+			break;
+
+		r = OK;
+	}
+
+	if (r == OK)
+		r = lower_ioctl(BASE, DIOCFLUSH, NULL, 0, 0);
+
+	lower_close(BASE);
+
+	if (r != OK)
+		return (r > 0) ? EIO : r;
+
+	cow_stats.commits++;
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				cow_discard				     *
+ *===========================================================================*/
+static void cow_discard(void)
+{
+	/* Throw away the overlay contents. Tell the overlay device that its
+	 * contents are no longer needed, so that a sparse device can release
+	 * the space; this is a hint only.
+	 */
+	struct part_range range;
+
+	map_clear();
+
+	range.base = 0;
+	range.size = cow_size;
+
+	(void) lower_ioctl(OVERLAY, DIOCDISCARD, &range, sizeof(range),
+		CPF_READ);
+}
+
+/*===========================================================================*
+ *				cow_ioctl				     *
+ *===========================================================================*/
+static int cow_ioctl(devminor_t UNUSED(minor), unsigned long request,
+	endpoint_t endpt, cp_grant_id_t grant, endpoint_t UNUSED(user_endpt))
+{
+	/* Handle an I/O control request. */
+	cp_grant_id_t gid;
+	message m;
+	int r;
+
+	/* We handle the COW requests, keep away requests that would change
+	 * the base device, and pass on everything else.
+	 */
+	switch (request) {
+	case COWCOMMIT:
+		if ((r = cow_commit()) != OK)
+			return r;
+
+		/* fall-through */
+	case COWDISCARD:
+		cow_discard();
+
+		return OK;
+
+	case COWGETSTAT:
+		cow_stats.size = cow_size;
+		cow_stats.chunk = cow_chunk;
+
+		return sys_safecopyto(endpt, grant, 0, (vir_bytes) &cow_stats,
+			sizeof(cow_stats));
+
+	case DIOCSETP:
+	case DIOCSETWC:
+	case DIOCDISCARD:
+	case DIOCZERO:
+		return ENOTTY;
+
+	case DIOCFLUSH:
+		/* All writes end up on the overlay device. */
+		return lower_ioctl(OVERLAY, DIOCFLUSH, NULL, 0, 0);
+	}
+
+	assert(grant != GRANT_INVALID);
+
+	gid = cpf_grant_indirect(lower[BASE].endpt, endpt, grant);
+	assert(gid != GRANT_INVALID);
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = BDEV_IOCTL;
+	m.m_lbdev_lblockdriver_msg.request = request;
+	m.m_lbdev_lblockdriver_msg.grant = gid;
+	m.m_lbdev_lblockdriver_msg.user = NONE;
+
+	r = lower_call(BASE, &m);
+
+	cpf_revoke(gid);
+
+	return r;
+}
+
+/*===========================================================================*
+ *				cow_copy				     *
+ *===========================================================================*/
+static void cow_copy(endpoint_t endpt, iovec_t *iov, unsigned int count,
+	size_t off, char *ptr, size_t len, int to_user)
+{
+	/* Copy a range of the caller's I/O vector, starting at the given
+	 * offset, from or to a local buffer.
+	 */
+	struct vscp_vec vscp_vec[SCPVEC_NR];
+	size_t size;
+	int i, j, r;
+
+	/* Skip the vector elements before the given offset. */
+	for (i = 0; i < count && off >= iov[i].iov_size; i++)
+		off -= iov[i].iov_size;
+
+	for (j = 0; i < count && len > 0; i++, j++) {
+		assert(j < SCPVEC_NR);
+
+		size = MIN(len, iov[i].iov_size - off);
+
+		vscp_vec[j].v_from = to_user ? SELF : endpt;
+		vscp_vec[j].v_to = to_user ? endpt : SELF;
+		vscp_vec[j].v_gid = iov[i].iov_addr;
+		vscp_vec[j].v_offset = off;
+		vscp_vec[j].v_addr = (vir_bytes) ptr;
+		vscp_vec[j].v_bytes = size;
+
+		ptr += size;
+		len -= size;
+		off = 0;
+	}
+
+	if (j > 0 && (r = sys_vsafecopy(vscp_vec, j)) != OK)
+		panic("vsafecopy failed (%d)\n", r);
+}
+
+/*===========================================================================*
+ *				cow_read_piece				     *
+ *===========================================================================*/
+static ssize_t cow_read_piece(u64_t position, size_t size, int flags)
+{
+	/* Read a range of at most the scratch buffer size into the scratch
+	 * buffer. Consecutive chunks held by the same device are read with a
+	 * single request. Return the number of bytes read, or an error.
+	 */
+	u64_t chunk, next, end;
+	size_t done, len;
+	ssize_t r;
+	int dev;
+
+	end = position + size;
+
+	for (done = 0; done < size; done += r) {
+		chunk = (position + done) / cow_chunk;
+		dev = map_get(chunk);
+
+		for (next = chunk + 1; next * cow_chunk < end &&
+				map_get(next) == dev; next++);
+
+		len = MIN(next * cow_chunk, end) - (position + done);
+
+		r = lower_io(dev, FALSE, position + done, cow_buf + done, len,
+			flags);
+
+		if (r < 0)
+			return (done > 0) ? done : r;
+
+		if (dev == OVERLAY)
+			cow_stats.over_read += r;
+		else
+			cow_stats.base_read += r;
+
+		if (r < (ssize_t) len)
+			return done + r;
+	}
+
+	return done;
+}
+
+/*===========================================================================*
+ *				cow_fill				     *
+ *===========================================================================*/
+static int cow_fill(u64_t chunk, char *ptr)
+{
+	/* A chunk is about to be written partially. Read its current contents
+	 * into the given part of the scratch buffer first.
+	 */
+	u64_t pos;
+	size_t len;
+	ssize_t r;
+	int dev;
+
+	pos = chunk * cow_chunk;
+	len = MIN(cow_chunk, cow_size - pos);
+	dev = map_get(chunk);
+
+	if ((r = lower_io(dev, FALSE, pos, ptr, len, 0)) != (ssize_t) len)
+		return (r < 0) ? r : EIO;
+
+	cow_stats.fills++;
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				cow_write_piece				     *
+ *===========================================================================*/
+static ssize_t cow_write_piece(u64_t position, endpoint_t endpt,
+	iovec_t *iov, unsigned int count, size_t off, size_t size, int flags)
+{
+	/* Write part of the caller's data to the overlay, in whole chunks.
+	 * Return the number of bytes of the caller's data that were written,
+	 * or an error.
+	 */
+	u64_t start, end, first, last;
+	size_t len;
+	ssize_t r;
+
+	/* Limit the range so that all affected chunks fit in the buffer. */
+	start = position - position % cow_chunk;
+	size = MIN(size, start + BUF_SIZE - position);
+	end = (position + size + cow_chunk - 1) / cow_chunk * cow_chunk;
+	end = MIN(end, cow_size);
+
+	first = start / cow_chunk;
+	last = (end - 1) / cow_chunk;
+
+	if ((r = map_prepare(first, last)) != OK)
+		return r;
+
+	/* Fill up the chunks at either end, if they are written partially. */
+	if (position > start && (r = cow_fill(first, cow_buf)) != OK)
+		return r;
+
+	if (position + size < end && (first != last || position == start) &&
+			(r = cow_fill(last, cow_buf + (last - first) * cow_chunk))
+			!= OK)
+		return r;
+
+	cow_copy(endpt, iov, count, off, cow_buf + (position - start), size,
+		FALSE);
+
+	len = end - start;
+
+	if ((r = lower_io(OVERLAY, TRUE, start, cow_buf, len, flags)) < 0)
+		return r;
+
+	if (r != (ssize_t) len)
+		return EIO;
+
+	cow_stats.over_write += len;
+
+	map_set(first, last);
+
+	return size;
+}
+
+/*===========================================================================*
+ *				cow_transfer				     *
+ *===========================================================================*/
+static ssize_t cow_transfer(devminor_t UNUSED(minor), int do_write,
+	u64_t position, endpoint_t endpt, iovec_t *iov, unsigned int nr_req,
+	int flags)
+{
+	/* Transfer data from or to the device. Writes go to the overlay, and
+	 * reads are served from whichever device holds each chunk.
+	 */
+	size_t size, off, len;
+	unsigned int i;
+	ssize_t r;
+
+	/* Compute the total size of the request. */
+	for (size = i = 0; i < nr_req; i++)
+		size += iov[i].iov_size;
+
+	if (position >= cow_size || size == 0)
+		return 0;
+
+	size = MIN(size, cow_size - position);
+
+	for (off = 0, r = OK; off < size; off += r) {
+		len = MIN(size - off, BUF_SIZE);
+
+		if (do_write) {
+			r = cow_write_piece(position + off, endpt, iov,
+				nr_req, off, len, flags);
+		} else {
+			r = cow_read_piece(position + off, len, flags);
+
+			if (r > 0)
+				cow_copy(endpt, iov, nr_req, off, cow_buf, r,
+					TRUE);
+		}
+
+		if (r <= 0)
+			break;
+	}
+
+#if DEBUG
+	printf("COW: %s operation for pos %"PRIx64" size %u -> %d\n",
+		do_write ? "write" : "read", position, size,
+		(off > 0) ? off : r);
+#endif
+
+	return (off > 0 || r == 0) ? off : r;
+}
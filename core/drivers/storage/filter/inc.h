@@ -78,6 +78,11 @@ typedef enum {
 
 #define LABEL_SIZE	32
 
+/* Verity settings: maximum salt size, and root hash and salt string sizes. */
+#define MAX_SALT	64
+#define ROOT_STR_SIZE	(32 * 2 + 1)
+#define SALT_STR_SIZE	(MAX_SALT * 2 + 1)
+
 typedef unsigned long	sector_t;
 
 /* main.c */
@@ -92,6 +97,12 @@ extern int NR_RETRIES;
 extern int NR_RESTARTS;
 extern int DRIVER_TIMEOUT;
 extern int CHUNK_SIZE;
+extern int USE_VERITY;
+extern int VERITY_BLOCK;
+extern int VERITY_BLOCKS;
+extern int VERITY_HASH_SEC;
+extern char VERITY_ROOT[ROOT_STR_SIZE];
+extern char VERITY_SALT[SALT_STR_SIZE];
 
 extern char MAIN_LABEL[LABEL_SIZE];
 extern char BACKUP_LABEL[LABEL_SIZE];
@@ -114,6 +125,11 @@ extern int read_write(u64_t pos, char *bufa, char *bufb, size_t *sizep,
 	int flag_rw);
 extern void ds_event(void);
 
+/* verity.c */
+extern int verity_init(void);
+extern u64_t verity_size(void);
+extern int verity_read(u64_t pos, char *buffer, size_t *sizep);
+
 /* util.c */
 extern char *flt_malloc(size_t size, char *sbuf, size_t ssize);
 extern void flt_free(char *buf, size_t size, const char *sbuf);
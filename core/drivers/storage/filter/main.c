@@ -5,6 +5,8 @@
  * corrupted data (toggled by USE_CHECKSUM) and recover it (toggled
  * by USE_MIRROR). These two functions are independent from each other. 
  * The mirroring function requires two disks, on separate disk drivers.
+ * Alternatively, the filter can present a read-only disk, the contents of
+ * which are verified against a tree of hashes (toggled by USE_VERITY).
  */
 
 #include "inc.h"
@@ -30,6 +32,13 @@ int DRIVER_TIMEOUT = 5;	/* timeout in seconds to declare a driver dead (T) */
 
 int CHUNK_SIZE = 0;	/* driver requests will be vectorized at this size */
 
+int USE_VERITY = 0;	/* enable read-only hash tree verification */
+int VERITY_BLOCK = 4096;	/* data and hash block size */
+int VERITY_BLOCKS = 0;	/* number of data blocks */
+int VERITY_HASH_SEC = 0;	/* sector at which the hash tree starts */
+char VERITY_ROOT[ROOT_STR_SIZE] = "";	/* root hash, in hexadecimal */
+char VERITY_SALT[SALT_STR_SIZE] = "";	/* salt, in hexadecimal */
+
 char MAIN_LABEL[LABEL_SIZE] = "";		/* main disk driver label */
 char BACKUP_LABEL[LABEL_SIZE] = "";		/* backup disk driver label */
 int MAIN_MINOR = -1;				/* main partition minor nr */
@@ -60,6 +69,12 @@ static struct optset optset_table[] = {
   { "timeout",	OPT_INT,	&DRIVER_TIMEOUT,	10		},
   { "T",	OPT_INT,	&DRIVER_TIMEOUT,	10		},
   { "chunk",	OPT_INT,	&CHUNK_SIZE,		10		},
+  { "verity",	OPT_BOOL,	&USE_VERITY,		1		},
+  { "vblock",	OPT_INT,	&VERITY_BLOCK,		10		},
+  { "vblocks",	OPT_INT,	&VERITY_BLOCKS,		10		},
+  { "vhash",	OPT_INT,	&VERITY_HASH_SEC,	10		},
+  { "vroot",	OPT_STRING,	VERITY_ROOT,		ROOT_STR_SIZE	},
+  { "vsalt",	OPT_STRING,	VERITY_SALT,		SALT_STR_SIZE	},
   { NULL,	0,		NULL,			0		}
 };
 
@@ -160,6 +175,10 @@ static ssize_t filter_transfer(devminor_t UNUSED(minor), int do_write,
 		return EINVAL;
 	}
 
+	/* A verified disk is read-only. */
+	if (USE_VERITY && do_write)
+		return EROFS;
+
 	buffer = flt_malloc(size, buf_array, BUF_SIZE);
 
 	if (do_write)
@@ -169,8 +188,11 @@ static ssize_t filter_transfer(devminor_t UNUSED(minor), int do_write,
 
 	for (;;) {
 		size_ret = size;
-		r = transfer(pos, buffer, &size_ret,
-			do_write ? FLT_WRITE : FLT_READ);
+		if (USE_VERITY)
+			r = verity_read(pos, buffer, &size_ret);
+		else
+			r = transfer(pos, buffer, &size_ret,
+				do_write ? FLT_WRITE : FLT_READ);
 		if(r != RET_REDO)
 			break;
 
@@ -215,7 +237,8 @@ static int filter_ioctl(devminor_t UNUSED(minor), unsigned long request,
 		/* The presented disk size is the raw partition size,
 		 * corrected for space needed for checksums.
 		 */
-		sizepart.size = convert(get_raw_size());
+		sizepart.size = USE_VERITY ? verity_size() :
+			convert(get_raw_size());
 
 		if (sys_safecopyto(endpt, grant, 0, (vir_bytes) &sizepart,
 				sizeof(struct part_geom)) != OK) {
@@ -260,6 +283,10 @@ static int parse_arguments(int argc, char *argv[])
 			BACKUP_MINOR < 0 || BACKUP_MINOR > 255))
 		return EINVAL;
 
+	/* Verity is a mode of its own. */
+	if (USE_VERITY && (USE_CHECKSUM || USE_MIRROR || USE_SUM_LAYOUT))
+		return EINVAL;
+
 	/* Checksumming implies a checksum layout. */
 	if (USE_CHECKSUM)
 		USE_SUM_LAYOUT = 1;
@@ -308,6 +335,13 @@ static int parse_arguments(int argc, char *argv[])
 	}
 	else printf("  USE_SUM_LAYOUT : %3s\n", USE_SUM_LAYOUT ? "yes" : "no");
 
+	if (USE_VERITY) {
+		printf("  USE_VERITY :     yes   VERITY_BLOCK : %d\n",
+			VERITY_BLOCK);
+		printf("  VERITY_BLOCKS : %d   VERITY_HASH_SEC : %d\n",
+			VERITY_BLOCKS, VERITY_HASH_SEC);
+	}
+
 	printf("  N : %3dx       M : %3dx        T : %3ds\n",
 		NR_RETRIES, NR_RESTARTS, DRIVER_TIMEOUT);
 
@@ -379,6 +413,11 @@ static int sef_cb_init_fresh(int type, sef_init_info_t *UNUSED(info))
 
 	sum_init();
 
+	if (USE_VERITY && verity_init() != OK) {
+		printf("Filter: bad verity settings!\n");
+		return 1;
+	}
+
 	driver_init();
 
 	/* Subscribe to block driver events. */
@@ -0,0 +1,416 @@
+/* Filter driver - verity layer - read-only integrity checking */
+
+/* In verity mode, the filter presents a read-only device, each data block of
+ * which is checked against a precomputed tree of SHA-256 hashes before being
+ * returned. The tree is stored on the main disk, starting at a given sector
+ * beyond the data area. Each hash is computed over the salt followed by the
+ * block contents. The lowest level of the tree consists of hash blocks with
+ * the hashes of all data blocks; each next level holds the hashes of the hash
+ * blocks of the level below, up to a level of a single block, the hash of
+ * which is the root hash given at startup. Hash blocks are zero-padded. The
+ * levels are stored from the top down, as with Linux' dm-verity.
+ *
+ * Hash blocks are verified once, and then kept in a cache. For each request,
+ * all hash blocks that are needed and not yet cached are read in with as few
+ * disk requests as possible, after which all the data blocks are checked.
+ */
+
+#include "inc.h"
+#include <sys/sha2.h>
+
+#define HASH_SIZE	SHA256_DIGEST_LENGTH
+#define MAX_LEVELS	8	/* maximum number of tree levels */
+#define CACHE_SIZE	64	/* number of cached hash blocks */
+#define MAX_RUN		16	/* maximum hash blocks read at once */
+
+#define NO_LEVEL	(-1)	/* cache entry is unused */
+#define PENDING		(-2)	/* cache entry is being verified */
+
+static struct {
+	unsigned long count;	/* number of hash blocks on this level */
+	u64_t pos;		/* disk position of the first hash block */
+} level[MAX_LEVELS];
+
+static int nr_levels;		/* number of levels in the tree */
+static int per_block;		/* number of hashes per hash block */
+static u64_t data_size;		/* size of the data area */
+
+static unsigned char root_hash[HASH_SIZE];
+static unsigned char salt[MAX_SALT];
+static size_t salt_size;
+
+static struct vcache {
+	int level;		/* tree level, NO_LEVEL, or PENDING */
+	unsigned long index;	/* block index within the level */
+	unsigned long stamp;	/* time of last use, for LRU replacement */
+	char *data;		/* block contents */
+} cache[CACHE_SIZE];
+
+static unsigned long cache_clock;
+
+/* Data buffers. */
+static char *cache_array;	/* contents of cached hash blocks */
+static char *hash_array;	/* buffer for reading in hash blocks */
+static char *data_array;	/* buffer for unaligned data requests */
+
+/*===========================================================================*
+ *				parse_hex				     *
+ *===========================================================================*/
+static int parse_hex(const char *str, unsigned char *buf, size_t max)
+{
+	/* Convert a hexadecimal string to bytes. Return the number of bytes,
+	 * or -1 if the string is not valid or too long.
+	 */
+	size_t i;
+	int j, c, v;
+
+	for (i = 0; str[i * 2] != 0; i++) {
+		if (i == max)
+			return -1;
+
+		for (j = v = 0; j < 2; j++) {
+			c = str[i * 2 + j];
+
+			if (c >= '0' && c <= '9') v = v * 16 + c - '0';
+			else if (c >= 'a' && c <= 'f') v = v * 16 + c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') v = v * 16 + c - 'A' + 10;
+			else return -1;
+		}
+
+		buf[i] = v;
+	}
+
+	return i;
+}
+
+/*===========================================================================*
+ *				verity_init				     *
+ *===========================================================================*/
+int verity_init(void)
+{
+	/* Check the verity settings, and compute the tree layout. Return OK
+	 * or EINVAL.
+	 */
+	unsigned long count;
+	u64_t pos;
+	int i, r;
+
+	if (VERITY_BLOCK < SECTOR_SIZE || VERITY_BLOCK > BUF_SIZE ||
+			(VERITY_BLOCK & (VERITY_BLOCK - 1)) || VERITY_BLOCKS <= 0)
+		return EINVAL;
+
+	if (parse_hex(VERITY_ROOT, root_hash, HASH_SIZE) != HASH_SIZE)
+		return EINVAL;
+
+	if ((r = parse_hex(VERITY_SALT, salt, MAX_SALT)) < 0)
+		return EINVAL;
+	salt_size = r;
+
+	data_size = (u64_t) VERITY_BLOCKS * VERITY_BLOCK;
+
+	if ((u64_t) VERITY_HASH_SEC * SECTOR_SIZE < data_size)
+		return EINVAL;
+
+	/* Compute the number of hash blocks on each level. */
+	per_block = VERITY_BLOCK / HASH_SIZE;
+	count = VERITY_BLOCKS;
+
+	for (nr_levels = 0; nr_levels == 0 || count > 1; nr_levels++) {
+		if (nr_levels == MAX_LEVELS)
+			return EINVAL;
+
+		count = (count + per_block - 1) / per_block;
+		level[nr_levels].count = count;
+	}
+
+	/* The levels are stored from the top down. */
+	pos = (u64_t) VERITY_HASH_SEC * SECTOR_SIZE;
+
+	for (i = nr_levels - 1; i >= 0; i--) {
+		level[i].pos = pos;
+		pos += (u64_t) level[i].count * VERITY_BLOCK;
+	}
+
+	/* Allocate buffers. */
+	cache_array = flt_malloc(CACHE_SIZE * VERITY_BLOCK, NULL, 0);
+	hash_array = flt_malloc(MAX_RUN * VERITY_BLOCK, NULL, 0);
+	data_array = flt_malloc(BUF_SIZE + 2 * VERITY_BLOCK, NULL, 0);
+
+	if (cache_array == NULL || hash_array == NULL || data_array == NULL)
+		panic("no memory available");
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		cache[i].level = NO_LEVEL;
+		cache[i].data = cache_array + i * VERITY_BLOCK;
+	}
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				verity_size				     *
+ *===========================================================================*/
+u64_t verity_size(void)
+{
+	/* Return the size of the device presented to the user. */
+
+	return data_size;
+}
+
+/*===========================================================================*
+ *				hash_block				     *
+ *===========================================================================*/
+static void hash_block(const char *data, unsigned char *hash)
+{
+	/* Compute the salted hash of a data or hash block. */
+	SHA256_CTX ctx;
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, salt, salt_size);
+	SHA256_Update(&ctx, (const uint8_t *) data, VERITY_BLOCK);
+	SHA256_Final(hash, &ctx);
+}
+
+/*===========================================================================*
+ *				cache_find				     *
+ *===========================================================================*/
+static char *cache_find(int lvl, unsigned long index)
+{
+	/* Return the contents of a verified hash block if it is cached, or
+	 * NULL otherwise.
+	 */
+	int i;
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		if (cache[i].level == lvl && cache[i].index == index) {
+			cache[i].stamp = ++cache_clock;
+
+			return cache[i].data;
+		}
+	}
+
+	return NULL;
+}
+
+/*===========================================================================*
+ *				cache_alloc				     *
+ *===========================================================================*/
+static struct vcache *cache_alloc(void)
+{
+	/* Take the least recently used cache entry that is not pending, and
+	 * mark it as pending.
+	 */
+	struct vcache *vc;
+	int i;
+
+	vc = NULL;
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		if (cache[i].level == PENDING)
+			continue;
+
+		if (vc == NULL || cache[i].level == NO_LEVEL ||
+				(vc->level != NO_LEVEL &&
+				cache[i].stamp < vc->stamp))
+			vc = &cache[i];
+	}
+
+	if (vc == NULL)
+		panic("no free verity cache entries");
+
+	vc->level = PENDING;
+
+	return vc;
+}
+
+static int verify_range(int lvl, unsigned long first, unsigned long last);
+
+/*===========================================================================*
+ *				get_hash				     *
+ *===========================================================================*/
+static int get_hash(int lvl, unsigned long index, unsigned char **hashp)
+{
+	/* Return a pointer to the verified hash of the block with the given
+	 * index on the given level. Level -1 stands for the data blocks. The
+	 * hash block containing the hash is read in and verified if needed.
+	 */
+	char *data;
+	int r;
+
+	if (lvl == nr_levels - 1) {
+		*hashp = root_hash;
+
+		return OK;
+	}
+
+	lvl++;
+
+	if ((data = cache_find(lvl, index / per_block)) == NULL) {
+		if ((r = verify_range(lvl, index / per_block,
+				index / per_block)) != OK)
+			return r;
+
+		if ((data = cache_find(lvl, index / per_block)) == NULL)
+			panic("verified hash block not cached");
+	}
+
+	*hashp = (unsigned char *) data + (index % per_block) * HASH_SIZE;
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				verify_range				     *
+ *===========================================================================*/
+static int verify_range(int lvl, unsigned long first, unsigned long last)
+{
+	/* Make sure that the given range of hash blocks on the given level are
+	 * all verified and cached. Blocks that are not cached are read in
+	 * runs, after the hash blocks they are checked against have been
+	 * dealt with the same way. Return OK, EIO on verification failure,
+	 * or another error from the disk driver.
+	 */
+	struct vcache *run[MAX_RUN];
+	unsigned char hash[HASH_SIZE], *expected;
+	unsigned long i, j, k;
+	size_t size;
+	int r;
+
+	/* Get the parent blocks of the entire range in one go. */
+	if (lvl < nr_levels - 1 && (r = verify_range(lvl + 1, first / per_block,
+			last / per_block)) != OK)
+		return r;
+
+	for (i = first; i <= last; i = j + 1) {
+		j = i;
+
+		if (cache_find(lvl, i) != NULL)
+			continue;
+
+		while (j < last && j - i + 1 < MAX_RUN &&
+				cache_find(lvl, j + 1) == NULL)
+			j++;
+
+		/* Read in the run, and move it into cache entries. */
+		size = (j - i + 1) * VERITY_BLOCK;
+
+		r = read_write(level[lvl].pos + (u64_t) i * VERITY_BLOCK,
+			hash_array, hash_array, &size, FLT_READ);
+
+		if (r == OK && size != (j - i + 1) * VERITY_BLOCK) {
+			printf("Filter: verity: hash tree truncated\n");
+			r = EIO;
+		}
+
+		if (r != OK)
+			return r;
+
+		for (k = i; k <= j; k++) {
+			run[k - i] = cache_alloc();
+
+			memcpy(run[k - i]->data,
+				hash_array + (k - i) * VERITY_BLOCK,
+				VERITY_BLOCK);
+		}
+
+		/* Check each block against its parent. */
+		for (k = i; k <= j; k++) {
+			if ((r = get_hash(lvl, k, &expected)) == OK) {
+				hash_block(run[k - i]->data, hash);
+
+				if (memcmp(hash, expected, HASH_SIZE)) {
+					printf("Filter: verity: BAD HASH BLOCK"
+						" %lu at level %d\n", k, lvl);
+					r = EIO;
+				}
+			}
+
+			if (r != OK) {
+				for (; k <= j; k++)
+					run[k - i]->level = NO_LEVEL;
+
+				return r;
+			}
+
+			run[k - i]->level = lvl;
+			run[k - i]->index = k;
+			run[k - i]->stamp = ++cache_clock;
+		}
+	}
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				verity_read				     *
+ *===========================================================================*/
+int verity_read(u64_t pos, char *buffer, size_t *sizep)
+{
+	/* Read data from the disk, and verify it. Requests are extended to
+	 * whole blocks as needed. Return OK, RET_REDO if the disk driver
+	 * needs to be checked, EIO if verification failed, or another error.
+	 */
+	unsigned long first, last, b;
+	unsigned char hash[HASH_SIZE], *expected;
+	size_t size, ext_size, res_size;
+	u64_t ext_pos;
+	char *buf;
+	int r;
+
+	if (pos >= data_size) {
+		*sizep = 0;
+
+		return OK;
+	}
+
+	size = MIN(*sizep, data_size - pos);
+
+	first = pos / VERITY_BLOCK;
+	last = (pos + size - 1) / VERITY_BLOCK;
+
+	ext_pos = (u64_t) first * VERITY_BLOCK;
+	ext_size = (last - first + 1) * VERITY_BLOCK;
+
+	/* Aligned requests are read straight into the given buffer. */
+	if (ext_pos == pos && ext_size == size)
+		buf = buffer;
+	else
+		buf = flt_malloc(ext_size, data_array,
+			BUF_SIZE + 2 * VERITY_BLOCK);
+
+	res_size = ext_size;
+
+	r = read_write(ext_pos, buf, buf, &res_size, FLT_READ);
+
+	if (r == OK && res_size != ext_size) {
+		printf("Filter: verity: data area truncated\n");
+		r = EIO;
+	}
+
+	/* Get all the needed lowest-level hash blocks, then check the data. */
+	if (r == OK)
+		r = verify_range(0, first / per_block, last / per_block);
+
+	for (b = first; r == OK && b <= last; b++) {
+		if ((r = get_hash(-1, b, &expected)) != OK)
+			break;
+
+		hash_block(buf + (b - first) * VERITY_BLOCK, hash);
+
+		if (memcmp(hash, expected, HASH_SIZE)) {
+			printf("Filter: verity: BAD DATA BLOCK %lu\n", b);
+			r = EIO;
+		}
+	}
+
+	if (r == OK && buf != buffer)
+		memcpy(buffer, buf + (pos - ext_pos), size);
+
+	if (buf != buffer)
+		flt_free(buf, ext_size, data_array);
+
+	if (r == OK)
+		*sizep = size;
+
+	return r;
+}
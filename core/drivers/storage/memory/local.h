@@ -7,3 +7,19 @@ extern unsigned char _binary_imgrd_mfs_start, _binary_imgrd_mfs_end;
 #define	imgrd	&_binary_imgrd_mfs_start
 #define	imgrd_size \
 	(((size_t) &_binary_imgrd_mfs_end - (size_t)&_binary_imgrd_mfs_start))
+
+/* lz.c */
+size_t lz_compress(const u8_t *in, size_t in_len, u8_t *out, size_t out_max);
+ssize_t lz_decompress(const u8_t *in, size_t in_len, u8_t *out,
+	size_t out_max);
+
+/* sparse.c */
+struct ram_sparse;
+struct ramdisk_stat;
+
+struct ram_sparse *sparse_create(u64_t size, int flags);
+void sparse_destroy(struct ram_sparse *sp);
+int sparse_transfer(struct ram_sparse *sp, int do_write, u64_t position,
+	endpoint_t endpt, cp_grant_id_t grant, vir_bytes offset, size_t count);
+int sparse_zero(struct ram_sparse *sp, u64_t position, u64_t count);
+void sparse_stat(struct ram_sparse *sp, struct ramdisk_stat *stat);
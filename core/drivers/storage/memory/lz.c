@@ -0,0 +1,163 @@
+/* This file contains a small LZ77-style compressor, used to compress the
+ * pages of sparse RAM disks. Its output consists of a sequence of literal
+ * runs and back references, each introduced by a control byte:
+ *
+ *   000LLLLL			literal run of L+1 bytes, which follow
+ *   LLLOOOOO OOOOOOOO		back reference of L+2 bytes, at offset O+1
+ *   111OOOOO LLLLLLLL OOOOOOOO	back reference of L+9 bytes, at offset O+1
+ *
+ * In the last form, the extra length byte comes before the low offset byte.
+ * Back references may overlap with the bytes being produced.
+ */
+
+#include <minix/drivers.h>
+
+#include "local.h"
+
+#define LZ_HLOG		10		/* log2 of hash table size */
+#define LZ_HSIZE	(1 << LZ_HLOG)
+#define LZ_MAX_LIT	32		/* maximum literal run length */
+#define LZ_MAX_OFF	8192		/* maximum back reference offset */
+#define LZ_MAX_REF	(7 + 255 + 2)	/* maximum back reference length */
+
+#define LZ_HASH(p) \
+	((((p)[0] << 8 | (p)[1]) ^ ((p)[1] << 4 | (p)[2]) * 2654435761U) >> \
+	(32 - LZ_HLOG))
+
+/*===========================================================================*
+ *				lz_compress				     *
+ *===========================================================================*/
+size_t lz_compress(const u8_t *in, size_t in_len, u8_t *out, size_t out_max)
+{
+/* Compress the given input buffer into the given output buffer. Return the
+ * size of the compressed data, or 0 if it would not fit in the output buffer.
+ * The input may not be larger than 64KB.
+ */
+  static u16_t htab[LZ_HSIZE];	/* input positions plus one, by hash */
+  size_t ip, op, lit, ref, len, max, off;
+  u32_t h;
+
+  assert(in_len <= UINT16_MAX);
+
+  memset(htab, 0, sizeof(htab));
+
+  ip = 0;
+  op = 1;	/* reserve a control byte for the first literal run */
+  lit = 0;
+
+  while (ip < in_len) {
+	/* Make sure that there is room for the worst case step. */
+	if (op + 4 > out_max)
+		return 0;
+
+	if (ip + 2 < in_len) {
+		h = LZ_HASH(&in[ip]);
+		ref = htab[h];
+		htab[h] = ip + 1;
+
+		if (ref > 0 && ip - ref < LZ_MAX_OFF &&
+			in[ref - 1] == in[ip] && in[ref] == in[ip + 1] &&
+			in[ref + 1] == in[ip + 2]) {
+			ref--;
+			off = ip - ref - 1;
+
+			max = MIN(in_len - ip, LZ_MAX_REF);
+			for (len = 3; len < max && in[ref + len] == in[ip + len];
+				len++);
+
+			/* Terminate the current literal run, if any. */
+			if (lit > 0)
+				out[op - lit - 1] = lit - 1;
+			else
+				op--;
+
+			len -= 2;
+			if (len < 7) {
+				out[op++] = (len << 5) | (off >> 8);
+			} else {
+				out[op++] = (7 << 5) | (off >> 8);
+				out[op++] = len - 7;
+			}
+			out[op++] = off & 0xff;
+
+			ip += len + 2;
+
+			/* Start a new literal run. */
+			lit = 0;
+			op++;
+
+			continue;
+		}
+	}
+
+	out[op++] = in[ip++];
+
+	if (++lit == LZ_MAX_LIT) {
+		out[op - lit - 1] = lit - 1;
+		lit = 0;
+		op++;
+	}
+  }
+
+  /* Terminate the last literal run, or drop its control byte. */
+  if (lit > 0)
+	out[op - lit - 1] = lit - 1;
+  else
+	op--;
+
+  return op;
+}
+
+/*===========================================================================*
+ *				lz_decompress				     *
+ *===========================================================================*/
+ssize_t lz_decompress(const u8_t *in, size_t in_len, u8_t *out,
+	size_t out_max)
+{
+/* Decompress the given input buffer into the given output buffer. Return the
+ * size of the decompressed data, or EINVAL if the input is corrupt or does
+ * not fit in the output buffer.
+ */
+  size_t ip, op, len, off;
+  u8_t c;
+
+  ip = op = 0;
+
+  while (ip < in_len) {
+	c = in[ip++];
+
+	if (c < LZ_MAX_LIT) {
+		len = c + 1;
+
+		if (ip + len > in_len || op + len > out_max)
+			return EINVAL;
+
+		memcpy(&out[op], &in[ip], len);
+		ip += len;
+		op += len;
+
+		continue;
+	}
+
+	len = c >> 5;
+	if (len == 7) {
+		if (ip >= in_len)
+			return EINVAL;
+		len += in[ip++];
+	}
+	len += 2;
+
+	if (ip >= in_len)
+		return EINVAL;
+	off = ((c & 0x1f) << 8 | in[ip++]) + 1;
+
+	if (off > op || op + len > out_max)
+		return EINVAL;
+
+	/* Copy byte by byte, as the source and target may overlap. */
+	for (; len > 0; len--, op++)
+		out[op] = out[op - off];
+  }
+
+  return op;
+}
@@ -1,6 +1,6 @@
 /* This file contains the device dependent part of the drivers for the
  * following special files:
- *     /dev/ram		- RAM disk 
+ *     /dev/ram		- RAM disk (contiguous or sparse)
  *     /dev/mem		- absolute memory
  *     /dev/kmem	- kernel virtual memory
  *     /dev/null	- null device (data sink)
@@ -20,6 +20,8 @@
 #include <minix/chardriver.h>
 #include <minix/blockdriver.h>
 #include <sys/ioc_memory.h>
+#include <sys/ioc_disk.h>
+#include <minix/partition.h>
 #include <minix/ds.h>
 #include <minix/vm.h>
 #include <machine/param.h>
@@ -42,6 +44,7 @@
 
 static struct device m_geom[NR_DEVS];  /* base and size of each device */
 static vir_bytes m_vaddrs[NR_DEVS];
+static struct ram_sparse *m_sparse[NR_DEVS];	/* sparse RAM disks */
 
 static int openct[NR_DEVS];
 
@@ -439,6 +442,27 @@ static int m_block_transfer(
   dv_size = dv->dv_size;
   dev_vaddr = m_vaddrs[minor];
 
+  /* Sparse RAM disks keep track of their own pages. */
+  if (m_sparse[minor] != NULL) {
+	while (nr_req > 0) {
+		if (position >= dv_size) break;	/* check for EOF */
+
+		count = iov->iov_size;
+		if (position + count > dv_size) count = dv_size - position;
+
+		if ((r = sparse_transfer(m_sparse[minor], do_write, position,
+			endpt, (cp_grant_id_t) iov->iov_addr, 0, count)) != OK)
+			return (total > 0) ? total : r;
+
+		position += count;
+		total += count;
+		iov++;
+		nr_req--;
+	}
+
+	return(total);
+  }
+
   if (ex64hi(position) != 0)
 	return OK;	/* Beyond EOF */
 
@@ -507,57 +531,49 @@ static int m_block_close(devminor_t minor)
 }
 
 /*===========================================================================*
- *				m_block_ioctl				     *
+ *				m_ramdisk_check				     *
  *===========================================================================*/
-static int m_block_ioctl(devminor_t minor, unsigned long request,
-	endpoint_t endpt, cp_grant_id_t grant, endpoint_t UNUSED(user_endpt))
+static int m_ramdisk_check(devminor_t minor, const char *name)
 {
-/* I/O controls for the block devices of the memory driver. Currently there is
- * one I/O control specific to the memory driver:
- * - MIOCRAMSIZE: to set the size of the RAM disk.
+/* Check whether the given minor device may be (re)created as a RAM disk:
+ * it must be a RAM disk device, and not be in use by anyone else.
  */
-  struct device *dv;
-  u32_t ramdev_size;
-  int s;
-  void *mem;
-  int is_imgrd = 0;
-
-  if (request != MIOCRAMSIZE)
-	return EINVAL;
 
-  if(minor == IMGRD_DEV) 
-	is_imgrd = 1;
-
-  /* Someone wants to create a new RAM disk with the given size.
-   * A ramdisk can be created only once, and only on RAM disk device.
-   */
-  if ((dv = m_block_part(minor)) == NULL) return ENXIO;
-  if((minor < RAM_DEV_FIRST || minor > RAM_DEV_LAST) &&
-  	minor != RAM_DEV_OLD && !is_imgrd) {
-	printf("MEM: MIOCRAMSIZE: %d not a ramdisk\n", minor);
+  if ((minor < RAM_DEV_FIRST || minor > RAM_DEV_LAST) &&
+	minor != RAM_DEV_OLD && minor != IMGRD_DEV) {
+	printf("MEM: %s: %d not a ramdisk\n", name, minor);
 	return EINVAL;
   }
 
-  /* Get request structure */
-  s= sys_safecopyfrom(endpt, grant, 0, (vir_bytes)&ramdev_size,
-	sizeof(ramdev_size));
-  if (s != OK)
-	return s;
-  if(is_imgrd)
-  	ramdev_size = 0;
-  if(m_vaddrs[minor] && dv->dv_size == (u64_t) ramdev_size) {
-	return(OK);
-  }
   /* openct is 1 for the ioctl(). */
-  if(openct[minor] != 1) {
-	printf("MEM: MIOCRAMSIZE: %d in use (count %d)\n",
-		minor, openct[minor]);
-	return(EBUSY);
+  if (openct[minor] != 1) {
+	printf("MEM: %s: %d in use (count %d)\n", name, minor, openct[minor]);
+	return EBUSY;
   }
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				m_ramdisk_free				     *
+ *===========================================================================*/
+static void m_ramdisk_free(devminor_t minor)
+{
+/* Free the memory of a RAM disk, whether contiguous or sparse. */
+  struct device *dv;
+  u32_t a, o;
+  u64_t size;
+  int r;
+
+  dv = &m_geom[minor];
+
+  if (m_sparse[minor] != NULL) {
+	sparse_destroy(m_sparse[minor]);
+	m_sparse[minor] = NULL;
+	dv->dv_size = 0;
+  }
+
   if(m_vaddrs[minor]) {
-	u32_t a, o;
-	u64_t size;
-	int r;
 	if(ex64hi(dv->dv_size)) {
 		panic("huge old ramdisk");
 	}
@@ -576,6 +592,36 @@ static int m_block_ioctl(devminor_t minor, unsigned long request,
 	m_vaddrs[minor] = (vir_bytes) NULL;
 	dv->dv_size = 0;
   }
+}
+
+/*===========================================================================*
+ *				m_ramdisk_size				     *
+ *===========================================================================*/
+static int m_ramdisk_size(devminor_t minor, endpoint_t endpt,
+	cp_grant_id_t grant)
+{
+/* Someone wants to create a new RAM disk with the given size. */
+  struct device *dv;
+  u32_t ramdev_size;
+  int s;
+  void *mem;
+
+  dv = &m_geom[minor];
+
+  /* Get request structure */
+  s= sys_safecopyfrom(endpt, grant, 0, (vir_bytes)&ramdev_size,
+	sizeof(ramdev_size));
+  if (s != OK)
+	return s;
+  if(minor == IMGRD_DEV)
+  	ramdev_size = 0;
+  if(m_vaddrs[minor] && dv->dv_size == (u64_t) ramdev_size) {
+	return(OK);
+  }
+  if ((s = m_ramdisk_check(minor, "MIOCRAMSIZE")) != OK)
+	return s;
+
+  m_ramdisk_free(minor);
 
 #if DEBUG
   printf("MEM:%d: allocating ramdisk of size 0x%x\n", minor, ramdev_size);
@@ -597,3 +643,138 @@ static int m_block_ioctl(devminor_t minor, unsigned long request,
 
   return(OK);
 }
+
+/*===========================================================================*
+ *				m_ramdisk_sparse			     *
+ *===========================================================================*/
+static int m_ramdisk_sparse(devminor_t minor, endpoint_t endpt,
+	cp_grant_id_t grant)
+{
+/* Someone wants to create a new sparse RAM disk. Memory for its pages is
+ * allocated only once they are written to.
+ */
+  struct ramdisk_sparse req;
+  struct ram_sparse *sp;
+  int s;
+
+  if ((s = sys_safecopyfrom(endpt, grant, 0, (vir_bytes) &req,
+	sizeof(req))) != OK)
+	return s;
+
+  if (minor == IMGRD_DEV || (req.flags & ~RAMDISK_COMPRESS))
+	return EINVAL;
+
+  if ((s = m_ramdisk_check(minor, "MIOCRAMSPARSE")) != OK)
+	return s;
+
+  m_ramdisk_free(minor);
+
+  if (req.size == 0)
+	return OK;
+
+  if ((sp = sparse_create(req.size, req.flags)) == NULL) {
+	printf("MEM: failed to get memory for sparse ramdisk\n");
+	return ENOMEM;
+  }
+
+  m_sparse[minor] = sp;
+
+  m_geom[minor].dv_size = req.size;
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				m_ramdisk_stat				     *
+ *===========================================================================*/
+static int m_ramdisk_stat(devminor_t minor, endpoint_t endpt,
+	cp_grant_id_t grant)
+{
+/* Return memory usage statistics for a RAM disk. */
+  struct ramdisk_stat stat;
+  u64_t size;
+
+  if (m_sparse[minor] != NULL) {
+	sparse_stat(m_sparse[minor], &stat);
+  } else {
+	/* A contiguous RAM disk uses all its memory all the time. */
+	size = m_geom[minor].dv_size;
+
+	memset(&stat, 0, sizeof(stat));
+	stat.size = size;
+	stat.pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	stat.stored_bytes = size;
+  }
+
+  return sys_safecopyto(endpt, grant, 0, (vir_bytes) &stat, sizeof(stat));
+}
+
+/*===========================================================================*
+ *				m_ramdisk_zero				     *
+ *===========================================================================*/
+static int m_ramdisk_zero(devminor_t minor, endpoint_t endpt,
+	cp_grant_id_t grant)
+{
+/* Discard or zero a range of a RAM disk. Either way, the range reads as
+ * zeroes afterwards. For sparse RAM disks, the memory of all pages covered
+ * entirely by the range is freed.
+ */
+  struct part_range range;
+  struct device *dv;
+  int s;
+
+  if ((s = sys_safecopyfrom(endpt, grant, 0, (vir_bytes) &range,
+	sizeof(range))) != OK)
+	return s;
+
+  dv = &m_geom[minor];
+
+  if (range.base > dv->dv_size || range.size > dv->dv_size - range.base)
+	return EINVAL;
+
+  if (m_sparse[minor] != NULL)
+	return sparse_zero(m_sparse[minor], range.base, range.size);
+
+  if (!m_vaddrs[minor] || m_vaddrs[minor] == (vir_bytes) MAP_FAILED)
+	return EIO;
+
+  memset((void *) (m_vaddrs[minor] + (vir_bytes) range.base), 0,
+	(size_t) range.size);
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				m_block_ioctl				     *
+ *===========================================================================*/
+static int m_block_ioctl(devminor_t minor, unsigned long request,
+	endpoint_t endpt, cp_grant_id_t grant, endpoint_t UNUSED(user_endpt))
+{
+/* I/O controls for the block devices of the memory driver. Currently there are
+ * three I/O controls specific to the memory driver:
+ * - MIOCRAMSIZE: to set the size of the RAM disk;
+ * - MIOCRAMSPARSE: to turn the RAM disk into a sparse RAM disk;
+ * - MIOCRAMSTAT: to get the memory usage of the RAM disk.
+ * In addition, RAM disks support discarding and zeroing ranges.
+ */
+
+  if (m_block_part(minor) == NULL) return ENXIO;
+
+  switch (request) {
+  case MIOCRAMSIZE:
+	return m_ramdisk_size(minor, endpt, grant);
+
+  case MIOCRAMSPARSE:
+	return m_ramdisk_sparse(minor, endpt, grant);
+
+  case MIOCRAMSTAT:
+	return m_ramdisk_stat(minor, endpt, grant);
+
+  case DIOCDISCARD:
+  case DIOCZERO:
+	return m_ramdisk_zero(minor, endpt, grant);
+
+  default:
+	return EINVAL;
+  }
+}
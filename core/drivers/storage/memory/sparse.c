@@ -0,0 +1,354 @@
+/* This file implements sparse RAM disks. Rather than being backed by one
+ * preallocated memory area, a sparse RAM disk allocates memory for each of its
+ * pages only once the page is written to with nonzero data, and frees it again
+ * when the page is discarded or overwritten with zeroes. Pages may optionally
+ * be stored in compressed form. Unallocated pages read as zeroes.
+ *
+ * The pages are looked up through a two-level table: a directory with
+ * pointers to leaf tables, each of which covers RAM_LEAF_PAGES pages. Leaf
+ * tables are allocated on demand as well.
+ */
+
+#include <minix/drivers.h>
+#include <sys/ioc_memory.h>
+#include <machine/param.h>
+#include <machine/vmparam.h>
+
+#include "local.h"
+
+#define RAM_LEAF_PAGES	1024		/* pages per leaf table */
+
+/* A compressed page is stored only if it saves at least a quarter. */
+#define RAM_COMP_MAX	(PAGE_SIZE - PAGE_SIZE / 4)
+
+/* A single page. A NULL data pointer means that the page is all zeroes. Data
+ * of PAGE_SIZE bytes is uncompressed; any smaller size means compressed.
+ */
+struct ram_page {
+  u8_t *data;				/* page contents, or NULL */
+  size_t len;				/* size of the stored contents */
+};
+
+struct ram_sparse {
+  u64_t size;				/* size of the disk in bytes */
+  int flags;				/* RAMDISK_ flags */
+  size_t nleaves;			/* number of directory entries */
+  struct ram_page **dir;		/* directory of leaf tables */
+  struct ramdisk_stat stat;		/* usage statistics */
+};
+
+/* Uncompressed page contents; aligned for sparse_is_zero(). */
+static u8_t ram_buf[PAGE_SIZE] __aligned(sizeof(u32_t));
+static u8_t ram_comp[RAM_COMP_MAX];	/* compressed page contents */
+
+/*===========================================================================*
+ *				sparse_create				     *
+ *===========================================================================*/
+struct ram_sparse *sparse_create(u64_t size, int flags)
+{
+/* Create a new sparse RAM disk of the given size, initially all zeroes.
+ * Return a pointer to it, or NULL if out of memory.
+ */
+  struct ram_sparse *sp;
+  u64_t pages;
+
+  pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+  if ((sp = malloc(sizeof(*sp))) == NULL)
+	return NULL;
+
+  memset(sp, 0, sizeof(*sp));
+  sp->size = size;
+  sp->flags = flags;
+  sp->nleaves = (pages + RAM_LEAF_PAGES - 1) / RAM_LEAF_PAGES;
+
+  if ((u64_t) sp->nleaves * RAM_LEAF_PAGES < pages ||
+	(sp->dir = calloc(MAX(sp->nleaves, 1), sizeof(sp->dir[0]))) == NULL) {
+	free(sp);
+	return NULL;
+  }
+
+  sp->stat.size = size;
+  sp->stat.flags = flags;
+  sp->stat.meta_bytes = sizeof(*sp) + sp->nleaves * sizeof(sp->dir[0]);
+
+  return sp;
+}
+
+/*===========================================================================*
+ *				sparse_destroy				     *
+ *===========================================================================*/
+void sparse_destroy(struct ram_sparse *sp)
+{
+/* Free a sparse RAM disk and all memory associated with it.
+ */
+  size_t i, j;
+
+  for (i = 0; i < sp->nleaves; i++) {
+	if (sp->dir[i] == NULL)
+		continue;
+
+	for (j = 0; j < RAM_LEAF_PAGES; j++)
+		free(sp->dir[i][j].data);
+
+	free(sp->dir[i]);
+  }
+
+  free(sp->dir);
+  free(sp);
+}
+
+/*===========================================================================*
+ *				sparse_page				     *
+ *===========================================================================*/
+static struct ram_page *sparse_page(struct ram_sparse *sp, u64_t index,
+	int alloc)
+{
+/* Return the page table entry for the given page index. If the entry's leaf
+ * table has not been allocated, allocate it if requested, or otherwise return
+ * NULL. Also return NULL if allocation fails.
+ */
+  struct ram_page **leaf;
+
+  leaf = &sp->dir[index / RAM_LEAF_PAGES];
+
+  if (*leaf == NULL) {
+	if (!alloc)
+		return NULL;
+
+	if ((*leaf = calloc(RAM_LEAF_PAGES, sizeof(**leaf))) == NULL)
+		return NULL;
+
+	sp->stat.meta_bytes += RAM_LEAF_PAGES * sizeof(**leaf);
+  }
+
+  return &(*leaf)[index % RAM_LEAF_PAGES];
+}
+
+/*===========================================================================*
+ *				sparse_is_zero				     *
+ *===========================================================================*/
+static int sparse_is_zero(const u8_t *data)
+{
+/* Return TRUE iff the given page consists of zeroes only.
+ */
+  const u32_t *p;
+  size_t i;
+
+  p = (const u32_t *) data;
+
+  for (i = 0; i < PAGE_SIZE / sizeof(*p); i++)
+	if (p[i] != 0)
+		return FALSE;
+
+  return TRUE;
+}
+
+/*===========================================================================*
+ *				sparse_free				     *
+ *===========================================================================*/
+static void sparse_free(struct ram_sparse *sp, struct ram_page *pg)
+{
+/* Free the contents of a page, turning it into a zero page.
+ */
+
+  if (pg->data == NULL)
+	return;
+
+  sp->stat.pages--;
+  sp->stat.stored_bytes -= pg->len;
+  if (pg->len < PAGE_SIZE)
+	sp->stat.comp_pages--;
+
+  free(pg->data);
+  pg->data = NULL;
+  pg->len = 0;
+}
+
+/*===========================================================================*
+ *				sparse_load				     *
+ *===========================================================================*/
+static void sparse_load(struct ram_page *pg, u8_t *buf)
+{
+/* Retrieve the uncompressed contents of a page into the given buffer.
+ */
+
+  if (pg == NULL || pg->data == NULL)
+	memset(buf, 0, PAGE_SIZE);
+  else if (pg->len == PAGE_SIZE)
+	memcpy(buf, pg->data, PAGE_SIZE);
+  else if (lz_decompress(pg->data, pg->len, buf, PAGE_SIZE) != PAGE_SIZE)
+	panic("memory: corrupt compressed page");
+}
+
+/*===========================================================================*
+ *				sparse_store				     *
+ *===========================================================================*/
+static int sparse_store(struct ram_sparse *sp, struct ram_page *pg,
+	const u8_t *buf)
+{
+/* Store the given new contents of a page, compressing them if enabled and
+ * worthwhile. Zero pages are not stored at all.
+ */
+  const u8_t *src;
+  u8_t *data;
+  size_t len;
+
+  if (sparse_is_zero(buf)) {
+	sparse_free(sp, pg);
+
+	return OK;
+  }
+
+  src = buf;
+  len = PAGE_SIZE;
+
+  if ((sp->flags & RAMDISK_COMPRESS) &&
+	(len = lz_compress(buf, PAGE_SIZE, ram_comp, sizeof(ram_comp))) > 0)
+	src = ram_comp;
+  else
+	len = PAGE_SIZE;
+
+  /* Reuse the current allocation if it has the right size. */
+  if (pg->data != NULL && pg->len == len) {
+	memcpy(pg->data, src, len);
+
+	return OK;
+  }
+
+  if ((data = malloc(len)) == NULL)
+	return ENOMEM;
+
+  memcpy(data, src, len);
+
+  sparse_free(sp, pg);
+
+  pg->data = data;
+  pg->len = len;
+
+  sp->stat.pages++;
+  sp->stat.stored_bytes += len;
+  if (len < PAGE_SIZE)
+	sp->stat.comp_pages++;
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				sparse_transfer				     *
+ *===========================================================================*/
+int sparse_transfer(struct ram_sparse *sp, int do_write, u64_t position,
+	endpoint_t endpt, cp_grant_id_t grant, vir_bytes offset, size_t count)
+{
+/* Read or write a range of a sparse RAM disk, from or to the given grant at
+ * the given offset. The range must be within the disk. Return OK or an error.
+ */
+  struct ram_page *pg;
+  u64_t index;
+  size_t page_off, chunk;
+  int r;
+
+  assert(position <= sp->size && count <= sp->size - position);
+
+  while (count > 0) {
+	index = position / PAGE_SIZE;
+	page_off = position % PAGE_SIZE;
+	chunk = MIN(count, PAGE_SIZE - page_off);
+
+	pg = sparse_page(sp, index, do_write);
+
+	if (!do_write) {
+		if (pg == NULL || pg->data == NULL) {
+			r = sys_safememset(endpt, grant, offset, 0, chunk);
+		} else if (pg->len == PAGE_SIZE) {
+			r = sys_safecopyto(endpt, grant, offset,
+				(vir_bytes) pg->data + page_off, chunk);
+		} else {
+			sparse_load(pg, ram_buf);
+
+			r = sys_safecopyto(endpt, grant, offset,
+				(vir_bytes) ram_buf + page_off, chunk);
+		}
+	} else if (pg == NULL) {
+		return ENOMEM;
+	} else if (pg->len == PAGE_SIZE && !(sp->flags & RAMDISK_COMPRESS)) {
+		/* Uncompressed pages can be written to in place. */
+		if ((r = sys_safecopyfrom(endpt, grant, offset,
+			(vir_bytes) pg->data + page_off, chunk)) == OK &&
+			sparse_is_zero(pg->data))
+			sparse_free(sp, pg);
+	} else {
+		/* Partial page writes need the old contents. */
+		if (chunk < PAGE_SIZE)
+			sparse_load(pg, ram_buf);
+
+		if ((r = sys_safecopyfrom(endpt, grant, offset,
+			(vir_bytes) ram_buf + page_off, chunk)) == OK)
+			r = sparse_store(sp, pg, ram_buf);
+	}
+
+	if (r != OK)
+		return r;
+
+	position += chunk;
+	offset += chunk;
+	count -= chunk;
+  }
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				sparse_zero				     *
+ *===========================================================================*/
+int sparse_zero(struct ram_sparse *sp, u64_t position, u64_t count)
+{
+/* Zero a range of a sparse RAM disk, freeing the memory of all pages that
+ * are covered entirely. The range must be within the disk.
+ */
+  struct ram_page *pg;
+  u64_t index;
+  size_t page_off, chunk;
+  int r;
+
+  assert(position <= sp->size && count <= sp->size - position);
+
+  while (count > 0) {
+	index = position / PAGE_SIZE;
+	page_off = position % PAGE_SIZE;
+	chunk = MIN(count, PAGE_SIZE - page_off);
+
+	/* Skip over leaf tables that have not been allocated at all. */
+	if (sp->dir[index / RAM_LEAF_PAGES] == NULL) {
+		chunk = MIN(count, (RAM_LEAF_PAGES - index % RAM_LEAF_PAGES) *
+			(u64_t) PAGE_SIZE - page_off);
+	} else if ((pg = sparse_page(sp, index, FALSE))->data != NULL) {
+		if (chunk == PAGE_SIZE) {
+			sparse_free(sp, pg);
+		} else {
+			sparse_load(pg, ram_buf);
+
+			memset(ram_buf + page_off, 0, chunk);
+
+			if ((r = sparse_store(sp, pg, ram_buf)) != OK)
+				return r;
+		}
+	}
+
+	position += chunk;
+	count -= chunk;
+  }
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				sparse_stat				     *
+ *===========================================================================*/
+void sparse_stat(struct ram_sparse *sp, struct ramdisk_stat *stat)
+{
+/* Return usage statistics for a sparse RAM disk.
+ */
+
+  *stat = sp->stat;
+}
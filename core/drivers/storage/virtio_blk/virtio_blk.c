@@ -28,8 +28,13 @@
 	printf("\n");						\
 } while (0)
 
-/* Number of threads to use */
-#define VIRTIO_BLK_NUM_THREADS		4
+/* Number of threads to use. With indirect descriptors, each request takes up
+ * only a single slot in the ring, so we can afford quite a few of them.
+ */
+#define VIRTIO_BLK_NUM_THREADS		16
+
+/* Maximum number of virtqueues to use, if the host offers several */
+#define VIRTIO_BLK_MAX_QUEUES		4
 
 /* virtio-blk blocksize is always 512 bytes */
 #define VIRTIO_BLK_BLOCK_SIZE		512
@@ -51,7 +56,12 @@ struct virtio_feature blkf[] = {
 	{ "scsi",	VIRTIO_BLK_F_SCSI,	0,	0	},
 	{ "flush",	VIRTIO_BLK_F_FLUSH,	0,	0	},
 	{ "topology",	VIRTIO_BLK_F_TOPOLOGY,	0,	0	},
-	{ "idbytes",	VIRTIO_BLK_ID_BYTES,	0,	0	}
+	{ "idbytes",	VIRTIO_BLK_ID_BYTES,	0,	0	},
+	{ "multiqueue",	VIRTIO_BLK_F_MQ,	0,	1	},
+	{ "discard",	VIRTIO_BLK_F_DISCARD,	0,	1	},
+	{ "writezeroes",VIRTIO_BLK_F_WRITE_ZEROES,0,	1	},
+	{ "indirect",	VIRTIO_RING_F_INDIRECT_DESC,0,	1	},
+	{ "eventidx",	VIRTIO_RING_F_EVENT_IDX,0,	1	}
 };
 
 /* State information */
@@ -59,6 +69,13 @@ static int spurious_interrupt = 0;
 static int terminating = 0;
 static int open_count = 0;
 
+/* Number of virtqueues in use; requests from thread N go to queue N modulo
+ * this number.
+ */
+static int num_queues = 1;
+
+#define blk_queue(tid)	((tid) % num_queues)
+
 /* Partition magic */
 struct device part[DEV_PER_DRIVE];
 struct device subpart[SUB_PER_DRIVE];
@@ -76,6 +93,10 @@ static phys_bytes hdrs_phys;
 static u16_t *status_vir;
 static phys_bytes status_phys;
 
+/* Ranges for discard and write zeroes requests */
+static struct virtio_blk_discard_write_zeroes *ranges_vir;
+static phys_bytes ranges_phys;
+
 /* Prototypes */
 static int virtio_blk_open(devminor_t minor, int access);
 static int virtio_blk_close(devminor_t minor);
@@ -90,8 +111,11 @@ static void virtio_blk_device_intr(void);
 static void virtio_blk_spurious_intr(void);
 static void virtio_blk_intr(unsigned int irqs);
 static int virtio_blk_device(devminor_t minor, device_id_t *id);
+static int virtio_blk_poll(int spin);
 
 static int virtio_blk_flush(void);
+static int virtio_blk_discard(devminor_t minor, int zero, endpoint_t endpt,
+	cp_grant_id_t grant);
 static void virtio_blk_terminate(void);
 static void virtio_blk_cleanup(void);
 static int virtio_blk_status2error(u8_t status);
@@ -111,7 +135,8 @@ static struct blockdriver virtio_blk_dtab  = {
 	.bdr_part	= virtio_blk_part,
 	.bdr_geometry	= virtio_blk_geometry,
 	.bdr_intr	= virtio_blk_intr,
-	.bdr_device	= virtio_blk_device
+	.bdr_device	= virtio_blk_device,
+	.bdr_poll	= virtio_blk_poll
 };
 
 static int
@@ -357,7 +382,7 @@ virtio_blk_transfer(devminor_t minor, int write, u64_t position,
 	phys[1 + pcnt].vp_addr |= 1;
 
 	/* Send addresses to queue */
-	virtio_to_queue(blk_dev, 0, phys, 2 + pcnt, &tid);
+	virtio_to_queue(blk_dev, blk_queue(tid), phys, 2 + pcnt, &tid);
 
 	/* Wait for completion */
 	blockdriver_mt_sleep();
@@ -387,6 +412,12 @@ virtio_blk_ioctl(devminor_t minor, unsigned long req, endpoint_t endpt,
 	case DIOCFLUSH:
 		return virtio_blk_flush();
 
+	case DIOCDISCARD:
+		return virtio_blk_discard(minor, 0, endpt, grant);
+
+	case DIOCZERO:
+		return virtio_blk_discard(minor, 1, endpt, grant);
+
 	}
 
 	return ENOTTY;
@@ -437,10 +468,33 @@ static void
 virtio_blk_device_intr(void)
 {
 	thread_id_t *tid;
+	int q;
+
+	/* Multiple requests might have finished, on any of the queues */
+	for (q = 0; q < num_queues; q++)
+		while (!virtio_from_queue(blk_dev, q, (void**)&tid, NULL))
+			blockdriver_mt_wakeup(*tid);
+}
+
+static int
+virtio_blk_poll(int spin)
+{
+	thread_id_t *tid;
+	int q, count = 0;
+
+	/* No need for interrupts while libblockdriver keeps polling. When it
+	 * stops, turn them back on before the final check of the queues.
+	 */
+	for (q = 0; q < num_queues; q++) {
+		virtio_queue_intr(blk_dev, q, !spin);
+
+		while (!virtio_from_queue(blk_dev, q, (void**)&tid, NULL)) {
+			blockdriver_mt_wakeup(*tid);
+			count++;
+		}
+	}
 
-	/* Multiple requests might have finished */
-	while (!virtio_from_queue(blk_dev, 0, (void**)&tid, NULL))
-		blockdriver_mt_wakeup(*tid);
+	return count;
 }
 
 static void
@@ -510,7 +564,7 @@ virtio_blk_flush(void)
 	phys[1].vp_addr |= 1;
 
 	/* Send flush request to queue */
-	virtio_to_queue(blk_dev, 0, phys, phys_cnt, &tid);
+	virtio_to_queue(blk_dev, blk_queue(tid), phys, phys_cnt, &tid);
 
 	blockdriver_mt_sleep();
 
@@ -524,6 +578,107 @@ virtio_blk_flush(void)
 	return virtio_blk_status2error(mystatus(tid));
 }
 
+static int
+virtio_blk_discard(devminor_t minor, int zero, endpoint_t endpt,
+	cp_grant_id_t grant)
+{
+	/* Discard or zero a range of sectors, without transferring data */
+	struct part_range range;
+	struct vumap_phys phys[3];
+	size_t phys_cnt = sizeof(phys) / sizeof(phys[0]);
+	struct device *dv;
+	u64_t sector, count, end;
+	u32_t max, chunk, align;
+	int r;
+
+	/* Which thread is doing this request? */
+	thread_id_t tid = blockdriver_mt_get_tid();
+
+	/* Host may not support the request */
+	if (!virtio_host_supports(blk_dev, zero ? VIRTIO_BLK_F_WRITE_ZEROES :
+	    VIRTIO_BLK_F_DISCARD))
+		return EOPNOTSUPP;
+
+	if (virtio_host_supports(blk_dev, VIRTIO_BLK_F_RO))
+		return EACCES;
+
+	if ((r = sys_safecopyfrom(endpt, grant, 0, (vir_bytes)&range,
+	    sizeof(range))) != OK)
+		return r;
+
+	if (!(dv = virtio_blk_part(minor)))
+		return ENXIO;
+
+	/* Whole sectors within the partition only */
+	if ((range.base % VIRTIO_BLK_BLOCK_SIZE) ||
+	    (range.size % VIRTIO_BLK_BLOCK_SIZE) ||
+	    range.base > dv->dv_size || range.size > dv->dv_size - range.base)
+		return EINVAL;
+
+	sector = (dv->dv_base + range.base) / VIRTIO_BLK_BLOCK_SIZE;
+	count = range.size / VIRTIO_BLK_BLOCK_SIZE;
+
+	max = zero ? blk_config.max_write_zeroes_sectors :
+	    blk_config.max_discard_sectors;
+
+	if (max == 0)
+		max = UINT32_MAX;
+
+	/* Discarding is advisory: shrink the range to the host's alignment */
+	align = zero ? 1 : blk_config.discard_sector_alignment;
+
+	if (align > 1) {
+		end = (sector + count) / align * align;
+		sector = (sector + align - 1) / align * align;
+		count = (end > sector) ? end - sector : 0;
+
+		/* Keep chunks aligned too, unless the host takes less */
+		if (max >= align)
+			max -= max % align;
+	}
+
+	/* One single-segment request per chunk the host can take at once */
+	while (count > 0) {
+		chunk = (count > max) ? max : (u32_t)count;
+
+		memset(&hdrs_vir[tid], 0, sizeof(hdrs_vir[0]));
+		hdrs_vir[tid].type =
+		    zero ? VIRTIO_BLK_T_WRITE_ZEROES : VIRTIO_BLK_T_DISCARD;
+
+		ranges_vir[tid].sector = sector;
+		ranges_vir[tid].num_sectors = chunk;
+		ranges_vir[tid].flags = 0;
+
+		/* Header, range and status for the queue */
+		phys[0].vp_addr = hdrs_phys + tid * sizeof(hdrs_vir[0]);
+		phys[0].vp_size = sizeof(hdrs_vir[0]);
+		phys[1].vp_addr = ranges_phys + tid * sizeof(ranges_vir[0]);
+		phys[1].vp_size = sizeof(ranges_vir[0]);
+		phys[2].vp_addr = status_phys + tid * sizeof(status_vir[0]);
+		phys[2].vp_size = 1;
+
+		/* Status always needs write access */
+		phys[2].vp_addr |= 1;
+
+		virtio_to_queue(blk_dev, blk_queue(tid), phys, phys_cnt, &tid);
+
+		blockdriver_mt_sleep();
+
+		if (mystatus(tid) != VIRTIO_BLK_S_OK) {
+			dprintf(("ERROR status=%02x sector=%llu cnt=%u op=%s "
+			    "t=%d", mystatus(tid), sector, chunk,
+			    zero ? "zero" : "discard", tid));
+
+			return virtio_blk_status2error(mystatus(tid));
+		}
+
+		sector += chunk;
+		count -= chunk;
+	}
+
+	return OK;
+}
+
 static void
 virtio_blk_terminate(void)
 {
@@ -580,6 +735,15 @@ virtio_blk_alloc_requests(void)
 		return ENOMEM;
 	}
 
+	ranges_vir = alloc_contig(VIRTIO_BLK_NUM_THREADS * sizeof(ranges_vir[0]),
+				  AC_ALIGN4K, &ranges_phys);
+
+	if (!ranges_vir) {
+		free_contig(hdrs_vir, VIRTIO_BLK_NUM_THREADS * sizeof(hdrs_vir[0]));
+		free_contig(status_vir, VIRTIO_BLK_NUM_THREADS * sizeof(status_vir[0]));
+		return ENOMEM;
+	}
+
 	return OK;
 }
 
@@ -588,6 +752,7 @@ virtio_blk_free_requests(void)
 {
 	free_contig(hdrs_vir, VIRTIO_BLK_NUM_THREADS * sizeof(hdrs_vir[0]));
 	free_contig(status_vir, VIRTIO_BLK_NUM_THREADS * sizeof(status_vir[0]));
+	free_contig(ranges_vir, VIRTIO_BLK_NUM_THREADS * sizeof(ranges_vir[0]));
 }
 
 static int
@@ -628,6 +793,22 @@ virtio_blk_feature_setup(void)
 	if (virtio_host_supports(blk_dev, VIRTIO_BLK_F_BARRIER))
 		dprintf(("Supports barrier"));
 
+	if (virtio_host_supports(blk_dev, VIRTIO_BLK_F_DISCARD)) {
+		blk_config.max_discard_sectors = virtio_sread32(blk_dev, 36);
+		blk_config.discard_sector_alignment =
+					virtio_sread32(blk_dev, 44);
+		dprintf(("Supports discard (max %u sectors, alignment %u)",
+					blk_config.max_discard_sectors,
+					blk_config.discard_sector_alignment));
+	}
+
+	if (virtio_host_supports(blk_dev, VIRTIO_BLK_F_WRITE_ZEROES)) {
+		blk_config.max_write_zeroes_sectors =
+					virtio_sread32(blk_dev, 48);
+		dprintf(("Supports write zeroes (max %u sectors)",
+					blk_config.max_write_zeroes_sectors));
+	}
+
 	return 0;
 }
 
@@ -662,8 +843,16 @@ virtio_blk_probe(int skip)
 	if (!blk_dev)
 		return ENXIO;
 
-	/* virtio-blk has one queue only */
-	if ((r = virtio_alloc_queues(blk_dev, 1)) != OK) {
+	/* Use several queues if the host offers them */
+	if (virtio_host_supports(blk_dev, VIRTIO_BLK_F_MQ)) {
+		blk_config.num_queues = virtio_sread16(blk_dev, 34);
+		num_queues = MAX(MIN(blk_config.num_queues,
+					VIRTIO_BLK_MAX_QUEUES), 1);
+		dprintf(("Queues: %d of %d", num_queues,
+					blk_config.num_queues));
+	}
+
+	if ((r = virtio_alloc_queues(blk_dev, num_queues)) != OK) {
 		virtio_free_device(blk_dev);
 		return r;
 	}
@@ -41,6 +41,9 @@
 #define VIRTIO_BLK_F_SCSI	7	/* Supports scsi command passthru */
 #define VIRTIO_BLK_F_FLUSH	9	/* Cache flush command support */
 #define VIRTIO_BLK_F_TOPOLOGY	10	/* Topology information is available */
+#define VIRTIO_BLK_F_MQ		12	/* Support more than one vq */
+#define VIRTIO_BLK_F_DISCARD	13	/* DISCARD is supported */
+#define VIRTIO_BLK_F_WRITE_ZEROES	14	/* WRITE ZEROES is supported */
 
 #define VIRTIO_BLK_ID_BYTES	20	/* ID string length */
 
@@ -71,6 +74,31 @@ struct virtio_blk_config {
 	/* optimal sustained I/O size in logical blocks. */
 	u32_t opt_io_size;
 
+	/* writeback mode (if VIRTIO_BLK_F_CONFIG_WCE) */
+	u8_t wce;
+	u8_t unused;
+
+	/* number of vqs, only available when VIRTIO_BLK_F_MQ is set */
+	u16_t num_queues;
+
+	/* the next 3 entries are guarded by VIRTIO_BLK_F_DISCARD */
+	/* maximum discard sectors for one segment. */
+	u32_t max_discard_sectors;
+	/* maximum number of discard segments in a discard command. */
+	u32_t max_discard_seg;
+	/* discard commands must be aligned to this number of sectors. */
+	u32_t discard_sector_alignment;
+
+	/* the next 3 entries are guarded by VIRTIO_BLK_F_WRITE_ZEROES */
+	/* maximum write zeroes sectors for one segment. */
+	u32_t max_write_zeroes_sectors;
+	/* maximum number of segments in a write zeroes command. */
+	u32_t max_write_zeroes_seg;
+	/* set if a VIRTIO_BLK_T_WRITE_ZEROES request may result in the
+	 * deallocation of one or more of the sectors.
+	 */
+	u8_t write_zeroes_may_unmap;
+
 } __attribute__((packed));
 
 /*
@@ -97,6 +125,12 @@ struct virtio_blk_config {
 /* Get device ID command */
 #define VIRTIO_BLK_T_GET_ID    8
 
+/* Discard command */
+#define VIRTIO_BLK_T_DISCARD	11
+
+/* Write zeroes command */
+#define VIRTIO_BLK_T_WRITE_ZEROES	13
+
 /* Barrier before this op. */
 #define VIRTIO_BLK_T_BARRIER	0x80000000
 
@@ -110,6 +144,19 @@ struct virtio_blk_outhdr {
 	u64_t sector;
 };
 
+/* Unmap this range (only valid for write zeroes command) */
+#define VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP	0x00000001
+
+/* Discard/write zeroes range for each request. */
+struct virtio_blk_discard_write_zeroes {
+	/* discard/write zeroes start sector */
+	u64_t sector;
+	/* number of discard/write zeroes sectors */
+	u32_t num_sectors;
+	/* flags for this range */
+	u32_t flags;
+};
+
 struct virtio_scsi_inhdr {
 	u32_t errors;
 	u32_t data_len;
@@ -9,7 +9,14 @@
 #include <fcntl.h>
 #include <assert.h>
 
-#define VND_BUF_SIZE	65536
+/*
+ * The intermediate buffer doubles as a cache of the most recently read part
+ * of the file.  Reads that follow each other sequentially get an increasing
+ * amount of read-ahead, starting at VND_RA_MIN and growing up to the buffer
+ * size, so that image scans take as few VFS backcalls as possible.
+ */
+#define VND_BUF_SIZE	(256 * 1024)
+#define VND_RA_MIN	(32 * 1024)
 
 static struct {
 	int fd;			/* file descriptor for the underlying file */
@@ -22,6 +29,10 @@ static struct {
 	struct device subpart[SUB_PER_DRIVE];	/* same for subpartitions */
 	struct part_geom geom;	/* geometry information */
 	char *buf;		/* intermediate I/O transfer buffer */
+	u64_t cache_pos;	/* file position of data cached in buffer */
+	size_t cache_len;	/* number of bytes cached in buffer */
+	u64_t ra_next;		/* file position after the last read */
+	size_t ra_size;		/* current read-ahead size */
 } state;
 
 static unsigned int instance;
@@ -59,6 +70,19 @@ vnd_partition(void)
 	partition(&vnd_dtab, 0, P_PRIMARY, FALSE /*atapi*/);
 }
 
+/*
+ * Forget any data cached in the intermediate buffer, as well as any
+ * sequential read pattern.
+ */
+static void
+vnd_invalidate(void)
+{
+
+	state.cache_len = 0;
+	state.ra_next = 0;
+	state.ra_size = 0;
+}
+
 /*
  * Open a device.
  */
@@ -116,6 +140,13 @@ vnd_close(devminor_t UNUSED(minor))
 
 	state.openct--;
 
+	/*
+	 * Once the device is fully closed, the file may be changed by others.
+	 * Do not keep serving data from before that point.
+	 */
+	if (state.openct == 0)
+		vnd_invalidate();
+
 	if (state.exiting)
 		blockdriver_terminate();
 
@@ -123,12 +154,13 @@ vnd_close(devminor_t UNUSED(minor))
 }
 
 /*
- * Copy a number of bytes from or to the caller, to or from the intermediate
- * buffer.  If the given endpoint is SELF, a local memory copy must be made.
+ * Copy a number of bytes from or to the caller, to or from the given part of
+ * the intermediate buffer.  If the given endpoint is SELF, a local memory copy
+ * must be made.
  */
 static int
-vnd_copy(iovec_s_t *iov, size_t iov_off, size_t bytes, endpoint_t endpt,
-	int do_write)
+vnd_copy(iovec_s_t *iov, size_t iov_off, char *buf, size_t bytes,
+	endpoint_t endpt, int do_write)
 {
 	struct vscp_vec vvec[SCPVEC_NR], *vvp;
 	size_t off, chunk;
@@ -147,9 +179,9 @@ vnd_copy(iovec_s_t *iov, size_t iov_off, size_t bytes, endpoint_t endpt,
 			ptr = (char *) iov->iov_grant + iov_off;
 
 			if (do_write)
-				memcpy(&state.buf[off], ptr, chunk);
+				memcpy(&buf[off], ptr, chunk);
 			else
-				memcpy(ptr, &state.buf[off], chunk);
+				memcpy(ptr, &buf[off], chunk);
 		} else {
 			assert(count < SCPVEC_NR); /* SCPVEC_NR >= NR_IOREQS */
 
@@ -158,7 +190,7 @@ vnd_copy(iovec_s_t *iov, size_t iov_off, size_t bytes, endpoint_t endpt,
 			vvp->v_bytes = chunk;
 			vvp->v_gid = iov->iov_grant;
 			vvp->v_offset = iov_off;
-			vvp->v_addr = (vir_bytes) &state.buf[off];
+			vvp->v_addr = (vir_bytes) &buf[off];
 
 			vvp++;
 			count++;
@@ -205,6 +237,49 @@ vnd_advance(iovec_s_t *iov, size_t *iov_offp, size_t bytes)
 	return iov;
 }
 
+/*
+ * Make sure that the intermediate buffer caches data at the given file
+ * position, reading in at least the given number of bytes if not.  Return the
+ * number of bytes available in the cache from the given position onward,
+ * which may be less than requested or zero at the end of the file, or a
+ * negative error code.
+ */
+static ssize_t
+vnd_fill(u64_t position, size_t bytes)
+{
+	ssize_t r;
+
+	if (position < state.cache_pos ||
+	    position >= state.cache_pos + state.cache_len) {
+		/*
+		 * For sequential reads, read ahead by twice as much as last
+		 * time, up to the buffer size.  Otherwise, read only what is
+		 * needed.
+		 */
+		if ((state.ra_next != 0 && position == state.ra_next) ||
+		    (state.cache_len > 0 &&
+		    position == state.cache_pos + state.cache_len))
+			state.ra_size = MIN(MAX(state.ra_size * 2,
+			    VND_RA_MIN), VND_BUF_SIZE);
+		else
+			state.ra_size = 0;
+
+		bytes = MIN(MAX(bytes, state.ra_size), VND_BUF_SIZE);
+
+		state.cache_len = 0;
+
+		if ((r = pread(state.fd, state.buf, bytes, position)) < 0) {
+			printf("VND%u: pread failed (%d)\n", instance, -errno);
+			return -errno;
+		}
+
+		state.cache_pos = position;
+		state.cache_len = r;
+	}
+
+	return state.cache_pos + state.cache_len - position;
+}
+
 /*
  * Perform data transfer on the selected device.
  */
@@ -217,6 +292,7 @@ vnd_transfer(devminor_t minor, int do_write, u64_t position,
 	size_t off, chunk, bytes, iov_off;
 	ssize_t r;
 	unsigned int i;
+	char *buf;
 
 	iov = (iovec_s_t *) iovt;
 
@@ -254,22 +330,29 @@ vnd_transfer(devminor_t minor, int do_write, u64_t position,
 
 		assert((unsigned int) (iov - (iovec_s_t *) iovt) < nr_req);
 
-		/* For reads, read in the data for the chunk; possibly less. */
+		/*
+		 * For reads, get the data for the chunk into the cache, if it
+		 * is not there yet; possibly less.  For writes, the buffer is
+		 * used for the data to write, so any cached data is lost.
+		 */
 		if (!do_write) {
-			chunk = r = pread(state.fd, state.buf, chunk,
-			    position);
-
-			if (r < 0) {
-				printf("VND%u: pread failed (%d)\n", instance,
-				    -errno);
-				return -errno;
-			}
+			if ((r = vnd_fill(position, chunk)) < 0)
+				return r;
 			if (r == 0)
 				break;
+
+			chunk = MIN(chunk, (size_t) r);
+
+			buf = &state.buf[position - state.cache_pos];
+		} else {
+			vnd_invalidate();
+
+			buf = state.buf;
 		}
 
 		/* Copy the data for this chunk from or to the caller. */
-		if ((r = vnd_copy(iov, iov_off, chunk, endpt, do_write)) < 0) {
+		if ((r = vnd_copy(iov, iov_off, buf, chunk, endpt,
+		    do_write)) < 0) {
 			printf("VND%u: data copy failed (%d)\n", instance, r);
 			return r;
 		}
@@ -294,6 +377,10 @@ vnd_transfer(devminor_t minor, int do_write, u64_t position,
 		position += chunk;
 	}
 
+	/* Remember where the next sequential read would start. */
+	if (!do_write)
+		state.ra_next = position;
+
 	/* If force-write is requested, flush the underlying file to disk. */
 	if (do_write && (flags & BDEV_FORCEWRITE))
 		fsync(state.fd);
@@ -417,6 +504,7 @@ vnd_ioctl(devminor_t UNUSED(minor), unsigned long request, endpoint_t endpt,
 		}
 
 		/* Set various device state fields. */
+		vnd_invalidate();
 		state.dev = st.st_dev;
 		state.ino = st.st_ino;
 		state.rdonly = !!(vnd.vnd_flags & VNDIOF_READONLY);
@@ -460,6 +548,7 @@ vnd_ioctl(devminor_t UNUSED(minor), unsigned long request, endpoint_t endpt,
 		munmap(state.buf, VND_BUF_SIZE);
 		close(state.fd);
 		state.fd = -1;
+		vnd_invalidate();
 
 		return OK;
 
@@ -435,6 +435,8 @@ do_new_kmess(void)
 		if (kernel_msg_color != 0)
 			reset_color(tp);
 		if (restore) {
+			/* The timer may be linked on the wheel; keep it. */
+			rtp.tty_tmr = tp->tty_tmr;
 			*tp = rtp;
 		}
 	}
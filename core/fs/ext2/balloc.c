@@ -1,9 +1,17 @@
 /* This files manages blocks allocation and deallocation.
+ *
+ * Sequentially written inodes get their blocks from preallocated runs: when
+ * a new block is needed, a run of free blocks is looked up in the bitmap and
+ * reserved at once, and the following writes of that inode are served from
+ * it. Every run taken doubles the size of the next one (up to
+ * EXT2_PREALLOC_MAX_BLOCKS), so files that keep growing are laid out in long
+ * contiguous pieces even when several of them are appended to in parallel.
  *
  * The entry points into this file are:
  *   discard_preallocated_blocks:	Discard preallocated blocks.
  *   alloc_block:	somebody wants to allocate a block; find one.
  *   free_block:	indicate that a block is available for new allocation.
+ *   alloc_stats:	print block allocation statistics.
  *
  * Created:
  *   June 2010 (Evgeniy Ivanov)
@@ -37,30 +45,24 @@ void discard_preallocated_blocks(struct inode *rip)
  * 4. inode is "unloaded" from the memory.
  * 5. No free blocks left (discard all preallocated blocks).
  */
-  int i;
-
   if (rip) {
-	rip->i_prealloc_count = rip->i_prealloc_index = 0;
-	for (i = 0; i < EXT2_PREALLOC_BLOCKS; i++) {
-		if (rip->i_prealloc_blocks[i] != NO_BLOCK) {
-			free_block(rip->i_sp, rip->i_prealloc_blocks[i]);
-			rip->i_prealloc_blocks[i] = NO_BLOCK;
+	if (rip->i_prealloc_count > 0) {
+		rip->i_sp->s_stat_prealloc_unused += rip->i_prealloc_count;
+		while (rip->i_prealloc_count > 0) {
+			rip->i_prealloc_count--;
+			free_block(rip->i_sp,
+				rip->i_prealloc_start + rip->i_prealloc_count);
 		}
 	}
+	rip->i_prealloc_window = EXT2_PREALLOC_BLOCKS;
 	return;
   }
 
   /* Discard all allocated blocks.
    * Probably there are just few blocks on the disc, so forbid preallocation.*/
   for(rip = &inode[0]; rip < &inode[NR_INODES]; rip++) {
-	rip->i_prealloc_count = rip->i_prealloc_index = 0;
+	discard_preallocated_blocks(rip);
 	rip->i_preallocation = 0; /* forbid preallocation */
-	for (i = 0; i < EXT2_PREALLOC_BLOCKS; i++) {
-		if (rip->i_prealloc_blocks[i] != NO_BLOCK) {
-			free_block(rip->i_sp, rip->i_prealloc_blocks[i]);
-			rip->i_prealloc_blocks[i] = NO_BLOCK;
-		}
-	}
   }
 }
 
@@ -87,7 +89,7 @@ block_t alloc_block(struct inode *rip, block_t block)
   if (!opt.use_reserved_blocks &&
       sp->s_free_blocks_count <= sp->s_r_blocks_count) {
 	discard_preallocated_blocks(NULL);
-  } else if (sp->s_free_blocks_count <= EXT2_PREALLOC_BLOCKS) {
+  } else if (sp->s_free_blocks_count <= EXT2_PREALLOC_MAX_BLOCKS) {
 	discard_preallocated_blocks(NULL);
   }
 
@@ -102,17 +104,14 @@ block_t alloc_block(struct inode *rip, block_t block)
 	goal = block;
 	if (rip->i_preallocation && rip->i_prealloc_count > 0) {
 		/* check if goal is preallocated */
-		b = rip->i_prealloc_blocks[rip->i_prealloc_index];
+		b = rip->i_prealloc_start;
 		if (block == b || (block + 1) == b) {
 			/* use preallocated block */
-			rip->i_prealloc_blocks[rip->i_prealloc_index] = NO_BLOCK;
+			rip->i_prealloc_start++;
 			rip->i_prealloc_count--;
-			rip->i_prealloc_index++;
-			if (rip->i_prealloc_index >= EXT2_PREALLOC_BLOCKS) {
-				rip->i_prealloc_index = 0;
-				ASSERT(rip->i_prealloc_count == 0);
-			}
 			rip->i_bsearch = b;
+			sp->s_stat_alloc_blocks++;
+			sp->s_stat_alloc_contig++;
 			return b;
 		} else {
 			/* probably non-sequential write operation,
@@ -134,8 +133,12 @@ block_t alloc_block(struct inode *rip, block_t block)
 
   b = alloc_block_bit(sp, goal, rip);
 
-  if (b != NO_BLOCK)
+  if (b != NO_BLOCK) {
 	rip->i_bsearch = b;
+	sp->s_stat_alloc_blocks++;
+	if (b == block)
+		sp->s_stat_alloc_contig++;
+  }
 
   return b;
 }
@@ -155,9 +158,10 @@ struct inode *rip;		/* used for preallocation */
   block_t block = NO_BLOCK;	/* allocated block */
   int word;			/* word in block bitmap */
   bit_t	bit = -1;
+  bit_t origin;			/* bit in block bitmap */
   int group;
   char update_bsearch = FALSE;
-  int i;
+  int i, len;
 
   if (goal >= sp->s_blocks_count ||
       (goal < sp->s_first_data_block && goal != 0)) {
@@ -171,8 +175,8 @@ struct inode *rip;		/* used for preallocation */
   }
 
   /* Figure out where to start the bit search. */
-  word = ((goal - sp->s_first_data_block) % sp->s_blocks_per_group)
-			/ FS_BITCHUNK_BITS;
+  origin = (goal - sp->s_first_data_block) % sp->s_blocks_per_group;
+  word = origin / FS_BITCHUNK_BITS;
 
   /* Try to allocate block at any group starting from the goal's group.
    * First time goal's group is checked from the word=goal, after all
@@ -191,15 +195,17 @@ struct inode *rip;		/* used for preallocation */
 		panic("can't get group_desc to alloc block");
 
 	if (gd->free_blocks_count == 0) {
-		word = 0;
+		word = origin = 0;
 		continue;
 	}
 
 	bp = get_block(sp->s_dev, gd->block_bitmap, NORMAL);
 
 	if (rip->i_preallocation &&
-	    gd->free_blocks_count >= (EXT2_PREALLOC_BLOCKS * 4) ) {
-		/* Try to preallocate blocks */
+	    gd->free_blocks_count >= rip->i_prealloc_window * 4) {
+		/* Try to preallocate a run of blocks, starting at the goal
+		 * if that one is free.
+		 */
 		if (rip->i_prealloc_count != 0) {
 			/* kind of glitch... */
 			discard_preallocated_blocks(rip);
@@ -207,33 +213,37 @@ struct inode *rip;		/* used for preallocation */
 				    blocks! It had to be done by another code.");
 		}
 		ASSERT(rip->i_prealloc_count == 0);
-		/* we preallocate bytes only */
-		ASSERT(EXT2_PREALLOC_BLOCKS == sizeof(char)*CHAR_BIT);
 
-		bit = setbyte(b_bitmap(bp), sp->s_blocks_per_group);
+		len = rip->i_prealloc_window;
+		bit = setrun(b_bitmap(bp), sp->s_blocks_per_group, origin,
+			&len);
 		if (bit != -1) {
 			block = bit + sp->s_first_data_block +
 					group * sp->s_blocks_per_group;
 			check_block_number(block, sp, gd);
+			check_block_number(block + len - 1, sp, gd);
 
-			/* We preallocate a byte starting from block.
-			 * First preallocated block will be returned as
+			/* First preallocated block will be returned as
 			 * normally allocated block.
 			 */
-			for (i = 1; i < EXT2_PREALLOC_BLOCKS; i++) {
-				check_block_number(block + i, sp, gd);
-				rip->i_prealloc_blocks[i-1] = block + i;
-			}
-			rip->i_prealloc_index = 0;
-			rip->i_prealloc_count = EXT2_PREALLOC_BLOCKS - 1;
+			rip->i_prealloc_start = block + 1;
+			rip->i_prealloc_count = len - 1;
+			if (rip->i_prealloc_window < EXT2_PREALLOC_MAX_BLOCKS)
+				rip->i_prealloc_window *= 2;
 
 			lmfs_markdirty(bp);
 			put_block(bp);
 
-			gd->free_blocks_count -= EXT2_PREALLOC_BLOCKS;
-			sp->s_free_blocks_count -= EXT2_PREALLOC_BLOCKS;
-			lmfs_change_blockusage(EXT2_PREALLOC_BLOCKS);
+			gd->free_blocks_count -= len;
+			sp->s_free_blocks_count -= len;
+			sp->s_stat_prealloc_runs++;
+			sp->s_stat_prealloc_blocks += len - 1;
+			lmfs_change_blockusage(len);
 			group_descriptors_dirty = 1;
+
+			if (update_bsearch && bit == origin)
+				sp->s_bsearch = block;
+
 			return block;
 		}
 	}
@@ -244,7 +254,8 @@ struct inode *rip;		/* used for preallocation */
 			panic("ext2: allocator failed to allocate a bit in bitmap\
 				with free bits.");
 		} else {
-			word = 0;
+			put_block(bp);
+			word = origin = 0;
 			continue;
 		}
 	}
@@ -360,3 +371,33 @@ static void check_block_number(block_t block, struct super_block *sp,
 			total number of blocks.\n");
   }
 }
+
+
+/*===========================================================================*
+ *				alloc_stats				     *
+ *===========================================================================*/
+void alloc_stats(struct super_block *sp)
+{
+/* Print how well block allocation kept files contiguous on this mount.
+ * A block is counted as contiguous when it directly follows the block
+ * allocated before it for the same inode, so the rest is a measure of
+ * fragmentation. For extent mapped files the number of extents started
+ * versus blocks merged into existing extents is shown as well.
+ */
+  u32_t pct;
+
+  if (sp->s_stat_alloc_blocks == 0)
+	return;
+
+  pct = (u32_t) ((u64_t) sp->s_stat_alloc_contig * 100 /
+	sp->s_stat_alloc_blocks);
+  printf("ext2: allocated %u blocks, %u%% contiguous (%u fragments)\n",
+	sp->s_stat_alloc_blocks, pct,
+	sp->s_stat_alloc_blocks - sp->s_stat_alloc_contig);
+  printf("ext2: %u preallocated runs of %u blocks, %u returned unused\n",
+	sp->s_stat_prealloc_runs, sp->s_stat_prealloc_blocks,
+	sp->s_stat_prealloc_unused);
+  if (sp->s_stat_extents_new + sp->s_stat_extents_merged > 0)
+	printf("ext2: %u extents started, %u blocks merged into extents\n",
+		sp->s_stat_extents_new, sp->s_stat_extents_merged);
+}
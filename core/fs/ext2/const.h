@@ -126,10 +126,11 @@
 #define INCOMPAT_RECOVER           0x0004
 #define INCOMPAT_JOURNAL_DEV       0x0008
 #define INCOMPAT_META_BG           0x0010
+#define INCOMPAT_EXTENTS           0x0040
 #define INCOMPAT_ANY               0xffffffff
 
 /* What do we support? */
-#define SUPPORTED_INCOMPAT_FEATURES	(INCOMPAT_FILETYPE)
+#define SUPPORTED_INCOMPAT_FEATURES	(INCOMPAT_FILETYPE | INCOMPAT_EXTENTS)
 #define SUPPORTED_RO_COMPAT_FEATURES	(RO_COMPAT_SPARSE_SUPER | \
 					 RO_COMPAT_LARGE_FILE)
 
@@ -159,8 +160,51 @@
 #define EXT2_INDEX_FL			0x00001000
 /* Top of directory hierarchies*/
 #define EXT2_TOPDIR_FL                  0x00020000
-
+/* Inode uses extents */
+#define EXT4_EXTENTS_FL			0x00080000
+
+/* Extent trees */
+#define EXT4_EXT_MAGIC			0xF30A
+#define EXT4_EXT_INIT_MAX_LEN		(1 << 15) /* longer: unwritten */
+#define EXT4_EXT_MAX_DEPTH		5
+#define EXT4_EXT_ROOT_ENTRIES		4	/* in i_block[] */
+#define EXT4_EXT_BLOCK_ENTRIES(bsize)	(((bsize) - \
+			sizeof(struct ext4_extent_header)) / \
+			sizeof(struct ext4_extent))
+
+/* Preallocation window: the first run reserved for a sequentially written
+ * inode, and the limit it may double up to while writes stay sequential.
+ */
 #define EXT2_PREALLOC_BLOCKS		8
+#define EXT2_PREALLOC_MAX_BLOCKS	128
+
+/* Superblock s_flags */
+#define EXT2_FLAGS_SIGNED_HASH		0x0001  /* Signed dirhash in use */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002  /* Unsigned dirhash in use */
+
+/* HTree (directory index) hash versions. Whether chars are hashed signed
+ * or unsigned is selected by the EXT2_FLAGS_*_HASH superblock flags.
+ */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+
+#define DX_HASH_EOF		0x7fffffff	/* hash reserved for EOF */
+
+/* The root of the index hides in the first block behind the "." (12 bytes)
+ * and ".." entries; the ".." entry covers the rest of the block. Interior
+ * index blocks start with a single empty entry covering the whole block.
+ */
+#define DX_ROOT_INFO_OFFSET	24
+#define DX_ROOT_INFO_LENGTH	8
+#define DX_ROOT_ENTRIES_OFFSET	(DX_ROOT_INFO_OFFSET + DX_ROOT_INFO_LENGTH)
+#define DX_NODE_ENTRIES_OFFSET	8
+#define DX_MAX_LEVELS		2	/* root plus one level of index nodes */
+
+#define DX_ROOT_LIMIT(bsize)	(((bsize) - DX_ROOT_ENTRIES_OFFSET) / \
+				 sizeof(struct ext2_dx_entry))
+#define DX_NODE_LIMIT(bsize)	(((bsize) - DX_NODE_ENTRIES_OFFSET) / \
+				 sizeof(struct ext2_dx_entry))
 
 
 #endif /* EXT2_CONST_H */
@@ -0,0 +1,638 @@
+/* This file contains the code for files that map their blocks through an
+ * ext4 extent tree (the EXTENTS incompat feature) rather than through
+ * indirect blocks.
+ *
+ * The entry points into this file are
+ *   extent_init:	set up an empty extent tree in a new inode
+ *   extent_read_map:	find the block for a position in a file
+ *   extent_write_map:	map a new block into a file, or free one
+ *
+ * The root of the tree is kept in i_block[] of the inode and has room for
+ * four entries; deeper levels are full blocks. Every entry starts with the
+ * first logical block it covers, so index and leaf entries are looked up
+ * the same way. An extent with a length above EXT4_EXT_INIT_MAX_LEN is
+ * "unwritten": its blocks are allocated, but read as zeroes.
+ */
+
+#include "fs.h"
+#include <string.h>
+#include "buf.h"
+#include "inode.h"
+#include "super.h"
+
+struct ext_path {
+  struct buf *ep_bp;		/* NULL for the root in the inode */
+  struct ext4_extent_header *ep_hdr;
+  int ep_at;			/* entry we went through, -1 if none */
+};
+
+#define EXT_EXTENT(hdr, i)	((struct ext4_extent *) ((hdr) + 1) + (i))
+#define EXT_INDEX(hdr, i)	((struct ext4_extent_idx *) ((hdr) + 1) + (i))
+#define EXT_KEY(hdr, i)		((block_t) conv4(le_CPU, EXT_EXTENT(hdr, i)->ee_block))
+#define EXT_ENTRIES(hdr)	conv2(le_CPU, (hdr)->eh_entries)
+#define EXT_MAX(hdr)		conv2(le_CPU, (hdr)->eh_max)
+#define EXT_DEPTH(hdr)		conv2(le_CPU, (hdr)->eh_depth)
+
+static int ext_find(struct inode *rip, block_t lblock, struct ext_path *path,
+	int iomode);
+static void ext_put_path(struct ext_path *path, int depth);
+static int ext_insert(struct inode *rip, struct ext_path *path, int *depth,
+	int pos, struct ext4_extent *entry);
+static void ext_remove(struct inode *rip, struct ext_path *path, int level,
+	int pos);
+static void ext_fix_keys(struct inode *rip, struct ext_path *path, int level,
+	u32_t key);
+static int ext_free_block(struct inode *rip, block_t lblock);
+
+/*===========================================================================*
+ *				ext_len					     *
+ *===========================================================================*/
+static unsigned int ext_len(struct ext4_extent *ex, int *unwritten)
+{
+  unsigned int len = conv2(le_CPU, ex->ee_len);
+
+  *unwritten = (len > EXT4_EXT_INIT_MAX_LEN);
+  return(*unwritten ? len - EXT4_EXT_INIT_MAX_LEN : len);
+}
+
+/*===========================================================================*
+ *				ext_set_len				     *
+ *===========================================================================*/
+static void ext_set_len(struct ext4_extent *ex, unsigned int len,
+	int unwritten)
+{
+  ex->ee_len = conv2(le_CPU, unwritten ? len + EXT4_EXT_INIT_MAX_LEN : len);
+}
+
+/*===========================================================================*
+ *				ext_start				     *
+ *===========================================================================*/
+static block_t ext_start(struct ext4_extent *ex)
+{
+  /* We don't do 64bit block numbers, so the high part is always zero. */
+  return (block_t) conv4(le_CPU, ex->ee_start_lo);
+}
+
+/*===========================================================================*
+ *				ext_set_start				     *
+ *===========================================================================*/
+static void ext_set_start(struct ext4_extent *ex, block_t b)
+{
+  ex->ee_start_lo = conv4(le_CPU, b);
+  ex->ee_start_hi = 0;
+}
+
+/*===========================================================================*
+ *				ext_dirty				     *
+ *===========================================================================*/
+static void ext_dirty(struct inode *rip, struct ext_path *path, int level)
+{
+  if (path[level].ep_bp != NULL)
+	lmfs_markdirty(path[level].ep_bp);
+  else
+	rip->i_dirt = IN_DIRTY;
+}
+
+
+/*===========================================================================*
+ *				extent_init				     *
+ *===========================================================================*/
+void extent_init(struct inode *rip)
+{
+/* Give a new inode an empty extent tree. */
+  struct ext4_extent_header *hdr;
+
+  memset(rip->i_block, 0, sizeof(rip->i_block));
+  hdr = (struct ext4_extent_header *) rip->i_block;
+  hdr->eh_magic = conv2(le_CPU, EXT4_EXT_MAGIC);
+  hdr->eh_max = conv2(le_CPU, EXT4_EXT_ROOT_ENTRIES);
+  rip->i_flags |= EXT4_EXTENTS_FL;
+  rip->i_dirt = IN_DIRTY;
+}
+
+
+/*===========================================================================*
+ *				extent_read_map				     *
+ *===========================================================================*/
+block_t extent_read_map(struct inode *rip, off_t position, int opportunistic)
+{
+/* Given an inode using extents and a position within the file, return the
+ * block holding that position, or NO_BLOCK for holes and unwritten extents.
+ */
+  struct ext_path path[EXT4_EXT_MAX_DEPTH + 1];
+  struct ext4_extent *ex;
+  block_t lblock, first, b;
+  unsigned int len;
+  int depth, at, unwritten;
+
+  lblock = position / rip->i_sp->s_block_size;
+
+  depth = ext_find(rip, lblock, path, opportunistic ? PEEK : NORMAL);
+  if (depth < 0)
+	return(NO_BLOCK);
+
+  b = NO_BLOCK;
+  if ((at = path[depth].ep_at) >= 0) {
+	ex = EXT_EXTENT(path[depth].ep_hdr, at);
+	first = conv4(le_CPU, ex->ee_block);
+	len = ext_len(ex, &unwritten);
+	if (lblock < first + len && !unwritten) {
+		if (ex->ee_start_hi != 0)
+			ext2_debug("ext2: 64bit extent in inode %llu\n",
+				(unsigned long long) rip->i_num);
+		else
+			b = ext_start(ex) + (lblock - first);
+	}
+  }
+
+  ext_put_path(path, depth);
+  return(b);
+}
+
+
+/*===========================================================================*
+ *				extent_write_map			     *
+ *===========================================================================*/
+int extent_write_map(struct inode *rip, off_t position, block_t new_wblock,
+	int op)
+{
+/* Write a new block into an inode using extents, or free the block at
+ * 'position' if op includes WMAP_FREE. New blocks that continue an extent on
+ * disk just extend it, so files written sequentially end up with few
+ * extents. Like write_map(), this takes care of rip->i_blocks.
+ */
+  struct ext_path path[EXT4_EXT_MAX_DEPTH + 1];
+  struct ext4_extent_header *hdr;
+  struct ext4_extent *ex, entry;
+  block_t lblock, first;
+  unsigned int len;
+  int depth, at, unwritten, r;
+
+  lblock = position / rip->i_sp->s_block_size;
+  rip->i_dirt = IN_DIRTY;		/* inode will be changed */
+
+  if (op & WMAP_FREE)
+	return ext_free_block(rip, lblock);
+
+  if ((depth = ext_find(rip, lblock, path, NORMAL)) < 0)
+	return(EIO);
+
+  hdr = path[depth].ep_hdr;
+  at = path[depth].ep_at;
+
+  if (at >= 0) {
+	ex = EXT_EXTENT(hdr, at);
+	first = conv4(le_CPU, ex->ee_block);
+	len = ext_len(ex, &unwritten);
+	if (lblock < first + len) {
+		/* Only blocks in unwritten extents read as holes. Take the
+		 * block out of the extent, and map the new one after all.
+		 */
+		ext_put_path(path, depth);
+		if (!unwritten)
+			panic("ext2: block %u of inode %llu already mapped",
+				lblock, (unsigned long long) rip->i_num);
+		if ((r = ext_free_block(rip, lblock)) != OK)
+			return(r);
+		return extent_write_map(rip, position, new_wblock, op);
+	}
+
+	/* Append to the extent on the left? */
+	if (!unwritten && lblock == first + len &&
+	    new_wblock == ext_start(ex) + len &&
+	    len < EXT4_EXT_INIT_MAX_LEN) {
+		ext_set_len(ex, len + 1, FALSE);
+		ext_dirty(rip, path, depth);
+		rip->i_sp->s_stat_extents_merged++;
+		goto done;
+	}
+  }
+
+  /* Prepend to the extent on the right? */
+  if (at + 1 < (int) EXT_ENTRIES(hdr)) {
+	ex = EXT_EXTENT(hdr, at + 1);
+	len = ext_len(ex, &unwritten);
+	if (!unwritten && lblock + 1 == conv4(le_CPU, ex->ee_block) &&
+	    new_wblock + 1 == ext_start(ex) && len < EXT4_EXT_INIT_MAX_LEN) {
+		ex->ee_block = conv4(le_CPU, lblock);
+		ext_set_start(ex, new_wblock);
+		ext_set_len(ex, len + 1, FALSE);
+		ext_dirty(rip, path, depth);
+		if (at + 1 == 0)
+			ext_fix_keys(rip, path, depth, ex->ee_block);
+		rip->i_sp->s_stat_extents_merged++;
+		goto done;
+	}
+  }
+
+  /* Start a new extent. */
+  entry.ee_block = conv4(le_CPU, lblock);
+  ext_set_len(&entry, 1, FALSE);
+  ext_set_start(&entry, new_wblock);
+  if ((r = ext_insert(rip, path, &depth, at + 1, &entry)) != OK) {
+	ext_put_path(path, depth);
+	return(r);
+  }
+  rip->i_sp->s_stat_extents_new++;
+
+done:
+  ext_put_path(path, depth);
+  rip->i_blocks += rip->i_sp->s_sectors_in_block;
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				ext_hdr_ok				     *
+ *===========================================================================*/
+static int ext_hdr_ok(struct ext4_extent_header *hdr, int depth,
+	unsigned int max)
+{
+  return(conv2(le_CPU, hdr->eh_magic) == EXT4_EXT_MAGIC &&
+	(int) EXT_DEPTH(hdr) == depth &&
+	EXT_MAX(hdr) <= max && EXT_ENTRIES(hdr) <= EXT_MAX(hdr));
+}
+
+
+/*===========================================================================*
+ *				ext_search				     *
+ *===========================================================================*/
+static int ext_search(struct ext4_extent_header *hdr, block_t lblock)
+{
+/* Return the last entry in a node starting at or before 'lblock', or -1. */
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = (int) EXT_ENTRIES(hdr) - 1;
+  while (lo <= hi) {
+	mid = lo + (hi - lo) / 2;
+	if (EXT_KEY(hdr, mid) > lblock)
+		hi = mid - 1;
+	else
+		lo = mid + 1;
+  }
+  return(lo - 1);
+}
+
+
+/*===========================================================================*
+ *				ext_find				     *
+ *===========================================================================*/
+static int ext_find(struct inode *rip, block_t lblock, struct ext_path *path,
+	int iomode)
+{
+/* Walk the extent tree down to the leaf that covers 'lblock', filling in
+ * 'path'. Return the depth of the tree, or -1 if the tree is damaged or a
+ * block is not in the cache while peeking.
+ */
+  struct ext4_extent_header *hdr;
+  struct ext4_extent_idx *idx;
+  struct buf *bp;
+  unsigned int max_entries;
+  int depth, level, at;
+  block_t b;
+
+  max_entries = EXT4_EXT_BLOCK_ENTRIES(rip->i_sp->s_block_size);
+
+  hdr = (struct ext4_extent_header *) rip->i_block;
+  depth = EXT_DEPTH(hdr);
+  if (depth > EXT4_EXT_MAX_DEPTH ||
+      !ext_hdr_ok(hdr, depth, EXT4_EXT_ROOT_ENTRIES)) {
+	ext2_debug("ext2: bad extent tree root in inode %llu\n",
+		(unsigned long long) rip->i_num);
+	return(-1);
+  }
+  path[0].ep_bp = NULL;
+  path[0].ep_hdr = hdr;
+
+  for (level = 0; level < depth; level++) {
+	hdr = path[level].ep_hdr;
+	if (EXT_ENTRIES(hdr) == 0)
+		goto bad;
+
+	/* Blocks below the first index entry still go through it. */
+	if ((at = ext_search(hdr, lblock)) < 0)
+		at = 0;
+	path[level].ep_at = at;
+
+	idx = EXT_INDEX(hdr, at);
+	b = conv4(le_CPU, idx->ei_leaf_lo);
+	if (idx->ei_leaf_hi != 0 || b >= rip->i_sp->s_blocks_count)
+		goto bad;
+	if ((bp = get_block(rip->i_dev, b, iomode)) == NULL) {
+		ext_put_path(path, level);
+		return(-1);
+	}
+	path[level + 1].ep_bp = bp;
+	path[level + 1].ep_hdr = (struct ext4_extent_header *) b_data(bp);
+	if (!ext_hdr_ok(path[level + 1].ep_hdr, depth - level - 1,
+	    max_entries)) {
+		level++;
+		goto bad;
+	}
+  }
+
+  path[depth].ep_at = ext_search(path[depth].ep_hdr, lblock);
+  return(depth);
+
+bad:
+  ext2_debug("ext2: bad extent tree in inode %llu\n",
+	(unsigned long long) rip->i_num);
+  ext_put_path(path, level);
+  return(-1);
+}
+
+
+/*===========================================================================*
+ *				ext_put_path				     *
+ *===========================================================================*/
+static void ext_put_path(struct ext_path *path, int depth)
+{
+/* Release the tree blocks held by 'path'. */
+  int level;
+
+  for (level = 1; level <= depth; level++)
+	put_block(path[level].ep_bp);	/* put_block() accepts NULL */
+}
+
+
+/*===========================================================================*
+ *				ext_fix_keys				     *
+ *===========================================================================*/
+static void ext_fix_keys(struct inode *rip, struct ext_path *path, int level,
+	u32_t key)
+{
+/* The first entry of the node at 'level' now starts at 'key' (in disk byte
+ * order). Update the index entries on the way up that refer to it.
+ */
+  for (; level > 0; level--) {
+	EXT_INDEX(path[level - 1].ep_hdr, path[level - 1].ep_at)->ei_block =
+		key;
+	ext_dirty(rip, path, level - 1);
+	if (path[level - 1].ep_at != 0)
+		break;
+  }
+}
+
+
+/*===========================================================================*
+ *				ext_new_node				     *
+ *===========================================================================*/
+static struct buf *ext_new_node(struct inode *rip, block_t b, int depth)
+{
+/* Initialize block 'b' as an empty tree node at 'depth' above the leaves. */
+  struct ext4_extent_header *hdr;
+  struct buf *bp;
+
+  bp = get_block(rip->i_dev, b, NO_READ);
+  zero_block(bp);
+  hdr = (struct ext4_extent_header *) b_data(bp);
+  hdr->eh_magic = conv2(le_CPU, EXT4_EXT_MAGIC);
+  hdr->eh_max = conv2(le_CPU,
+	EXT4_EXT_BLOCK_ENTRIES(rip->i_sp->s_block_size));
+  hdr->eh_depth = conv2(le_CPU, depth);
+  rip->i_blocks += rip->i_sp->s_sectors_in_block;
+  return(bp);
+}
+
+
+/*===========================================================================*
+ *				ext_put_entry				     *
+ *===========================================================================*/
+static void ext_put_entry(struct ext4_extent_header *hdr, int pos,
+	struct ext4_extent *entry)
+{
+/* Insert an entry into a node that has room for it. Index and leaf entries
+ * have the same size, so this works for both.
+ */
+  unsigned int entries = EXT_ENTRIES(hdr);
+
+  memmove(EXT_EXTENT(hdr, pos + 1), EXT_EXTENT(hdr, pos),
+	(entries - pos) * sizeof(struct ext4_extent));
+  memcpy(EXT_EXTENT(hdr, pos), entry, sizeof(*entry));
+  hdr->eh_entries = conv2(le_CPU, entries + 1);
+}
+
+
+/*===========================================================================*
+ *				ext_insert_level			     *
+ *===========================================================================*/
+static void ext_insert_level(struct inode *rip, struct ext_path *path,
+	int *depth, int level, int pos, struct ext4_extent *entry,
+	block_t *new_blocks)
+{
+/* Insert 'entry' at 'pos' into the node at 'level', splitting full nodes on
+ * the way up. Blocks for new nodes are taken from 'new_blocks', which the
+ * caller allocated beforehand, so that this can not fail halfway.
+ */
+  struct ext4_extent_header *hdr, *nhdr;
+  struct ext4_extent_idx idx;
+  struct buf *bp;
+  unsigned int entries, split;
+  int l;
+
+  hdr = path[level].ep_hdr;
+  entries = EXT_ENTRIES(hdr);
+
+  if (entries < EXT_MAX(hdr)) {
+	ext_put_entry(hdr, pos, entry);
+	ext_dirty(rip, path, level);
+	return;
+  }
+
+  if (level == 0) {
+	/* The root in the inode is full. Move its entries into a new node
+	 * and make that node the only child of the root.
+	 */
+	bp = ext_new_node(rip, *new_blocks, EXT_DEPTH(hdr));
+	nhdr = (struct ext4_extent_header *) b_data(bp);
+	memcpy(EXT_EXTENT(nhdr, 0), EXT_EXTENT(hdr, 0),
+		entries * sizeof(struct ext4_extent));
+	nhdr->eh_entries = hdr->eh_entries;
+	ext_put_entry(nhdr, pos, entry);
+	lmfs_markdirty(bp);
+
+	EXT_INDEX(hdr, 0)->ei_block = EXT_EXTENT(nhdr, 0)->ee_block;
+	EXT_INDEX(hdr, 0)->ei_leaf_lo = conv4(le_CPU, *new_blocks);
+	EXT_INDEX(hdr, 0)->ei_leaf_hi = 0;
+	EXT_INDEX(hdr, 0)->ei_unused = 0;
+	hdr->eh_entries = conv2(le_CPU, 1);
+	hdr->eh_depth = conv2(le_CPU, EXT_DEPTH(hdr) + 1);
+	rip->i_dirt = IN_DIRTY;
+
+	/* The path is one level deeper now. */
+	for (l = *depth; l >= 1; l--)
+		path[l + 1] = path[l];
+	path[1].ep_bp = bp;
+	path[1].ep_hdr = nhdr;
+	path[1].ep_at = path[0].ep_at;
+	path[0].ep_at = 0;
+	(*depth)++;
+	return;
+  }
+
+  /* Split the node. When appending at the end, as sequential writes do,
+   * leave the node full and start a new one with just the new entry.
+   */
+  split = (pos == (int) entries) ? entries : entries / 2;
+  bp = ext_new_node(rip, *new_blocks, EXT_DEPTH(hdr));
+  nhdr = (struct ext4_extent_header *) b_data(bp);
+  memcpy(EXT_EXTENT(nhdr, 0), EXT_EXTENT(hdr, split),
+	(entries - split) * sizeof(struct ext4_extent));
+  nhdr->eh_entries = conv2(le_CPU, entries - split);
+  hdr->eh_entries = conv2(le_CPU, split);
+  if (pos >= (int) split)
+	ext_put_entry(nhdr, pos - split, entry);
+  else
+	ext_put_entry(hdr, pos, entry);
+  ext_dirty(rip, path, level);
+
+  idx.ei_block = EXT_EXTENT(nhdr, 0)->ee_block;
+  idx.ei_leaf_lo = conv4(le_CPU, *new_blocks);
+  idx.ei_leaf_hi = 0;
+  idx.ei_unused = 0;
+  lmfs_markdirty(bp);
+  put_block(bp);
+
+  ext_insert_level(rip, path, depth, level - 1, path[level - 1].ep_at + 1,
+	(struct ext4_extent *) &idx, new_blocks + 1);
+}
+
+
+/*===========================================================================*
+ *				ext_insert				     *
+ *===========================================================================*/
+static int ext_insert(struct inode *rip, struct ext_path *path, int *depth,
+	int pos, struct ext4_extent *entry)
+{
+/* Insert 'entry' at 'pos' into the leaf on 'path'. */
+  block_t new_blocks[EXT4_EXT_MAX_DEPTH + 1];
+  int level, needed, i;
+
+  /* Every full node from the leaf up needs a new block. */
+  for (level = *depth, needed = 0; level >= 0; level--, needed++) {
+	if (EXT_ENTRIES(path[level].ep_hdr) < EXT_MAX(path[level].ep_hdr))
+		break;
+  }
+  if (level < 0 && *depth >= EXT4_EXT_MAX_DEPTH)
+	return(EFBIG);
+
+  for (i = 0; i < needed; i++) {
+	if ((new_blocks[i] = alloc_block(rip, rip->i_bsearch)) == NO_BLOCK) {
+		while (i-- > 0)
+			free_block(rip->i_sp, new_blocks[i]);
+		return(ENOSPC);
+	}
+  }
+
+  /* A new first entry changes the keys on the way up. Entries added to
+   * index nodes by splits are never first, so this is the only place.
+   */
+  if (pos == 0 && *depth > 0)
+	ext_fix_keys(rip, path, *depth, entry->ee_block);
+
+  ext_insert_level(rip, path, depth, *depth, pos, entry, new_blocks);
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				ext_remove				     *
+ *===========================================================================*/
+static void ext_remove(struct inode *rip, struct ext_path *path, int level,
+	int pos)
+{
+/* Remove entry 'pos' from the node at 'level'. Nodes that become empty are
+ * freed and removed from their parent in turn.
+ */
+  struct ext4_extent_header *hdr;
+  unsigned int entries;
+  block_t b;
+
+  hdr = path[level].ep_hdr;
+  entries = EXT_ENTRIES(hdr) - 1;
+  memmove(EXT_EXTENT(hdr, pos), EXT_EXTENT(hdr, pos + 1),
+	(entries - pos) * sizeof(struct ext4_extent));
+  hdr->eh_entries = conv2(le_CPU, entries);
+  ext_dirty(rip, path, level);
+
+  if (entries == 0 && level > 0) {
+	b = conv4(le_CPU,
+		EXT_INDEX(path[level - 1].ep_hdr, path[level - 1].ep_at)->ei_leaf_lo);
+	put_block(path[level].ep_bp);
+	path[level].ep_bp = NULL;
+	free_block(rip->i_sp, b);
+	rip->i_blocks -= rip->i_sp->s_sectors_in_block;
+	ext_remove(rip, path, level - 1, path[level - 1].ep_at);
+  } else if (entries == 0) {
+	/* The whole tree is gone, the root is an empty leaf again. */
+	hdr->eh_depth = 0;
+  } else if (pos == 0 && level > 0) {
+	ext_fix_keys(rip, path, level, EXT_EXTENT(hdr, 0)->ee_block);
+  }
+}
+
+
+/*===========================================================================*
+ *				ext_free_block				     *
+ *===========================================================================*/
+static int ext_free_block(struct inode *rip, block_t lblock)
+{
+/* Free the block at logical block 'lblock', if any, trimming or splitting
+ * the extent that holds it.
+ */
+  struct ext_path path[EXT4_EXT_MAX_DEPTH + 1];
+  struct ext4_extent *ex, tail;
+  block_t first, b;
+  unsigned int len;
+  int depth, at, unwritten, r;
+
+  if ((depth = ext_find(rip, lblock, path, NORMAL)) < 0)
+	return(EIO);
+
+  if ((at = path[depth].ep_at) < 0) {
+	ext_put_path(path, depth);
+	return(OK);
+  }
+
+  ex = EXT_EXTENT(path[depth].ep_hdr, at);
+  first = conv4(le_CPU, ex->ee_block);
+  len = ext_len(ex, &unwritten);
+  if (lblock >= first + len) {
+	ext_put_path(path, depth);	/* a hole */
+	return(OK);
+  }
+  b = ext_start(ex) + (lblock - first);
+
+  if (len == 1) {
+	ext_remove(rip, path, depth, at);
+  } else if (lblock == first) {
+	ex->ee_block = conv4(le_CPU, lblock + 1);
+	ext_set_start(ex, b + 1);
+	ext_set_len(ex, len - 1, unwritten);
+	ext_dirty(rip, path, depth);
+	if (at == 0)
+		ext_fix_keys(rip, path, depth, ex->ee_block);
+  } else if (lblock == first + len - 1) {
+	ext_set_len(ex, len - 1, unwritten);
+	ext_dirty(rip, path, depth);
+  } else {
+	/* Punch a hole in the middle: the extent becomes two. */
+	tail.ee_block = conv4(le_CPU, lblock + 1);
+	ext_set_start(&tail, b + 1);
+	ext_set_len(&tail, first + len - lblock - 1, unwritten);
+	ext_set_len(ex, lblock - first, unwritten);
+	if ((r = ext_insert(rip, path, &depth, at + 1, &tail)) != OK) {
+		ext_set_len(ex, len, unwritten);
+		ext_put_path(path, depth);
+		return(r);
+	}
+	ext_dirty(rip, path, depth);
+  }
+
+  ext_put_path(path, depth);
+
+  free_block(rip->i_sp, b);
+  rip->i_blocks -= rip->i_sp->s_sectors_in_block;
+  return(OK);
+}
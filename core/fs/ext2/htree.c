@@ -0,0 +1,901 @@
+/* This file contains the code for hash-indexed (HTree) directories, as
+ * created by Linux on file systems with the dir_index feature.
+ *
+ * The entry points into this file are
+ *   htree_indexed:	 check whether a directory is searched through its index
+ *   htree_search:	 look up or delete a directory entry through the index
+ *   htree_enter:	 enter a name, splitting leaf and index blocks as needed
+ *   htree_make_indexed: turn a full single-block directory into an indexed one
+ *
+ * An indexed directory is still a valid linear directory: the root of the
+ * index hides in the padding of the ".." entry in block 0, and index nodes
+ * look like blocks with a single empty entry. Leaf blocks are ordinary
+ * directory blocks holding the names whose hash falls in the range of their
+ * index entry. The low bit of an index hash is set if the previous leaf
+ * holds names with the same hash ("collision continuation").
+ */
+
+#include "fs.h"
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "buf.h"
+#include "inode.h"
+#include "super.h"
+
+struct dx_frame {
+  off_t df_pos;			/* position of the index block in the dir */
+  unsigned int df_offset;	/* offset of the entries in that block */
+  int df_at;			/* entry we descended through */
+};
+
+struct dx_path {
+  u32_t dp_hash;		/* hash of the name, low bit clear */
+  int dp_levels;		/* number of index levels, root included */
+  struct dx_frame dp_frame[DX_MAX_LEVELS];
+  off_t dp_leaf;		/* position of the leaf block */
+};
+
+/* Entries of a leaf block, sorted by hash when splitting the leaf. */
+struct dx_map_entry {
+  u32_t dm_hash;
+  u16_t dm_offs;
+  u16_t dm_size;
+};
+
+static u32_t dx_hash(struct super_block *sp, int version, const char *name,
+	int len);
+static int dx_probe(struct inode *dirp, const char *name, int len,
+	struct dx_path *path);
+static int dx_next_leaf(struct inode *dirp, struct dx_path *path);
+static int dx_make_room(struct inode *dirp, struct dx_path *path);
+static int dx_split_leaf(struct inode *dirp, struct dx_path *path);
+static struct buf *dx_new_block(struct inode *dirp, off_t *pos);
+static void dx_fallback(struct inode *dirp);
+
+#define dx_entries(bp, off) ((struct ext2_dx_entry *) (b_data(bp) + (off)))
+#define dx_countlimit(ent)  ((struct ext2_dx_countlimit *) (ent))
+#define dx_get_count(ent)   conv2(le_CPU, dx_countlimit(ent)->dx_count)
+#define dx_get_limit(ent)   conv2(le_CPU, dx_countlimit(ent)->dx_limit)
+#define dx_get_hash(ent, i) ((u32_t) conv4(le_CPU, (ent)[i].dx_hash))
+#define dx_get_block(ent, i) \
+	((block_t) (conv4(le_CPU, (ent)[i].dx_block) & 0x00ffffff))
+
+#define DIR_ENTRY_SIZE(len)	(roundup(MIN_DIR_ENTRY_SIZE + (len), \
+				 DIR_ENTRY_ALIGN))
+
+/*===========================================================================*
+ *				htree_indexed				     *
+ *===========================================================================*/
+int htree_indexed(struct inode *dirp)
+{
+/* Return TRUE if the directory should be searched through its index. */
+
+  return(HAS_COMPAT_FEATURE(dirp->i_sp, COMPAT_DIR_INDEX) &&
+	(dirp->i_flags & EXT2_INDEX_FL));
+}
+
+
+/*===========================================================================*
+ *				htree_search				     *
+ *===========================================================================*/
+int htree_search(struct inode *dirp, const char *string, ino_t *numb, int flag)
+{
+/* Look up (LOOK_UP) or delete (DELETE) 'string' in an indexed directory.
+ * Only the leaf blocks the name can hash to are searched.
+ */
+  struct dx_path path;
+  struct buf *bp;
+  int r;
+
+  if (dx_probe(dirp, string, strlen(string), &path) != OK) {
+	dx_fallback(dirp);
+	return(ENOENT);
+  }
+
+  do {
+	bp = get_block_map(dirp, path.dp_leaf);
+	if (bp == NULL) {
+		dx_fallback(dirp);
+		return(ENOENT);
+	}
+	r = search_dir_block(dirp, bp, path.dp_leaf, string, numb, flag);
+	put_block(bp);
+	if (r != ENOENT)
+		return(r);
+  } while (dx_next_leaf(dirp, &path));
+
+  return(ENOENT);
+}
+
+
+/*===========================================================================*
+ *				htree_enter				     *
+ *===========================================================================*/
+int htree_enter(struct inode *dirp, const char *string, ino_t numb, int ftype)
+{
+/* Enter 'string' with inode number 'numb' into an indexed directory. The
+ * name goes into the leaf block its hash maps to; if that block is full, it
+ * is split in two by hash. The caller has made sure the name is not present.
+ */
+  struct ext2_disk_dir_desc *dp;
+  struct dx_path path;
+  struct buf *bp;
+  unsigned int block_size;
+  int r, len, required_space;
+
+  block_size = dirp->i_sp->s_block_size;
+  len = strlen(string);
+  required_space = DIR_ENTRY_SIZE(len);
+
+  if (dx_probe(dirp, string, len, &path) != OK) {
+	dx_fallback(dirp);
+	return(EINVAL);
+  }
+
+  if ((bp = get_block_map(dirp, path.dp_leaf)) == NULL) {
+	dx_fallback(dirp);
+	return(EINVAL);
+  }
+
+  if ((dp = find_dir_slot(bp, block_size, required_space)) == NULL) {
+	put_block(bp);
+	if ((r = dx_split_leaf(dirp, &path)) != OK)
+		return(r);
+	bp = get_block_map(dirp, path.dp_leaf);
+	if (bp == NULL ||
+	    (dp = find_dir_slot(bp, block_size, required_space)) == NULL) {
+		/* Too many long names with the same hash to split them. */
+		if (bp != NULL) put_block(bp);
+		dx_fallback(dirp);
+		return(ENOSPC);
+	}
+  }
+
+  fill_dir_entry(dirp, dp, string, len, numb, ftype);
+  lmfs_markdirty(bp);
+  put_block(bp);
+  dirp->i_update |= CTIME | MTIME;	/* mark mtime for update later */
+  dirp->i_dirt = IN_DIRTY;
+
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				htree_make_indexed			     *
+ *===========================================================================*/
+int htree_make_indexed(struct inode *dirp)
+{
+/* The single block of 'dirp' is full. Move all entries except "." and ".."
+ * into a new leaf block, and put the index root into block 0, with the new
+ * leaf as its only entry.
+ */
+  struct ext2_disk_dir_desc *dot, *dotdot, *dp, *ndp, *last;
+  struct ext2_dx_root_info *info;
+  struct ext2_dx_entry *ent;
+  struct buf *bp, *nbp;
+  unsigned int block_size, size;
+  off_t pos;
+  u8_t hash_version;
+  char *end;
+
+  block_size = dirp->i_sp->s_block_size;
+
+  if ((bp = get_block_map(dirp, 0)) == NULL)
+	return(EINVAL);
+
+  /* Only convert directories that start with "." and ".." as they should. */
+  dot = (struct ext2_disk_dir_desc *) &b_data(bp);
+  dotdot = NEXT_DISC_DIR_DESC(dot);
+  if (ansi_strcmp(dot->d_name, ".", dot->d_name_len) != 0 ||
+      DIR_ENTRY_ACTUAL_SIZE(dot) != DX_ROOT_INFO_OFFSET / 2 ||
+      CUR_DISC_DIR_POS(dotdot, &b_data(bp)) != DX_ROOT_INFO_OFFSET / 2 ||
+      ansi_strcmp(dotdot->d_name, "..", dotdot->d_name_len) != 0) {
+	put_block(bp);
+	return(EINVAL);
+  }
+
+  if ((nbp = dx_new_block(dirp, &pos)) == NULL) {
+	put_block(bp);
+	return(err_code);
+  }
+
+  /* Copy all entries in use after ".." into the new leaf, compacting them. */
+  end = &b_data(bp)[block_size];
+  last = NULL;
+  ndp = (struct ext2_disk_dir_desc *) &b_data(nbp);
+  for (dp = NEXT_DISC_DIR_DESC(dotdot); (char *) dp < end;
+       dp = NEXT_DISC_DIR_DESC(dp)) {
+	if (dp->d_ino == NO_ENTRY)
+		continue;
+	size = DIR_ENTRY_ACTUAL_SIZE(dp);
+	memcpy(ndp, dp, size);
+	ndp->d_rec_len = conv2(le_CPU, size);
+	last = ndp;
+	ndp = NEXT_DISC_DIR_DESC(ndp);
+  }
+  if (last == NULL) {
+	last = (struct ext2_disk_dir_desc *) &b_data(nbp);
+	last->d_ino = NO_ENTRY;
+  }
+  last->d_rec_len = conv2(le_CPU, block_size -
+	CUR_DISC_DIR_POS(last, &b_data(nbp)));
+  lmfs_markdirty(nbp);
+  put_block(nbp);
+
+  /* Turn block 0 into the index root. */
+  dotdot->d_rec_len = conv2(le_CPU, block_size - DX_ROOT_INFO_OFFSET / 2);
+  memset(&b_data(bp)[DX_ROOT_INFO_OFFSET], 0,
+	block_size - DX_ROOT_INFO_OFFSET);
+
+  hash_version = dirp->i_sp->s_def_hash_version;
+  if (hash_version > DX_HASH_TEA)
+	hash_version = DX_HASH_HALF_MD4;
+
+  info = (struct ext2_dx_root_info *) &b_data(bp)[DX_ROOT_INFO_OFFSET];
+  info->dr_hash_version = hash_version;
+  info->dr_info_length = DX_ROOT_INFO_LENGTH;
+  info->dr_indirect_levels = 0;
+
+  ent = dx_entries(bp, DX_ROOT_ENTRIES_OFFSET);
+  dx_countlimit(ent)->dx_limit = conv2(le_CPU, DX_ROOT_LIMIT(block_size));
+  dx_countlimit(ent)->dx_count = conv2(le_CPU, 1);
+  ent[0].dx_block = conv4(le_CPU, pos / block_size);
+  lmfs_markdirty(bp);
+  put_block(bp);
+
+  dirp->i_flags |= EXT2_INDEX_FL;
+  dirp->i_dirt = IN_DIRTY;
+
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				dx_probe				     *
+ *===========================================================================*/
+static int dx_probe(struct inode *dirp, const char *name, int len,
+	struct dx_path *path)
+{
+/* Walk down the index to the leaf block that 'name' hashes to, recording the
+ * index entry used at each level in 'path'. Return EINVAL if the index does
+ * not look sane.
+ */
+  struct ext2_dx_root_info *info;
+  struct ext2_dx_entry *ent;
+  struct dx_frame *frame;
+  struct buf *bp;
+  unsigned int block_size, count, limit, offset;
+  int level, lo, hi, mid;
+  block_t block;
+
+  block_size = dirp->i_sp->s_block_size;
+
+  if ((bp = get_block_map(dirp, 0)) == NULL)
+	return(EINVAL);
+
+  info = (struct ext2_dx_root_info *) &b_data(bp)[DX_ROOT_INFO_OFFSET];
+  if (info->dr_reserved_zero != 0 ||
+      info->dr_hash_version > DX_HASH_TEA ||
+      info->dr_info_length != DX_ROOT_INFO_LENGTH ||
+      info->dr_indirect_levels >= DX_MAX_LEVELS) {
+	put_block(bp);
+	return(EINVAL);
+  }
+
+  path->dp_hash = dx_hash(dirp->i_sp, info->dr_hash_version, name, len);
+  path->dp_levels = info->dr_indirect_levels + 1;
+  path->dp_frame[0].df_pos = 0;
+  offset = DX_ROOT_ENTRIES_OFFSET;
+  limit = DX_ROOT_LIMIT(block_size);
+
+  for (level = 0; ; level++) {
+	frame = &path->dp_frame[level];
+	ent = dx_entries(bp, offset);
+	count = dx_get_count(ent);
+	if (dx_get_limit(ent) != limit || count == 0 || count > limit) {
+		put_block(bp);
+		return(EINVAL);
+	}
+
+	/* Find the last entry with a hash not above ours. Entry 0 has no
+	 * hash and covers everything below the hash of entry 1.
+	 */
+	lo = 1;
+	hi = count - 1;
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dx_get_hash(ent, mid) > path->dp_hash)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	frame->df_offset = offset;
+	frame->df_at = lo - 1;
+	block = dx_get_block(ent, frame->df_at);
+	put_block(bp);
+
+	if ((off_t) block * block_size >= dirp->i_size)
+		return(EINVAL);
+
+	if (level == path->dp_levels - 1)
+		break;
+
+	path->dp_frame[level + 1].df_pos = (off_t) block * block_size;
+	if ((bp = get_block_map(dirp, (off_t) block * block_size)) == NULL)
+		return(EINVAL);
+	offset = DX_NODE_ENTRIES_OFFSET;
+	limit = DX_NODE_LIMIT(block_size);
+  }
+
+  path->dp_leaf = (off_t) block * block_size;
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				dx_next_leaf				     *
+ *===========================================================================*/
+static int dx_next_leaf(struct inode *dirp, struct dx_path *path)
+{
+/* Advance 'path' to the next leaf block if that block may still contain
+ * names with our hash, that is if its index hash is ours with the
+ * continuation bit set. Return TRUE if there is such a block.
+ */
+  struct ext2_dx_entry *ent;
+  struct dx_frame *frame;
+  struct buf *bp;
+  unsigned int block_size;
+  int level;
+  u32_t hash;
+  block_t block;
+
+  block_size = dirp->i_sp->s_block_size;
+
+  /* Find the lowest level that has an entry to the right of ours. */
+  for (level = path->dp_levels - 1; level >= 0; level--) {
+	frame = &path->dp_frame[level];
+	if ((bp = get_block_map(dirp, frame->df_pos)) == NULL)
+		return(FALSE);
+	ent = dx_entries(bp, frame->df_offset);
+	if (frame->df_at + 1 < (int) dx_get_count(ent))
+		break;
+	put_block(bp);
+  }
+  if (level < 0)
+	return(FALSE);
+
+  hash = dx_get_hash(ent, frame->df_at + 1);
+  if ((hash & ~1) != path->dp_hash) {
+	put_block(bp);
+	return(FALSE);
+  }
+  frame->df_at++;
+  block = dx_get_block(ent, frame->df_at);
+  put_block(bp);
+
+  /* Go down the leftmost entries of the levels below. */
+  for (level++; level < path->dp_levels; level++) {
+	frame = &path->dp_frame[level];
+	frame->df_pos = (off_t) block * block_size;
+	frame->df_at = 0;
+	if ((bp = get_block_map(dirp, frame->df_pos)) == NULL)
+		return(FALSE);
+	block = dx_get_block(dx_entries(bp, frame->df_offset), 0);
+	put_block(bp);
+  }
+
+  path->dp_leaf = (off_t) block * block_size;
+  return(path->dp_leaf < dirp->i_size);
+}
+
+
+/*===========================================================================*
+ *				dx_insert_entry				     *
+ *===========================================================================*/
+static void dx_insert_entry(struct buf *bp, struct dx_frame *frame,
+	u32_t hash, block_t block)
+{
+/* Insert (hash, block) into the index block 'bp' right after the entry
+ * 'frame' points to. The caller has checked there is room.
+ */
+  struct ext2_dx_entry *ent;
+  unsigned int count;
+
+  ent = dx_entries(bp, frame->df_offset);
+  count = dx_get_count(ent);
+
+  memmove(&ent[frame->df_at + 2], &ent[frame->df_at + 1],
+	(count - frame->df_at - 1) * sizeof(*ent));
+  ent[frame->df_at + 1].dx_hash = conv4(le_CPU, hash);
+  ent[frame->df_at + 1].dx_block = conv4(le_CPU, block);
+  dx_countlimit(ent)->dx_count = conv2(le_CPU, count + 1);
+  lmfs_markdirty(bp);
+}
+
+
+/*===========================================================================*
+ *				dx_make_room				     *
+ *===========================================================================*/
+static int dx_make_room(struct inode *dirp, struct dx_path *path)
+{
+/* Make sure the lowest index block on 'path' can take one more entry. A full
+ * root gets a level of index nodes below it, a full node is split in two.
+ * If the index is full, the directory can only continue as a linear one.
+ */
+  struct ext2_dx_root_info *info;
+  struct ext2_dx_entry *ent, *nent;
+  struct dx_frame *frame, *parent;
+  struct buf *bp, *pbp, *nbp;
+  struct ext2_disk_dir_desc *fake;
+  unsigned int block_size, count, half;
+  off_t pos;
+
+  block_size = dirp->i_sp->s_block_size;
+  frame = &path->dp_frame[path->dp_levels - 1];
+
+  if ((bp = get_block_map(dirp, frame->df_pos)) == NULL) {
+	dx_fallback(dirp);
+	return(EINVAL);
+  }
+  ent = dx_entries(bp, frame->df_offset);
+  count = dx_get_count(ent);
+  if (count < dx_get_limit(ent)) {
+	put_block(bp);
+	return(OK);
+  }
+
+  if (path->dp_levels == 1) {
+	/* The root is full. Move its entries into a new index node and
+	 * make that node the only entry of the root.
+	 */
+	if ((nbp = dx_new_block(dirp, &pos)) == NULL) {
+		put_block(bp);
+		return(err_code);
+	}
+	fake = (struct ext2_disk_dir_desc *) &b_data(nbp);
+	fake->d_ino = NO_ENTRY;
+	fake->d_rec_len = conv2(le_CPU, block_size);
+	nent = dx_entries(nbp, DX_NODE_ENTRIES_OFFSET);
+	memcpy(nent, ent, count * sizeof(*ent));
+	dx_countlimit(nent)->dx_limit =
+		conv2(le_CPU, DX_NODE_LIMIT(block_size));
+	lmfs_markdirty(nbp);
+	put_block(nbp);
+
+	dx_countlimit(ent)->dx_count = conv2(le_CPU, 1);
+	ent[0].dx_block = conv4(le_CPU, pos / block_size);
+	info = (struct ext2_dx_root_info *)
+		&b_data(bp)[DX_ROOT_INFO_OFFSET];
+	info->dr_indirect_levels = 1;
+	lmfs_markdirty(bp);
+	put_block(bp);
+
+	path->dp_frame[1].df_pos = pos;
+	path->dp_frame[1].df_offset = DX_NODE_ENTRIES_OFFSET;
+	path->dp_frame[1].df_at = path->dp_frame[0].df_at;
+	path->dp_frame[0].df_at = 0;
+	path->dp_levels = 2;
+	return(OK);
+  }
+
+  /* A full index node. Split it, if its parent (the root) has room. */
+  parent = &path->dp_frame[path->dp_levels - 2];
+  if ((pbp = get_block_map(dirp, parent->df_pos)) == NULL) {
+	put_block(bp);
+	dx_fallback(dirp);
+	return(EINVAL);
+  }
+  if (dx_get_count(dx_entries(pbp, parent->df_offset)) >=
+      dx_get_limit(dx_entries(pbp, parent->df_offset))) {
+	put_block(pbp);
+	put_block(bp);
+	dx_fallback(dirp);
+	return(ENOSPC);
+  }
+
+  if ((nbp = dx_new_block(dirp, &pos)) == NULL) {
+	put_block(pbp);
+	put_block(bp);
+	return(err_code);
+  }
+  half = count / 2;
+  fake = (struct ext2_disk_dir_desc *) &b_data(nbp);
+  fake->d_ino = NO_ENTRY;
+  fake->d_rec_len = conv2(le_CPU, block_size);
+  nent = dx_entries(nbp, DX_NODE_ENTRIES_OFFSET);
+  memcpy(nent, &ent[half], (count - half) * sizeof(*ent));
+  dx_countlimit(nent)->dx_limit = conv2(le_CPU, DX_NODE_LIMIT(block_size));
+  dx_countlimit(nent)->dx_count = conv2(le_CPU, count - half);
+  lmfs_markdirty(nbp);
+  put_block(nbp);
+
+  dx_insert_entry(pbp, parent, dx_get_hash(ent, half), pos / block_size);
+  put_block(pbp);
+
+  dx_countlimit(ent)->dx_count = conv2(le_CPU, half);
+  lmfs_markdirty(bp);
+  put_block(bp);
+
+  if (frame->df_at >= (int) half) {
+	frame->df_pos = pos;
+	frame->df_at -= half;
+	parent->df_at++;
+  }
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				dx_map_cmp				     *
+ *===========================================================================*/
+static int dx_map_cmp(const void *a, const void *b)
+{
+  const struct dx_map_entry *ma = a, *mb = b;
+
+  if (ma->dm_hash != mb->dm_hash)
+	return(ma->dm_hash < mb->dm_hash ? -1 : 1);
+  return((int) ma->dm_offs - (int) mb->dm_offs);
+}
+
+
+/*===========================================================================*
+ *				dx_split_leaf				     *
+ *===========================================================================*/
+static int dx_split_leaf(struct inode *dirp, struct dx_path *path)
+{
+/* The leaf block on 'path' is full. Sort its entries by hash, move the upper
+ * half into a new leaf block and add that block to the index. On return
+ * 'path' points to the leaf that should receive the name being entered.
+ */
+  static char *scratch = NULL;
+  static struct dx_map_entry *map = NULL;
+  static unsigned int scratch_size = 0;
+  struct ext2_dx_root_info *info;
+  struct ext2_disk_dir_desc *dp, *last;
+  struct dx_frame *frame;
+  struct buf *bp, *nbp, *ibp;
+  unsigned int block_size, count, split, size, i;
+  u32_t split_hash;
+  int r, hash_version;
+  off_t pos;
+  char *out;
+
+  block_size = dirp->i_sp->s_block_size;
+
+  if (scratch_size < block_size) {
+	free(scratch);
+	free(map);
+	scratch = malloc(block_size);
+	map = malloc((block_size / DIR_ENTRY_SIZE(1)) * sizeof(*map));
+	if (scratch == NULL || map == NULL)
+		panic("ext2: can't allocate htree split buffers");
+	scratch_size = block_size;
+  }
+
+  if ((r = dx_make_room(dirp, path)) != OK)
+	return(r);
+
+  if ((bp = get_block_map(dirp, 0)) == NULL) {
+	dx_fallback(dirp);
+	return(EINVAL);
+  }
+  info = (struct ext2_dx_root_info *) &b_data(bp)[DX_ROOT_INFO_OFFSET];
+  hash_version = info->dr_hash_version;
+  put_block(bp);
+
+  /* Hash all entries in use and sort them. */
+  if ((bp = get_block_map(dirp, path->dp_leaf)) == NULL) {
+	dx_fallback(dirp);
+	return(EINVAL);
+  }
+  memcpy(scratch, b_data(bp), block_size);
+  count = 0;
+  size = 0;
+  for (dp = (struct ext2_disk_dir_desc *) scratch;
+       CUR_DISC_DIR_POS(dp, scratch) < block_size;
+       dp = NEXT_DISC_DIR_DESC(dp)) {
+	if (dp->d_ino == NO_ENTRY)
+		continue;
+	map[count].dm_hash = dx_hash(dirp->i_sp, hash_version, dp->d_name,
+		dp->d_name_len);
+	map[count].dm_offs = CUR_DISC_DIR_POS(dp, scratch);
+	map[count].dm_size = DIR_ENTRY_ACTUAL_SIZE(dp);
+	size += map[count].dm_size;
+	count++;
+  }
+  if (count < 2) {
+	put_block(bp);
+	dx_fallback(dirp);
+	return(ENOSPC);
+  }
+  qsort(map, count, sizeof(*map), dx_map_cmp);
+
+  /* Split at half the used space, keeping at least one entry per block. */
+  for (split = 0, i = 0; split < count - 1 && i + map[split].dm_size <=
+      size / 2; split++)
+	i += map[split].dm_size;
+  if (split == 0)
+	split = 1;
+  split_hash = map[split].dm_hash;
+  if (map[split - 1].dm_hash == split_hash)
+	split_hash |= 1;	/* names with this hash continue in new leaf */
+
+  if ((nbp = dx_new_block(dirp, &pos)) == NULL) {
+	put_block(bp);
+	return(err_code);
+  }
+
+  /* Rewrite both leaves from the sorted map. */
+  out = b_data(nbp);
+  last = NULL;
+  for (i = split; i < count; i++) {
+	memcpy(out, &scratch[map[i].dm_offs], map[i].dm_size);
+	last = (struct ext2_disk_dir_desc *) out;
+	last->d_rec_len = conv2(le_CPU, map[i].dm_size);
+	out += map[i].dm_size;
+  }
+  last->d_rec_len = conv2(le_CPU, block_size -
+	CUR_DISC_DIR_POS(last, b_data(nbp)));
+  lmfs_markdirty(nbp);
+  put_block(nbp);
+
+  memset(b_data(bp), 0, block_size);
+  out = b_data(bp);
+  for (i = 0; i < split; i++) {
+	memcpy(out, &scratch[map[i].dm_offs], map[i].dm_size);
+	last = (struct ext2_disk_dir_desc *) out;
+	last->d_rec_len = conv2(le_CPU, map[i].dm_size);
+	out += map[i].dm_size;
+  }
+  last->d_rec_len = conv2(le_CPU, block_size -
+	CUR_DISC_DIR_POS(last, b_data(bp)));
+  lmfs_markdirty(bp);
+  put_block(bp);
+
+  /* Add the new leaf to the index, right after the old one. */
+  frame = &path->dp_frame[path->dp_levels - 1];
+  if ((ibp = get_block_map(dirp, frame->df_pos)) == NULL)
+	panic("ext2: index block vanished during htree split");
+  dx_insert_entry(ibp, frame, split_hash, pos / block_size);
+  put_block(ibp);
+
+  if (path->dp_hash >= (split_hash & ~1)) {
+	frame->df_at++;
+	path->dp_leaf = pos;
+  }
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				dx_new_block				     *
+ *===========================================================================*/
+static struct buf *dx_new_block(struct inode *dirp, off_t *pos)
+{
+/* Append a zeroed block to the directory and return it. */
+  struct buf *bp;
+
+  *pos = dirp->i_size;
+  if ((bp = new_block(dirp, *pos)) == NULL)
+	return(NULL);
+
+  dirp->i_size += dirp->i_sp->s_block_size;
+  dirp->i_update |= CTIME | MTIME;
+  dirp->i_dirt = IN_DIRTY;
+  /* Send the change to disk if the directory is extended. */
+  rw_inode(dirp, WRITING);
+
+  return(bp);
+}
+
+
+/*===========================================================================*
+ *				dx_fallback				     *
+ *===========================================================================*/
+static void dx_fallback(struct inode *dirp)
+{
+/* The index of 'dirp' is corrupt or full. Clear EXT2_INDEX_FL, so that the
+ * directory is treated as a plain linear one from now on, as Linux does.
+ */
+  ext2_debug("ext2: dropping directory index of inode %llu\n",
+	(unsigned long long) dirp->i_num);
+
+  dirp->i_flags &= ~EXT2_INDEX_FL;
+  if (!dirp->i_sp->s_rd_only)
+	dirp->i_dirt = IN_DIRTY;
+}
+
+
+/* The hash functions below follow the ones in Linux (fs/ext4/hash.c), as the
+ * hash values are part of the on-disk format.
+ */
+
+#define DX_DELTA	0x9E3779B9
+#define ROL32(x, s)	(((x) << (s)) | ((x) >> (32 - (s))))
+
+/*===========================================================================*
+ *				tea_transform				     *
+ *===========================================================================*/
+static void tea_transform(u32_t buf[4], const u32_t in[4])
+{
+  u32_t sum = 0;
+  u32_t b0 = buf[0], b1 = buf[1];
+  u32_t a = in[0], b = in[1], c = in[2], d = in[3];
+  int n = 16;
+
+  do {
+	sum += DX_DELTA;
+	b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+	b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+  } while (--n);
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+#define MD4_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z)	((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + (x), a = ROL32(a, s))
+#define MD4_K1	0
+#define MD4_K2	013240474631UL
+#define MD4_K3	015666365641UL
+
+/*===========================================================================*
+ *				half_md4_transform			     *
+ *===========================================================================*/
+static void half_md4_transform(u32_t buf[4], const u32_t in[8])
+{
+  u32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  /* Round 1 */
+  MD4_ROUND(MD4_F, a, b, c, d, in[0] + MD4_K1,  3);
+  MD4_ROUND(MD4_F, d, a, b, c, in[1] + MD4_K1,  7);
+  MD4_ROUND(MD4_F, c, d, a, b, in[2] + MD4_K1, 11);
+  MD4_ROUND(MD4_F, b, c, d, a, in[3] + MD4_K1, 19);
+  MD4_ROUND(MD4_F, a, b, c, d, in[4] + MD4_K1,  3);
+  MD4_ROUND(MD4_F, d, a, b, c, in[5] + MD4_K1,  7);
+  MD4_ROUND(MD4_F, c, d, a, b, in[6] + MD4_K1, 11);
+  MD4_ROUND(MD4_F, b, c, d, a, in[7] + MD4_K1, 19);
+
+  /* Round 2 */
+  MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2,  3);
+  MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2,  5);
+  MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2,  9);
+  MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+  MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2,  3);
+  MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2,  5);
+  MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2,  9);
+  MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+  /* Round 3 */
+  MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3,  3);
+  MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3,  9);
+  MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+  MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+  MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3,  3);
+  MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3,  9);
+  MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+  MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+/*===========================================================================*
+ *				legacy_hash				     *
+ *===========================================================================*/
+static u32_t legacy_hash(const char *name, int len, int is_unsigned)
+{
+  u32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+  int c;
+
+  while (len--) {
+	c = is_unsigned ? (int) (unsigned char) *name : (int) (signed char) *name;
+	name++;
+	hash = hash1 + (hash0 ^ (u32_t) (c * 7152373));
+	if (hash & 0x80000000)
+		hash -= 0x7fffffff;
+	hash1 = hash0;
+	hash0 = hash;
+  }
+  return(hash0 << 1);
+}
+
+/*===========================================================================*
+ *				str2hashbuf				     *
+ *===========================================================================*/
+static void str2hashbuf(const char *msg, int len, u32_t *buf, int num,
+	int is_unsigned)
+{
+  u32_t pad, val;
+  int i, c;
+
+  pad = (u32_t) len | ((u32_t) len << 8);
+  pad |= pad << 16;
+
+  val = pad;
+  if (len > num * 4)
+	len = num * 4;
+  for (i = 0; i < len; i++) {
+	c = is_unsigned ? (int) (unsigned char) msg[i] :
+		(int) (signed char) msg[i];
+	val = (u32_t) c + (val << 8);
+	if ((i % 4) == 3) {
+		*buf++ = val;
+		val = pad;
+		num--;
+	}
+  }
+  if (--num >= 0)
+	*buf++ = val;
+  while (--num >= 0)
+	*buf++ = pad;
+}
+
+/*===========================================================================*
+ *				dx_hash					     *
+ *===========================================================================*/
+static u32_t dx_hash(struct super_block *sp, int version, const char *name,
+	int len)
+{
+/* Compute the directory index hash of a name. The low bit is always clear;
+ * in index entries it is used as the continuation flag.
+ */
+  u32_t buf[4], in[8], hash;
+  int i, is_unsigned;
+
+  if (sp->s_flags & EXT2_FLAGS_UNSIGNED_HASH)
+	is_unsigned = TRUE;
+  else if (sp->s_flags & EXT2_FLAGS_SIGNED_HASH)
+	is_unsigned = FALSE;
+  else
+	is_unsigned = ((char) -1 > 0);	/* what Linux would pick here */
+
+  buf[0] = 0x67452301;
+  buf[1] = 0xefcdab89;
+  buf[2] = 0x98badcfe;
+  buf[3] = 0x10325476;
+
+  /* Use the seed from the superblock, unless it is all zeroes. */
+  for (i = 0; i < 4; i++) {
+	if (sp->s_hash_seed[i] != 0) {
+		memcpy(buf, sp->s_hash_seed, sizeof(buf));
+		break;
+	}
+  }
+
+  switch (version) {
+  case DX_HASH_LEGACY:
+	hash = legacy_hash(name, len, is_unsigned);
+	break;
+  case DX_HASH_HALF_MD4:
+	for (; len > 0; len -= 32, name += 32) {
+		str2hashbuf(name, len, in, 8, is_unsigned);
+		half_md4_transform(buf, in);
+	}
+	hash = buf[1];
+	break;
+  case DX_HASH_TEA:
+	for (; len > 0; len -= 16, name += 16) {
+		str2hashbuf(name, len, in, 4, is_unsigned);
+		tea_transform(buf, in);
+	}
+	hash = buf[0];
+	break;
+  default:
+	return(0);
+  }
+
+  hash &= ~1;
+  if (hash == (DX_HASH_EOF << 1))
+	hash = (DX_HASH_EOF - 1) << 1;
+  return(hash);
+}
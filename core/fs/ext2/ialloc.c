@@ -79,6 +79,11 @@ struct inode *alloc_inode(struct inode *parent, mode_t bits, uid_t uid,
 	 * not to repeat the code twice.
 	 */
 	wipe_inode(rip);
+
+	/* New files and directories use extents, if the file system does. */
+	if (HAS_INCOMPAT_FEATURE(sp, INCOMPAT_EXTENTS) &&
+	    ((bits & I_TYPE) == I_REGULAR || (bits & I_TYPE) == I_DIRECTORY))
+		extent_init(rip);
   }
 
   return(rip);
@@ -122,7 +122,6 @@ struct inode *get_inode(
  */
   register struct inode *rip;
   int hashi;
-  int i;
 
   hashi = (int) numb & INODE_HASH_MASK;
 
@@ -168,17 +167,13 @@ struct inode *get_inode(
   rip->i_last_dentry_size = 0;
   rip->i_mountpoint= FALSE;
 
-  rip->i_preallocation = opt.use_prealloc;
-  rip->i_prealloc_count = rip->i_prealloc_index = 0;
-
-  for (i = 0; i < EXT2_PREALLOC_BLOCKS; i++) {
-	if (rip->i_prealloc_blocks[i] != NO_BLOCK) {
-		/* Actually this should never happen */
-		free_block(rip->i_sp, rip->i_prealloc_blocks[i]);
-		rip->i_prealloc_blocks[i] = NO_BLOCK;
-		ext2_debug("Warning: Unexpected preallocated block.");
-	}
+  if (rip->i_prealloc_count != 0) {
+	/* Actually this should never happen */
+	ext2_debug("Warning: Unexpected preallocated blocks.");
+	discard_preallocated_blocks(rip);
   }
+  rip->i_preallocation = opt.use_prealloc;
+  rip->i_prealloc_window = EXT2_PREALLOC_BLOCKS;
 
   /* Add to hash */
   addhash_inode(rip);
@@ -373,7 +368,10 @@ static void icopy(
 	rip->i_flags	= conv4(norm,dip->i_flags);
 	/* Minix doesn't touch osd1 and osd2 either, so just copy. */
 	memcpy(&rip->osd1, &dip->osd1, sizeof(rip->osd1));
-	for (i = 0; i < EXT2_N_BLOCKS; i++)
+	/* Extent trees are converted where they are used. */
+	if (rip->i_flags & EXT4_EXTENTS_FL)
+		memcpy(rip->i_block, dip->i_block, sizeof(rip->i_block));
+	else for (i = 0; i < EXT2_N_BLOCKS; i++)
 		rip->i_block[i] = conv4(norm, dip->i_block[i]);
 	rip->i_generation = conv4(norm,dip->i_generation);
 	rip->i_file_acl	= conv4(norm,dip->i_file_acl);
@@ -395,7 +393,9 @@ static void icopy(
 	dip->i_flags	= conv4(norm,rip->i_flags);
 	/* Minix doesn't touch osd1 and osd2 either, so just copy. */
 	memcpy(&dip->osd1, &rip->osd1, sizeof(dip->osd1));
-	for (i = 0; i < EXT2_N_BLOCKS; i++)
+	if (rip->i_flags & EXT4_EXTENTS_FL)
+		memcpy(dip->i_block, rip->i_block, sizeof(dip->i_block));
+	else for (i = 0; i < EXT2_N_BLOCKS; i++)
 		dip->i_block[i] = conv4(norm, rip->i_block[i]);
 	dip->i_generation  = conv4(norm,rip->i_generation);
 	dip->i_file_acl = conv4(norm,rip->i_file_acl);
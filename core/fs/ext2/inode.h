@@ -90,9 +90,9 @@ EXTERN struct inode {
     char i_seek;                /* set on LSEEK, cleared on READ/WRITE */
     char i_update;              /* the ATIME, CTIME, and MTIME bits are here */
 
-    block_t i_prealloc_blocks[EXT2_PREALLOC_BLOCKS];	/* preallocated blocks */
-    int i_prealloc_count;	/* number of preallocated blocks */
-    int i_prealloc_index;	/* index into i_prealloc_blocks */
+    block_t i_prealloc_start;	/* first of the preallocated blocks */
+    int i_prealloc_count;	/* number of preallocated blocks left */
+    int i_prealloc_window;	/* size of the next run to preallocate */
     int i_preallocation;	/* use preallocation for this inode, normally
 				 * it's reset only when non-sequential write
 				 * happens.
@@ -20,6 +20,8 @@ static struct optset optset_table[] = {
   { "reserved",		OPT_BOOL,   &opt.use_reserved_blocks,	TRUE    },
   { "prealloc",		OPT_BOOL,   &opt.use_prealloc, 		TRUE	},
   { "noprealloc",	OPT_BOOL,   &opt.use_prealloc, 		FALSE	},
+  { "allocstats",	OPT_BOOL,   &opt.alloc_stats,		TRUE	},
+  { "iodepth",		OPT_INT,    &opt.io_depth,		10	},
   { NULL,		0,	    NULL,			0	}
 };
 
@@ -75,6 +77,8 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
   opt.use_reserved_blocks = FALSE;
   opt.block_with_super = 0;
   opt.use_prealloc = FALSE;
+  opt.alloc_stats = FALSE;
+  opt.io_depth = LMFS_DEF_IODEPTH;
 
   /* If we have been given an options string, parse options from there. */
   for (i = 1; i < env_argc - 1; i++)
@@ -82,6 +86,7 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
 		optset_parse(optset_table, env_argv[++i]);
 
   lmfs_may_use_vmcache(1);
+  lmfs_set_iodepth(opt.io_depth > 0 ? opt.io_depth : 1);
 
   /* Init inode table */
   for (i = 0; i < NR_INODES; ++i) {
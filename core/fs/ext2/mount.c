@@ -204,6 +204,9 @@ void fs_unmount(void)
 
   put_inode(root_ip);
 
+  if (opt.alloc_stats)
+	alloc_stats(superblock);
+
   if (!superblock->s_rd_only) {
 	superblock->s_wtime = clock_time(NULL);
 	superblock->s_state = EXT2_VALID_FS;
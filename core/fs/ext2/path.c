@@ -106,9 +106,8 @@ int ftype;			 /* used when ENTER and INCOMPAT_FILETYPE */
  * if (flag == IS_EMPTY) return OK if only . and .. in dir else ENOTEMPTY;
  */
   register struct ext2_disk_dir_desc  *dp = NULL;
-  register struct ext2_disk_dir_desc  *prev_dp = NULL;
   register struct buf *bp = NULL;
-  int i, r, e_hit, t, match;
+  int r, e_hit;
   off_t pos;
   unsigned new_slots;
   int extended = 0;
@@ -122,12 +121,27 @@ int ftype;			 /* used when ENTER and INCOMPAT_FILETYPE */
 
   new_slots = 0;
   e_hit = FALSE;
-  match = 0;    	/* set when a string match occurs */
   pos = 0;
 
   if ((string_len = strlen(string)) > EXT2_NAME_MAX)
 	return(ENAMETOOLONG);
 
+  /* Indexed directories are searched through their hash tree. If the index
+   * turns out to be unusable, htree_search() and htree_enter() drop the
+   * EXT2_INDEX_FL flag and we fall back to the linear search below, which
+   * works on indexed directories as well. "." and ".." are not hashed, they
+   * always live in the first block, in front of the index root.
+   */
+  if (flag != IS_EMPTY && htree_indexed(ldir_ptr) &&
+      strcmp(string, ".") != 0 && strcmp(string, "..") != 0) {
+	if (flag == ENTER)
+		r = htree_enter(ldir_ptr, string, *numb, ftype);
+	else
+		r = htree_search(ldir_ptr, string, numb, flag);
+	if (htree_indexed(ldir_ptr))
+		return(r);
+  }
+
   if (flag == ENTER) {
 	required_space = MIN_DIR_ENTRY_SIZE + string_len;
 	required_space += (required_space & 0x03) == 0 ? 0 :
@@ -144,112 +158,21 @@ int ftype;			 /* used when ENTER and INCOMPAT_FILETYPE */
 	   rounddown(pos, ldir_ptr->i_sp->s_block_size))))
 		panic("get_block returned NO_BLOCK");
 
-	prev_dp = NULL; /* New block - new first dentry, so no prev. */
-
-	/* Search a directory block.
-	 * Note, we set prev_dp at the end of the loop.
-	 */
-	for (dp = (struct ext2_disk_dir_desc*) &b_data(bp);
-	     CUR_DISC_DIR_POS(dp, &b_data(bp)) < ldir_ptr->i_sp->s_block_size;
-	     dp = NEXT_DISC_DIR_DESC(dp) ) {
-		/* Match occurs if string found. */
-		if (flag != ENTER && dp->d_ino != NO_ENTRY) {
-			if (flag == IS_EMPTY) {
-				/* If this test succeeds, dir is not empty. */
-				if (ansi_strcmp(dp->d_name, ".", dp->d_name_len) != 0 &&
-				    ansi_strcmp(dp->d_name, "..", dp->d_name_len) != 0) match = 1;
-			} else {
-				if (ansi_strcmp(dp->d_name, string, dp->d_name_len) == 0){
-					match = 1;
-				}
-			}
-		}
-
-		if (match) {
-			/* LOOK_UP or DELETE found what it wanted. */
-			r = OK;
-			if (flag == IS_EMPTY) r = ENOTEMPTY;
-			else if (flag == DELETE) {
-				if (dp->d_name_len >= sizeof(ino_t)) {
-					/* Save d_ino for recovery. */
-					t = dp->d_name_len - sizeof(ino_t);
-					memcpy(&dp->d_name[t], &dp->d_ino, sizeof(dp->d_ino));
-				}
-				dp->d_ino = NO_ENTRY;	/* erase entry */
-				lmfs_markdirty(bp);
-
-				/* If we don't support HTree (directory index),
-				 * which is fully compatible ext2 feature,
-				 * we should reset EXT2_INDEX_FL, when modify
-				 * linked directory structure.
-				 *
-				 * @TODO: actually we could just reset it for
-				 * each directory, but I added if() to not
-				 * forget about it later, when add HTree
-				 * support.
-				 */
-				if (!HAS_COMPAT_FEATURE(ldir_ptr->i_sp,
-							COMPAT_DIR_INDEX))
-					ldir_ptr->i_flags &= ~EXT2_INDEX_FL;
-				if (pos < ldir_ptr->i_last_dpos) {
-					ldir_ptr->i_last_dpos = pos;
-					ldir_ptr->i_last_dentry_size =
-						conv2(le_CPU, dp->d_rec_len);
-				}
-				ldir_ptr->i_update |= CTIME | MTIME;
-				ldir_ptr->i_dirt = IN_DIRTY;
-				/* Now we have cleared dentry, if it's not
-				 * the first one, merge it with previous one.
-				 * Since we assume, that existing dentry must be
-				 * correct, there is no way to spann a data block.
-				 */
-				if (prev_dp) {
-					u16_t temp = conv2(le_CPU,
-							prev_dp->d_rec_len);
-					temp += conv2(le_CPU,
-							dp->d_rec_len);
-					prev_dp->d_rec_len = conv2(le_CPU,
-							temp);
-				}
-			} else {
-				/* 'flag' is LOOK_UP */
-				*numb = (ino_t) conv4(le_CPU, dp->d_ino);
-			}
-			put_block(bp);
+	if (flag != ENTER) {
+		/* LOOK_UP, DELETE or IS_EMPTY. */
+		r = search_dir_block(ldir_ptr, bp, pos, string, numb, flag);
+		put_block(bp);
+		if (r != ENOENT)
 			return(r);
-		}
-
-		/* Check for free slot for the benefit of ENTER. */
-		if (flag == ENTER && dp->d_ino == NO_ENTRY) {
-			/* we found a free slot, check if it has enough space */
-			if (required_space <= conv2(le_CPU, dp->d_rec_len)) {
-				e_hit = TRUE;	/* we found a free slot */
-				break;
-			}
-		}
-		/* Can we shrink dentry? */
-		if (flag == ENTER && required_space <= DIR_ENTRY_SHRINK(dp)) {
-			/* Shrink directory and create empty slot, now
-			 * dp->d_rec_len = DIR_ENTRY_ACTUAL_SIZE + DIR_ENTRY_SHRINK.
-			 */
-			int new_slot_size = conv2(le_CPU, dp->d_rec_len);
-			int actual_size = DIR_ENTRY_ACTUAL_SIZE(dp);
-			new_slot_size -= actual_size;
-			dp->d_rec_len = conv2(le_CPU, actual_size);
-			dp = NEXT_DISC_DIR_DESC(dp);
-			dp->d_rec_len = conv2(le_CPU, new_slot_size);
-			/* if we fail before writing real ino */
-			dp->d_ino = NO_ENTRY;
-			lmfs_markdirty(bp);
-			e_hit = TRUE;	/* we found a free slot */
-			break;
-		}
-
-		prev_dp = dp;
+		continue;
 	}
 
-	/* The whole block has been searched or ENTER has a free slot. */
-	if (e_hit) break;	/* e_hit set if ENTER can be performed now */
+	/* Check for free slot for the benefit of ENTER. */
+	if ((dp = find_dir_slot(bp, ldir_ptr->i_sp->s_block_size,
+	    required_space)) != NULL) {
+		e_hit = TRUE;	/* we found a free slot */
+		break;
+	}
 	put_block(bp);		 /* otherwise, continue searching dir */
   }
 
@@ -264,6 +187,17 @@ int ftype;			 /* used when ENTER and INCOMPAT_FILETYPE */
   ldir_ptr->i_last_dpos = pos;
   ldir_ptr->i_last_dentry_size = required_space;
 
+  /* A directory outgrowing its first block is turned into an indexed one,
+   * just like Linux does, if the file system has the dir_index feature.
+   */
+  if (e_hit == FALSE && HAS_COMPAT_FEATURE(ldir_ptr->i_sp, COMPAT_DIR_INDEX)
+      && ldir_ptr->i_size == ldir_ptr->i_sp->s_block_size &&
+      htree_make_indexed(ldir_ptr) == OK) {
+	r = htree_enter(ldir_ptr, string, *numb, ftype);
+	if (htree_indexed(ldir_ptr))
+		return(r);
+  }
+
   /* This call is for ENTER.  If no free slot has been found so far, try to
    * extend directory.
    */
@@ -278,10 +212,174 @@ int ftype;			 /* used when ENTER and INCOMPAT_FILETYPE */
   }
 
   /* 'bp' now points to a directory block with space. 'dp' points to slot. */
+  fill_dir_entry(ldir_ptr, dp, string, string_len, *numb, ftype);
+  lmfs_markdirty(bp);
+  put_block(bp);
+  ldir_ptr->i_update |= CTIME | MTIME;	/* mark mtime for update later */
+  ldir_ptr->i_dirt = IN_DIRTY;
+
+  if (new_slots == 1) {
+	ldir_ptr->i_size += (off_t) conv2(le_CPU, dp->d_rec_len);
+	/* Send the change to disk if the directory is extended. */
+	if (extended) rw_inode(ldir_ptr, WRITING);
+  }
+  return(OK);
+
+}
+
+
+/*===========================================================================*
+ *				search_dir_block			     *
+ *===========================================================================*/
+int search_dir_block(ldir_ptr, bp, pos, string, numb, flag)
+struct inode *ldir_ptr;		/* ptr to inode for dir to search */
+struct buf *bp;			/* directory block to search */
+off_t pos;			/* position of the block in the directory */
+const char *string;		/* component to search for */
+ino_t *numb;			/* pointer to inode number */
+int flag;			/* LOOK_UP, DELETE or IS_EMPTY */
+{
+/* Search one directory block on behalf of search_dir(). Returns ENOENT if
+ * the block does not contain what 'flag' asks for, otherwise the result of
+ * the operation. The caller still owns 'bp'.
+ */
+  struct ext2_disk_dir_desc *dp;
+  struct ext2_disk_dir_desc *prev_dp = NULL;
+  int t, match = 0;
+
+  /* Search a directory block.
+   * Note, we set prev_dp at the end of the loop.
+   */
+  for (dp = (struct ext2_disk_dir_desc*) &b_data(bp);
+       CUR_DISC_DIR_POS(dp, &b_data(bp)) < ldir_ptr->i_sp->s_block_size;
+       dp = NEXT_DISC_DIR_DESC(dp) ) {
+	/* Match occurs if string found. */
+	if (dp->d_ino != NO_ENTRY) {
+		if (flag == IS_EMPTY) {
+			/* If this test succeeds, dir is not empty. */
+			if (ansi_strcmp(dp->d_name, ".", dp->d_name_len) != 0 &&
+			    ansi_strcmp(dp->d_name, "..", dp->d_name_len) != 0) match = 1;
+		} else {
+			if (ansi_strcmp(dp->d_name, string, dp->d_name_len) == 0){
+				match = 1;
+			}
+		}
+	}
+
+	if (match)
+		break;
+
+	prev_dp = dp;
+  }
+
+  if (!match)
+	return(ENOENT);
+
+  /* LOOK_UP or DELETE found what it wanted. */
+  if (flag == IS_EMPTY)
+	return(ENOTEMPTY);
+
+  if (flag == LOOK_UP) {
+	*numb = (ino_t) conv4(le_CPU, dp->d_ino);
+	return(OK);
+  }
+
+  /* 'flag' is DELETE */
+  if (dp->d_name_len >= sizeof(ino_t)) {
+	/* Save d_ino for recovery. */
+	t = dp->d_name_len - sizeof(ino_t);
+	memcpy(&dp->d_name[t], &dp->d_ino, sizeof(dp->d_ino));
+  }
+  dp->d_ino = NO_ENTRY;	/* erase entry */
+  lmfs_markdirty(bp);
+
+  /* If we don't support HTree (directory index), which is fully compatible
+   * ext2 feature, we should reset EXT2_INDEX_FL, when modify linked directory
+   * structure. Removing an entry from a leaf block keeps the index valid.
+   */
+  if (!HAS_COMPAT_FEATURE(ldir_ptr->i_sp, COMPAT_DIR_INDEX))
+	ldir_ptr->i_flags &= ~EXT2_INDEX_FL;
+  if (pos < ldir_ptr->i_last_dpos) {
+	ldir_ptr->i_last_dpos = pos;
+	ldir_ptr->i_last_dentry_size = conv2(le_CPU, dp->d_rec_len);
+  }
+  ldir_ptr->i_update |= CTIME | MTIME;
+  ldir_ptr->i_dirt = IN_DIRTY;
+  /* Now we have cleared dentry, if it's not the first one, merge it with
+   * previous one. Since we assume, that existing dentry must be correct,
+   * there is no way to spann a data block.
+   */
+  if (prev_dp) {
+	u16_t temp = conv2(le_CPU, prev_dp->d_rec_len);
+	temp += conv2(le_CPU, dp->d_rec_len);
+	prev_dp->d_rec_len = conv2(le_CPU, temp);
+  }
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				find_dir_slot				     *
+ *===========================================================================*/
+struct ext2_disk_dir_desc *find_dir_slot(bp, block_size, required_space)
+struct buf *bp;			/* directory block to search */
+unsigned int block_size;	/* block size of the file system */
+int required_space;		/* aligned size of the new entry */
+{
+/* Find room for a new entry of 'required_space' bytes in a directory block,
+ * either a free slot or the padding of an existing entry. Return a pointer
+ * to the (free) slot, or NULL if the block is full.
+ */
+  struct ext2_disk_dir_desc *dp;
+
+  for (dp = (struct ext2_disk_dir_desc*) &b_data(bp);
+       CUR_DISC_DIR_POS(dp, &b_data(bp)) < block_size;
+       dp = NEXT_DISC_DIR_DESC(dp) ) {
+	if (dp->d_ino == NO_ENTRY) {
+		/* we found a free slot, check if it has enough space */
+		if (required_space <= conv2(le_CPU, dp->d_rec_len))
+			return(dp);
+	}
+	/* Can we shrink dentry? */
+	if (required_space <= DIR_ENTRY_SHRINK(dp)) {
+		/* Shrink directory and create empty slot, now
+		 * dp->d_rec_len = DIR_ENTRY_ACTUAL_SIZE + DIR_ENTRY_SHRINK.
+		 */
+		int new_slot_size = conv2(le_CPU, dp->d_rec_len);
+		int actual_size = DIR_ENTRY_ACTUAL_SIZE(dp);
+		new_slot_size -= actual_size;
+		dp->d_rec_len = conv2(le_CPU, actual_size);
+		dp = NEXT_DISC_DIR_DESC(dp);
+		dp->d_rec_len = conv2(le_CPU, new_slot_size);
+		/* if we fail before writing real ino */
+		dp->d_ino = NO_ENTRY;
+		lmfs_markdirty(bp);
+		return(dp);
+	}
+  }
+
+  return(NULL);
+}
+
+
+/*===========================================================================*
+ *				fill_dir_entry				     *
+ *===========================================================================*/
+void fill_dir_entry(ldir_ptr, dp, string, string_len, numb, ftype)
+struct inode *ldir_ptr;		/* directory the entry belongs to */
+struct ext2_disk_dir_desc *dp;	/* free slot found by find_dir_slot() */
+const char *string;		/* component to enter */
+int string_len;			/* length of 'string' */
+ino_t numb;			/* inode number of the new entry */
+int ftype;			/* used when INCOMPAT_FILETYPE */
+{
+/* Store name, inode number and file type in a free directory slot. */
+  int i;
+
   dp->d_name_len = string_len;
   for (i = 0; i < NAME_MAX && i < dp->d_name_len && string[i]; i++)
 	dp->d_name[i] = string[i];
-  dp->d_ino = (int) conv4(le_CPU, *numb);
+  dp->d_ino = (int) conv4(le_CPU, numb);
   if (HAS_INCOMPAT_FEATURE(ldir_ptr->i_sp, INCOMPAT_FILETYPE)) {
 	/* Convert ftype (from inode.i_mode) to dp->d_file_type */
 	if (ftype == I_REGULAR)
@@ -299,16 +397,4 @@ int ftype;			 /* used when ENTER and INCOMPAT_FILETYPE */
 	else
 		dp->d_file_type = EXT2_FT_UNKNOWN;
   }
-  lmfs_markdirty(bp);
-  put_block(bp);
-  ldir_ptr->i_update |= CTIME | MTIME;	/* mark mtime for update later */
-  ldir_ptr->i_dirt = IN_DIRTY;
-
-  if (new_slots == 1) {
-	ldir_ptr->i_size += (off_t) conv2(le_CPU, dp->d_rec_len);
-	/* Send the change to disk if the directory is extended. */
-	if (extended) rw_inode(ldir_ptr, WRITING);
-  }
-  return(OK);
-
 }
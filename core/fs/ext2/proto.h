@@ -7,6 +7,7 @@
 
 /* Structs used in prototypes must be declared as such first. */
 struct buf;
+struct ext2_disk_dir_desc;
 struct filp;
 struct inode;
 struct super_block;
@@ -15,6 +16,21 @@ struct super_block;
 void discard_preallocated_blocks(struct inode *rip);
 block_t alloc_block(struct inode *rip, block_t goal);
 void free_block(struct super_block *sp, bit_t bit);
+void alloc_stats(struct super_block *sp);
+
+/* extent.c */
+void extent_init(struct inode *rip);
+block_t extent_read_map(struct inode *rip, off_t position, int opportunistic);
+int extent_write_map(struct inode *rip, off_t position, block_t new_wblock,
+	int op);
+
+/* htree.c */
+int htree_indexed(struct inode *dirp);
+int htree_search(struct inode *dirp, const char *string, ino_t *numb,
+	int flag);
+int htree_enter(struct inode *dirp, const char *string, ino_t numb,
+	int ftype);
+int htree_make_indexed(struct inode *dirp);
 
 /* ialloc.c */
 struct inode *alloc_inode(struct inode *parent, mode_t bits, uid_t uid,
@@ -65,6 +81,12 @@ int fs_lookup(ino_t dir_nr, char *name, struct fsdriver_node *node,
 struct inode *advance(struct inode *dirp, const char *string);
 int search_dir(struct inode *ldir_ptr, const char *string, ino_t *numb,
 	int flag, int ftype);
+int search_dir_block(struct inode *ldir_ptr, struct buf *bp, off_t pos,
+	const char *string, ino_t *numb, int flag);
+struct ext2_disk_dir_desc *find_dir_slot(struct buf *bp,
+	unsigned int block_size, int required_space);
+void fill_dir_entry(struct inode *ldir_ptr, struct ext2_disk_dir_desc *dp,
+	const char *string, int string_len, ino_t numb, int ftype);
 
 /* protect.c */
 int fs_chmod(ino_t ino_nr, mode_t *mode);
@@ -100,7 +122,7 @@ long conv4(int norm, long x);
 int ansi_strcmp(register const char* ansi_s, register const char *s2,
 	register size_t ansi_s_length);
 bit_t setbit(bitchunk_t *bitmap, bit_t max_bits, unsigned int word);
-bit_t setbyte(bitchunk_t *bitmap, bit_t max_bits);
+bit_t setrun(bitchunk_t *bitmap, bit_t max_bits, bit_t origin, int *count);
 int unsetbit(bitchunk_t *bitmap, bit_t bit);
 
 /* write.c */
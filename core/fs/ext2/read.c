@@ -219,6 +219,9 @@ int opportunistic;
   static long out_range_s;
   int iomode;
  
+  if (rip->i_flags & EXT4_EXTENTS_FL)
+	return extent_read_map(rip, position, opportunistic);
+
   iomode = opportunistic ? PEEK : NORMAL;
 
   if (first_time) {
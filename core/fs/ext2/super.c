@@ -210,6 +210,12 @@ register struct super_block *sp; /* pointer to a superblock */
 
   sp->s_igsearch = 0;
 
+  /* No allocation statistics yet for this mount. */
+  sp->s_stat_alloc_blocks = sp->s_stat_alloc_contig = 0;
+  sp->s_stat_prealloc_runs = sp->s_stat_prealloc_blocks = 0;
+  sp->s_stat_prealloc_unused = 0;
+  sp->s_stat_extents_new = sp->s_stat_extents_merged = 0;
+
   sp->s_dev = dev; /* restore device number */
   return(OK);
 }
@@ -418,6 +424,12 @@ static void super_copy(
   dest->s_prealloc_blocks = source->s_prealloc_blocks;
   dest->s_prealloc_dir_blocks = source->s_prealloc_dir_blocks;
   dest->s_padding1 = conv2(le_CPU, source->s_padding1);
+  dest->s_hash_seed[0] = conv4(le_CPU, source->s_hash_seed[0]);
+  dest->s_hash_seed[1] = conv4(le_CPU, source->s_hash_seed[1]);
+  dest->s_hash_seed[2] = conv4(le_CPU, source->s_hash_seed[2]);
+  dest->s_hash_seed[3] = conv4(le_CPU, source->s_hash_seed[3]);
+  dest->s_def_hash_version = source->s_def_hash_version;
+  dest->s_flags = conv4(le_CPU, source->s_flags);
 }
 
 
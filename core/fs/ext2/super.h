@@ -79,7 +79,9 @@ EXTERN struct super_block {
     u16_t   s_reserved_word_pad;
     u32_t   s_default_mount_opts;
     u32_t   s_first_meta_bg;        /* First metablock block group */
-    u32_t   s_reserved[190];        /* Padding to the end of the block */
+    u32_t   s_reserved1[22];        /* ext3/ext4 fields we don't use */
+    u32_t   s_flags;                /* Miscellaneous flags */
+    u32_t   s_reserved[167];        /* Padding to the end of the block */
 
     /* The following items are only used when the super_block is in memory. */
     u32_t   s_inodes_per_block;     /* Number of inodes per block */
@@ -102,6 +104,15 @@ EXTERN struct super_block {
     int     s_igsearch; /* all groups below this one have no free inodes */
     u32_t   s_dirs_counter;
 
+    /* Block allocation statistics, reported by alloc_stats(). */
+    u32_t   s_stat_alloc_blocks;	/* blocks handed out by alloc_block */
+    u32_t   s_stat_alloc_contig;	/* ..of which right after the goal */
+    u32_t   s_stat_prealloc_runs;	/* preallocated runs taken */
+    u32_t   s_stat_prealloc_blocks;	/* blocks preallocated in those runs */
+    u32_t   s_stat_prealloc_unused;	/* ..and given back unused */
+    u32_t   s_stat_extents_new;		/* extents started by a new block */
+    u32_t   s_stat_extents_merged;	/* new blocks appended to an extent */
+
 } *superblock, *ondisk_superblock;
 
 
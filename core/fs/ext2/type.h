@@ -83,6 +83,57 @@ struct ext2_disk_dir_desc {
 /* Return next dentry's position in block */
 #define NEXT_DISC_DIR_POS(cur_desc, base) (cur_desc->d_rec_len +\
 					   CUR_DISC_DIR_POS(cur_desc, base))
+
+/* HTree (directory index) structures, stored in little endian format.
+ * The first entry of each index block has no hash; its hash field holds
+ * the count/limit pair instead.
+ */
+struct ext2_dx_entry {
+  u32_t     dx_hash;
+  u32_t     dx_block;	/* logical block number within the directory */
+};
+
+struct ext2_dx_countlimit {
+  u16_t     dx_limit;	/* max number of entries in this block */
+  u16_t     dx_count;	/* number of entries in use */
+};
+
+struct ext2_dx_root_info {
+  u32_t     dr_reserved_zero;
+  u8_t      dr_hash_version;
+  u8_t      dr_info_length;	/* 8 */
+  u8_t      dr_indirect_levels;
+  u8_t      dr_unused_flags;
+};
+
+
+/* ext4 extent tree structures, stored in little endian format. The root of
+ * the tree lives in i_block[] of the inode: a header and up to four entries.
+ * Interior nodes hold ext4_extent_idx entries, leaves ext4_extent entries;
+ * both start with the first logical block they cover.
+ */
+struct ext4_extent_header {
+  u16_t     eh_magic;	/* EXT4_EXT_MAGIC */
+  u16_t     eh_entries;	/* number of valid entries */
+  u16_t     eh_max;	/* capacity of store in entries */
+  u16_t     eh_depth;	/* 0 for leaves */
+  u32_t     eh_generation;
+};
+
+struct ext4_extent {
+  u32_t     ee_block;	/* first logical block extent covers */
+  u16_t     ee_len;	/* number of blocks covered by extent */
+  u16_t     ee_start_hi;	/* high 16 bits of physical block */
+  u32_t     ee_start_lo;	/* low 32 bits of physical block */
+};
+
+struct ext4_extent_idx {
+  u32_t     ei_block;	/* index covers logical blocks from 'block' */
+  u32_t     ei_leaf_lo;	/* block of the next level */
+  u16_t     ei_leaf_hi;	/* high 16 bits of physical block */
+  u16_t     ei_unused;
+};
+
 /* Structure with options affecting global behavior. */
 struct opt {
   int use_orlov;		/* Bool: Use Orlov allocator */
@@ -95,6 +146,8 @@ struct opt {
   unsigned int block_with_super;/* Int: where to read super block,
                                  * uses 1k units. */
   int use_prealloc;		/* Bool: use preallocation */
+  int alloc_stats;		/* Bool: print allocation stats on unmount */
+  int io_depth;			/* Int: outstanding block transfer requests */
 };
 
 
@@ -139,43 +139,77 @@ bit_t setbit(bitchunk_t *bitmap, bit_t max_bits, unsigned int word)
 
 
 /*===========================================================================*
- *				setbyte   				     *
+ *				setrun   				     *
  *===========================================================================*/
-bit_t setbyte(bitchunk_t *bitmap, bit_t max_bits)
+bit_t setrun(bitchunk_t *bitmap, bit_t max_bits, bit_t origin, int *count)
 {
-  /* Find free byte in bitmap and set it. Return number of the starting bit,
-   * if failed return -1.
-   */
-  unsigned char *wptr, *wlim;
-  bit_t b = -1;
-
-  wptr = (unsigned char*) &bitmap[0];
-  /* TODO: do we need to add 1? I saw a situation, when it was
-   * required, and since we check bit number with max_bits it
-   * should be safe.
+  /* Find a run of up to *count free bits at or after bit 'origin' and set
+   * them. A run starting right at 'origin' is taken whatever its length,
+   * since it continues what was allocated before it. Otherwise the first
+   * run of the full length wins, or failing that the longest run seen.
+   * Return number of the first bit and store the run length in *count,
+   * if there is no free bit after 'origin' return -1.
    */
-  wlim = &wptr[(max_bits >> 3)];
+  bitchunk_t *wptr;
+  bit_t b, start, best = -1;
+  int len, best_len = 0, want = *count;
 
-  /* Iterate over the words in block. */
-  for ( ; wptr < wlim; wptr++) {
-	/* Is it a free byte? */
-	if (*wptr | 0)
-		continue;
+#define BIT_SET(b) (bitmap[(b) / FS_BITCHUNK_BITS] & \
+			((bitchunk_t) 1 << ((b) % FS_BITCHUNK_BITS)))
 
-	/* Bit number from the start of the bit map. */
-	b = (wptr - (unsigned char*) &bitmap[0]) * CHAR_BIT;
+  b = origin;
+  while (b < max_bits) {
+	wptr = &bitmap[b / FS_BITCHUNK_BITS];
 
-	/* Don't allocate bits beyond the end of the map. */
-	if (b + CHAR_BIT >= max_bits) {
-		b = -1;
+	/* Skip used words as a whole. */
+	if (*wptr == (bitchunk_t) ~0) {
+		b = (b / FS_BITCHUNK_BITS + 1) * FS_BITCHUNK_BITS;
+		continue;
+	}
+	if (BIT_SET(b)) {
+		b++;
 		continue;
 	}
 
-	/* Allocate byte number. */
-	*wptr = (unsigned char) ~0;
-	break;
+	/* Measure the free run starting at b; empty words are counted
+	 * in one go.
+	 */
+	start = b;
+	len = 0;
+	while (b < max_bits && len < want) {
+		if (b % FS_BITCHUNK_BITS == 0 &&
+		    bitmap[b / FS_BITCHUNK_BITS] == 0 &&
+		    len + FS_BITCHUNK_BITS <= want &&
+		    b + FS_BITCHUNK_BITS <= max_bits) {
+			b += FS_BITCHUNK_BITS;
+			len += FS_BITCHUNK_BITS;
+			continue;
+		}
+		if (BIT_SET(b))
+			break;
+		b++;
+		len++;
+	}
+
+	if (len > best_len) {
+		best = start;
+		best_len = len;
+	}
+	if (start == origin || len == want)
+		break;
   }
-  return b;
+
+  if (best == -1)
+	return -1;
+
+  /* Allocate the run. */
+  for (b = best; b < best + best_len; b++)
+	bitmap[b / FS_BITCHUNK_BITS] |= (bitchunk_t) 1 << (b % FS_BITCHUNK_BITS);
+
+#undef BIT_SET
+
+  *count = best_len;
+  return best;
 }
 
 
@@ -54,6 +54,9 @@ int op;				/* special actions */
   static long triple_ind_s;
   static long out_range_s;
 
+  if (rip->i_flags & EXT4_EXTENTS_FL)
+	return extent_write_map(rip, position, new_wblock, op);
+
   if (first_time) {
 	addr_in_block = rip->i_sp->s_block_size / BLOCK_ADDRESS_BYTES;
 	addr_in_block2 = addr_in_block * addr_in_block;
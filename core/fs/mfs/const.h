@@ -10,6 +10,8 @@
 				 * NR_VNODES in vfs
 				 */
 
+#define NR_MAP_RUNS        4	/* # zone runs cached per inode by read_map */
+
 #define INODE_HASH_LOG2   7     /* 2 based logarithm of the inode hash size */
 #define INODE_HASH_SIZE   ((unsigned long)1<<INODE_HASH_LOG2)
 #define INODE_HASH_MASK   (((unsigned long)1<<INODE_HASH_LOG2)-1)
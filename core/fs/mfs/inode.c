@@ -166,6 +166,7 @@ struct inode *get_inode(
   rip->i_zsearch = NO_ZONE;	/* no zones searched for yet */
   rip->i_mountpoint= FALSE;
   rip->i_last_dpos = 0;		/* no dentries searched for yet */
+  invalidate_map(rip);		/* no zone runs cached yet */
 
   /* Add to hash */
   addhash_inode(rip);
@@ -320,6 +321,7 @@ register struct inode *rip;	/* the inode to be erased */
   rip->i_update = ATIME | CTIME | MTIME;	/* update all times later */
   IN_MARKDIRTY(rip);
   for (i = 0; i < V2_NR_TZONES; i++) rip->i_zone[i] = NO_ZONE;
+  invalidate_map(rip);
 }
 
 /*===========================================================================*
@@ -17,6 +17,16 @@
 
 #include "super.h"
 
+/* A run of blocks that are contiguous both in a file and on the device, as
+ * remembered by read_map() so that it need not walk the indirect blocks for
+ * each of them.
+ */
+struct map_run {
+  block_t mr_pos;		/* first block of the run within the file */
+  block_t mr_block;		/* block number of that block on the device */
+  unsigned int mr_len;		/* # blocks in the run, 0 if slot unused */
+};
+
 EXTERN struct inode {
   u16_t i_mode;		/* file type, protection, etc. */
   u16_t i_nlinks;		/* how many links to this file */
@@ -44,6 +54,9 @@ EXTERN struct inode {
   char i_seek;			/* set on LSEEK, cleared on READ/WRITE */
   char i_update;		/* the ATIME, CTIME, and MTIME bits are here */
 
+  struct map_run i_map[NR_MAP_RUNS];	/* cached zone runs */
+  int i_map_next;		/* slot to replace next in i_map */
+
   LIST_ENTRY(inode) i_hash;     /* hash list */
   TAILQ_ENTRY(inode) i_unused;  /* free and unused list */
   
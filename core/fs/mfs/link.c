@@ -472,6 +472,7 @@ off_t newsize;			/* inode must become this size */
 
   /* Free the actual space if truncating. */
   if (newsize < rip->i_size) {
+	invalidate_map(rip);
   	if ((r = freesp_inode(rip, newsize, rip->i_size)) != OK)
   		return(r);
   }
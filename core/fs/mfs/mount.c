@@ -3,6 +3,9 @@
 #include "super.h"
 #include <minix/vfsif.h>
 #include <minix/bdev.h>
+#include <stdlib.h>
+
+static void free_bit_summaries(void);
 
 /*===========================================================================*
  *				fs_mount				     *
@@ -57,11 +60,17 @@ int fs_mount(dev_t dev, unsigned int flags, struct fsdriver_node *root_node,
    */
   used_zones = superblock.s_zones - count_free_bits(&superblock, ZMAP);
 
+  /* Also count the free inodes. From here on, alloc_bit() and free_bit()
+   * keep both counts up to date.
+   */
+  (void) count_free_bits(&superblock, IMAP);
+
   lmfs_set_blockusage(superblock.s_zones, used_zones);
   
   /* Get the root inode of the mounted file system. */
   if( (root_ip = get_inode(fs_dev, ROOT_INODE)) == NULL)  {
 	printf("MFS: couldn't get root inode\n");
+	free_bit_summaries();
 	superblock.s_dev = NO_DEV;
 	bdev_close(fs_dev);
 	return(EINVAL);
@@ -70,6 +79,7 @@ int fs_mount(dev_t dev, unsigned int flags, struct fsdriver_node *root_node,
   if(root_ip->i_mode == 0) {
 	printf("%s:%d zero mode for root inode?\n", __FILE__, __LINE__);
 	put_inode(root_ip);
+	free_bit_summaries();
 	superblock.s_dev = NO_DEV;
 	bdev_close(fs_dev);
 	return(EINVAL);
@@ -168,6 +178,20 @@ void fs_unmount(void)
   lmfs_invalidate(fs_dev);
 
   /* Finish off the unmount. */
+  free_bit_summaries();
   superblock.s_dev = NO_DEV;
 }
 
+
+/*===========================================================================*
+ *				free_bit_summaries			     *
+ *===========================================================================*/
+static void free_bit_summaries(void)
+{
+/* Release the free bit counts of the bit map blocks. */
+
+  free(superblock.s_imap_free);
+  free(superblock.s_zmap_free);
+  superblock.s_imap_free = superblock.s_zmap_free = NULL;
+}
+
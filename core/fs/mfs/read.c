@@ -12,6 +12,10 @@
 
 static struct buf *rahead(struct inode *rip, block_t baseblock, u64_t
 	position, unsigned bytes_ahead);
+static block_t map_lookup(struct inode *rip, block_t block_pos,
+	unsigned int *left);
+static void map_enter(struct inode *rip, unsigned long zone, zone_t z,
+	struct buf *bp, int index, int last);
 static int rw_chunk(struct inode *rip, u64_t position, unsigned off,
 	size_t chunk, unsigned left, int call, struct fsdriver_data *data,
 	unsigned buf_off, unsigned int block_size, int *completed);
@@ -214,6 +218,8 @@ int opportunistic;		/* if nonzero, only use cache for metadata */
 {
 /* Given an inode and a position within the corresponding file, locate the
  * block (not zone) number in which that position is to be found and return it.
+ * The run of contiguous zones found around it is remembered in the inode, so
+ * that later lookups in the same run need not walk the indirect blocks.
  */
 
   struct buf *bp;
@@ -228,6 +234,8 @@ int opportunistic;		/* if nonzero, only use cache for metadata */
 
   scale = rip->i_sp->s_log_zone_size;	/* for block-zone conversion */
   block_pos = position/rip->i_sp->s_block_size;	/* relative blk # in file */
+  if ((b = map_lookup(rip, (block_t) block_pos, NULL)) != NO_BLOCK)
+	return(b);
   zone = block_pos >> scale;	/* position's zone */
   boff = (int) (block_pos - (zone << scale) ); /* relative blk # within zone */
   dzones = rip->i_ndzones;
@@ -238,6 +246,7 @@ int opportunistic;		/* if nonzero, only use cache for metadata */
 	zind = (int) zone;	/* index should be an int */
 	z = rip->i_zone[zind];
 	if (z == NO_ZONE) return(NO_BLOCK);
+	map_enter(rip, zone, z, NULL, zind, dzones - 1);
 	b = (block_t) ((z << scale) + boff);
 	return(b);
   }
@@ -272,12 +281,92 @@ int opportunistic;		/* if nonzero, only use cache for metadata */
   if (bp == NULL)
 	return NO_BLOCK;			/* peeking failed */
   z = rd_indir(bp, (int) excess);		/* get block pointed to */
+  if (z != NO_ZONE)
+	map_enter(rip, zone, z, bp, (int) excess, nr_indirects - 1);
   put_block(bp);				/* release single indir blk */
   if (z == NO_ZONE) return(NO_BLOCK);
   b = (block_t) ((z << scale) + boff);
   return(b);
 }
 
+/*===========================================================================*
+ *				map_lookup				     *
+ *===========================================================================*/
+static block_t map_lookup(rip, block_pos, left)
+struct inode *rip;		/* inode to look in */
+block_t block_pos;		/* relative blk # in file */
+unsigned int *left;		/* if not NULL, # blocks left in the run */
+{
+/* Look up a block in the zone runs cached for the inode. Return its block
+ * number, or NO_BLOCK if it is not in any of them.
+ */
+  struct map_run *mr;
+  block_t off;
+
+  for (mr = &rip->i_map[0]; mr < &rip->i_map[NR_MAP_RUNS]; mr++) {
+	off = block_pos - mr->mr_pos;
+	if (block_pos >= mr->mr_pos && off < mr->mr_len) {
+		if (left != NULL)
+			*left = mr->mr_len - off;
+		return(mr->mr_block + off);
+	}
+  }
+  return(NO_BLOCK);
+}
+
+/*===========================================================================*
+ *				map_enter				     *
+ *===========================================================================*/
+static void map_enter(rip, zone, z, bp, index, last)
+struct inode *rip;		/* inode to cache the run for */
+unsigned long zone;		/* relative zone # in file */
+zone_t z;			/* zone it maps to */
+struct buf *bp;			/* indirect block holding z, or NULL for inode */
+int index;			/* index of z in the indirect block or inode */
+int last;			/* last valid index */
+{
+/* Cache the run of contiguous zones around zone 'z', as far as it is listed in
+ * the same place (the inode's direct zones, or one indirect block) as 'z'.
+ */
+  struct map_run *mr;
+  int scale, first, end;
+
+#define ZONE_AT(i) ((bp) == NULL ? rip->i_zone[i] : rd_indir(bp, (i)))
+
+  for (first = index; first > 0 && z - (index - first) > 1 &&
+	ZONE_AT(first - 1) == z - (index - first) - 1; first--) {}
+  for (end = index; end < last &&
+	ZONE_AT(end + 1) == z + (end - index) + 1; end++) {}
+
+#undef ZONE_AT
+
+  scale = rip->i_sp->s_log_zone_size;
+  mr = &rip->i_map[rip->i_map_next];
+  mr->mr_pos = (block_t) (zone - (index - first)) << scale;
+  mr->mr_block = (block_t) (z - (index - first)) << scale;
+  mr->mr_len = (unsigned int) (end - first + 1) << scale;
+  rip->i_map_next = (rip->i_map_next + 1) % NR_MAP_RUNS;
+}
+
+/*===========================================================================*
+ *				invalidate_map				     *
+ *===========================================================================*/
+void invalidate_map(rip)
+struct inode *rip;		/* inode whose zones change */
+{
+/* Forget the zone runs cached for an inode. This must be done whenever its
+ * zone mapping may change.
+ */
+  int i;
+
+  for (i = 0; i < NR_MAP_RUNS; i++)
+	rip->i_map[i].mr_len = 0;
+  rip->i_map_next = 0;
+}
+
+/*===========================================================================*
+ *				get_block_map				     *
+ *===========================================================================*/
 struct buf *get_block_map(register struct inode *rip, u64_t position)
 {
 	struct buf *bp;
@@ -343,7 +432,7 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
 /* Minimum number of blocks to prefetch. */
 # define BLOCKS_MINIMUM		32
   int r, scale, read_q_size;
-  unsigned int blocks_ahead, fragment, block_size;
+  unsigned int blocks_ahead, fragment, block_size, run_left;
   block_t block, blocks_left;
   off_t ind1_pos;
   dev_t dev;
@@ -370,6 +459,15 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
   if (r != ENOENT)
 	panic("MFS: error getting block (%llu,%u): %d", dev, block, r);
 
+  /* Blocks following the current one in its cached zone run are known
+   * without looking them up.
+   */
+  if (map_lookup(rip, (block_t) (position / block_size), &run_left) !=
+	NO_BLOCK)
+	run_left--;
+  else
+	run_left = 0;
+
   /* The best guess for the number of blocks to prefetch:  A lot.
    * It is impossible to tell what the device looks like, so we don't even
    * try to guess the geometry, but leave it to the driver.
@@ -384,10 +482,9 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
    * read as much as you can.  With luck the caching on the drive allows
    * for a little time to start the next read.
    *
-   * The current solution below is a bit of a hack, it just reads blocks from
-   * the current file position hoping that more of the file can be found.  A
-   * better solution must look at the already available zone pointers and
-   * indirect blocks (but don't call read_map!).
+   * The current solution below reads blocks from the current file position,
+   * following the zone runs cached by read_map() and otherwise mapping blocks
+   * only through metadata already in the cache.
    */
 
   blocks_left = (block_t) (rip->i_size-ex64lo(position)+(block_size-1)) /
@@ -423,7 +520,17 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
 	block++;
 	position_running += block_size;
 
-	thisblock = read_map(rip, (off_t) ex64lo(position_running), 1);
+	if (run_left > 0) {
+		thisblock = block;
+		run_left--;
+	} else {
+		thisblock = read_map(rip, (off_t) ex64lo(position_running), 1);
+		if (thisblock == NO_BLOCK || map_lookup(rip,
+		    (block_t) (position_running / block_size), &run_left) ==
+		    NO_BLOCK)
+			run_left = 1;
+		run_left--;
+	}
 	if (thisblock != NO_BLOCK) {
 		r = lmfs_get_block_ino(&bp, dev, thisblock, PEEK, rip->i_num,
 		    position_running);
@@ -96,7 +96,7 @@ int fs_statvfs(struct statvfs *st)
   st->f_frsize = sp->s_block_size;
   st->f_iosize = st->f_frsize;
   st->f_files = sp->s_ninodes;
-  st->f_ffree = count_free_bits(sp, IMAP);
+  st->f_ffree = sp->s_ifree;
   st->f_favail = st->f_ffree;
   st->f_namemax = MFS_DIRSIZ;
 
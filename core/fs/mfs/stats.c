@@ -1,5 +1,7 @@
 #include "fs.h"
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 #include <minix/com.h>
 #include <assert.h>
 #include <minix/u64.h>
@@ -12,20 +14,23 @@
  *				count_free_bits				     *
  *===========================================================================*/
 bit_t count_free_bits(sp, map)
-struct super_block *sp;		/* the filesystem to allocate from */
+struct super_block *sp;		/* the filesystem to count in */
 int map;			/* IMAP (inode map) or ZMAP (zone map) */
 {
-/* Allocate a bit from a bit map and return its bit number. */
+/* Count the free bits in a bit map. The count of each bit map block is kept
+ * in the map's summary, which alloc_bit() uses to skip full blocks and
+ * alloc_bit() and free_bit() keep up to date, so this needs to be done only
+ * once, at mount time. For the inode map the total is kept as well.
+ */
   block_t start_block;		/* first bit block */
   block_t block;
   bit_t map_bits;		/* how many bits are there in the bit map? */
   short bit_blocks;		/* how many blocks are there in the bit map? */
-  bit_t origin;			/* number of bit to start searching at */
-  unsigned word, bcount;
+  unsigned int **summary;
   struct buf *bp;
   bitchunk_t *wptr, *wlim, k;
-  bit_t i, b;
-  bit_t free_bits;
+  bit_t b;
+  bit_t free_bits, block_free;
 
   assert(sp != NULL);
 
@@ -33,57 +38,44 @@ int map;			/* IMAP (inode map) or ZMAP (zone map) */
     start_block = START_BLOCK;
     map_bits = (bit_t) (sp->s_ninodes + 1);
     bit_blocks = sp->s_imap_blocks;
-    origin = sp->s_isearch;
+    summary = &sp->s_imap_free;
   } else {
     start_block = START_BLOCK + sp->s_imap_blocks;
     map_bits = (bit_t) (sp->s_zones - (sp->s_firstdatazone - 1));
     bit_blocks = sp->s_zmap_blocks;
-    origin = sp->s_zsearch;
+    summary = &sp->s_zmap_free;
   }
 
-  /* Figure out where to start the bit search (depends on 'origin'). */
-  if (origin >= map_bits) origin = 0;    /* for robustness */
-  free_bits = 0;
-
-  /* Locate the starting place. */
-  block = (block_t) (origin / FS_BITS_PER_BLOCK(sp->s_block_size));
-  word = (origin % FS_BITS_PER_BLOCK(sp->s_block_size)) / FS_BITCHUNK_BITS;
+  if (*summary == NULL &&
+      (*summary = malloc(bit_blocks * sizeof(**summary))) == NULL)
+    panic("can't allocate bit map summary");
 
-  /* Iterate over all blocks plus one, because we start in the middle. */
-  bcount = bit_blocks;
-  do {
+  free_bits = 0;
+  b = 0;
+  for (block = 0; block < (block_t) bit_blocks; block++) {
     bp = get_block(sp->s_dev, start_block + block, NORMAL);
     assert(bp);
     wlim = &b_bitmap(bp)[FS_BITMAP_CHUNKS(sp->s_block_size)];
 
-    /* Iterate over the words in block. */
-    for (wptr = &b_bitmap(bp)[word]; wptr < wlim; wptr++) {
-
-      /* Does this word contain a free bit? */
-      if (*wptr == (bitchunk_t) ~0) continue;
-
-      k = (bitchunk_t) conv4(sp->s_native, (int) *wptr);
+    /* Count a word at a time; only the last word in use may have bits
+     * beyond the end of the map, those are not counted.
+     */
+    block_free = 0;
+    for (wptr = &b_bitmap(bp)[0]; wptr < wlim && b < map_bits;
+        wptr++, b += FS_BITCHUNK_BITS) {
+      k = ~(bitchunk_t) conv4(sp->s_native, (int) *wptr);
+      if (map_bits - b < FS_BITCHUNK_BITS)
+        k &= ((bitchunk_t) 1 << (map_bits - b)) - 1;
+      block_free += popcount32(k);
+    }
+    put_block(bp);
 
-      for (i = 0; i < 8*sizeof(k); ++i) {
-        /* Bit number from the start of the bit map. */
-        b = ((bit_t) block * FS_BITS_PER_BLOCK(sp->s_block_size))
-            + (wptr - &b_bitmap(bp)[0]) * FS_BITCHUNK_BITS
-            + i;
+    (*summary)[block] = block_free;
+    free_bits += block_free;
+  }
 
-        /* Don't count bits beyond the end of the map. */
-        if (b >= map_bits) {
-          break;
-        } 
-        if ((k & (1 << i)) == 0) {
-          free_bits++;
-        }
-      }
+  if (map == IMAP)
+    sp->s_ifree = free_bits;
 
-      if (b >= map_bits) break;
-    }
-    put_block(bp);
-    ++block;
-    word = 0;
-  } while (--bcount > 0);
   return free_bits;
 }
@@ -1,7 +1,9 @@
 /* This file manages the super block table and the related data structures,
  * namely, the bit maps that keep track of which zones and which inodes are
  * allocated and which are free.  When a new inode or zone is needed, the
- * appropriate bit map is searched for a free entry.
+ * appropriate bit map is searched for a free entry.  A summary with the
+ * number of free bits in each bit map block is kept in memory, so that
+ * blocks without free bits need not be read while searching.
  *
  * The entry points into this file are
  *   alloc_bit:       somebody wants to allocate a zone or inode; find one
@@ -12,6 +14,7 @@
 
 #include "fs.h"
 #include <string.h>
+#include <strings.h>
 #include <assert.h>
 #include <minix/com.h>
 #include <minix/u64.h>
@@ -37,6 +40,7 @@ bit_t origin;			/* number of bit to start searching at */
   block_t block;
   bit_t map_bits;		/* how many bits are there in the bit map? */
   short bit_blocks;		/* how many blocks are there in the bit map? */
+  unsigned int *summary;	/* free bits in each bit map block */
   unsigned word, bcount;
   struct buf *bp;
   bitchunk_t *wptr, *wlim, k;
@@ -49,10 +53,12 @@ bit_t origin;			/* number of bit to start searching at */
 	start_block = START_BLOCK;
 	map_bits = (bit_t) (sp->s_ninodes + 1);
 	bit_blocks = sp->s_imap_blocks;
+	summary = sp->s_imap_free;
   } else {
 	start_block = START_BLOCK + sp->s_imap_blocks;
 	map_bits = (bit_t) (sp->s_zones - (sp->s_firstdatazone - 1));
 	bit_blocks = sp->s_zmap_blocks;
+	summary = sp->s_zmap_free;
   }
 
   /* Figure out where to start the bit search (depends on 'origin'). */
@@ -65,6 +71,10 @@ bit_t origin;			/* number of bit to start searching at */
   /* Iterate over all blocks plus one, because we start in the middle. */
   bcount = bit_blocks + 1;
   do {
+	/* Only look into blocks with free bits. */
+	if (summary[block] == 0)
+		goto next;
+
 	bp = get_block(sp->s_dev, start_block + block, NORMAL);
 	wlim = &b_bitmap(bp)[FS_BITMAP_CHUNKS(sp->s_block_size)];
 
@@ -76,7 +86,7 @@ bit_t origin;			/* number of bit to start searching at */
 
 		/* Find and allocate the free bit. */
 		k = (bitchunk_t) conv4(sp->s_native, (int) *wptr);
-		for (i = 0; (k & (1 << i)) != 0; ++i) {}
+		i = ffs((int) ~k) - 1;
 
 		/* Bit number from the start of the bit map. */
 		b = ((bit_t) block * FS_BITS_PER_BLOCK(sp->s_block_size))
@@ -87,17 +97,21 @@ bit_t origin;			/* number of bit to start searching at */
 		if (b >= map_bits) break;
 
 		/* Allocate and return bit number. */
-		k |= 1 << i;
+		k |= (bitchunk_t) 1 << i;
 		*wptr = (bitchunk_t) conv4(sp->s_native, (int) k);
 		MARKDIRTY(bp);
 		put_block(bp);
+		summary[block]--;
 		if(map == ZMAP) {
 			used_zones++;
 			lmfs_change_blockusage(1);
+		} else {
+			sp->s_ifree--;
 		}
 		return(b);
 	}
 	put_block(bp);
+next:
 	if (++block >= (unsigned int) bit_blocks) /* last block, wrap around */
 		block = 0;
 	word = 0;
@@ -150,8 +164,12 @@ bit_t bit_returned;		/* number of bit to insert into the map */
   put_block(bp);
 
   if(map == ZMAP) {
+	sp->s_zmap_free[block]++;
 	used_zones--;
 	lmfs_change_blockusage(-1);
+  } else {
+	sp->s_imap_free[block]++;
+	sp->s_ifree++;
   }
 }
 
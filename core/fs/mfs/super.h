@@ -57,6 +57,9 @@ EXTERN struct super_block {
   int s_nindirs;		/* # indirect zones per indirect block */
   bit_t s_isearch;		/* inodes below this bit number are in use */
   bit_t s_zsearch;		/* all zones below this bit number are in use*/
+  unsigned int *s_imap_free;	/* # free bits in each inode map block */
+  unsigned int *s_zmap_free;	/* # free bits in each zone map block */
+  bit_t s_ifree;		/* # free inodes */
 } superblock;
 
 #define IMAP		0	/* operating on the inode bit map */
@@ -47,6 +47,7 @@ int op;				/* special actions */
   struct buf *bp_dindir = NULL, *bp = NULL;
 
   IN_MARKDIRTY(rip);
+  invalidate_map(rip);				/* cached runs may change */
   scale = rip->i_sp->s_log_zone_size;		/* for zone-block conversion */
   	/* relative zone # to insert */
   zone = (position/rip->i_sp->s_block_size) >> scale;
@@ -28,6 +28,7 @@ struct blockdriver {
   void (*bdr_alarm)(clock_t stamp);
   void (*bdr_other)(message *m_ptr, int ipc_status);
   int (*bdr_device)(devminor_t minor, device_id_t *id);
+  int (*bdr_poll)(int spin);
 };
 
 /* Functions defined by libblockdriver. These can be used for both
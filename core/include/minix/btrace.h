@@ -4,7 +4,8 @@
 /* Control directives. */
 enum {
   BTCTL_START,
-  BTCTL_STOP
+  BTCTL_STOP,
+  BTCTL_RING
 };
 
 /* Request codes. */
@@ -37,4 +38,72 @@ typedef struct {
  */
 #define BTBUF_SIZE	1024
 
+/* Number of buckets in each block trace statistics histogram. Bucket N counts
+ * values less than 2^(N+1), but not less than 2^N (except for bucket 0); the
+ * last bucket counts the rest.
+ */
+#define BTHIST_BUCKETS	24
+
+/* Block trace statistics for the traced device, as returned by BIOCTRACESTAT.
+ * All times are in microseconds since the start of the trace. Transfer
+ * counters and histograms are indexed by direction: 0 for reads, 1 for writes.
+ */
+typedef struct {
+  u32_t enabled;		/* is tracing currently enabled? */
+  u32_t inflight;		/* number of transfers currently in progress */
+  u64_t time;			/* current time */
+  u64_t busy;			/* time with at least one transfer in progress */
+  u64_t depth_time;		/* sum over time of transfers in progress */
+  u64_t dropped;		/* trace entries lost or overwritten unread */
+  u64_t ops[2];			/* number of transfers completed */
+  u64_t bytes[2];		/* number of bytes transferred */
+  u64_t errors;			/* number of transfers that failed */
+  u32_t depth[BTHIST_BUCKETS];	/* transfers in progress, on submission */
+  u32_t size[BTHIST_BUCKETS];	/* transfer size (bytes) */
+  u32_t latency[2][BTHIST_BUCKETS];	/* transfer service time (us) */
+} btrace_stats;
+
+/* Request scheduler control directives. */
+enum {
+  BSCHED_OFF,
+  BSCHED_ON,
+  BSCHED_RESET
+};
+
+/* Number of buckets in each request scheduler latency histogram. Bucket N
+ * counts requests that took less than 2^(N+1) microseconds, but not less than
+ * 2^N microseconds (except for bucket 0); the last bucket counts the rest.
+ */
+#define BSCHED_BUCKETS	24
+
+/* Request scheduler statistics for a device, as returned by BIOCSCHEDGET. */
+typedef struct {
+  u32_t enabled;		/* is request scheduling enabled? */
+  u32_t queued;			/* number of requests currently queued */
+  u64_t dispatched;		/* number of transfers started */
+  u64_t merged;			/* requests merged into another transfer */
+  u64_t expired;		/* requests handed out after their deadline */
+  u32_t wait[BSCHED_BUCKETS];	/* queueing latency histogram */
+  u32_t service[BSCHED_BUCKETS];/* transfer latency histogram */
+} bsched_stats;
+
+/* Completion polling control directives. */
+enum {
+  BPOLL_OFF,
+  BPOLL_ON,
+  BPOLL_RESET
+};
+
+/* Completion polling statistics for a driver, as returned by BIOCPOLLGET. */
+typedef struct {
+  u32_t enabled;		/* is completion polling enabled? */
+  u32_t budget;			/* current spin budget, in microseconds */
+  u64_t rounds;			/* number of polling rounds started */
+  u64_t polls;			/* number of calls to the poll routine */
+  u64_t hits;			/* number of those that found completions */
+  u64_t completions;		/* number of requests completed by polling */
+  u64_t timeouts;		/* rounds ended by exhausting the budget */
+  u64_t intrs;			/* number of interrupts received */
+} bpoll_stats;
+
 #endif /* _MINIX_BTRACE_H */
@@ -1099,6 +1099,8 @@
 #define NDEV_RECV		(NDEV_RQ_BASE + 3)	/* receive a packet */
 #define NDEV_IOCTL		(NDEV_RQ_BASE + 4)	/* (reserved) */
 #define NDEV_STATUS_REPLY	(NDEV_RQ_BASE + 5)	/* status reply */
+#define NDEV_SEND_RING		(NDEV_RQ_BASE + 6)	/* send packets (ring) */
+#define NDEV_RECV_RING		(NDEV_RQ_BASE + 7)	/* receive packets (ring) */
 
 #define NDEV_INIT_REPLY		(NDEV_RS_BASE + 0)	/* initialize reply */
 #define NDEV_CONF_REPLY		(NDEV_RS_BASE + 1)	/* configure reply */
@@ -1106,6 +1108,8 @@
 #define NDEV_RECV_REPLY		(NDEV_RS_BASE + 3)	/* receive reply */
 #define NDEV_IOCTL_REPLY	(NDEV_RS_BASE + 4)	/* (reserved) */
 #define NDEV_STATUS		(NDEV_RS_BASE + 5)	/* status report */
+#define NDEV_SEND_RING_REPLY	(NDEV_RS_BASE + 6)	/* send reply (ring) */
+#define NDEV_RECV_RING_REPLY	(NDEV_RS_BASE + 7)	/* receive reply (ring) */
 
 /* Bits in the 'set' field of configuration requests. */
 #  define NDEV_SET_MODE		0x01	/* set I/O mode and multicast list */
@@ -1133,6 +1137,10 @@
 #  define NDEV_CAP_BCAST	0x40000000	/* init only: bcast capable */
 #  define NDEV_CAP_HWADDR	0x80000000	/* init only: can set hwaddr */
 
+/* Bits in the per-packet receive flags of the descriptor ring. */
+#  define NDEV_RXF_CSUM_IP4	0x01	/* IPv4 header checksum verified */
+#  define NDEV_RXF_CSUM_L4	0x02	/* TCP/UDP checksum verified */
+
 /* Values for the 'flags' field of configuration requests. */
 #  define NDEV_FLAG_DEBUG	0x01	/* enable driver-specific debug mode */
 #  define NDEV_FLAG_LINK0	0x02	/* enable driver-specific LINK0 flag */
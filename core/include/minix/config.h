@@ -102,5 +102,6 @@
 #define NDEV_NAME_MAX	16	/* max network driver name length (incl nul) */
 #define NDEV_HWADDR_MAX	6	/* max network hardware address length */
 #define NDEV_IOV_MAX	8	/* max number of elements in I/O vector */
+#define NDEV_RING_MAX	16	/* max number of requests per ring queue */
 
 #endif /* _CONFIG_H */
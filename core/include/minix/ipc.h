@@ -1592,10 +1592,37 @@ typedef struct {
 } mess_mmap;
 _ASSERT_MSG_SIZE(mess_mmap);
 
+/*
+ * Descriptor ring shared between the TCP/IP service and a network driver, to
+ * pass multiple send and receive requests per message.  The ring is owned by
+ * the TCP/IP service, which passes a grant for it in the initialization
+ * request.  The descriptor and result for the request with sequence number
+ * 'id' are in slot (id % NDEV_RING_MAX) of the queue's arrays.  Since the
+ * ring also carries per-packet checksum offload information, the checksum
+ * offload capabilities are available only to callers that provide a ring.
+ */
+struct ndev_desc {
+	cp_grant_id_t nd_grant[NDEV_IOV_MAX];	/* I/O vector grants */
+	uint16_t nd_len[NDEV_IOV_MAX];		/* I/O vector lengths */
+	uint32_t nd_count;			/* number of I/O vector elements */
+	uint16_t nd_csum_start;			/* send: checksum start, or 0 */
+	uint16_t nd_csum_off;			/* send: checksum field offset */
+};
+
+struct ndev_ring {
+	struct ndev_desc nr_send[NDEV_RING_MAX];	/* send descriptors */
+	struct ndev_desc nr_recv[NDEV_RING_MAX];	/* receive descriptors */
+	int32_t nr_send_result[NDEV_RING_MAX];		/* send results */
+	int32_t nr_recv_result[NDEV_RING_MAX];		/* receive results */
+	uint32_t nr_recv_flags[NDEV_RING_MAX];		/* receive flags */
+};
+
 typedef struct {
 	uint32_t id;
+	cp_grant_id_t ring_grant;
+	uint32_t ring_size;
 
-	uint8_t padding[52];
+	uint8_t padding[44];
 } mess_ndev_netdriver_init;
 _ASSERT_MSG_SIZE(mess_ndev_netdriver_init);
 
@@ -1622,6 +1649,14 @@ typedef struct {
 } mess_ndev_netdriver_transfer;
 _ASSERT_MSG_SIZE(mess_ndev_netdriver_transfer);
 
+typedef struct {
+	uint32_t id;
+	uint32_t count;
+
+	uint8_t padding[48];
+} mess_ndev_netdriver_ring;
+_ASSERT_MSG_SIZE(mess_ndev_netdriver_ring);
+
 typedef struct {
 	uint32_t id;
 
@@ -1639,8 +1674,9 @@ typedef struct {
 	uint8_t hwaddr_len;
 	uint8_t max_send;
 	uint8_t max_recv;
+	uint8_t ring;
 
-	uint8_t padding[15];
+	uint8_t padding[14];
 } mess_netdriver_ndev_init_reply;
 _ASSERT_MSG_SIZE(mess_netdriver_ndev_init_reply);
 
@@ -1652,6 +1688,14 @@ typedef struct {
 } mess_netdriver_ndev_reply;
 _ASSERT_MSG_SIZE(mess_netdriver_ndev_reply);
 
+typedef struct {
+	uint32_t id;
+	uint32_t count;
+
+	uint8_t padding[48];
+} mess_netdriver_ndev_ring_reply;
+_ASSERT_MSG_SIZE(mess_netdriver_ndev_ring_reply);
+
 typedef struct {
 	uint32_t id;
 	uint32_t link;
@@ -2585,9 +2629,11 @@ typedef struct noxfer_message {
 		mess_ndev_netdriver_init m_ndev_netdriver_init;
 		mess_ndev_netdriver_conf m_ndev_netdriver_conf;
 		mess_ndev_netdriver_transfer m_ndev_netdriver_transfer;
+		mess_ndev_netdriver_ring m_ndev_netdriver_ring;
 		mess_ndev_netdriver_status_reply m_ndev_netdriver_status_reply;
 		mess_netdriver_ndev_init_reply m_netdriver_ndev_init_reply;
 		mess_netdriver_ndev_reply m_netdriver_ndev_reply;
+		mess_netdriver_ndev_ring_reply m_netdriver_ndev_ring_reply;
 		mess_netdriver_ndev_status m_netdriver_ndev_status;
 		mess_net_netdrv_dl_conf m_net_netdrv_dl_conf;
 		mess_net_netdrv_dl_getstat_s m_net_netdrv_dl_getstat_s;
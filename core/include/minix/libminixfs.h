@@ -8,6 +8,10 @@
 /* Maximum number of blocks that will be considered by lmfs_prefetch() */
 #define LMFS_MAX_PREFETCH	NR_IOREQS
 
+/* Default and maximum number of outstanding block transfer requests */
+#define LMFS_DEF_IODEPTH	4
+#define LMFS_MAX_IODEPTH	16
+
 struct buf {
   /* Data portion of the buffer. */
   void *data;
@@ -39,6 +43,7 @@ size_t lmfs_fs_block_size(void);
 void lmfs_may_use_vmcache(int);
 void lmfs_set_blocksize(size_t blocksize);
 void lmfs_buf_pool(int new_nr_bufs);
+void lmfs_set_iodepth(unsigned int depth);
 int lmfs_get_block(struct buf **bpp, dev_t dev, block64_t block, int how);
 int lmfs_get_block_ino(struct buf **bpp, dev_t dev, block64_t block, int how,
 	ino_t ino, u64_t off);
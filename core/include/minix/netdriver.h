@@ -63,6 +63,10 @@ void netdriver_copyin(struct netdriver_data * __restrict data, size_t off,
 void netdriver_copyout(struct netdriver_data * __restrict data, size_t off,
 	const void * __restrict ptr, size_t size);
 
+int netdriver_get_csum(const struct netdriver_data * data, size_t * start,
+	size_t * off);
+void netdriver_set_rxflags(struct netdriver_data * data, uint32_t flags);
+
 void netdriver_portinb(struct netdriver_data * data, size_t off, long port,
 	size_t size);
 void netdriver_portoutb(struct netdriver_data * data, size_t off, long port,
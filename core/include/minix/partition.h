@@ -20,4 +20,12 @@ struct part_geom {
   unsigned sectors;
 };
 
+/* Byte range within a partition, for use with the DIOCDISCARD and DIOCZERO
+ * ioctl's.
+ */
+struct part_range {
+  u64_t base;		/* byte offset from the partition start */
+  u64_t size;		/* number of bytes in the range */
+};
+
 #endif /* _MINIX__PARTITION_H */
@@ -2,6 +2,7 @@
 #define _MINIX_SOCKEVENT_H
 
 #include <minix/sockdriver.h>
+#include <minix/timers.h>
 
 /* Socket events. */
 #define SEV_BIND	0x01	/* a pending bind operation has ended */
@@ -16,7 +17,6 @@
 #define SFL_SHUT_WR	0x02	/* socket has been shut down for writing */
 #define SFL_CLOSING	0x04	/* socket close operation in progress */
 #define SFL_CLONED	0x08	/* socket has been cloned but not accepted */
-#define SFL_TIMER	0x10	/* socket is on list of timers */
 
 /*
  * Special return value from sop_recv callback functions.  This pseudo-value
@@ -44,7 +44,7 @@ struct sock {
 	const struct sockevent_ops *sock_ops;	/* socket operations table */
 	SIMPLEQ_ENTRY(sock) sock_next;		/* list for pending events */
 	SLIST_ENTRY(sock) sock_hash;		/* list for hash table */
-	SLIST_ENTRY(sock) sock_timer;		/* list of socks with timers */
+	minix_timer_t sock_timer;		/* timer for socket timeouts */
 	struct sockevent_proc *sock_proc;	/* list of suspended calls */
 	struct sockdriver_select sock_select;	/* pending select query */
 	unsigned int sock_selops;	/* pending select operations, or 0 */
@@ -62,6 +62,7 @@ double getidle(void);
 void util_stacktrace(void);
 int micro_delay(u32_t micros);
 u32_t tsc_64_to_micros(u64_t tsc);
+u64_t tsc_64_to_micros64(u64_t tsc);
 u32_t tsc_to_micros(u32_t low, u32_t high);
 u32_t tsc_get_khz(void);
 u32_t micros_to_ticks(u32_t micros);
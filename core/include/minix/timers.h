@@ -1,6 +1,6 @@
 /* This library provides generic watchdog timer management functionality.
  * The functions operate on a timer queue provided by the caller. Note that
- * the timers must use absolute time to allow sorting. The library provides:
+ * the timers must use absolute time. The library provides:
  *
  *    tmrs_settimer:     (re)set a new watchdog timer in the timers queue
  *    tmrs_clrtimer:     remove a timer from both the timers queue
@@ -32,11 +32,33 @@ typedef void (*tmr_func_t)(int arg);
 typedef struct minix_timer
 {
   struct minix_timer	*tmr_next;	/* next in a timer chain */
+  struct minix_timer	**tmr_prev;	/* link to timer, NULL if not queued */
   clock_t 		tmr_exp_time;	/* expiration time (absolute) */
   tmr_func_t		tmr_func;	/* function to call when expired */
   int			tmr_arg;	/* integer argument */
+  unsigned char		tmr_level;	/* timer wheel level */
+  unsigned char		tmr_slot;	/* timer wheel slot */
 } minix_timer_t;
 
+/* A timers queue is a hierarchical timing wheel. Each slot at level N covers
+ * 64^N clock ticks. A timer is put on the lowest level that can hold its
+ * expiry time, and moved down as the wheel reaches the start of its slot, so
+ * that setting and clearing a timer take constant time. A zero-filled
+ * minix_timers_t structure is an empty queue.
+ */
+#define TMRS_BITS		6		/* log2 of # slots per level */
+#define TMRS_SLOTS		(1 << TMRS_BITS)	/* # slots per level */
+#define TMRS_LEVELS		4		/* # levels */
+
+typedef struct minix_timers
+{
+  minix_timer_t		*tmrs_slot[TMRS_LEVELS][TMRS_SLOTS];	/* chains */
+  u64_t			tmrs_map[TMRS_LEVELS];	/* bitmaps of slots in use */
+  clock_t		tmrs_now;	/* time up to which wheel is done */
+  clock_t		tmrs_head;	/* next time the wheel must move */
+  unsigned int		tmrs_count;	/* number of timers on the wheel */
+} minix_timers_t;
+
 /*
  * Clock times may wrap.  Thus, we must only ever compare relative times, which
  * means they must be no more than half the total maximum time value apart.
@@ -57,21 +79,32 @@ typedef struct minix_timer
 #define tmr_is_first(a,b)	((clock_t)(b) - (clock_t)(a) <= TMRDIFF_MAX)
 #define tmr_has_expired(tp,now)	tmr_is_first((tp)->tmr_exp_time, (now))
 
+/* tmrs_has_expired() returns TRUE iff the given timers queue must be processed
+ * with tmrs_exptimers() at the given time. This may be slightly before any of
+ * its timers actually expire, namely when timers must be moved down the wheel.
+ */
+#define tmrs_has_expired(tmrs,now) \
+	((tmrs)->tmrs_count > 0 && tmr_is_first((tmrs)->tmrs_head, (now)))
+
 /* Timers should be initialized once before they are being used. Be careful
  * not to reinitialize a timer that is in a list of timers, or the chain
  * will be broken.
  */
-#define tmr_inittimer(tp) (void)((tp)->tmr_func = NULL, (tp)->tmr_next = NULL)
+#define tmr_inittimer(tp) (void)((tp)->tmr_func = NULL, (tp)->tmr_next = NULL, \
+	(tp)->tmr_prev = NULL)
 
 /* The following generic timer management functions are available. They
- * can be used to operate on the lists of timers. Adding a timer to a list
- * automatically takes care of removing it.
+ * can be used to operate on queues of timers. Adding a timer to a queue
+ * automatically takes care of removing it. The head times they return are the
+ * times at which the queue must next be processed, which the caller should
+ * use to schedule its alarm.
  */
-int tmrs_settimer(minix_timer_t **tmrs, minix_timer_t *tp, clock_t exp_time,
-	tmr_func_t watchdog, int arg, clock_t *old_head, clock_t *new_head);
-int tmrs_clrtimer(minix_timer_t **tmrs, minix_timer_t *tp, clock_t *old_head,
+int tmrs_settimer(minix_timers_t *tmrs, minix_timer_t *tp, clock_t exp_time,
+	clock_t now, tmr_func_t watchdog, int arg, clock_t *old_head,
+	clock_t *new_head);
+int tmrs_clrtimer(minix_timers_t *tmrs, minix_timer_t *tp, clock_t *old_head,
 	clock_t *new_head);
-int tmrs_exptimers(minix_timer_t **tmrs, clock_t now, clock_t *new_head);
+int tmrs_exptimers(minix_timers_t *tmrs, clock_t now, clock_t *new_head);
 
 #define PRINT_STATS(cum_spenttime, cum_instances) {		\
 		if(ex64hi(cum_spenttime)) { util_stacktrace(); printf(" ( ??? %lu %lu)\n",	\
@@ -33,6 +33,11 @@
 #define VIRTIO_STATUS_DRV_OK			0x04
 #define VIRTIO_STATUS_FAIL			0x80
 
+/* Ring features. These are handled by the library itself, but are used only
+ * if the driver lists them in its feature table with guest support set.
+ */
+#define VIRTIO_RING_F_INDIRECT_DESC	28
+#define VIRTIO_RING_F_EVENT_IDX		29
 
 /* Feature description */
 struct virtio_feature {
@@ -109,6 +114,13 @@ int virtio_from_queue(struct virtio_device *dev, int qidx, void **data,
 void virtio_irq_enable(struct virtio_device *dev);
 void virtio_irq_disable(struct virtio_device *dev);
 
+/*
+ * Ask the host to stop or resume interrupting for elements used on a queue,
+ * for example while polling it. After resuming, the caller must check the
+ * queue once more, as the host may have used elements in the meantime.
+ */
+void virtio_queue_intr(struct virtio_device *dev, int qidx, int enable);
+
 /* Checks the ISR field of the device and returns true if
  * the interrupt was for this device.
  */
@@ -11,5 +11,10 @@
 #define BIOCTRACEBUF	_IOW('b', 1, size_t)
 #define BIOCTRACECTL	_IOW('b', 2, int)
 #define BIOCTRACEGET	_IOR_BIG(3, btrace_entry[BTBUF_SIZE])
+#define BIOCSCHEDCTL	_IOW('b', 4, int)
+#define BIOCSCHEDGET	_IOR('b', 5, bsched_stats)
+#define BIOCTRACESTAT	_IOR('b', 6, btrace_stats)
+#define BIOCPOLLCTL	_IOW('b', 7, int)
+#define BIOCPOLLGET	_IOR('b', 8, bpoll_stats)
 
 #endif /* _S_I_BLOCK_H */
@@ -0,0 +1,27 @@
+/*	sys/ioc_cow.h - Copy-On-Write block device ioctl() command codes.
+ *
+ */
+
+#ifndef _S_I_COW_H
+#define _S_I_COW_H
+
+#include <minix/ioctl.h>
+
+/* COW overlay statistics. */
+struct cow_stat {
+	u64_t size;		/* size of the device, in bytes */
+	u32_t chunk;		/* allocation chunk size, in bytes */
+	u64_t used;		/* number of chunks held in the overlay */
+	u64_t base_read;	/* bytes read from the base device */
+	u64_t over_read;	/* bytes read from the overlay device */
+	u64_t over_write;	/* bytes written to the overlay device */
+	u64_t fills;		/* partially written chunks filled first */
+	u64_t commits;		/* number of completed commits */
+};
+
+/* The I/O control requests. These share the 'B' group with FBD. */
+#define COWCOMMIT	_IO('B', 8)			/* write back overlay */
+#define COWDISCARD	_IO('B', 9)			/* throw away overlay */
+#define COWGETSTAT	_IOR('B', 10, struct cow_stat)	/* get statistics */
+
+#endif /* _S_I_COW_H */
@@ -16,5 +16,7 @@
 #define DIOCFLUSH	_IO ('d', 8)
 #define DIOCSETWC	_IOW('d', 9, int)
 #define DIOCGETWC	_IOR('d', 10, int)
+#define DIOCDISCARD	_IOW('d', 11, struct part_range)
+#define DIOCZERO	_IOW('d', 12, struct part_range)
 
 #endif /* _S_I_DISK_H */
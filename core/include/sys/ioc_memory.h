@@ -9,6 +9,26 @@
 
 #include <minix/ioctl.h>
 
+/* Sparse RAM disk creation request, for MIOCRAMSPARSE. */
+struct ramdisk_sparse {
+	u64_t size;		/* size of the RAM disk in bytes */
+	u32_t flags;		/* RAMDISK_ flags, see below */
+};
+
+#define RAMDISK_COMPRESS	0x01	/* store pages compressed */
+
+/* RAM disk memory usage, as returned by MIOCRAMSTAT. */
+struct ramdisk_stat {
+	u64_t size;		/* size of the RAM disk in bytes */
+	u32_t flags;		/* RAMDISK_ flags of a sparse RAM disk */
+	u32_t pages;		/* number of pages holding data */
+	u32_t comp_pages;	/* number of those pages stored compressed */
+	u64_t stored_bytes;	/* memory used for page data */
+	u64_t meta_bytes;	/* memory used for bookkeeping */
+};
+
 #define MIOCRAMSIZE	_IOW('m', 3, u32_t)
+#define MIOCRAMSPARSE	_IOW('m', 4, struct ramdisk_sparse)
+#define MIOCRAMSTAT	_IOR('m', 5, struct ramdisk_stat)
 
 #endif /* _S_I_MEMORY_H */
@@ -34,7 +34,7 @@ static void load_update(void);
  * via (re)set_kernel_timer().
  * When a timer expires its watchdog function is run by the CLOCK task.
  */
-static minix_timer_t *clock_timers;	/* queue of CLOCK timers */
+static minix_timers_t clock_timers;	/* queue of CLOCK timers */
 
 /* Number of ticks to adjust realtime by. A negative value implies slowing
  * down realtime, a positive value implies speeding it up.
@@ -156,8 +156,7 @@ int timer_int_handler(void)
 		 * that clock tick values may overflow, so we must only look at
 		 * relative differences, and only if there are timers at all.
 		 */
-		if (clock_timers != NULL &&
-		    tmr_has_expired(clock_timers, kclockinfo.uptime))
+		if (tmrs_has_expired(&clock_timers, kclockinfo.uptime))
 			tmrs_exptimers(&clock_timers, kclockinfo.uptime, NULL);
 
 #ifdef DEBUG_SERIAL
@@ -236,7 +235,8 @@ void set_kernel_timer(
 /* Insert the new timer in the active timers list. Always update the
  * next timeout time by setting it to the front of the active list.
  */
-  (void)tmrs_settimer(&clock_timers, tp, exp_time, watchdog, arg, NULL, NULL);
+  (void)tmrs_settimer(&clock_timers, tp, exp_time, kclockinfo.uptime, watchdog,
+	arg, NULL, NULL);
 }
 
 /*===========================================================================*
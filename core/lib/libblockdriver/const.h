@@ -18,4 +18,21 @@
 #define MAIN_THREAD	(MAX_THREADS)			/* main thread ID */
 #define SINGLE_THREAD	(0)				/* single-thread ID */
 
+/* Request scheduling: deadlines (in milliseconds) after which a queued read
+ * or write request is handed out regardless of its position, and limits on
+ * the number and total size of requests merged into a single transfer.
+ */
+#define SCHED_READ_EXPIRE	50
+#define SCHED_WRITE_EXPIRE	500
+#define SCHED_MAX_MERGE		16
+#define SCHED_MAX_SIZE		(256 * 1024)
+
+/* Completion polling: the initial, minimum, and maximum amount of time (in
+ * microseconds) that the master thread spins waiting for completions before
+ * falling back to interrupts.
+ */
+#define POLL_BUDGET		50
+#define POLL_BUDGET_MIN		10
+#define POLL_BUDGET_MAX		400
+
 #endif /* _BLOCKDRIVER_CONST_H */
@@ -38,19 +38,54 @@
  */
 
 #include <minix/drivers.h>
-#include <minix/blockdriver.h>
+#include <minix/blockdriver_mt.h>
 #include <minix/ds.h>
 #include <sys/ioc_block.h>
 #include <sys/ioc_disk.h>
 
+#include "const.h"
 #include "driver.h"
 #include "mq.h"
+#include "poll.h"
 #include "trace.h"
 
 /* Management data for opened devices. */
 static int open_devs[MAX_NR_OPEN_DEVICES];
 static int next_open_devs_slot = 0;
 
+/* A request taking part in a merged transfer. */
+struct merge_req {
+  message mess;			/* request message */
+  int ipc_status;		/* IPC status of the request */
+  unsigned int first;		/* index of first element in merged vector */
+  unsigned int count;		/* number of vector elements */
+  u64_t pos;			/* starting position */
+  size_t size;			/* total size */
+};
+
+/* Per-thread state for merging transfer requests. It is allocated on first
+ * use, as thread stacks are too small to hold it.
+ */
+struct merge_state {
+  struct merge_req req[SCHED_MAX_MERGE];	/* merged requests */
+  iovec_t iovec[NR_IOREQS];			/* merged vector */
+  iovec_t work[NR_IOREQS];			/* copy given to driver */
+};
+
+/* Matching criteria for a request to merge. */
+struct merge_match {
+  const message *mess;		/* the request being dispatched */
+  u64_t start;			/* start of the merged range so far */
+  u64_t end;			/* end of the merged range so far */
+  unsigned int left;		/* number of vector elements left */
+  size_t room;			/* number of bytes left */
+  iovec_t *iovec;		/* buffer for the request's vector */
+  unsigned int count;		/* resulting number of vector elements */
+  size_t size;			/* resulting request size */
+};
+
+static struct merge_state *merge_state[MAX_THREADS + 1];
+
 /*===========================================================================*
  *				clear_open_devs				     *
  *===========================================================================*/
@@ -257,6 +292,223 @@ static int do_vrdwt(struct blockdriver *bdp, message *mp, thread_id_t id)
   return r;
 }
 
+/*===========================================================================*
+ *				get_vector				     *
+ *===========================================================================*/
+static int get_vector(const message *mp, iovec_t *iovec, unsigned int max,
+  unsigned int *count, size_t *size)
+{
+/* Construct the I/O vector for a transfer request, and compute its size.
+ * Vectors longer than the given maximum are truncated.
+ */
+  unsigned int i, nr_req;
+  ssize_t total;
+
+  if (mp->m_type == BDEV_READ || mp->m_type == BDEV_WRITE) {
+	if (mp->m_lbdev_lblockdriver_msg.count < 0) return EINVAL;
+
+	iovec[0].iov_addr = mp->m_lbdev_lblockdriver_msg.grant;
+	iovec[0].iov_size = mp->m_lbdev_lblockdriver_msg.count;
+
+	*count = 1;
+	*size = iovec[0].iov_size;
+
+	return OK;
+  }
+
+  nr_req = mp->m_lbdev_lblockdriver_msg.count;
+  if (nr_req > max) nr_req = max;
+
+  if (OK != sys_safecopyfrom(mp->m_source,
+		(vir_bytes) mp->m_lbdev_lblockdriver_msg.grant,
+		0, (vir_bytes) iovec, nr_req * sizeof(iovec[0])))
+	return EINVAL;
+
+  for (i = total = 0; i < nr_req; i++) {
+	if ((ssize_t) (total + iovec[i].iov_size) < total) return EINVAL;
+	total += iovec[i].iov_size;
+  }
+
+  *count = nr_req;
+  *size = total;
+
+  return OK;
+}
+
+/*===========================================================================*
+ *				is_write_req				     *
+ *===========================================================================*/
+static int is_write_req(const message *mp)
+{
+/* Return whether the given transfer request is a write request. */
+
+  return (mp->m_type == BDEV_WRITE || mp->m_type == BDEV_SCATTER);
+}
+
+/*===========================================================================*
+ *				merge_match				     *
+ *===========================================================================*/
+static int merge_match(const message *mp, void *arg)
+{
+/* See whether the given queued request can be merged into the transfer
+ * described by the given matching criteria. That is the case if it is for
+ * the same caller, device, direction and flags, and it lies right before or
+ * after the range covered so far, and it fits.
+ */
+  struct merge_match *mm = (struct merge_match *) arg;
+  const message *mp0 = mm->mess;
+  u64_t pos;
+
+  if (mp->m_source != mp0->m_source ||
+	mp->m_lbdev_lblockdriver_msg.minor !=
+		mp0->m_lbdev_lblockdriver_msg.minor ||
+	mp->m_lbdev_lblockdriver_msg.flags !=
+		mp0->m_lbdev_lblockdriver_msg.flags ||
+	is_write_req(mp) != is_write_req(mp0))
+	return FALSE;
+
+  pos = mp->m_lbdev_lblockdriver_msg.pos;
+
+  if (pos != mm->end && (pos >= mm->start || mm->start - pos > mm->room))
+	return FALSE;
+
+  if (get_vector(mp, mm->iovec, NR_IOREQS, &mm->count, &mm->size) != OK)
+	return FALSE;
+
+  if (mm->size == 0 || mm->count > mm->left || mm->size > mm->room)
+	return FALSE;
+
+  return (pos == mm->end || pos + mm->size == mm->start);
+}
+
+/*===========================================================================*
+ *				do_merged				     *
+ *===========================================================================*/
+static int do_merged(struct blockdriver *bdp, message *mp, device_id_t did,
+  thread_id_t id)
+{
+/* Carry out a transfer request with request scheduling enabled. Take any
+ * queued requests from the same caller that are adjacent to this one out of
+ * the queue, and perform them all as a single transfer. Each merged request
+ * gets its own reply. If the merged transfer fails or comes up short, the
+ * requests that were not completed are retried one by one, so that each of
+ * them gets the same result as it would have gotten without merging.
+ */
+  struct merge_state *st;
+  struct merge_match mm;
+  struct merge_req *rq;
+  iovec_t iovec[NR_IOREQS];
+  unsigned int i, n, count;
+  u64_t start, end, tsc;
+  size_t size;
+  ssize_t r, res, result;
+  int do_write;
+
+  if ((st = merge_state[id]) == NULL &&
+	(st = merge_state[id] = malloc(sizeof(*st))) == NULL)
+	return ENOMEM;
+
+  /* Start off with the request being dispatched. */
+  rq = &st->req[0];
+  if ((r = get_vector(mp, st->iovec, NR_IOREQS, &rq->count, &rq->size)) != OK)
+	return r;
+
+  rq->mess = *mp;
+  rq->first = 0;
+  rq->pos = mp->m_lbdev_lblockdriver_msg.pos;
+
+  trace_setsize(id, rq->size);
+
+  start = rq->pos;
+  end = start + rq->size;
+  count = rq->count;
+  size = rq->size;
+
+  /* Pull in adjacent requests, in front or at the back. */
+  for (n = 1; n < SCHED_MAX_MERGE && size < SCHED_MAX_SIZE; n++) {
+	mm.mess = mp;
+	mm.start = start;
+	mm.end = end;
+	mm.left = NR_IOREQS - count;
+	mm.room = SCHED_MAX_SIZE - size;
+	mm.iovec = iovec;
+
+	if (mm.left == 0 || st->req[0].size == 0)
+		break;
+
+	rq = &st->req[n];
+
+	if (!mq_dequeue_match(did, merge_match, &mm, &rq->mess,
+		&rq->ipc_status))
+		break;
+
+	rq->pos = rq->mess.m_lbdev_lblockdriver_msg.pos;
+	rq->count = mm.count;
+	rq->size = mm.size;
+
+	if (rq->pos == end) {
+		rq->first = count;
+		end += rq->size;
+	} else {
+		memmove(&st->iovec[mm.count], &st->iovec[0],
+			count * sizeof(st->iovec[0]));
+		for (i = 0; i < n; i++)
+			st->req[i].first += mm.count;
+		rq->first = 0;
+		start = rq->pos;
+	}
+
+	memcpy(&st->iovec[rq->first], iovec, mm.count * sizeof(iovec[0]));
+
+	count += mm.count;
+	size += mm.size;
+  }
+
+  /* Perform the (merged) transfer. The driver may modify the vector, so it
+   * gets a copy.
+   */
+  do_write = is_write_req(mp);
+
+  memcpy(st->work, st->iovec, count * sizeof(st->iovec[0]));
+
+  mq_sched_dispatch(did, end);
+
+  read_tsc_64(&tsc);
+
+  r = (*bdp->bdr_transfer)(mp->m_lbdev_lblockdriver_msg.minor, do_write,
+	start, mp->m_source, st->work, count, mp->m_lbdev_lblockdriver_msg.flags);
+
+  mq_sched_done(did, tsc);
+
+  if (n == 1)
+	return r;
+
+  /* Hand out the results. */
+  result = r;
+
+  for (i = 0; i < n; i++) {
+	rq = &st->req[i];
+
+	if (r >= 0 && (u64_t) r >= rq->pos - start + rq->size) {
+		res = rq->size;
+	} else {
+		memcpy(st->work, &st->iovec[rq->first],
+			rq->count * sizeof(st->iovec[0]));
+
+		res = (*bdp->bdr_transfer)(mp->m_lbdev_lblockdriver_msg.minor,
+			do_write, rq->pos, mp->m_source, st->work, rq->count,
+			mp->m_lbdev_lblockdriver_msg.flags);
+	}
+
+	if (i == 0)
+		result = res;
+	else
+		blockdriver_reply(&rq->mess, rq->ipc_status, res);
+  }
+
+  return result;
+}
+
 /*===========================================================================*
  *				do_dioctl				     *
  *===========================================================================*/
@@ -320,6 +572,7 @@ static int do_ioctl(struct blockdriver *bdp, message *mp)
   unsigned long request;
   cp_grant_id_t grant;
   endpoint_t user_endpt;
+  device_id_t did;
   int r;
 
   minor = mp->m_lbdev_lblockdriver_msg.minor;
@@ -331,11 +584,30 @@ static int do_ioctl(struct blockdriver *bdp, message *mp)
   case BIOCTRACEBUF:
   case BIOCTRACECTL:
   case BIOCTRACEGET:
+  case BIOCTRACESTAT:
 	/* Block trace control. */
 	r = trace_ctl(minor, request, mp->m_source, grant);
 
 	break;
 
+  case BIOCSCHEDCTL:
+  case BIOCSCHEDGET:
+	/* Request scheduler control, for multithreaded drivers only. */
+	if (bdp->bdr_device == NULL ||
+		(*bdp->bdr_device)(minor, &did) != OK)
+		r = ENOTTY;
+	else
+		r = mq_sched_ctl(did, request, mp->m_source, grant);
+
+	break;
+
+  case BIOCPOLLCTL:
+  case BIOCPOLLGET:
+	/* Completion polling control, for the whole driver. */
+	r = poll_ctl(request, mp->m_source, grant);
+
+	break;
+
   case DIOCSETP:
   case DIOCGETP:
 	/* Handle disk-specific IOCTLs only for disk-type drivers. */
@@ -385,6 +657,7 @@ void blockdriver_process_on_thread(struct blockdriver *bdp, message *m_ptr,
  * a result code to the caller. The call is processed in the context of the
  * given thread ID, which may be SINGLE_THREAD for single-threaded callers.
  */
+  device_id_t did;
   int r;
 
   /* Check for notifications first. We never reply to notifications. */
@@ -441,9 +714,19 @@ void blockdriver_process_on_thread(struct blockdriver *bdp, message *m_ptr,
   case BDEV_OPEN:	r = do_open(bdp, m_ptr);	break;
   case BDEV_CLOSE:	r = do_close(bdp, m_ptr);	break;
   case BDEV_READ:
-  case BDEV_WRITE:	r = do_rdwt(bdp, m_ptr);	break;
+  case BDEV_WRITE:
   case BDEV_GATHER:
-  case BDEV_SCATTER:	r = do_vrdwt(bdp, m_ptr, id);	break;
+  case BDEV_SCATTER:
+	/* With request scheduling, transfers may be merged. */
+	if (bdp->bdr_device != NULL && (*bdp->bdr_device)
+		(m_ptr->m_lbdev_lblockdriver_msg.minor, &did) == OK &&
+		mq_sched_enabled(did))
+		r = do_merged(bdp, m_ptr, did, id);
+	else if (m_ptr->m_type == BDEV_READ || m_ptr->m_type == BDEV_WRITE)
+		r = do_rdwt(bdp, m_ptr);
+	else
+		r = do_vrdwt(bdp, m_ptr, id);
+	break;
   case BDEV_IOCTL:	r = do_ioctl(bdp, m_ptr);	break;
   default:
 	if (bdp->bdr_other != NULL)
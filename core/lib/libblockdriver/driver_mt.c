@@ -13,12 +13,15 @@
 
 #include <minix/blockdriver_mt.h>
 #include <minix/mthread.h>
+#include <minix/sysutil.h>
+#include <minix/minlib.h>
 #include <assert.h>
 
 #include "const.h"
 #include "driver.h"
 #include "driver_mt.h"
 #include "mq.h"
+#include "poll.h"
 
 /* A thread ID is composed of a device ID and a per-device worker thread ID.
  * All thread IDs must be in the range 0..(MAX_THREADS-1) inclusive.
@@ -64,6 +67,8 @@ static device_t device[MAX_DEVICES];
 static worker_t *exited[MAX_THREADS];
 static int num_exited = 0;
 
+static unsigned int num_busy = 0;	/* number of busy worker threads */
+
 /*===========================================================================*
  *				enqueue					     *
  *===========================================================================*/
@@ -175,6 +180,7 @@ static void *worker_thread(void *param)
 
 	/* Even if the thread was stopped before, a new message resumes it. */
 	wp->state = STATE_BUSY;
+	num_busy++;
 
 	/* If the request is a transfer request, we acquire the read barrier
 	 * lock. Otherwise, we acquire the write lock.
@@ -189,6 +195,7 @@ static void *worker_thread(void *param)
 
 	/* Switch the thread back to running state, and unlock the barrier. */
 	wp->state = STATE_RUNNING;
+	num_busy--;
 	mthread_rwlock_unlock(&dp->barrier);
   }
 
@@ -307,6 +314,9 @@ static void master_handle_message(message *m_ptr, int ipc_status)
    * it either. In that case, the master thread has to handle it instead.
    */
   if (is_ipc_notify(ipc_status) || !IS_BDEV_RQ(m_ptr->m_type)) {
+	if (is_ipc_notify(ipc_status) && m_ptr->m_source == HARDWARE)
+		poll_intr();
+
 	/* Process as 'other' message. */
 	blockdriver_process_on_thread(bdtab, m_ptr, ipc_status, MAIN_THREAD);
 
@@ -372,6 +382,13 @@ static void master_init(struct blockdriver *bdp)
 		device[i].worker[j].state = STATE_DEAD;
   }
 
+  /* All requests are queued, so request scheduling may be used. */
+  mq_allow_sched();
+
+  /* Completions may be polled for if the driver supports it. */
+  if (bdp->bdr_poll != NULL)
+	poll_allow();
+
   /* Initialize a per-thread key, where each worker thread stores its own
    * reference to the worker structure.
    */
@@ -411,6 +428,65 @@ static void blockdriver_mt_receive(message *m_ptr, int *ipc_status)
 	panic("blockdriver_mt: sef_receive_status() returned %d", r);
 }
 
+/*===========================================================================*
+ *				master_poll				     *
+ *===========================================================================*/
+static void master_poll(void)
+{
+/* If completion polling is enabled and requests are in progress, poll the
+ * driver for completions until some are found or the spin budget runs out,
+ * rather than waiting for an interrupt. Completed requests are handed back to
+ * their worker threads right away. There is no nonblocking receive, so new
+ * messages have to wait for the end of the round; the budget bounds the delay.
+ * Afterwards, the driver is told to make sure that its interrupts are enabled,
+ * upon which it checks for completions once more.
+ */
+  unsigned int polls, hits, completions;
+  u64_t start, now;
+  u32_t budget;
+  int n, reason;
+
+  if (!poll_enabled() || num_busy == 0)
+	return;
+
+  budget = poll_budget();
+  polls = hits = completions = 0;
+
+  read_tsc_64(&start);
+
+  for (;;) {
+	n = (*bdtab->bdr_poll)(TRUE);
+	polls++;
+
+	if (n > 0) {
+		hits++;
+		completions += n;
+
+		master_yield();
+
+		reason = POLL_HIT;
+
+		break;
+	}
+
+	read_tsc_64(&now);
+
+	if (tsc_64_to_micros(now - start) >= budget) {
+		reason = POLL_TIMEOUT;
+
+		break;
+	}
+  }
+
+  if ((n = (*bdtab->bdr_poll)(FALSE)) > 0) {
+	completions += n;
+
+	master_yield();
+  }
+
+  poll_done(reason, polls, hits, completions);
+}
+
 /*===========================================================================*
  *				blockdriver_mt_task			     *
  *===========================================================================*/
@@ -430,6 +506,9 @@ void blockdriver_mt_task(struct blockdriver *driver_tab)
 
   /* The main message loop. */
   while (running) {
+	/* Poll for completions first, if requested. */
+	master_poll();
+
 	/* Receive a message. */
 	blockdriver_mt_receive(&mess, &ipc_status);
 
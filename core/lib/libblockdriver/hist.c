@@ -0,0 +1,22 @@
+/* This file contains the histogram support shared by the tracing and request
+ * scheduling statistics. All histograms use power-of-two buckets.
+ */
+
+#include <minix/drivers.h>
+
+#include "hist.h"
+
+/*===========================================================================*
+ *				hist_add				     *
+ *===========================================================================*/
+void hist_add(u32_t *hist, unsigned int buckets, u64_t value)
+{
+/* Add a value to a histogram of the given number of buckets. Bucket N counts
+ * values below 2^(N+1); the last bucket counts everything else.
+ */
+  unsigned int i;
+
+  for (i = 0; i < buckets - 1 && (value >> (i + 1)) != 0; i++);
+
+  hist[i]++;
+}
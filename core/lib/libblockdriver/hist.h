@@ -0,0 +1,6 @@
+#ifndef _BLOCKDRIVER_HIST_H
+#define _BLOCKDRIVER_HIST_H
+
+void hist_add(u32_t *hist, unsigned int buckets, u64_t value);
+
+#endif /* _BLOCKDRIVER_HIST_H */
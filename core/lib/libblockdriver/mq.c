@@ -1,5 +1,9 @@
 /* This file contains a simple message queue implementation to support both
- * the singlethread and the multithreaded driver implementation.
+ * the singlethread and the multithreaded driver implementation. For the
+ * multithreaded implementation, it also contains an optional request
+ * scheduler, which hands out transfer requests in disk order rather than
+ * arrival order, subject to a deadline, and allows adjacent requests to be
+ * taken out of the queue so that they can be merged into a single transfer.
  *
  * Changes:
  *   Oct 27, 2011   rewritten to use sys/queue.h (D.C. van Moolenbroek)
@@ -7,10 +11,16 @@
  */
 
 #include <minix/blockdriver_mt.h>
+#include <minix/btrace.h>
+#include <minix/sysutil.h>
+#include <minix/minlib.h>
 #include <sys/queue.h>
+#include <sys/ioc_block.h>
 #include <assert.h>
+#include <string.h>
 
 #include "const.h"
+#include "hist.h"
 #include "mq.h"
 
 #define MQ_SIZE		128
@@ -18,9 +28,20 @@
 struct mq_cell {
   message mess;
   int ipc_status;
+  clock_t deadline;		/* dispatch deadline, if scheduling */
+  u64_t stamp;			/* TSC value at enqueue time */
   STAILQ_ENTRY(mq_cell) next;
 };
 
+/* Per-device request scheduling state. */
+static struct {
+  int enabled;			/* is request scheduling enabled? */
+  u64_t head;			/* position right after the last dispatch */
+  bsched_stats stats;		/* statistics */
+} sched[MAX_DEVICES];
+
+static int sched_allowed = FALSE;
+
 static struct mq_cell pool[MQ_SIZE];
 static STAILQ_HEAD(queue, mq_cell) queue[MAX_DEVICES];
 static STAILQ_HEAD(free_list, mq_cell) free_list;
@@ -43,6 +64,26 @@ void mq_init(void)
 	STAILQ_INSERT_HEAD(&free_list, &pool[i], next);
 }
 
+/*===========================================================================*
+ *				is_transfer				     *
+ *===========================================================================*/
+static int is_transfer(const message *mess)
+{
+/* Return whether the given message is a block transfer request.
+ */
+
+  switch (mess->m_type) {
+  case BDEV_READ:
+  case BDEV_WRITE:
+  case BDEV_GATHER:
+  case BDEV_SCATTER:
+	return TRUE;
+
+  default:
+	return FALSE;
+  }
+}
+
 /*===========================================================================*
  *				mq_enqueue				     *
  *===========================================================================*/
@@ -53,6 +94,7 @@ int mq_enqueue(device_id_t device_id, const message *mess,
  * Return TRUE iff the message was added successfully.
  */
   struct mq_cell *cell;
+  clock_t expire;
 
   assert(device_id >= 0 && device_id < MAX_DEVICES);
 
@@ -65,6 +107,20 @@ int mq_enqueue(device_id_t device_id, const message *mess,
   cell->mess = *mess;
   cell->ipc_status = ipc_status;
 
+  if (sched[device_id].enabled) {
+	/* Reads are usually waited for, writes are usually not. */
+	if (mess->m_type == BDEV_READ || mess->m_type == BDEV_GATHER)
+		expire = SCHED_READ_EXPIRE;
+	else
+		expire = SCHED_WRITE_EXPIRE;
+
+	cell->deadline = getticks() + (expire * sys_hz() + 999) / 1000;
+
+	read_tsc_64(&cell->stamp);
+
+	sched[device_id].stats.queued++;
+  }
+
   STAILQ_INSERT_TAIL(&queue[device_id], cell, next);
 
   return TRUE;
@@ -83,6 +139,89 @@ int mq_isempty(device_id_t device_id)
   return STAILQ_EMPTY(&queue[device_id]);
 }
 
+/*===========================================================================*
+ *				sched_account				     *
+ *===========================================================================*/
+static void sched_account(u32_t *hist, u64_t start)
+{
+/* Add the time elapsed since the given TSC value, in microseconds, to a
+ * latency histogram.
+ */
+  u64_t now;
+
+  read_tsc_64(&now);
+
+  hist_add(hist, BSCHED_BUCKETS, tsc_64_to_micros64(now - start));
+}
+
+/*===========================================================================*
+ *				sched_remove				     *
+ *===========================================================================*/
+static void sched_remove(device_id_t device_id, struct mq_cell *cell,
+  message *mess, int *ipc_status)
+{
+/* Take a cell out of a device queue, and return its contents.
+ */
+
+  STAILQ_REMOVE(&queue[device_id], cell, mq_cell, next);
+
+  *mess = cell->mess;
+  *ipc_status = cell->ipc_status;
+
+  if (sched[device_id].enabled && sched[device_id].stats.queued > 0) {
+	sched[device_id].stats.queued--;
+
+	sched_account(sched[device_id].stats.wait, cell->stamp);
+  }
+
+  STAILQ_INSERT_HEAD(&free_list, cell, next);
+}
+
+/*===========================================================================*
+ *				sched_pick				     *
+ *===========================================================================*/
+static struct mq_cell *sched_pick(device_id_t device_id)
+{
+/* Pick the next cell to hand out from a device queue. Among the transfer
+ * requests at the front of the queue, up to the first request of any other
+ * kind, take the oldest one if its deadline has passed, or otherwise the one
+ * with the lowest position at or after the current head position, wrapping
+ * around to the lowest position overall if there is none.
+ */
+  struct mq_cell *cell, *first, *best, *lowest;
+  u64_t pos;
+
+  first = STAILQ_FIRST(&queue[device_id]);
+
+  if (first == NULL || !is_transfer(&first->mess))
+	return first;
+
+  if ((long) (getticks() - first->deadline) >= 0) {
+	sched[device_id].stats.expired++;
+
+	return first;
+  }
+
+  best = lowest = NULL;
+
+  STAILQ_FOREACH(cell, &queue[device_id], next) {
+	if (!is_transfer(&cell->mess))
+		break;
+
+	pos = cell->mess.m_lbdev_lblockdriver_msg.pos;
+
+	if (lowest == NULL ||
+	    pos < lowest->mess.m_lbdev_lblockdriver_msg.pos)
+		lowest = cell;
+
+	if (pos >= sched[device_id].head && (best == NULL ||
+	    pos < best->mess.m_lbdev_lblockdriver_msg.pos))
+		best = cell;
+  }
+
+  return (best != NULL) ? best : lowest;
+}
+
 /*===========================================================================*
  *				mq_dequeue				     *
  *===========================================================================*/
@@ -96,13 +235,171 @@ int mq_dequeue(device_id_t device_id, message *mess, int *ipc_status)
   if (mq_isempty(device_id))
 	return FALSE;
 
-  cell = STAILQ_FIRST(&queue[device_id]);
-  STAILQ_REMOVE_HEAD(&queue[device_id], next);
-
-  *mess = cell->mess;
-  *ipc_status = cell->ipc_status;
+  if (sched[device_id].enabled)
+	cell = sched_pick(device_id);
+  else
+	cell = STAILQ_FIRST(&queue[device_id]);
 
-  STAILQ_INSERT_HEAD(&free_list, cell, next);
+  sched_remove(device_id, cell, mess, ipc_status);
 
   return TRUE;
 }
+
+/*===========================================================================*
+ *				mq_dequeue_match			     *
+ *===========================================================================*/
+int mq_dequeue_match(device_id_t device_id,
+  int (*match)(const message *, void *), void *arg, message *mess,
+  int *ipc_status)
+{
+/* Find a transfer request in the front part of the given device's queue,
+ * that is, before any request of another kind, for which the given function
+ * returns TRUE. If one is found, return and remove it, and return TRUE.
+ * Return FALSE otherwise. Only used with request scheduling enabled.
+ */
+  struct mq_cell *cell;
+
+  assert(device_id >= 0 && device_id < MAX_DEVICES);
+
+  if (!sched[device_id].enabled)
+	return FALSE;
+
+  STAILQ_FOREACH(cell, &queue[device_id], next) {
+	if (!is_transfer(&cell->mess))
+		break;
+
+	if (match(&cell->mess, arg)) {
+		sched_remove(device_id, cell, mess, ipc_status);
+
+		sched[device_id].stats.merged++;
+
+		return TRUE;
+	}
+  }
+
+  return FALSE;
+}
+
+/*===========================================================================*
+ *				mq_allow_sched				     *
+ *===========================================================================*/
+void mq_allow_sched(void)
+{
+/* Allow request scheduling to be enabled. Only the multithreaded driver
+ * implementation queues all requests, so only it can benefit.
+ */
+
+  sched_allowed = TRUE;
+}
+
+/*===========================================================================*
+ *				mq_sched_enabled			     *
+ *===========================================================================*/
+int mq_sched_enabled(device_id_t device_id)
+{
+/* Return whether request scheduling is enabled for the given device.
+ */
+
+  assert(device_id >= 0 && device_id < MAX_DEVICES);
+
+  return sched[device_id].enabled;
+}
+
+/*===========================================================================*
+ *				mq_sched_dispatch			     *
+ *===========================================================================*/
+void mq_sched_dispatch(device_id_t device_id, u64_t end)
+{
+/* A transfer ending at the given position is about to be started. Requests
+ * at or beyond that position will be handed out first.
+ */
+
+  assert(device_id >= 0 && device_id < MAX_DEVICES);
+
+  sched[device_id].head = end;
+  sched[device_id].stats.dispatched++;
+}
+
+/*===========================================================================*
+ *				mq_sched_done				     *
+ *===========================================================================*/
+void mq_sched_done(device_id_t device_id, u64_t start)
+{
+/* A transfer started at the given TSC time has completed.
+ */
+
+  assert(device_id >= 0 && device_id < MAX_DEVICES);
+
+  if (sched[device_id].enabled)
+	sched_account(sched[device_id].stats.service, start);
+}
+
+/*===========================================================================*
+ *				mq_sched_ctl				     *
+ *===========================================================================*/
+int mq_sched_ctl(device_id_t device_id, unsigned long request,
+  endpoint_t endpt, cp_grant_id_t grant)
+{
+/* Process a request scheduler control request.
+ */
+  struct mq_cell *cell;
+  int r, ctl;
+
+  assert(device_id >= 0 && device_id < MAX_DEVICES);
+
+  switch (request) {
+  case BIOCSCHEDCTL:
+	if ((r = sys_safecopyfrom(endpt, grant, 0, (vir_bytes) &ctl,
+		sizeof(ctl))) != OK)
+		return r;
+
+	switch (ctl) {
+	case BSCHED_OFF:
+	case BSCHED_ON:
+		if (!sched_allowed) return ENOTTY;
+
+		if (ctl == sched[device_id].enabled) return OK;
+
+		/* Give any requests that are already queued an expired
+		 * deadline, so that they are handed out first.
+		 */
+		sched[device_id].stats.queued = 0;
+
+		if (ctl == BSCHED_ON) {
+			STAILQ_FOREACH(cell, &queue[device_id], next) {
+				cell->deadline = getticks();
+				read_tsc_64(&cell->stamp);
+				sched[device_id].stats.queued++;
+			}
+		}
+
+		sched[device_id].enabled = (ctl == BSCHED_ON);
+
+		return OK;
+
+	case BSCHED_RESET:
+		/* Keep the number of requests currently queued. */
+		ctl = sched[device_id].stats.queued;
+
+		memset(&sched[device_id].stats, 0,
+		    sizeof(sched[device_id].stats));
+
+		sched[device_id].stats.queued = ctl;
+
+		return OK;
+
+	default:
+		return EINVAL;
+	}
+
+  case BIOCSCHEDGET:
+	sched[device_id].stats.enabled = sched[device_id].enabled;
+
+	return sys_safecopyto(endpt, grant, 0,
+	    (vir_bytes) &sched[device_id].stats,
+	    sizeof(sched[device_id].stats));
+
+  default:
+	return EINVAL;
+  }
+}
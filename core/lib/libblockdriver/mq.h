@@ -6,5 +6,14 @@ int mq_enqueue(device_id_t device_id, const message *mess, int
 	ipc_status);
 int mq_dequeue(device_id_t device_id, message *mess, int *ipc_status);
 int mq_isempty(device_id_t device_id);
+int mq_dequeue_match(device_id_t device_id,
+	int (*match)(const message *, void *), void *arg, message *mess,
+	int *ipc_status);
+void mq_allow_sched(void);
+int mq_sched_enabled(device_id_t device_id);
+void mq_sched_dispatch(device_id_t device_id, u64_t end);
+void mq_sched_done(device_id_t device_id, u64_t start);
+int mq_sched_ctl(device_id_t device_id, unsigned long request,
+	endpoint_t endpt, cp_grant_id_t grant);
 
 #endif /* _BLOCKDRIVER_MQ_H */
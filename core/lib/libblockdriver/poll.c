@@ -0,0 +1,144 @@
+/* This file contains the state and control of optional completion polling.
+ * With polling enabled, the master thread of a multithreaded driver that has
+ * requests in progress spins on the driver's poll routine for a bounded amount
+ * of time, rather than waiting for an interrupt and the resulting kernel
+ * notification. The spin budget adapts to how often polling pays off: it grows
+ * whenever completions are found, and shrinks whenever it runs out without
+ * finding any, so that an idle or slow device is soon served by interrupts
+ * again. The polling loop itself is part of driver_mt.c.
+ */
+
+#include <minix/drivers.h>
+#include <minix/blockdriver.h>
+#include <minix/btrace.h>
+#include <sys/ioc_block.h>
+#include <string.h>
+
+#include "const.h"
+#include "poll.h"
+
+static int poll_allowed = FALSE;
+static bpoll_stats poll_stats = { .budget = POLL_BUDGET };
+
+/*===========================================================================*
+ *				poll_allow				     *
+ *===========================================================================*/
+void poll_allow(void)
+{
+/* Allow completion polling to be enabled. This requires a multithreaded
+ * driver that provides a poll routine.
+ */
+
+  poll_allowed = TRUE;
+}
+
+/*===========================================================================*
+ *				poll_enabled				     *
+ *===========================================================================*/
+int poll_enabled(void)
+{
+/* Return whether completion polling is enabled.
+ */
+
+  return poll_stats.enabled;
+}
+
+/*===========================================================================*
+ *				poll_budget				     *
+ *===========================================================================*/
+u32_t poll_budget(void)
+{
+/* Return the current spin budget, in microseconds.
+ */
+
+  return poll_stats.budget;
+}
+
+/*===========================================================================*
+ *				poll_intr				     *
+ *===========================================================================*/
+void poll_intr(void)
+{
+/* An interrupt notification has been received.
+ */
+
+  poll_stats.intrs++;
+}
+
+/*===========================================================================*
+ *				poll_done				     *
+ *===========================================================================*/
+void poll_done(int reason, unsigned int polls, unsigned int hits,
+  unsigned int completions)
+{
+/* A polling round has ended for the given reason. Update statistics, and
+ * adjust the spin budget for the next round.
+ */
+
+  poll_stats.rounds++;
+  poll_stats.polls += polls;
+  poll_stats.hits += hits;
+  poll_stats.completions += completions;
+
+  if (reason == POLL_TIMEOUT)
+	poll_stats.timeouts++;
+
+  if (hits > 0) {
+	if (poll_stats.budget < POLL_BUDGET_MAX)
+		poll_stats.budget = MIN(poll_stats.budget * 2,
+		    POLL_BUDGET_MAX);
+  } else if (reason == POLL_TIMEOUT) {
+	if (poll_stats.budget > POLL_BUDGET_MIN)
+		poll_stats.budget = MAX(poll_stats.budget / 2,
+		    POLL_BUDGET_MIN);
+  }
+}
+
+/*===========================================================================*
+ *				poll_ctl				     *
+ *===========================================================================*/
+int poll_ctl(unsigned long request, endpoint_t endpt, cp_grant_id_t grant)
+{
+/* Process a completion polling control request.
+ */
+  int r, ctl;
+
+  switch (request) {
+  case BIOCPOLLCTL:
+	if ((r = sys_safecopyfrom(endpt, grant, 0, (vir_bytes) &ctl,
+		sizeof(ctl))) != OK)
+		return r;
+
+	switch (ctl) {
+	case BPOLL_OFF:
+	case BPOLL_ON:
+		if (!poll_allowed) return ENOTTY;
+
+		poll_stats.enabled = (ctl == BPOLL_ON);
+
+		return OK;
+
+	case BPOLL_RESET:
+		/* Keep the current settings. */
+		ctl = poll_stats.enabled;
+		r = poll_stats.budget;
+
+		memset(&poll_stats, 0, sizeof(poll_stats));
+
+		poll_stats.enabled = ctl;
+		poll_stats.budget = r;
+
+		return OK;
+
+	default:
+		return EINVAL;
+	}
+
+  case BIOCPOLLGET:
+	return sys_safecopyto(endpt, grant, 0, (vir_bytes) &poll_stats,
+	    sizeof(poll_stats));
+
+  default:
+	return EINVAL;
+  }
+}
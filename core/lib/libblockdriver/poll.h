@@ -0,0 +1,18 @@
+#ifndef _BLOCKDRIVER_POLL_H
+#define _BLOCKDRIVER_POLL_H
+
+/* Reasons for ending a polling round. */
+enum {
+  POLL_HIT,		/* completions have been found */
+  POLL_TIMEOUT		/* the spin budget has run out */
+};
+
+void poll_allow(void);
+int poll_enabled(void);
+u32_t poll_budget(void);
+void poll_intr(void);
+void poll_done(int reason, unsigned int polls, unsigned int hits,
+	unsigned int completions);
+int poll_ctl(unsigned long request, endpoint_t endpt, cp_grant_id_t grant);
+
+#endif /* _BLOCKDRIVER_POLL_H */
@@ -1,4 +1,8 @@
-/* This file implements block level tracing support. */
+/* This file implements block level tracing support. A trace buffer is either
+ * filled once from start to end, or used as a ring, in which case completed
+ * entries overwrite the oldest ones and may be retrieved while tracing goes
+ * on. In both cases, statistics are kept for the traced device.
+ */
 
 #include <minix/drivers.h>
 #include <minix/blockdriver_mt.h>
@@ -8,18 +12,23 @@
 #include <assert.h>
 
 #include "const.h"
+#include "hist.h"
 #include "trace.h"
 
 #define NO_TRACEDEV		((devminor_t) -1)
 #define NO_TIME			((u32_t) -1)
+#define NO_XFER			(-1)
 
 static int trace_enabled	= FALSE;
+static int trace_ring		= FALSE;
 static devminor_t trace_dev	= NO_TRACEDEV;
 static btrace_entry *trace_buf	= NULL;
 static size_t trace_size	= 0;
 static size_t trace_pos;
 static size_t trace_next;
 static u64_t trace_tsc;
+static u64_t trace_last;
+static btrace_stats trace_stats;
 
 /* Pointers to in-progress trace entries for each thread (all worker threads,
  * plus one for the main thread). Each pointer is set to NULL whenever no
@@ -27,10 +36,20 @@ static u64_t trace_tsc;
  */
 static btrace_entry *trace_ptr[MAX_THREADS + 1] = { NULL };
 
+/* Additional per-thread state, allocated along with the trace buffer. In ring
+ * mode, in-progress entries are kept here, and added to the ring only once
+ * they are complete.
+ */
+static struct trace_thread {
+  btrace_entry entry;		/* in-progress entry, in ring mode */
+  u64_t start;			/* transfer start time */
+  int xfer;			/* transfer direction, or NO_XFER */
+} *trace_thr = NULL;
+
 /*===========================================================================*
  *				trace_gettime				     *
  *===========================================================================*/
-static u32_t trace_gettime(void)
+static u64_t trace_gettime(void)
 {
 /* Return the current time, in microseconds since the start of the trace.
  */
@@ -40,9 +59,53 @@ static u32_t trace_gettime(void)
 
   read_tsc_64(&tsc);
 
-  tsc -= trace_tsc;
+  return tsc_64_to_micros64(tsc - trace_tsc);
+}
+
+/*===========================================================================*
+ *				trace_account				     *
+ *===========================================================================*/
+static void trace_account(u64_t now)
+{
+/* Account for the time since the last change in the number of transfers in
+ * progress.
+ */
+  u64_t delta;
+
+  delta = now - trace_last;
+
+  if (trace_stats.inflight > 0) {
+	trace_stats.busy += delta;
+	trace_stats.depth_time += delta * trace_stats.inflight;
+  }
 
-  return tsc_64_to_micros(tsc);
+  trace_last = now;
+}
+
+/*===========================================================================*
+ *				trace_begin				     *
+ *===========================================================================*/
+static void trace_begin(int mode)
+{
+/* Start tracing, either once through the buffer or using it as a ring.
+ */
+  int i;
+
+  if (mode != trace_ring) {
+	trace_pos = 0;
+	trace_next = 0;
+	trace_ring = mode;
+  }
+
+  read_tsc_64(&trace_tsc);
+  trace_last = 0;
+
+  memset(&trace_stats, 0, sizeof(trace_stats));
+
+  for (i = 0; i < MAX_THREADS + 1; i++)
+	trace_thr[i].xfer = NO_XFER;
+
+  trace_enabled = TRUE;
 }
 
 /*===========================================================================*
@@ -80,18 +143,28 @@ int trace_ctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 		if (trace_dev != minor) return EINVAL;
 
 		free(trace_buf);
+		free(trace_thr);
+		trace_thr = NULL;
 
 		trace_dev = NO_TRACEDEV;
 	} else {
 		if ((trace_buf = malloc(size * sizeof(btrace_entry))) == NULL)
 			return errno;
 
+		if ((trace_thr = malloc((MAX_THREADS + 1) *
+			sizeof(trace_thr[0]))) == NULL) {
+			r = errno;
+			free(trace_buf);
+			return r;
+		}
+
 		trace_dev = minor;
 	}
 
 	trace_size = size;
 	trace_pos = 0;
 	trace_next = 0;
+	trace_ring = FALSE;
 
 	return OK;
 
@@ -109,17 +182,21 @@ int trace_ctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 	/* Start or stop tracing. */
 	switch (ctl) {
 	case BTCTL_START:
+	case BTCTL_RING:
 		if (trace_enabled) return EBUSY;
 
-		read_tsc_64(&trace_tsc);
-
-		trace_enabled = TRUE;
+		trace_begin(ctl == BTCTL_RING);
 
 		break;
 
 	case BTCTL_STOP:
 		if (!trace_enabled) return EINVAL;
 
+		/* Freeze the statistics. */
+		trace_stats.time = trace_gettime();
+		trace_account(trace_stats.time);
+		trace_stats.inflight = 0;
+
 		trace_enabled = FALSE;
 
 		/* Cancel all ongoing trace operations. */
@@ -139,23 +216,42 @@ int trace_ctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 	 */
 	if (trace_dev != minor) return EINVAL;
 
-	if (trace_enabled) return EBUSY;
+	/* A ring may be read while tracing is in progress. Its positions
+	 * keep increasing, and are taken modulo the buffer size.
+	 */
+	if (trace_enabled && !trace_ring) return EBUSY;
 
 	/* How much can we copy out? */
 	entries = MIN(trace_pos - trace_next,
 		_MINIX_IOCTL_SIZE_BIG(request) / sizeof(btrace_entry));
 
+	if (trace_ring)
+		entries = MIN(entries, trace_size - trace_next % trace_size);
+
 	if (entries == 0)
 		return 0;
 
 	if ((r = sys_safecopyto(endpt, grant, 0,
-		(vir_bytes) &trace_buf[trace_next],
+		(vir_bytes) &trace_buf[trace_next % trace_size],
 		entries * sizeof(btrace_entry))) != OK)
 		return r;
 
 	trace_next += entries;
 
 	return entries;
+
+  case BIOCTRACESTAT:
+	if (trace_dev != minor) return EINVAL;
+
+	if (trace_enabled) {
+		trace_stats.time = trace_gettime();
+		trace_account(trace_stats.time);
+	}
+
+	trace_stats.enabled = trace_enabled;
+
+	return sys_safecopyto(endpt, grant, 0, (vir_bytes) &trace_stats,
+		sizeof(trace_stats));
   }
 
   return EINVAL;
@@ -170,7 +266,7 @@ void trace_start(thread_id_t id, message *m_ptr)
  */
   btrace_entry *entry;
   int req;
-  u64_t pos;
+  u64_t pos, now;
   size_t size;
   int flags;
 
@@ -178,9 +274,6 @@ void trace_start(thread_id_t id, message *m_ptr)
 
   assert(id >= 0 && id < MAX_THREADS + 1);
 
-  if (trace_pos == trace_size)
-	return;
-
   switch (m_ptr->m_type) {
   case BDEV_OPEN:	req = BTREQ_OPEN;	break;
   case BDEV_CLOSE:	req = BTREQ_CLOSE;	break;
@@ -221,6 +314,7 @@ void trace_start(thread_id_t id, message *m_ptr)
 	case BIOCTRACEBUF:
 	case BIOCTRACECTL:
 	case BIOCTRACEGET:
+	case BIOCTRACESTAT:
 		return;
 	}
 
@@ -231,17 +325,43 @@ void trace_start(thread_id_t id, message *m_ptr)
 	return;
   }
 
-  entry = &trace_buf[trace_pos];
+  now = trace_gettime();
+
+  /* Update the statistics for transfers. */
+  if (req >= BTREQ_READ && req <= BTREQ_SCATTER) {
+	trace_account(now);
+
+	trace_stats.inflight++;
+	hist_add(trace_stats.depth, BTHIST_BUCKETS, trace_stats.inflight);
+
+	trace_thr[id].start = now;
+	trace_thr[id].xfer = (req == BTREQ_WRITE || req == BTREQ_SCATTER);
+  } else
+	trace_thr[id].xfer = NO_XFER;
+
+  /* In ring mode, the entry is added once it is complete. Otherwise, it is
+   * added right away, if there is still room.
+   */
+  if (trace_ring) {
+	entry = &trace_thr[id].entry;
+  } else {
+	if (trace_pos == trace_size) {
+		trace_stats.dropped++;
+		return;
+	}
+
+	entry = &trace_buf[trace_pos++];
+  }
+
   entry->request = req;
   entry->size = size;
   entry->position = pos;
   entry->flags = flags;
   entry->result = BTRES_INPROGRESS;
-  entry->start_time = trace_gettime();
+  entry->start_time = (u32_t) now;
   entry->finish_time = NO_TIME;
 
   trace_ptr[id] = entry;
-  trace_pos++;
 }
 
 /*===========================================================================*
@@ -270,15 +390,51 @@ void trace_finish(thread_id_t id, int result)
 /* Finish a trace entry.
  */
   btrace_entry *entry;
+  u64_t now;
+  int xfer;
 
   if (!trace_enabled) return;
 
   assert(id >= 0 && id < MAX_THREADS + 1);
 
+  now = trace_gettime();
+
+  /* Update the statistics for transfers. */
+  if ((xfer = trace_thr[id].xfer) != NO_XFER) {
+	trace_account(now);
+
+	trace_stats.inflight--;
+
+	if (result < 0) {
+		trace_stats.errors++;
+	} else {
+		trace_stats.ops[xfer]++;
+		trace_stats.bytes[xfer] += result;
+		hist_add(trace_stats.size, BTHIST_BUCKETS, result);
+	}
+
+	hist_add(trace_stats.latency[xfer], BTHIST_BUCKETS,
+	    now - trace_thr[id].start);
+
+	trace_thr[id].xfer = NO_XFER;
+  }
+
   if ((entry = trace_ptr[id]) == NULL) return;
 
   entry->result = result;
-  entry->finish_time = trace_gettime();
+  entry->finish_time = (u32_t) now;
 
   trace_ptr[id] = NULL;
+
+  /* In ring mode, add the entry now. If the reader has fallen behind by a
+   * full ring, the oldest entry is lost.
+   */
+  if (trace_ring) {
+	if (trace_pos - trace_next == trace_size) {
+		trace_next++;
+		trace_stats.dropped++;
+	}
+
+	trace_buf[trace_pos++ % trace_size] = *entry;
+  }
 }
@@ -218,6 +218,11 @@ tcp_backlog_delayed(struct tcp_pcb* pcb)
       pcb->listener->accepts_pending++;
       LWIP_ASSERT("accepts_pending != 0", pcb->listener->accepts_pending != 0);
       pcb->flags |= TF_BACKLOGPEND;
+#if defined(__minix)
+      /* MINIX 3 only: keep track of the accept queue length. */
+      pcb->listener->accepts_queued++;
+      pcb->flags |= TF_BACKLOGQUEUED;
+#endif /* defined(__minix) */
     }
   }
 }
@@ -240,6 +245,13 @@ tcp_backlog_accepted(struct tcp_pcb* pcb)
       LWIP_ASSERT("accepts_pending != 0", pcb->listener->accepts_pending != 0);
       pcb->listener->accepts_pending--;
       pcb->flags &= ~TF_BACKLOGPEND;
+#if defined(__minix)
+      if (pcb->flags & TF_BACKLOGQUEUED) {
+        LWIP_ASSERT("accepts_queued != 0", pcb->listener->accepts_queued != 0);
+        pcb->listener->accepts_queued--;
+        pcb->flags &= ~TF_BACKLOGQUEUED;
+      }
+#endif /* defined(__minix) */
     }
   }
 }
@@ -750,6 +762,14 @@ tcp_listen_with_backlog_and_err(struct tcp_pcb *pcb, u8_t backlog, err_t *err)
   lpcb->accepts_pending = 0;
   tcp_backlog_set(lpcb, backlog);
 #endif /* TCP_LISTEN_BACKLOG */
+#if defined(__minix)
+  lpcb->accepts_queued = 0;
+  lpcb->syncookie_time = 0;
+  lpcb->syn_drops = 0;
+  lpcb->syncookies_sent = 0;
+  lpcb->syncookies_recv = 0;
+  lpcb->accept_drops = 0;
+#endif /* defined(__minix) */
   TCP_REG(&tcp_listen_pcbs.pcbs, (struct tcp_pcb *)lpcb);
   res = ERR_OK;
 done:
@@ -59,6 +59,17 @@
 #include "lwip/nd6.h"
 #endif /* LWIP_ND6_TCP_REACHABILITY_HINTS */
 
+#if defined(__minix)
+/* MINIX 3 only: SYN cookies are generated and checked through hooks. */
+#include "lwip/sys.h"
+
+#include <string.h>
+
+#ifdef LWIP_HOOK_FILENAME
+#include LWIP_HOOK_FILENAME
+#endif
+#endif /* defined(__minix) */
+
 /** Initial CWND calculation as defined RFC 2581 */
 #define LWIP_TCP_CALC_INITIAL_CWND(mss) LWIP_MIN((4U * (mss)), LWIP_MAX((2U * (mss)), 4380U));
 
@@ -87,6 +98,12 @@ static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
 
 static void tcp_listen_input(struct tcp_pcb_listen *pcb);
+#if defined(__minix)
+static int tcp_syncookie_full(const struct tcp_pcb_listen *lpcb);
+static void tcp_syncookie_syn(struct tcp_pcb_listen *lpcb);
+static int tcp_syncookie_input(struct tcp_pcb_listen *lpcb,
+                               struct tcp_pcb **pcbp);
+#endif /* defined(__minix) */
 static void tcp_timewait_input(struct tcp_pcb *pcb);
 
 /**
@@ -317,9 +334,21 @@ tcp_input(struct pbuf *p, struct netif *inp)
       }
 
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
-      tcp_listen_input(lpcb);
-      pbuf_free(p);
-      return;
+#if defined(__minix)
+      /* MINIX 3 only: an ACK carrying a valid SYN cookie creates a new
+         connection, which then processes the ACK like any other. */
+      if (tcp_syncookie_input(lpcb, &pcb)) {
+        if (pcb == NULL) {
+          pbuf_free(p);
+          return;
+        }
+      } else
+#endif /* defined(__minix) */
+      {
+        tcp_listen_input(lpcb);
+        pbuf_free(p);
+        return;
+      }
     }
   }
 
@@ -566,6 +595,16 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 #if TCP_LISTEN_BACKLOG
     if (pcb->accepts_pending >= pcb->backlog) {
       LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: listen backlog exceeded for port %"U16_F"\n", tcphdr->dest));
+#if defined(__minix)
+      /* MINIX 3 only: if half-open connections use up the backlog, answer
+         with a SYN cookie instead of dropping.  If the accept queue itself
+         is full, drop the SYN as before, so that the client retries. */
+      if (!tcp_syncookie_full(pcb)) {
+        tcp_syncookie_syn(pcb);
+      } else {
+        pcb->syn_drops++;
+      }
+#endif /* defined(__minix) */
       return;
     }
 #endif /* TCP_LISTEN_BACKLOG */
@@ -579,6 +618,14 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
       TCP_STATS_INC(tcp.memerr);
       TCP_EVENT_ACCEPT(pcb, NULL, pcb->callback_arg, ERR_MEM, err);
       LWIP_UNUSED_ARG(err); /* err not useful here */
+#if defined(__minix)
+      /* MINIX 3 only: a SYN cookie needs no PCB; send one if we can. */
+      if (!tcp_syncookie_full(pcb)) {
+        tcp_syncookie_syn(pcb);
+      } else {
+        pcb->syn_drops++;
+      }
+#endif /* defined(__minix) */
       return;
     }
 #if TCP_LISTEN_BACKLOG
@@ -631,6 +678,152 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
   return;
 }
 
+#if defined(__minix)
+/**
+ * MINIX 3 only: check whether the accept queue of a listening pcb is full,
+ * that is, whether the backlog is used up by connections that are no longer
+ * half-open.  In that case, SYN cookies would not help.  Also make sure that
+ * connections created from SYN cookies, which do not count against the
+ * backlog while half-open, cannot overflow the pending connections counter.
+ *
+ * @param lpcb the tcp_pcb_listen to check
+ * @return 1 if no more connections can be queued, 0 otherwise
+ */
+static int
+tcp_syncookie_full(const struct tcp_pcb_listen *lpcb)
+{
+  return (lpcb->accepts_queued >= lpcb->backlog ||
+          lpcb->accepts_pending == 0xFF);
+}
+
+/**
+ * MINIX 3 only: respond to a SYN for a listening pcb that cannot take any
+ * more half-open connections, by sending a SYN|ACK whose sequence number is a
+ * SYN cookie.  No state is kept.  If SYN cookies are disabled, or the
+ * SYN|ACK cannot be sent, the SYN is dropped, and the client will retry.
+ *
+ * @param lpcb the tcp_pcb_listen for which a SYN arrived
+ */
+static void
+tcp_syncookie_syn(struct tcp_pcb_listen *lpcb)
+{
+  struct tcp_pcb tmp;
+  u32_t cookie;
+  u16_t mss;
+
+  if (!lwip_tcp_syncookies) {
+    lpcb->syn_drops++;
+    return;
+  }
+
+  /* Parse the client's MSS option, using a scratch PCB. */
+  memset(&tmp, 0, sizeof(tmp));
+  tmp.mss = LWIP_MIN(536, TCP_MSS);
+  tcp_parseopt(&tmp);
+  mss = tmp.mss;
+#if TCP_CALCULATE_EFF_SEND_MSS
+  mss = tcp_eff_send_mss(mss, ip_current_dest_addr(), ip_current_src_addr());
+#endif /* TCP_CALCULATE_EFF_SEND_MSS */
+
+  cookie = LWIP_HOOK_TCP_SYNCOOKIE(ip_current_dest_addr(), lpcb->local_port,
+    ip_current_src_addr(), tcphdr->src, seqno, mss);
+
+  if (tcp_syncookie_output(lpcb, cookie, seqno + 1, ip_current_dest_addr(),
+      ip_current_src_addr(), tcphdr->src) == ERR_OK) {
+    lpcb->syncookies_sent++;
+    lpcb->syncookie_time = sys_now();
+  } else {
+    lpcb->syn_drops++;
+  }
+}
+
+/**
+ * MINIX 3 only: check whether a segment that arrived for a listening pcb is
+ * the ACK that completes a handshake started with a SYN cookie.  If so,
+ * create a new PCB in the SYN_RCVD state for the connection, so that the
+ * caller can process the ACK (and any data) through tcp_process().  Checking
+ * a cookie is expensive, so this is done only if the listening pcb has sent
+ * SYN cookies that may still be valid.  If the accept queue is full, the ACK
+ * is dropped; the client will retransmit it, or send data, later.
+ *
+ * @param lpcb the tcp_pcb_listen for which a segment arrived
+ * @param pcbp a pointer to store the new PCB in, or NULL if none could be
+ *        allocated and the segment should be dropped
+ * @return 1 if the segment carried a valid SYN cookie, 0 otherwise
+ */
+static int
+tcp_syncookie_input(struct tcp_pcb_listen *lpcb, struct tcp_pcb **pcbp)
+{
+  struct tcp_pcb *npcb;
+  u16_t mss;
+
+  if (!lwip_tcp_syncookies ||
+      (flags & (TCP_SYN | TCP_RST | TCP_ACK)) != TCP_ACK) {
+    return 0;
+  }
+
+  if (lpcb->syncookies_sent == 0 || (u32_t)(sys_now() -
+      lpcb->syncookie_time) > LWIP_TCP_SYNCOOKIE_LIFETIME * 1000UL) {
+    return 0;
+  }
+
+  if (!LWIP_HOOK_TCP_SYNCOOKIE_CHECK(ip_current_dest_addr(),
+      lpcb->local_port, ip_current_src_addr(), tcphdr->src, seqno - 1,
+      ackno - 1, &mss)) {
+    return 0;
+  }
+
+  if (tcp_syncookie_full(lpcb)) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_syncookie_input: accept queue full for port %"U16_F"\n", tcphdr->dest));
+    lpcb->accept_drops++;
+    *pcbp = NULL;
+    return 1;
+  }
+
+  npcb = tcp_alloc(lpcb->prio);
+  if (npcb == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_syncookie_input: could not allocate PCB\n"));
+    TCP_STATS_INC(tcp.memerr);
+    lpcb->syn_drops++;
+    *pcbp = NULL;
+    return 1;
+  }
+
+  /* Set up the new PCB as if we had sent the SYN|ACK from it. */
+  ip_addr_copy(npcb->local_ip, *ip_current_dest_addr());
+  ip_addr_copy(npcb->remote_ip, *ip_current_src_addr());
+  npcb->local_port = lpcb->local_port;
+  npcb->remote_port = tcphdr->src;
+  npcb->state = SYN_RCVD;
+  npcb->rcv_nxt = seqno;
+  npcb->rcv_ann_right_edge = npcb->rcv_nxt;
+  npcb->snd_wl2 = ackno - 1;
+  npcb->lastack = ackno - 1;
+  npcb->snd_nxt = ackno;
+  npcb->snd_lbb = ackno;
+  npcb->snd_wl1 = seqno - 1;/* initialise to seqno-1 to force window update */
+  npcb->callback_arg = lpcb->callback_arg;
+#if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
+  npcb->listener = lpcb;
+#endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
+  /* inherit socket options */
+  npcb->so_options = lpcb->so_options & SOF_INHERITED;
+  /* The MSS was taken from the SYN and encoded in the cookie. */
+  npcb->mss = mss;
+  npcb->snd_wnd = tcphdr->wnd;
+  npcb->snd_wnd_max = npcb->snd_wnd;
+  /* Register the new PCB so that we can begin receiving segments
+     for it. */
+  TCP_REG_ACTIVE(npcb);
+
+  lpcb->syncookies_recv++;
+  MIB2_STATS_INC(mib2.tcppassiveopens);
+
+  *pcbp = npcb;
+  return 1;
+}
+#endif /* defined(__minix) */
+
 /**
  * Called by tcp_input() when a segment arrives for a connection in
  * TIME_WAIT.
@@ -690,6 +883,9 @@ static err_t
 tcp_process(struct tcp_pcb *pcb)
 {
   struct tcp_seg *rseg;
+#if defined(__minix)
+  struct tcp_pcb_listen *lpcb = NULL;
+#endif /* defined(__minix) */
   u8_t acceptable = 0;
   err_t err;
 
@@ -835,10 +1031,19 @@ tcp_process(struct tcp_pcb *pcb)
           LWIP_ASSERT("pcb->listener->accept != NULL", pcb->listener->accept != NULL);
 #endif
           tcp_backlog_accepted(pcb);
+#if defined(__minix)
+          lpcb = pcb->listener;
+#endif /* defined(__minix) */
           /* Call the accept function. */
           TCP_EVENT_ACCEPT(pcb->listener, pcb, pcb->callback_arg, ERR_OK, err);
         }
         if (err != ERR_OK) {
+#if defined(__minix)
+          /* MINIX 3 only: count refused connections on the listener. */
+          if (lpcb != NULL) {
+            lpcb->accept_drops++;
+          }
+#endif /* defined(__minix) */
           /* If the accept function returns with an error, we abort
            * the connection. */
           /* Already aborted? */
@@ -963,6 +963,10 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
         &pcb->local_ip, &pcb->remote_ip);
     }
 #endif
+#if defined(__minix)
+    /* MINIX 3 only: let the netif fill in the checksum, if it can. */
+    p->flags |= PBUF_FLAG_TCP_CSUM;
+#endif /* defined(__minix) */
     NETIF_SET_HWADDRHINT(netif, &(pcb->addr_hint));
     err = ip_output_if(p, &pcb->local_ip, &pcb->remote_ip,
       pcb->ttl, pcb->tos, IP_PROTO_TCP, netif);
@@ -1311,6 +1315,10 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 #endif /* TCP_CHECKSUM_ON_COPY */
   }
 #endif /* CHECKSUM_GEN_TCP */
+#if defined(__minix)
+  /* MINIX 3 only: let the netif fill in the checksum, if it can. */
+  seg->p->flags |= PBUF_FLAG_TCP_CSUM;
+#endif /* defined(__minix) */
   TCP_STATS_INC(tcp.xmit);
 
   NETIF_SET_HWADDRHINT(netif, &(pcb->addr_hint));
@@ -1381,6 +1389,10 @@ tcp_rst(u32_t seqno, u32_t ackno,
                                         local_ip, remote_ip);
     }
 #endif
+#if defined(__minix)
+    /* MINIX 3 only: let the netif fill in the checksum, if it can. */
+    p->flags |= PBUF_FLAG_TCP_CSUM;
+#endif /* defined(__minix) */
     /* Send output with hardcoded TTL/HL since we have no access to the pcb */
     ip_output_if(p, local_ip, remote_ip, TCP_TTL, 0, IP_PROTO_TCP, netif);
   }
@@ -1388,6 +1400,87 @@ tcp_rst(u32_t seqno, u32_t ackno,
   LWIP_DEBUGF(TCP_RST_DEBUG, ("tcp_rst: seqno %"U32_F" ackno %"U32_F".\n", seqno, ackno));
 }
 
+#if defined(__minix)
+/**
+ * MINIX 3 only: send a SYN|ACK segment carrying a SYN cookie as its sequence
+ * number.  Called by tcp_listen_input() when a SYN arrives for a listening
+ * pcb whose backlog is full.  Like tcp_rst(), no tcp_pcb is involved, so the
+ * segment is built and sent directly, and never retransmitted: the client
+ * retransmits its SYN instead if the SYN|ACK gets lost.
+ *
+ * @param lpcb the listening pcb on which the SYN arrived
+ * @param seqno the sequence number (SYN cookie) to use for the segment
+ * @param ackno the acknowledge number to use for the outgoing segment
+ * @param local_ip the local IP address to send the segment from
+ * @param remote_ip the remote IP address to send the segment to
+ * @param remote_port the remote TCP port to send the segment to
+ * @return ERR_OK if the segment was sent, an error code otherwise
+ */
+err_t
+tcp_syncookie_output(const struct tcp_pcb_listen *lpcb, u32_t seqno,
+  u32_t ackno, const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+  u16_t remote_port)
+{
+  struct pbuf *p;
+  struct tcp_hdr *tcphdr;
+  struct netif *netif;
+  u32_t *opts;
+  u16_t mss;
+  err_t err;
+
+  p = pbuf_alloc(PBUF_IP, TCP_HLEN + LWIP_TCP_OPT_LEN_MSS, PBUF_RAM);
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_syncookie_output: could not allocate memory for pbuf\n"));
+    return ERR_MEM;
+  }
+  LWIP_ASSERT("check that first pbuf can hold struct tcp_hdr",
+              (p->len >= sizeof(struct tcp_hdr) + LWIP_TCP_OPT_LEN_MSS));
+
+  tcphdr = (struct tcp_hdr *)p->payload;
+  tcphdr->src = lwip_htons(lpcb->local_port);
+  tcphdr->dest = lwip_htons(remote_port);
+  tcphdr->seqno = lwip_htonl(seqno);
+  tcphdr->ackno = lwip_htonl(ackno);
+  TCPH_HDRLEN_FLAGS_SET(tcphdr, (TCP_HLEN + LWIP_TCP_OPT_LEN_MSS)/4,
+    TCP_SYN | TCP_ACK);
+  tcphdr->wnd = PP_HTONS(TCPWND_MIN16(TCP_WND));
+  tcphdr->chksum = 0;
+  tcphdr->urgp = 0;
+
+#if TCP_CALCULATE_EFF_SEND_MSS
+  mss = tcp_eff_send_mss(TCP_MSS, local_ip, remote_ip);
+#else /* TCP_CALCULATE_EFF_SEND_MSS */
+  mss = TCP_MSS;
+#endif /* TCP_CALCULATE_EFF_SEND_MSS */
+  opts = (u32_t *)(void *)(tcphdr + 1);
+  *opts = TCP_BUILD_MSS_OPTION(mss);
+
+  TCP_STATS_INC(tcp.xmit);
+
+  netif = ip_route(local_ip, remote_ip);
+  if (netif == NULL) {
+    TCP_STATS_INC(tcp.rterr);
+    pbuf_free(p);
+    return ERR_RTE;
+  }
+#if CHECKSUM_GEN_TCP
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
+    tcphdr->chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len,
+                                      local_ip, remote_ip);
+  }
+#endif
+#if defined(__minix)
+  /* MINIX 3 only: let the netif fill in the checksum, if it can. */
+  p->flags |= PBUF_FLAG_TCP_CSUM;
+#endif /* defined(__minix) */
+  err = ip_output_if(p, local_ip, remote_ip, lpcb->ttl, lpcb->tos,
+    IP_PROTO_TCP, netif);
+  pbuf_free(p);
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_syncookie_output: seqno %"U32_F" ackno %"U32_F".\n", seqno, ackno));
+  return err;
+}
+#endif /* defined(__minix) */
+
 /**
  * Requeue all unacked segments for retransmission
  *
@@ -1559,6 +1652,10 @@ tcp_keepalive(struct tcp_pcb *pcb)
         &pcb->local_ip, &pcb->remote_ip);
     }
 #endif /* CHECKSUM_GEN_TCP */
+#if defined(__minix)
+    /* MINIX 3 only: let the netif fill in the checksum, if it can. */
+    p->flags |= PBUF_FLAG_TCP_CSUM;
+#endif /* defined(__minix) */
     TCP_STATS_INC(tcp.xmit);
 
     /* Send output to IP */
@@ -1652,6 +1749,10 @@ tcp_zero_window_probe(struct tcp_pcb *pcb)
         &pcb->local_ip, &pcb->remote_ip);
     }
 #endif
+#if defined(__minix)
+    /* MINIX 3 only: let the netif fill in the checksum, if it can. */
+    p->flags |= PBUF_FLAG_TCP_CSUM;
+#endif /* defined(__minix) */
     TCP_STATS_INC(tcp.xmit);
 
     /* Send output to IP */
@@ -153,6 +153,11 @@ typedef enum {
 #define PBUF_FLAG_LLMCAST   0x10U
 /** indicates this pbuf includes a TCP FIN flag */
 #define PBUF_FLAG_TCP_FIN   0x20U
+#if defined(__minix)
+/** MINIX 3 only: indicates this pbuf is a TCP segment generated by lwIP itself,
+    whose checksum may be filled in by the network device */
+#define PBUF_FLAG_TCP_CSUM  0x40U
+#endif /* defined(__minix) */
 
 /** Main packet buffer struct */
 struct pbuf {
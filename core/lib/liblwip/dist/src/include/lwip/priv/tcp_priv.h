@@ -454,6 +454,11 @@ void tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
 void tcp_rst(u32_t seqno, u32_t ackno,
        const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
        u16_t local_port, u16_t remote_port);
+#if defined(__minix)
+err_t tcp_syncookie_output(const struct tcp_pcb_listen *lpcb, u32_t seqno,
+       u32_t ackno, const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+       u16_t remote_port);
+#endif /* defined(__minix) */
 
 u32_t tcp_next_iss(struct tcp_pcb *pcb);
 
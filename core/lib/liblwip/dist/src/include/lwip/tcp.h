@@ -193,6 +193,17 @@ struct tcp_pcb_listen {
   u8_t backlog;
   u8_t accepts_pending;
 #endif /* TCP_LISTEN_BACKLOG */
+
+#if defined(__minix)
+  /* MINIX 3 only: accept queue length and SYN cookie state. */
+  u8_t accepts_queued;    /* of accepts_pending, those no longer half-open */
+  u32_t syncookie_time;   /* sys_now() at which the last SYN cookie was sent */
+  /* MINIX 3 only: backlog overflow and SYN cookie statistics. */
+  u32_t syn_drops;        /* SYNs dropped without any response */
+  u32_t syncookies_sent;  /* SYN|ACKs sent with a SYN cookie */
+  u32_t syncookies_recv;  /* connections created from a valid SYN cookie */
+  u32_t accept_drops;     /* established connections refused by accept */
+#endif /* defined(__minix) */
 };
 
 
@@ -224,6 +235,9 @@ struct tcp_pcb {
 #if LWIP_TCP_TIMESTAMPS
 #define TF_TIMESTAMP   0x0400U   /* Timestamp option enabled */
 #endif
+#if defined(__minix)
+#define TF_BACKLOGQUEUED 0x1000U /* MINIX 3 only: delayed by tcp_backlog_delayed() */
+#endif /* defined(__minix) */
 
   /* the rest of the fields are in host byte order
      as we have to do some math with them */
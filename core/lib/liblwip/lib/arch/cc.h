@@ -38,5 +38,6 @@ struct pbuf *pchain_alloc(int layer, size_t size);
 
 extern int lwip_ip4_forward;
 extern int lwip_ip6_forward;
+extern int lwip_tcp_syncookies;
 
 #endif /* !LWIP_ARCH_CC_H */
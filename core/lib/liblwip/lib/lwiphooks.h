@@ -10,6 +10,22 @@ u32_t lwip_hook_tcp_isn(const ip_addr_t * local_ip, u16_t local_port,
 
 #define LWIP_HOOK_TCP_ISN lwip_hook_tcp_isn
 
+/*
+ * TCP SYN cookie hooks, for listening sockets with a full backlog.  A SYN
+ * cookie is valid for at most the given number of seconds after it was sent.
+ */
+#define LWIP_TCP_SYNCOOKIE_LIFETIME	128
+
+u32_t lwip_hook_tcp_syncookie(const ip_addr_t * local_ip, u16_t local_port,
+	const ip_addr_t * remote_ip, u16_t remote_port, u32_t seqno,
+	u16_t mss);
+int lwip_hook_tcp_syncookie_check(const ip_addr_t * local_ip,
+	u16_t local_port, const ip_addr_t * remote_ip, u16_t remote_port,
+	u32_t seqno, u32_t cookie, u16_t * mss);
+
+#define LWIP_HOOK_TCP_SYNCOOKIE lwip_hook_tcp_syncookie
+#define LWIP_HOOK_TCP_SYNCOOKIE_CHECK lwip_hook_tcp_syncookie_check
+
 /*
  * IPv4 route hook.  Since we override the IPv4 routing function altogether,
  * this hook should not be called and will panic if it is called, because that
@@ -410,8 +410,29 @@
 #define SO_REUSE                        1
 #define SO_REUSE_RXTOALL                1
 
-/* We maintain our own, simpler statistics. */
-#define LWIP_STATS                      0
+/*
+ * We maintain our own, simpler statistics.  The one exception is the per-pool
+ * usage accounting of lwIP's own memory pools, which the LWIP service exports
+ * along with the statistics of its mempool module.  That accounting is cheap.
+ */
+#define LWIP_STATS                      1
+#define LINK_STATS                      0
+#define ETHARP_STATS                    0
+#define IP_STATS                        0
+#define IPFRAG_STATS                    0
+#define ICMP_STATS                      0
+#define IGMP_STATS                      0
+#define UDP_STATS                       0
+#define TCP_STATS                       0
+#define MEM_STATS                       0
+#define MEMP_STATS                      1
+#define SYS_STATS                       0
+#define IP6_STATS                       0
+#define ICMP6_STATS                     0
+#define IP6_FRAG_STATS                  0
+#define MLD6_STATS                      0
+#define ND6_STATS                       0
+#define MIB2_STATS                      0
 
 #define LWIP_CHECKSUM_CTRL_PER_NETIF    1
 #define CHECKSUM_GEN_IP                 1
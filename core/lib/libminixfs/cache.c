@@ -66,6 +66,19 @@ static fsblkcnt_t fs_btotal = 0, fs_bused = 0;
 
 static int quiet = 0;
 
+/* A contiguous run of blocks being transferred by rw_scattered(). Up to
+ * 'io_depth' runs are kept in flight as asynchronous bdev requests.
+ */
+struct io_run {
+  struct buf **bufq;		/* the blocks of the run */
+  unsigned int nblocks;		/* number of blocks in the run */
+  int rw_flag;			/* READING or WRITING */
+  bdev_id_t id;			/* bdev request ID */
+  int done;			/* set once the request has completed */
+};
+
+static unsigned int io_depth = LMFS_DEF_IODEPTH;
+
 typedef struct buf *noxfer_buf_ptr_t; /* annotation for temporary buf ptrs */
 
 void lmfs_setquiet(int q) { quiet = q; }
@@ -834,6 +847,88 @@ static void sort_blocks(struct buf **bufq, unsigned int bufqsize)
   }
 }
 
+/*===========================================================================*
+ *				lmfs_set_iodepth			     *
+ *===========================================================================*/
+void lmfs_set_iodepth(unsigned int depth)
+{
+/* Set the number of transfer requests that may be outstanding at once when
+ * writing back or reading ahead a set of blocks. A depth of one makes all
+ * block I/O synchronous. File servers that do not call this function get a
+ * depth of LMFS_DEF_IODEPTH; values above LMFS_MAX_IODEPTH are clamped.
+ */
+
+  io_depth = MAX(MIN(depth, LMFS_MAX_IODEPTH), 1);
+}
+
+/*===========================================================================*
+ *				rw_harvest				     *
+ *===========================================================================*/
+static void rw_harvest(dev_t dev, struct io_run *run, ssize_t r)
+{
+/* A transfer of a run of blocks has completed with result 'r'.  The driver
+ * may have returned an error, or it may have done less than what we asked
+ * for.  Reads that did not make it are invalidated and all read blocks are
+ * released; writes that did not make it leave their blocks dirty.
+ */
+  struct buf *bp;
+  unsigned int i;
+
+  if (r < 0) {
+	printf("fs cache: I/O error %zd on device %d/%d, block %"PRIu64"\n",
+	    r, major(dev), minor(dev), run->bufq[0]->lmfs_blocknr);
+  }
+  for (i = 0; i < run->nblocks; i++) {
+	bp = run->bufq[i];
+	if (r < (ssize_t)bp->lmfs_bytes) {
+		/* Transfer failed. */
+		if (i == 0 || run->rw_flag == READING) {
+			bp->lmfs_dev = NO_DEV;	/* Invalidate block */
+		}
+		if (run->rw_flag == READING) {
+			lmfs_put_block(bp);
+		}
+		continue;
+	}
+	if (run->rw_flag == READING) {
+		lmfs_put_block(bp);
+	} else {
+		MARKCLEAN(bp);
+	}
+	r -= bp->lmfs_bytes;
+  }
+}
+
+/*===========================================================================*
+ *				rw_done					     *
+ *===========================================================================*/
+static void rw_done(dev_t dev, bdev_id_t UNUSED(id), bdev_param_t param,
+	int r)
+{
+/* Completion callback of an asynchronous transfer issued by rw_scattered(). */
+  struct io_run *run = (struct io_run *) param;
+
+  rw_harvest(dev, run, r);
+
+  run->done = TRUE;
+}
+
+/*===========================================================================*
+ *				rw_wait					     *
+ *===========================================================================*/
+static void rw_wait(struct io_run *run)
+{
+/* Wait for an asynchronous transfer to complete.  Waiting handles the replies
+ * to all outstanding transfers on the device, so others may complete too.
+ */
+  int r;
+
+  if (!run->done && (r = bdev_wait_asyn(run->id)) != OK && !run->done)
+	panic("fs cache: unable to wait for I/O completion: %d", r);
+
+  assert(run->done);
+}
+
 /*===========================================================================*
  *				rw_scattered				     *
  *===========================================================================*/
@@ -844,13 +939,19 @@ static void rw_scattered(
   int rw_flag			/* READING or WRITING */
 )
 {
-/* Read or write scattered data from a device. */
+/* Read or write scattered data from a device.  Contiguous runs of blocks are
+ * transferred with one request each, and unless the I/O depth is set to one,
+ * up to that many requests are kept outstanding, so that the driver can have
+ * several of them in progress at once.
+ */
 
   register struct buf *bp;
   register iovec_t *iop;
   static iovec_t iovec[NR_IOREQS];
+  static struct io_run runs[LMFS_MAX_IODEPTH];
+  struct io_run *run;
   off_t pos;
-  unsigned int i, iov_per_block;
+  unsigned int i, iov_per_block, first, busy;
 #if !defined(NDEBUG)
   unsigned int start_in_use = bufs_in_use, start_bufqsize = bufqsize;
 #endif /* !defined(NDEBUG) */
@@ -884,9 +985,11 @@ static void rw_scattered(
   if (rw_flag == WRITING)
 	sort_blocks(bufq, bufqsize);
 
-  /* Set up I/O vector and do I/O.  The result of bdev I/O is OK if everything
-   * went fine, otherwise the error code for the first failed transfer.
+  /* Set up I/O vectors and do I/O, one request per contiguous run of blocks.
+   * Runs in flight occupy runs[first] up to (but excluding)
+   * runs[(first + busy) % io_depth], oldest first.
    */
+  first = busy = 0;
   while (bufqsize > 0) {
 	unsigned int p, nblocks = 0, niovecs = 0;
 	int r;
@@ -916,59 +1019,55 @@ static void rw_scattered(
 	assert(nblocks > 0);
 	assert(niovecs > 0 && niovecs <= NR_IOREQS);
 
-	pos = (off_t)bufq[0]->lmfs_blocknr * fs_block_size;
-	if (rw_flag == READING)
-		r = bdev_gather(dev, pos, iovec, niovecs, BDEV_NOFLAGS);
-	else
-		r = bdev_scatter(dev, pos, iovec, niovecs, BDEV_NOFLAGS);
-
-	/* Harvest the results.  The driver may have returned an error, or it
-	 * may have done less than what we asked for.
-	 */
-	if (r < 0) {
-		printf("fs cache: I/O error %d on device %d/%d, "
-		    "block %"PRIu64"\n",
-		    r, major(dev), minor(dev), bufq[0]->lmfs_blocknr);
-	}
-	for (i = 0; i < nblocks; i++) {
-		bp = bufq[i];
-		if (r < (ssize_t)bp->lmfs_bytes) {
-			/* Transfer failed. */
-			if (i == 0) {
-				bp->lmfs_dev = NO_DEV;	/* Invalidate block */
-			}
-			break;
-		}
-		if (rw_flag == READING) {
-			lmfs_put_block(bp);
-		} else {
-			MARKCLEAN(bp);
-		}
-		r -= bp->lmfs_bytes;
+	/* Make room for another request, retiring completed ones. */
+	if (busy == io_depth)
+		rw_wait(&runs[first]);
+	while (busy > 0 && runs[first].done) {
+		first = (first + 1) % io_depth;
+		busy--;
 	}
 
-	bufq += i;
-	bufqsize -= i;
+	run = &runs[(first + busy) % io_depth];
+	run->bufq = bufq;
+	run->nblocks = nblocks;
+	run->rw_flag = rw_flag;
+	run->done = FALSE;
 
-	if (rw_flag == READING) {
-		/* Don't bother reading more than the device is willing to
-		 * give at this time.  Don't forget to release those extras.
-		 */
-		while (bufqsize > 0) {
-			bp = *bufq++;
-			bp->lmfs_dev = NO_DEV;	/* invalidate block */
-			lmfs_put_block(bp);
-			bufqsize--;
-		}
-	}
-	if (rw_flag == WRITING && i == 0) {
-		/* We're not making progress, this means we might keep
-		 * looping. Buffers remain dirty if un-written. Buffers are
-		 * lost if invalidate()d or LRU-removed while dirty. This
-		 * is better than keeping unwritable blocks around forever..
+	pos = (off_t)bufq[0]->lmfs_blocknr * fs_block_size;
+	if (io_depth > 1) {
+		if (rw_flag == READING)
+			run->id = bdev_gather_asyn(dev, pos, iovec, niovecs,
+			    BDEV_NOFLAGS, rw_done, (bdev_param_t) run);
+		else
+			run->id = bdev_scatter_asyn(dev, pos, iovec, niovecs,
+			    BDEV_NOFLAGS, rw_done, (bdev_param_t) run);
+	} else
+		run->id = EINVAL;
+
+	if (run->id >= 0) {
+		busy++;
+	} else {
+		/* Synchronous I/O, by choice or because the request could
+		 * not be queued.
 		 */
-		break;
+		if (rw_flag == READING)
+			r = bdev_gather(dev, pos, iovec, niovecs,
+			    BDEV_NOFLAGS);
+		else
+			r = bdev_scatter(dev, pos, iovec, niovecs,
+			    BDEV_NOFLAGS);
+
+		rw_harvest(dev, run, r);
 	}
+
+	bufq += nblocks;
+	bufqsize -= nblocks;
+  }
+
+  /* Wait for all outstanding requests to complete. */
+  for (; busy > 0; busy--) {
+	rw_wait(&runs[first]);
+	first = (first + 1) % io_depth;
   }
 
 #if !defined(NDEBUG)
@@ -41,6 +41,24 @@ static unsigned int pending_recvs, pending_recvtail;
 static int pending_status;
 static endpoint_t status_endpt;
 
+/*
+ * If the TCP/IP service has given us a descriptor ring, send and receive
+ * requests may arrive in batches through the ring.  Their completions are
+ * collected here, and reported with a single reply message per queue once
+ * the current message has been processed.  Requests complete in order, so the
+ * ID of the first completed request and a count suffice.
+ */
+struct ring_done {
+	uint32_t id;				/* ID of first request */
+	unsigned int count;			/* number of completions */
+	int32_t result[NDEV_RING_MAX];		/* results of requests */
+	uint32_t flags[NDEV_RING_MAX];		/* receive flags of requests */
+};
+
+static cp_grant_id_t ring_grant;
+static endpoint_t ring_endpt;
+static struct ring_done ring_send_done, ring_recv_done;
+
 static int pending_link, pending_stat;
 static uint32_t stat_oerror, stat_coll, stat_ierror, stat_iqdrop;
 
@@ -203,6 +221,41 @@ netdriver_copyout(struct netdriver_data * __restrict data, size_t off,
 	netdriver_copy(data, off, (vir_bytes)ptr, size, FALSE /*copyin*/);
 }
 
+/*
+ * Retrieve the checksum offload request for a packet to be sent.  If the
+ * caller wants the driver to fill in a TCP or UDP checksum, return TRUE, with
+ * the offset into the packet of the start of the checksummed area in 'start',
+ * and the offset of the checksum field relative to that start in 'off'.  The
+ * checksum field already contains the pseudo-header checksum, and the sum over
+ * the area from 'start' to the end of the packet must be stored there.
+ * Otherwise, return FALSE.
+ */
+int
+netdriver_get_csum(const struct netdriver_data * data, size_t * start,
+	size_t * off)
+{
+
+	if (data->csum_start == 0)
+		return FALSE;
+
+	*start = data->csum_start;
+	*off = data->csum_off;
+	return TRUE;
+}
+
+/*
+ * Set the receive flags (NDEV_RXF_) for a received packet, to tell the caller
+ * which of its checksums have been verified by the hardware.  This function
+ * must be called from the driver's receive function.  It has no effect if the
+ * caller has not set up a descriptor ring.
+ */
+void
+netdriver_set_rxflags(struct netdriver_data * data, uint32_t flags)
+{
+
+	data->rxflags = flags;
+}
+
 /*
  * Send a reply to a request.
  */
@@ -215,6 +268,106 @@ send_reply(endpoint_t endpt, message * m_ptr)
 		panic("netdriver: unable to send to %d: %d", endpt, r);
 }
 
+/*
+ * Copy out 'count' consecutive 32-bit ring entries for the requests starting
+ * at 'id', to the ring array at offset 'off'.  The entries may wrap around the
+ * end of the ring array.
+ */
+static int
+copyto_ring(size_t off, uint32_t id, unsigned int count, const uint32_t * ptr)
+{
+	unsigned int slot, chunk;
+	int r;
+
+	slot = id % NDEV_RING_MAX;
+	chunk = NDEV_RING_MAX - slot;
+	if (chunk > count)
+		chunk = count;
+
+	r = sys_safecopyto(ring_endpt, ring_grant, off + slot * sizeof(ptr[0]),
+	    (vir_bytes)ptr, chunk * sizeof(ptr[0]));
+
+	if (r == OK && chunk < count)
+		r = sys_safecopyto(ring_endpt, ring_grant, off,
+		    (vir_bytes)&ptr[chunk], (count - chunk) * sizeof(ptr[0]));
+
+	return r;
+}
+
+/*
+ * Report the collected completions of ring requests for one queue, by storing
+ * the results (and for receive requests, the flags) in the ring and sending a
+ * single reply message.
+ */
+static void
+flush_ring(struct ring_done * rd, int do_send)
+{
+	message m;
+	int r;
+
+	if (rd->count == 0)
+		return;
+
+	if (do_send)
+		r = copyto_ring(offsetof(struct ndev_ring, nr_send_result),
+		    rd->id, rd->count, (const uint32_t *)rd->result);
+	else {
+		r = copyto_ring(offsetof(struct ndev_ring, nr_recv_flags),
+		    rd->id, rd->count, rd->flags);
+
+		if (r == OK)
+			r = copyto_ring(offsetof(struct ndev_ring,
+			    nr_recv_result), rd->id, rd->count,
+			    (const uint32_t *)rd->result);
+	}
+
+	/*
+	 * If the copy failed, the TCP/IP service has most likely gone away.
+	 * It will send a new initialization request if it comes back.
+	 */
+	if (r == OK) {
+		memset(&m, 0, sizeof(m));
+		m.m_type = (do_send) ? NDEV_SEND_RING_REPLY :
+		    NDEV_RECV_RING_REPLY;
+		m.m_netdriver_ndev_ring_reply.id = rd->id;
+		m.m_netdriver_ndev_ring_reply.count = rd->count;
+
+		send_reply(ring_endpt, &m);
+	}
+
+	rd->count = 0;
+}
+
+/*
+ * Report all collected completions of ring requests.
+ */
+static void
+flush_rings(void)
+{
+
+	flush_ring(&ring_send_done, TRUE /*do_send*/);
+	flush_ring(&ring_recv_done, FALSE /*do_send*/);
+}
+
+/*
+ * A ring request has finished.  Add its result to the collected completions.
+ */
+static void
+finish_ring(struct ring_done * rd, const struct netdriver_data * data,
+	int32_t result, int do_send)
+{
+
+	if (rd->count == __arraycount(rd->result) ||
+	    (rd->count > 0 && data->id != rd->id + rd->count))
+		flush_ring(rd, do_send);
+
+	if (rd->count == 0)
+		rd->id = data->id;
+
+	rd->flags[rd->count] = data->rxflags;
+	rd->result[rd->count++] = result;
+}
+
 /*
  * A packet receive request has finished.  Send a reply and clean up.
  */
@@ -228,12 +381,16 @@ finish_recv(int32_t result)
 
 	data = &pending_recvq[pending_recvtail];
 
-	memset(&m, 0, sizeof(m));
-	m.m_type = NDEV_RECV_REPLY;
-	m.m_netdriver_ndev_reply.id = data->id;
-	m.m_netdriver_ndev_reply.result = result;
+	if (data->ring)
+		finish_ring(&ring_recv_done, data, result, FALSE /*do_send*/);
+	else {
+		memset(&m, 0, sizeof(m));
+		m.m_type = NDEV_RECV_REPLY;
+		m.m_netdriver_ndev_reply.id = data->id;
+		m.m_netdriver_ndev_reply.result = result;
 
-	send_reply(data->endpt, &m);
+		send_reply(data->endpt, &m);
+	}
 
 	pending_recvtail = (pending_recvtail + 1) %
 	    __arraycount(pending_recvq);
@@ -262,6 +419,8 @@ netdriver_recv(void)
 		 * invalid packets.
 		 */
 		do {
+			data->rxflags = 0;
+
 			r = netdriver_table->ndr_recv(data, data->size);
 
 			/*
@@ -307,12 +466,16 @@ finish_send(int32_t result)
 
 	data = &pending_sendq[pending_sendtail];
 
-	memset(&m, 0, sizeof(m));
-	m.m_type = NDEV_SEND_REPLY;
-	m.m_netdriver_ndev_reply.id = data->id;
-	m.m_netdriver_ndev_reply.result = result;
+	if (data->ring)
+		finish_ring(&ring_send_done, data, result, TRUE /*do_send*/);
+	else {
+		memset(&m, 0, sizeof(m));
+		m.m_type = NDEV_SEND_REPLY;
+		m.m_netdriver_ndev_reply.id = data->id;
+		m.m_netdriver_ndev_reply.result = result;
 
-	send_reply(data->endpt, &m);
+		send_reply(data->endpt, &m);
+	}
 
 	pending_sendtail = (pending_sendtail + 1) %
 	    __arraycount(pending_sendq);
@@ -350,14 +513,14 @@ netdriver_send(void)
 }
 
 /*
- * Process a request to send or receive a packet.
+ * Add a request to send or receive a packet to the local queue.
  */
 static void
-do_transfer(const struct netdriver * __restrict ndp, const message * m_ptr,
-	int do_write)
+add_transfer(endpoint_t endpt, uint32_t id, unsigned int count,
+	const cp_grant_id_t * grants, const uint16_t * lens, int do_write,
+	int ring, size_t csum_start, size_t csum_off)
 {
 	struct netdriver_data *data;
-	cp_grant_id_t grant;
 	size_t size;
 	unsigned int i;
 
@@ -377,9 +540,13 @@ do_transfer(const struct netdriver * __restrict ndp, const message * m_ptr,
 		    __arraycount(pending_recvq)];
 	}
 
-	data->endpt = m_ptr->m_source;
-	data->id = m_ptr->m_ndev_netdriver_transfer.id;
-	data->count = m_ptr->m_ndev_netdriver_transfer.count;
+	data->endpt = endpt;
+	data->id = id;
+	data->ring = ring;
+	data->csum_start = csum_start;
+	data->csum_off = csum_off;
+	data->rxflags = 0;
+	data->count = count;
 
 	if (data->count == 0 || data->count > NDEV_IOV_MAX)
 		panic("netdriver: bad I/O vector count: %u", data->count);
@@ -387,12 +554,11 @@ do_transfer(const struct netdriver * __restrict ndp, const message * m_ptr,
 	data->size = 0;
 
 	for (i = 0; i < data->count; i++) {
-		grant = m_ptr->m_ndev_netdriver_transfer.grant[i];
-		size = (size_t)m_ptr->m_ndev_netdriver_transfer.len[i];
+		size = (size_t)lens[i];
 
 		assert(size > 0);
 
-		data->iovec[i].iov_grant = grant;
+		data->iovec[i].iov_grant = grants[i];
 		data->iovec[i].iov_size = size;
 		data->size += size;
 	}
@@ -401,10 +567,30 @@ do_transfer(const struct netdriver * __restrict ndp, const message * m_ptr,
 	    (!do_write && data->size < NDEV_ETH_PACKET_MAX_TAGGED))
 		panic("netdriver: invalid I/O vector size: %zu\n", data->size);
 
+	if (csum_start != 0 && csum_start + csum_off + sizeof(uint16_t) >
+	    data->size)
+		panic("netdriver: invalid checksum offsets: %zu, %zu",
+		    csum_start, csum_off);
+
 	if (do_write)
 		pending_sends++;
 	else
 		pending_recvs++;
+}
+
+/*
+ * Process a request to send or receive a packet.
+ */
+static void
+do_transfer(const struct netdriver * __restrict ndp, const message * m_ptr,
+	int do_write)
+{
+
+	add_transfer(m_ptr->m_source, m_ptr->m_ndev_netdriver_transfer.id,
+	    m_ptr->m_ndev_netdriver_transfer.count,
+	    m_ptr->m_ndev_netdriver_transfer.grant,
+	    m_ptr->m_ndev_netdriver_transfer.len, do_write, FALSE /*ring*/,
+	    0, 0);
 
 	/*
 	 * If the driver is down, immediately abort the request again.  This
@@ -427,6 +613,73 @@ do_transfer(const struct netdriver * __restrict ndp, const message * m_ptr,
 		netdriver_recv();
 }
 
+/*
+ * Process a request to send or receive a batch of packets, as described by
+ * consecutive descriptors in the shared descriptor ring.
+ */
+static void
+do_ring_transfer(const struct netdriver * __restrict ndp,
+	const message * m_ptr, int do_write)
+{
+	struct ndev_desc desc[NDEV_RING_MAX];
+	uint32_t id;
+	unsigned int i, count, slot, chunk;
+	size_t off;
+	int r;
+
+	if (!GRANT_VALID(ring_grant) || m_ptr->m_source != ring_endpt)
+		panic("netdriver: ring request without ring");
+
+	id = m_ptr->m_ndev_netdriver_ring.id;
+	count = m_ptr->m_ndev_netdriver_ring.count;
+
+	if (count == 0 || count > __arraycount(desc))
+		panic("netdriver: bad ring request count: %u", count);
+
+	off = (do_write) ? offsetof(struct ndev_ring, nr_send) :
+	    offsetof(struct ndev_ring, nr_recv);
+
+	/* Copy in the descriptors, which may wrap around the ring's end. */
+	slot = id % NDEV_RING_MAX;
+	chunk = NDEV_RING_MAX - slot;
+	if (chunk > count)
+		chunk = count;
+
+	r = sys_safecopyfrom(ring_endpt, ring_grant,
+	    off + slot * sizeof(desc[0]), (vir_bytes)desc,
+	    chunk * sizeof(desc[0]));
+
+	if (r == OK && chunk < count)
+		r = sys_safecopyfrom(ring_endpt, ring_grant, off,
+		    (vir_bytes)&desc[chunk], (count - chunk) * sizeof(desc[0]));
+
+	if (r != OK)
+		panic("netdriver: unable to copy ring descriptors: %d", r);
+
+	for (i = 0; i < count; i++)
+		add_transfer(ring_endpt, id + i, desc[i].nd_count,
+		    desc[i].nd_grant, desc[i].nd_len, do_write, TRUE /*ring*/,
+		    (do_write) ? desc[i].nd_csum_start : 0,
+		    (do_write) ? desc[i].nd_csum_off : 0);
+
+	/* If the driver is down, immediately abort the requests again. */
+	if (!up) {
+		for (i = 0; i < count; i++) {
+			if (do_write)
+				finish_send(EINTR);
+			else
+				finish_recv(EINTR);
+		}
+
+		return;
+	}
+
+	if (do_write)
+		netdriver_send();
+	else
+		netdriver_recv();
+}
+
 /*
  * Process a request to (re)configure the driver.
  */
@@ -443,6 +696,9 @@ do_conf(const struct netdriver * __restrict ndp,
 	set = m_ptr->m_ndev_netdriver_conf.set;
 	mode = m_ptr->m_ndev_netdriver_conf.mode;
 
+	/* Keep replies in request order. */
+	flush_rings();
+
 	/*
 	 * If the request includes taking down the interface, perform that step
 	 * first: it is expected that in many cases, changing other settings
@@ -722,6 +978,19 @@ do_init(const struct netdriver * __restrict ndp,
 
 	status_endpt = m_ptr->m_source;
 
+	/*
+	 * Use the caller's descriptor ring if it provided one that we can
+	 * understand.  Any completions still collected were for the previous
+	 * caller instance.
+	 */
+	if (m_ptr->m_ndev_netdriver_init.ring_size == sizeof(struct ndev_ring))
+		ring_grant = m_ptr->m_ndev_netdriver_init.ring_grant;
+	else
+		ring_grant = GRANT_INVALID;
+	ring_endpt = m_ptr->m_source;
+	ring_send_done.count = 0;
+	ring_recv_done.count = 0;
+
 	/*
 	 * Update link and media now, because we are about to send the initial
 	 * values of those to the caller as well.
@@ -733,7 +1002,17 @@ do_init(const struct netdriver * __restrict ndp,
 	m.m_netdriver_ndev_init_reply.id = m_ptr->m_ndev_netdriver_init.id;
 	m.m_netdriver_ndev_init_reply.link = device_link;
 	m.m_netdriver_ndev_init_reply.media = device_media;
+	/*
+	 * Checksum offloading requires per-packet information, which can be
+	 * exchanged only through the descriptor ring.  Without a ring, hide
+	 * the driver's checksum offload capabilities from the caller.
+	 */
 	m.m_netdriver_ndev_init_reply.caps = device_caps;
+	if (!GRANT_VALID(ring_grant))
+		m.m_netdriver_ndev_init_reply.caps &= ~(NDEV_CAP_CS_IP4_TX |
+		    NDEV_CAP_CS_IP4_RX | NDEV_CAP_CS_UDP_TX |
+		    NDEV_CAP_CS_UDP_RX | NDEV_CAP_CS_TCP_TX |
+		    NDEV_CAP_CS_TCP_RX);
 	strlcpy(m.m_netdriver_ndev_init_reply.name, device_name,
 	    sizeof(m.m_netdriver_ndev_init_reply.name));
 	assert(sizeof(device_hwaddr) <=
@@ -744,6 +1023,7 @@ do_init(const struct netdriver * __restrict ndp,
 
 	m.m_netdriver_ndev_init_reply.max_send = __arraycount(pending_sendq);
 	m.m_netdriver_ndev_init_reply.max_recv = __arraycount(pending_recvq);
+	m.m_netdriver_ndev_init_reply.ring = GRANT_VALID(ring_grant);
 
 	send_reply(m_ptr->m_source, &m);
 
@@ -787,6 +1067,8 @@ netdriver_process(const struct netdriver * __restrict ndp,
 				ndp->ndr_other(m_ptr, ipc_status);
 		}
 
+		flush_rings();
+
 		return;
 	}
 
@@ -821,6 +1103,14 @@ netdriver_process(const struct netdriver * __restrict ndp,
 		do_transfer(ndp, m_ptr, FALSE /*do_write*/);
 		break;
 
+	case NDEV_SEND_RING:
+		do_ring_transfer(ndp, m_ptr, TRUE /*do_write*/);
+		break;
+
+	case NDEV_RECV_RING:
+		do_ring_transfer(ndp, m_ptr, FALSE /*do_write*/);
+		break;
+
 	case NDEV_STATUS_REPLY:
 		do_status_reply(ndp, m_ptr);
 		break;
@@ -829,6 +1119,8 @@ netdriver_process(const struct netdriver * __restrict ndp,
 		if (ndp->ndr_other != NULL)
 			ndp->ndr_other(m_ptr, ipc_status);
 	}
+
+	flush_rings();
 }
 
 /*
@@ -893,6 +1185,11 @@ netdriver_init(const struct netdriver * ndp)
 	pending_status = FALSE;
 	pending_link = FALSE;
 
+	ring_grant = GRANT_INVALID;
+	ring_endpt = NONE;
+	ring_send_done.count = 0;
+	ring_recv_done.count = 0;
+
 	up = FALSE;
 
 	ticks = 0;
@@ -5,6 +5,10 @@
 struct netdriver_data {
 	endpoint_t endpt;
 	uint32_t id;
+	int ring;
+	size_t csum_start;
+	size_t csum_off;
+	uint32_t rxflags;
 	size_t size;
 	unsigned int count;
 	iovec_s_t iovec[NDEV_IOV_MAX];
@@ -13,7 +13,17 @@
 
 static SLIST_HEAD(, sock) sockhash[SOCKHASH_SLOTS];
 
-static SLIST_HEAD(, sock) socktimer;
+/*
+ * Socket objects with timers are kept on a timers queue of their own, which
+ * libtimers implements as a hierarchical timing wheel.  Each socket object has
+ * one timer, set to the earliest timeout of the socket.  Adding and removing a
+ * socket take constant time, and processing expired timers takes time
+ * proportional to the number of sockets involved, rather than to the total
+ * number of sockets with timers.  A single system alarm is used to process
+ * the queue at its head time.
+ */
+static minix_timers_t socktimers;
+static clock_t socktimer_now;		/* time of current expiry run */
 
 static minix_timer_t sockevent_timer;
 
@@ -24,6 +34,7 @@ static sockevent_socket_cb_t sockevent_socket_cb = NULL;
 static int sockevent_working;
 
 static void socktimer_del(struct sock * sock);
+static void socktimer_expire(int arg);
 static void sockevent_cancel_send(struct sock * sock,
 	struct sockevent_proc * spr, int err);
 static void sockevent_cancel_recv(struct sock * sock,
@@ -597,12 +608,24 @@ sockevent_resume(struct sock * sock, struct sockevent_proc * spr)
 		else {
 			len = spr->spr_datalen - spr->spr_dataoff;
 
-			if (sock->sock_err == OK) {
+			/*
+			 * A blocked MSG_WAITALL call will not return before
+			 * all of the requested data have been received, so
+			 * ask for the entire rest of the request.  This lets
+			 * the socket driver accumulate data and copy it out in
+			 * few large chunks, rather than one small chunk per
+			 * arriving packet.  The socket driver must bound
+			 * 'min' to what it can buffer, as for the low mark.
+			 */
+			if (sock->sock_err != OK)
+				min = 0;
+			else if (spr->spr_flags & MSG_WAITALL)
+				min = len;
+			else {
 				min = sock->sock_rlowat;
 				if (min > len)
 					min = len;
-			} else
-				min = 0;
+			}
 
 			sockdriver_unpack_data(&data, &spr->spr_call,
 			    &spr->spr_data, spr->spr_datalen);
@@ -970,11 +993,31 @@ static void
 socktimer_init(void)
 {
 
-	SLIST_INIT(&socktimer);
+	memset(&socktimers, 0, sizeof(socktimers));
 
 	init_timer(&sockevent_timer);
 }
 
+/*
+ * Make sure that the socket event alarm goes off no later than the given new
+ * head time of the socket timers queue.
+ */
+static void
+socktimer_set_alarm(clock_t now, clock_t head)
+{
+
+	/*
+	 * The queue may lag behind the current time if the alarm has not yet
+	 * gone off, in which case the head time may be due now.
+	 */
+	if (!tmr_is_first(now, head))
+		head = now + 1;
+
+	if (!tmr_is_set(&sockevent_timer) ||
+	    tmr_is_first(head, tmr_exp_time(&sockevent_timer)))
+		set_timer(&sockevent_timer, head - now, socktimer_expire, 0);
+}
+
 /*
  * Check whether the given socket object has any suspended requests that have
  * now expired.  If so, cancel them.  Also, if the socket object has any
@@ -992,13 +1035,17 @@ sockevent_expire(struct sock * sock, clock_t now)
 	/*
 	 * First handle the case that the socket is closed.  In this case,
 	 * there may be a linger timer, although the socket may also simply
-	 * still be on the timer list because of a request that did not time
+	 * still have a timer set because of a request that did not time
 	 * out right before the socket was closed.
 	 */
 	if (sock->sock_flags & SFL_CLOSING) {
-		/* Was there a linger timer and has it expired? */
+		/* Is there a linger timer that has not yet expired? */
 		if ((sock->sock_opt & SO_LINGER) &&
-		    tmr_is_first(sock->sock_linger, now)) {
+		    !tmr_is_first(sock->sock_linger, now))
+			return sock->sock_linger - now;
+
+		/* Was there a linger timer and has it expired? */
+		if (sock->sock_opt & SO_LINGER) {
 			assert(sock->sock_ops->sop_close != NULL);
 
 			/*
@@ -1089,60 +1136,62 @@ sockevent_expire(struct sock * sock, clock_t now)
 }
 
 /*
- * The socket event alarm went off.  Go through the set of socket objects with
- * timers, and see if any of their requests have now expired.  Set a new alarm
- * as necessary.
+ * The timer of a socket object went off.  Cancel its expired requests, and
+ * set its timer again for the earliest remaining timeout, if any.
  */
 static void
-socktimer_expire(int arg __unused)
+socktimer_fire(int arg)
 {
-	SLIST_HEAD(, sock) oldtimer;
-	struct sock *sock, *tsock;
-	clock_t now, lowest, left;
-	int working;
+	struct sock *sock;
+	clock_t left, time;
+
+	/* Sockets with a timer set are always in the hash table. */
+	if ((sock = sockhash_get((sockid_t)arg)) == NULL)
+		panic("libsockevent: timer fired for unknown socket %d", arg);
 
+	left = sockevent_expire(sock, socktimer_now);
 	/*
-	 * This function may or may not be called from a context where we are
-	 * already deferring events, so we have to cover both cases here.
+	 * The sock object may already have been deallocated now.  If 'left'
+	 * is TMR_NEVER, do not touch 'sock' anymore.
 	 */
-	if ((working = sockevent_working) == FALSE)
-		sockevent_working = TRUE;
 
-	/* Start a new list. */
-	memcpy(&oldtimer, &socktimer, sizeof(oldtimer));
-	SLIST_INIT(&socktimer);
+	if (left == TMR_NEVER)
+		return;
 
-	now = getticks();
-	lowest = TMR_NEVER;
+	time = socktimer_now + left;
 
-	/*
-	 * Go through all sockets that have or had a request with a timeout,
-	 * canceling any expired requests and building a new list of sockets
-	 * that still have requests with timeouts as we go.
-	 */
-	SLIST_FOREACH_SAFE(sock, &oldtimer, sock_timer, tsock) {
-		assert(sock->sock_flags & SFL_TIMER);
-		sock->sock_flags &= ~SFL_TIMER;
+	/* Expiry handling may have set a new timer already. */
+	if (tmr_is_set(&sock->sock_timer) &&
+	    !tmr_is_first(time, tmr_exp_time(&sock->sock_timer)))
+		return;
 
-		left = sockevent_expire(sock, now);
-		/*
-		 * The sock object may already have been deallocated now.
-		 * If 'next' is TMR_NEVER, do not touch 'sock' anymore.
-		 */
+	(void)tmrs_settimer(&socktimers, &sock->sock_timer, time,
+	    socktimer_now, socktimer_fire, arg, NULL, NULL);
+}
 
-		if (left != TMR_NEVER) {
-			if (lowest == TMR_NEVER || lowest > left)
-				lowest = left;
+/*
+ * The socket event alarm went off.  Process the socket timers queue up to the
+ * current time, canceling expired requests of the sockets whose timers went
+ * off.  Set a new alarm as necessary.
+ */
+static void
+socktimer_expire(int arg __unused)
+{
+	clock_t head;
+	int working;
 
-			SLIST_INSERT_HEAD(&socktimer, sock, sock_timer);
+	/*
+	 * This function may or may not be called from a context where we are
+	 * already deferring events, so we have to cover both cases here.
+	 */
+	if ((working = sockevent_working) == FALSE)
+		sockevent_working = TRUE;
 
-			sock->sock_flags |= SFL_TIMER;
-		}
-	}
+	socktimer_now = getticks();
 
-	/* If there is a new lowest timeout at all, set a new timer. */
-	if (lowest != TMR_NEVER)
-		set_timer(&sockevent_timer, lowest, socktimer_expire, 0);
+	/* If there are any timers left, set a new alarm. */
+	if (tmrs_exptimers(&socktimers, socktimer_now, &head))
+		socktimer_set_alarm(socktimer_now, head);
 
 	if (!working) {
 		/* If any new events were raised, process them now. */
@@ -1155,16 +1204,16 @@ socktimer_expire(int arg __unused)
 
 /*
  * Set a timer for the given (relative) number of clock ticks, adding the
- * associated socket object to the set of socket objects with timers, if it was
- * not already in that set.  Set a new alarm if necessary, and return the
- * absolute timeout for the timer.  Since the timers list is maintained lazily,
- * the caller need not take the object off the set if the call was canceled
- * later; see also socktimer_del().
+ * associated socket object to the socket timers queue, or moving it if the new
+ * timer expires sooner than the socket's current timer.  Set a new alarm if
+ * necessary, and return the absolute timeout for the timer.  Since the timers
+ * queue is maintained lazily, the caller need not take the object off the
+ * queue if the call was canceled later; see also socktimer_del().
  */
 static clock_t
 socktimer_add(struct sock * sock, clock_t ticks)
 {
-	clock_t now;
+	clock_t now, time, head;
 
 	/*
 	 * Relative time comparisons require that any two times are no more
@@ -1172,43 +1221,33 @@ socktimer_add(struct sock * sock, clock_t ticks)
 	 */
 	assert(ticks <= TMRDIFF_MAX);
 
-	/* If the socket was not already on the timers list, put it on. */
-	if (!(sock->sock_flags & SFL_TIMER)) {
-		SLIST_INSERT_HEAD(&socktimer, sock, sock_timer);
+	now = getticks();
+	time = now + ticks;
 
-		sock->sock_flags |= SFL_TIMER;
-	}
+	if (tmr_is_set(&sock->sock_timer) &&
+	    !tmr_is_first(time, tmr_exp_time(&sock->sock_timer)))
+		return time;
 
-	/*
-	 * (Re)set the timer if either it was not running at all or this new
-	 * timeout will occur sooner than the currently scheduled alarm.  Note
-	 * that setting a timer that was already set is allowed.
-	 */
-	now = getticks();
+	(void)tmrs_settimer(&socktimers, &sock->sock_timer, time, now,
+	    socktimer_fire, sock->sock_id, NULL, &head);
 
-	if (!tmr_is_set(&sockevent_timer) ||
-	    tmr_is_first(now + ticks, tmr_exp_time(&sockevent_timer)))
-		set_timer(&sockevent_timer, ticks, socktimer_expire, 0);
+	socktimer_set_alarm(now, head);
 
 	/* Return the absolute timeout. */
-	return now + ticks;
+	return time;
 }
 
 /*
- * Remove a socket object from the set of socket objects with timers.  Since
- * the timer list is maintained lazily, this needs to be done only right before
- * the socket object is freed.
+ * Take a socket object off the socket timers queue.  Since the queue is
+ * maintained lazily, this needs to be done only right before the socket object
+ * is freed.
  */
 static void
 socktimer_del(struct sock * sock)
 {
 
-	if (sock->sock_flags & SFL_TIMER) {
-		/* This macro is O(n). */
-		SLIST_REMOVE(&socktimer, sock, sock, sock_timer);
-
-		sock->sock_flags &= ~SFL_TIMER;
-	}
+	if (tmr_is_set(&sock->sock_timer))
+		(void)tmrs_clrtimer(&socktimers, &sock->sock_timer, NULL, NULL);
 }
 
 /*
@@ -2261,12 +2300,12 @@ sockevent_close(sockid_t id, const struct sockdriver_call * call)
 		 * the linger timeout with the close call.  Instead, we convert
 		 * the sock_linger value from a (relative) duration to an
 		 * (absolute) timeout time, and use the SFL_CLOSING flag (along
-		 * with SFL_TIMER) to tell the difference.  Since the socket is
-		 * otherwise unreachable from userland at this point, the
-		 * conversion is never visible in any way.
+		 * with the socket timer) to tell the difference.  Since the
+		 * socket is otherwise unreachable from userland at this point,
+		 * the conversion is never visible in any way.
 		 *
-		 * The socket may already be in the timers list, so we must
-		 * always check the SO_LINGER flag before checking sock_linger.
+		 * The socket may already have a timer set, so we must always
+		 * check the SO_LINGER flag before checking sock_linger.
 		 *
 		 * If SO_LINGER is not set, we must never suspend the call.
 		 */
@@ -2327,8 +2366,35 @@ sockevent_cancel_send(struct sock * sock, struct sockevent_proc * spr, int err)
 static void
 sockevent_cancel_recv(struct sock * sock, struct sockevent_proc * spr, int err)
 {
+	struct sockdriver_data data, ctl;
+	char addr[SOCKADDR_MAX];
+	socklen_t addr_len;
 	int r;
 
+	/*
+	 * A blocked MSG_WAITALL call may have left data in the socket driver
+	 * while waiting for more (see sockevent_resume).  Give the caller
+	 * whatever is available now, as it would have gotten without such
+	 * batching.  Do this only if no other receive calls are suspended, as
+	 * the data may otherwise be meant for an earlier call.
+	 */
+	if ((spr->spr_flags & MSG_WAITALL) && sock->sock_err == OK &&
+	    !(sock->sock_flags & SFL_SHUT_RD) &&
+	    !sockevent_has_suspended(sock, SEV_RECV)) {
+		sockdriver_unpack_data(&data, &spr->spr_call, &spr->spr_data,
+		    spr->spr_datalen);
+		sockdriver_unpack_data(&ctl, &spr->spr_call, &spr->spr_ctl,
+		    spr->spr_ctllen);
+
+		addr_len = 0;
+
+		(void)sock->sock_ops->sop_recv(sock, &data,
+		    spr->spr_datalen - spr->spr_dataoff, &spr->spr_dataoff,
+		    &ctl, spr->spr_ctllen - spr->spr_ctloff, &spr->spr_ctloff,
+		    (struct sockaddr *)&addr, &addr_len, spr->spr_endpt,
+		    spr->spr_flags, 1 /*min*/, &spr->spr_rflags);
+	}
+
 	/*
 	 * If any regular or control data were received, return the number of
 	 * data bytes received--possibly zero.  Otherwise return the given
@@ -28,6 +28,11 @@ u32_t tsc_64_to_micros(u64_t tsc)
 	return (u32_t) tmp;
 }
 
+u64_t tsc_64_to_micros64(u64_t tsc)
+{
+	return tsc / calib_hz;
+}
+
 u32_t tsc_to_micros(u32_t low, u32_t high)
 {
 	return tsc_64_to_micros(make64(low, high));
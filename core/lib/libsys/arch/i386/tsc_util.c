@@ -96,6 +96,13 @@ u32_t tsc_64_to_micros(u64_t tsc)
 	}
 }
 
+u64_t tsc_64_to_micros64(u64_t tsc)
+{
+	CALIBRATE;
+
+	return tsc / calib_mhz;
+}
+
 u32_t tsc_to_micros(u32_t low, u32_t high)
 {
 	return tsc_64_to_micros(make64(low, high));
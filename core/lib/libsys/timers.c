@@ -1,6 +1,6 @@
 /*
  * Watchdog timer management. These functions in this file provide a
- * convenient interface to the timers library that manages a list of
+ * convenient interface to the timers library that manages a queue of
  * watchdog timers. All details of scheduling an alarm at the CLOCK task
  * are hidden behind this interface.
  *
@@ -16,7 +16,7 @@
 #include <minix/timers.h>
 #include <minix/sysutil.h>
 
-static minix_timer_t *timers = NULL;
+static minix_timers_t timers;
 static int expiring = FALSE;
 
 /*
@@ -40,14 +40,15 @@ init_timer(minix_timer_t * tp)
 void
 set_timer(minix_timer_t *tp, clock_t ticks, tmr_func_t watchdog, int arg)
 {
-	clock_t prev_time, next_time;
+	clock_t now, prev_time, next_time;
 	int r, had_timers;
 
 	if (ticks > TMRDIFF_MAX)
 		panic("set_timer: ticks value too large: %u", (int)ticks);
 
-	/* Add the timer to the list. */
-	had_timers = tmrs_settimer(&timers, tp, getticks() + ticks, watchdog,
+	/* Add the timer to the queue. */
+	now = getticks();
+	had_timers = tmrs_settimer(&timers, tp, now + ticks, now, watchdog,
 	    arg, &prev_time, &next_time);
 
 	/* Reschedule our synchronous alarm if necessary. */
@@ -0,0 +1,9 @@
+#ifndef MINIX_LIBTIMERS_TMRS_H
+#define MINIX_LIBTIMERS_TMRS_H
+
+/* tmrs_wheel.c */
+void tmrs_insert(minix_timers_t *tmrs, minix_timer_t *tp, clock_t pos);
+void tmrs_remove(minix_timers_t *tmrs, minix_timer_t *tp);
+void tmrs_update(minix_timers_t *tmrs);
+
+#endif /* !MINIX_LIBTIMERS_TMRS_H */
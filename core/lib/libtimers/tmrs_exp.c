@@ -1,28 +1,93 @@
 #include <minix/timers.h>
 
+#include "tmrs.h"
+
 /*
- * Use the current time to check the timers queue list for expired timers.
- * Run the watchdog functions for all expired timers and deactivate them.
- * The caller is responsible for scheduling a new alarm if needed.
+ * Move all timers in the given slot of the timer wheel 'tmrs' one or more
+ * levels down, based on their expiry times.
+ */
+static void
+tmrs_cascade(minix_timers_t * tmrs, unsigned int level, unsigned int slot)
+{
+	minix_timer_t *tp, *list;
+
+	/*
+	 * Timers parked in the top level may end up in the same slot again,
+	 * so empty the slot first.
+	 */
+	list = NULL;
+
+	while ((tp = tmrs->tmrs_slot[level][slot]) != NULL) {
+		tmrs_remove(tmrs, tp);
+
+		tp->tmr_next = list;
+		list = tp;
+	}
+
+	while ((tp = list) != NULL) {
+		list = tp->tmr_next;
+		tp->tmr_next = NULL;
+
+		tmrs_insert(tmrs, tp, tp->tmr_exp_time);
+	}
+}
+
+/*
+ * Use the current time to advance the timer wheel of the timers queue.
+ * Move timers down the wheel as their slots are reached, and run the watchdog
+ * functions for all expired timers and deactivate them.  The work done is
+ * proportional to the number of timers involved, rather than to the total
+ * number of timers on the queue.  The caller is responsible for scheduling a
+ * new alarm if needed.
  */
 int
-tmrs_exptimers(minix_timer_t ** tmrs, clock_t now, clock_t * new_head)
+tmrs_exptimers(minix_timers_t * tmrs, clock_t now, clock_t * new_head)
 {
 	minix_timer_t *tp;
 	tmr_func_t func;
+	clock_t time;
+	unsigned int level, slot;
+
+	while (tmrs_has_expired(tmrs, now)) {
+		time = tmrs->tmrs_head;
+		tmrs->tmrs_now = time;
+
+		/* Move down timers in slots starting now, from the top. */
+		for (level = TMRS_LEVELS - 1; level > 0; level--) {
+			if (time & (((clock_t)1 << (TMRS_BITS * level)) - 1))
+				continue;
 
-	while ((tp = *tmrs) != NULL && tmr_has_expired(tp, now)) {
-		*tmrs = tp->tmr_next;
+			tmrs_cascade(tmrs, level,
+			    (time >> (TMRS_BITS * level)) & (TMRS_SLOTS - 1));
+		}
 
-		func = tp->tmr_func;
-		tp->tmr_func = NULL;
+		/*
+		 * Expire the timers in the lowest-level slot.  Watchdog
+		 * functions may set and clear timers, including timers in
+		 * this slot, but new timers always end up in later slots.
+		 */
+		slot = time & (TMRS_SLOTS - 1);
 
-		(*func)(tp->tmr_arg);
+		while ((tp = tmrs->tmrs_slot[0][slot]) != NULL) {
+			tmrs_remove(tmrs, tp);
+
+			func = tp->tmr_func;
+			tp->tmr_func = NULL;
+
+			(*func)(tp->tmr_arg);
+		}
+
+		if (tmrs->tmrs_count > 0)
+			tmrs_update(tmrs);
 	}
 
-	if (*tmrs != NULL) {
+	/* Never move the wheel back, as that would misplace timers. */
+	if (tmr_is_first(tmrs->tmrs_now, now))
+		tmrs->tmrs_now = now;
+
+	if (tmrs->tmrs_count > 0) {
 		if (new_head != NULL)
-			*new_head = (*tmrs)->tmr_exp_time;
+			*new_head = tmrs->tmrs_head;
 		return TRUE;
 	} else
 		return FALSE;
@@ -1,48 +1,61 @@
 #include <minix/timers.h>
 
+#include "tmrs.h"
+
 /*
  * Activate a timer to run function 'watchdog' at absolute time 'exp_time', as
- * part of timers queue 'tmrs'. If the timer is already in use, it is first
- * removed from the timers queue.  Then, it is put in the list of active timers
- * with the first to expire in front.  The caller responsible for scheduling a
- * new alarm for the timer if needed.  To that end, the function returns three
- * values: its return value (TRUE or FALSE) indicates whether there was an old
- * head timer; if TRUE, 'old_head' (if non-NULL) is filled with the absolute
- * expiry time of the old head timer.  If 'new_head' is non-NULL, it is filled
- * with the absolute expiry time of the new head timer.
+ * part of timers queue 'tmrs', given the current absolute time 'now'. If the
+ * timer is already in use, it is first removed from the timers queue.  Then,
+ * it is put on the queue's timer wheel.  An expiry time that has already
+ * passed is treated as the next clock tick.  The caller responsible for
+ * scheduling a new alarm for the timer if needed.  To that end, the function
+ * returns three values: its return value (TRUE or FALSE) indicates whether
+ * there was an old head time; if TRUE, 'old_head' (if non-NULL) is filled
+ * with the old absolute head time of the queue.  If 'new_head' is non-NULL,
+ * it is filled with the new absolute head time.
  */
 int
-tmrs_settimer(minix_timer_t ** tmrs, minix_timer_t * tp, clock_t exp_time,
-	tmr_func_t watchdog, int arg, clock_t * old_head, clock_t * new_head)
+tmrs_settimer(minix_timers_t * tmrs, minix_timer_t * tp, clock_t exp_time,
+	clock_t now, tmr_func_t watchdog, int arg, clock_t * old_head,
+	clock_t * new_head)
 {
-	minix_timer_t **atp;
+	clock_t pos;
 	int r;
 
-	if (*tmrs != NULL) {
+	if (tmrs->tmrs_count > 0) {
 		if (old_head != NULL)
-			*old_head = (*tmrs)->tmr_exp_time;
+			*old_head = tmrs->tmrs_head;
 		r = TRUE;
 	} else
 		r = FALSE;
 
 	/* Set the timer's variables. */
-	if (tmr_is_set(tp))
-		(void)tmrs_clrtimer(tmrs, tp, NULL, NULL);
+	if (tp->tmr_prev != NULL) {
+		tmrs_remove(tmrs, tp);
+
+		if (tmrs->tmrs_count > 0)
+			tmrs_update(tmrs);
+	}
 	tp->tmr_exp_time = exp_time;
 	tp->tmr_func = watchdog;	/* set the timer object */
 	tp->tmr_arg = arg;
 
 	/*
-	 * Add the timer to the active timers. The next timer due is in front.
+	 * Add the timer to the timer wheel.  An empty wheel need not lag
+	 * behind, but it must not move past the current time either: a timer
+	 * set later with an earlier expiry time would then fire too late.
 	 */
-	for (atp = tmrs; *atp != NULL; atp = &(*atp)->tmr_next) {
-		if (tmr_is_first(exp_time, (*atp)->tmr_exp_time))
-			break;
-	}
-	tp->tmr_next = *atp;
-	*atp = tp;
+	if (tmrs->tmrs_count == 0)
+		tmrs->tmrs_now = now;
+
+	if (tmr_is_first(exp_time, tmrs->tmrs_now))
+		pos = tmrs->tmrs_now + 1;
+	else
+		pos = exp_time;
+
+	tmrs_insert(tmrs, tp, pos);
 
 	if (new_head != NULL)
-		*new_head = (*tmrs)->tmr_exp_time;
+		*new_head = tmrs->tmrs_head;
 	return r;
 }
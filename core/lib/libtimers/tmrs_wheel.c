@@ -0,0 +1,115 @@
+#include <minix/timers.h>
+#include <assert.h>
+
+#include "tmrs.h"
+
+/*
+ * Put a timer on the timer wheel 'tmrs', in the slot that covers the wheel
+ * position 'pos'.  The position is normally the timer's expiry time, but must
+ * not lie before the time up to which the wheel has been processed.  A
+ * position equal to that time is allowed only for timers being moved down the
+ * wheel, and puts the timer in the lowest-level slot currently being
+ * processed.  A position beyond the range of the wheel is brought back to the
+ * furthest slot of the top level, from which the timer will be moved again
+ * once that slot is reached.  The timer must not already be on the wheel.
+ */
+void
+tmrs_insert(minix_timers_t * tmrs, minix_timer_t * tp, clock_t pos)
+{
+	minix_timer_t **head;
+	clock_t delta, start;
+	unsigned int level, slot;
+
+	assert(tp->tmr_prev == NULL);
+
+	delta = pos - tmrs->tmrs_now;
+
+	for (level = 0; level < TMRS_LEVELS - 1; level++)
+		if (delta < ((clock_t)1 << (TMRS_BITS * (level + 1))))
+			break;
+
+	if (level == TMRS_LEVELS - 1 &&
+	    delta >= ((clock_t)1 << (TMRS_BITS * TMRS_LEVELS)))
+		pos = tmrs->tmrs_now +
+		    ((clock_t)TMRS_SLOTS << (TMRS_BITS * level));
+
+	slot = (pos >> (TMRS_BITS * level)) & (TMRS_SLOTS - 1);
+
+	head = &tmrs->tmrs_slot[level][slot];
+	if ((tp->tmr_next = *head) != NULL)
+		tp->tmr_next->tmr_prev = &tp->tmr_next;
+	tp->tmr_prev = head;
+	*head = tp;
+
+	tp->tmr_level = level;
+	tp->tmr_slot = slot;
+
+	/* The wheel must move when the start of the timer's slot is reached. */
+	start = (pos >> (TMRS_BITS * level)) << (TMRS_BITS * level);
+	if (tmrs->tmrs_count == 0 || tmr_is_first(start, tmrs->tmrs_head))
+		tmrs->tmrs_head = start;
+
+	tmrs->tmrs_map[level] |= (u64_t)1 << slot;
+	tmrs->tmrs_count++;
+}
+
+/*
+ * Take a timer off the timer wheel 'tmrs'.  The timer must be on the wheel.
+ * The wheel's head time is not updated, so it may end up earlier than needed;
+ * call tmrs_update() to recompute it.
+ */
+void
+tmrs_remove(minix_timers_t * tmrs, minix_timer_t * tp)
+{
+
+	assert(tp->tmr_prev != NULL);
+	assert(tmrs->tmrs_count > 0);
+
+	if ((*tp->tmr_prev = tp->tmr_next) != NULL)
+		tp->tmr_next->tmr_prev = tp->tmr_prev;
+	tp->tmr_prev = NULL;
+	tp->tmr_next = NULL;
+
+	if (tmrs->tmrs_slot[tp->tmr_level][tp->tmr_slot] == NULL)
+		tmrs->tmrs_map[tp->tmr_level] &= ~((u64_t)1 << tp->tmr_slot);
+
+	tmrs->tmrs_count--;
+}
+
+/*
+ * Recompute the head time of the timer wheel 'tmrs': the first time after the
+ * time up to which the wheel has been processed, at which a slot in use is
+ * reached.  For the lowest level, this is the time at which its timers expire.
+ * For higher levels, this is the time at which its timers must be moved down.
+ */
+void
+tmrs_update(minix_timers_t * tmrs)
+{
+	clock_t cur, time;
+	unsigned int level, dist;
+	u64_t map;
+	int found;
+
+	found = FALSE;
+
+	for (level = 0; level < TMRS_LEVELS; level++) {
+		if ((map = tmrs->tmrs_map[level]) == 0)
+			continue;
+
+		cur = tmrs->tmrs_now >> (TMRS_BITS * level);
+
+		for (dist = 1; dist <= TMRS_SLOTS; dist++)
+			if (map & ((u64_t)1 << ((cur + dist) & (TMRS_SLOTS - 1))))
+				break;
+		assert(dist <= TMRS_SLOTS);
+
+		time = (cur + dist) << (TMRS_BITS * level);
+
+		if (!found || tmr_is_first(time, tmrs->tmrs_head)) {
+			tmrs->tmrs_head = time;
+			found = TRUE;
+		}
+	}
+
+	assert(found || tmrs->tmrs_count == 0);
+}
@@ -42,8 +42,16 @@
  *
  * descriptors to a queue as this represent the maximum size of an indirect
  * descriptor table.
+ *
+ * If the driver lists VIRTIO_RING_F_INDIRECT_DESC among its features and the
+ * host supports it, longer chains always go into an indirect table as long as
+ * one is free, so that a large scatter-gather request takes up only a single
+ * slot in the ring.
  */
 
+/* Chains longer than this are put in an indirect table when negotiated */
+#define INDIRECT_MIN_DESCS	2
+
 struct indirect_desc_table {
 	int in_use;
 	struct vring_desc *descs;
@@ -64,7 +72,8 @@ struct virtio_queue {
 	u16_t free_num;				/* free descriptors */
 	u16_t free_head;			/* next free descriptor */
 	u16_t free_tail;			/* last free descriptor */
-	u16_t last_used;			/* we checked in used */
+	u16_t last_used;			/* we checked in used (free-running) */
+	int intr_off;				/* interrupts suppressed? */
 
 	void **data;				/* points to pointers */
 };
@@ -89,6 +98,9 @@ struct virtio_device {
 
 	struct indirect_desc_table *indirect;	/* indirect descriptor tables */
 	int num_indirect;
+
+	int indirect_desc;			/* negotiated INDIRECT_DESC? */
+	int event_idx;				/* negotiated EVENT_IDX? */
 };
 
 static int is_matching_device(u16_t expected_sdid, u16_t vid, u16_t sdid);
@@ -102,8 +114,10 @@ static int init_indirect_desc_table(struct indirect_desc_table *desc);
 static int init_indirect_desc_tables(struct virtio_device *dev);
 static void virtio_irq_register(struct virtio_device *dev);
 static void virtio_irq_unregister(struct virtio_device *dev);
-static int wants_kick(struct virtio_queue *q);
-static void kick_queue(struct virtio_device *dev, int qidx);
+static int wants_kick(struct virtio_device *dev, struct virtio_queue *q,
+	u16_t old_idx);
+static void kick_queue(struct virtio_device *dev, int qidx, u16_t old_idx);
+static int ring_feature(struct virtio_device *dev, int bit);
 
 struct virtio_device *
 virtio_setup_device(u16_t subdevid, const char *name,
@@ -240,9 +254,29 @@ exchange_features(struct virtio_device *dev)
 	/* let the device know about our features */
 	virtio_write32(dev, VIRTIO_GUEST_F_OFF, guest_features);
 
+	/* remember which ring features are in use by both sides */
+	dev->indirect_desc = ring_feature(dev, VIRTIO_RING_F_INDIRECT_DESC);
+	dev->event_idx = ring_feature(dev, VIRTIO_RING_F_EVENT_IDX);
+
 	return OK;
 }
 
+static int
+ring_feature(struct virtio_device *dev, int bit)
+{
+	/* Ring features are optional for the driver, so unlike the feature
+	 * helpers below, this one does not require the bit to be listed.
+	 */
+	for (int i = 0; i < dev->num_features; i++) {
+		struct virtio_feature *f = &dev->features[i];
+
+		if (f->bit == bit)
+			return f->host_support && f->guest_support;
+	}
+
+	return 0;
+}
+
 int
 virtio_alloc_queues(struct virtio_device *dev, int num_queues)
 {
@@ -306,7 +340,7 @@ init_phys_queues(struct virtio_device *dev)
 /* Error path */
 free_phys_queues:
 	for (j = 0; j < i; j++)
-		free_phys_queue(&dev->queues[i]);
+		free_phys_queue(&dev->queues[j]);
 
 	return r;
 }
@@ -399,6 +433,7 @@ init_phys_queue(struct virtio_queue *q)
 	q->free_head = 0;
 	q->free_tail = q->num - 1;
 	q->last_used = 0;
+	q->intr_off = 0;
 
 	return;
 }
@@ -513,6 +548,20 @@ use_vring_desc(struct vring_desc *vd, struct vumap_phys *vp)
 		vd->flags |= VRING_DESC_F_WRITE;
 }
 
+static struct indirect_desc_table *
+find_indirect_table(struct virtio_device *dev)
+{
+	/* Find the first unused indirect descriptor table, if any */
+	int i;
+
+	for (i = 0; i < dev->num_indirect; i++) {
+		if (!dev->indirect[i].in_use)
+			return &dev->indirect[i];
+	}
+
+	return NULL;
+}
+
 static void
 set_indirect_descriptors(struct virtio_device *dev, struct virtio_queue *q,
 	struct vumap_phys *bufs, size_t num)
@@ -526,23 +575,13 @@ set_indirect_descriptors(struct virtio_device *dev, struct virtio_queue *q,
 	if (0 == num)
 		return;
 
-	/* Find the first unused indirect descriptor table */
-	for (i = 0; i < dev->num_indirect; i++) {
-		desc = &dev->indirect[i];
-
-		/* If an unused indirect descriptor table was found,
-		 * mark it as being used and exit the loop.
-		 */
-		if (!desc->in_use) {
-			desc->in_use = 1;
-			break;
-		}
-	}
-
 	/* Sanity check */
-	if (i >= dev->num_indirect)
+	if ((desc = find_indirect_table(dev)) == NULL)
 		panic("No indirect descriptor tables left");
 
+	/* Mark it as being used */
+	desc->in_use = 1;
+
 	/* For indirect descriptor tables, only a single descriptor from
 	 * the main ring is used.
 	 */
@@ -606,7 +645,7 @@ int
 virtio_to_queue(struct virtio_device *dev, int qidx, struct vumap_phys *bufs,
 	size_t num, void *data)
 {
-	u16_t free_first;
+	u16_t free_first, old_idx;
 	int left;
 	struct virtio_queue *q = &dev->queues[qidx];
 	struct vring *vring = &q->vring;
@@ -622,6 +661,9 @@ virtio_to_queue(struct virtio_device *dev, int qidx, struct vumap_phys *bufs,
 
 	if (left < dev->threads)
 		set_indirect_descriptors(dev, q, bufs, num);
+	else if (dev->indirect_desc && num > INDIRECT_MIN_DESCS &&
+	    find_indirect_table(dev) != NULL)
+		set_indirect_descriptors(dev, q, bufs, num);
 	else
 		set_direct_descriptors(q, bufs, num);
 
@@ -635,13 +677,17 @@ virtio_to_queue(struct virtio_device *dev, int qidx, struct vumap_phys *bufs,
 	__insn_barrier();
 
 	/* advance last idx */
-	vring->avail->idx += 1;
+	old_idx = vring->avail->idx;
+	vring->avail->idx = old_idx + 1;
 
-	/* Make sure the host sees the avail->idx */
-	__insn_barrier();
+	/* Make sure the host sees the avail->idx before we read back whether
+	 * it wants a kick. The CPU may otherwise let that read pass the store,
+	 * so this takes a full memory barrier rather than a compiler one.
+	 */
+	__sync_synchronize();
 
 	/* kick it! */
-	kick_queue(dev, qidx);
+	kick_queue(dev, qidx, old_idx);
 	return 0;
 }
 
@@ -655,7 +701,6 @@ virtio_from_queue(struct virtio_device *dev, int qidx, void **data,
 	struct vring_desc *vd;
 	int count = 0;
 	u16_t idx;
-	u16_t used_idx;
 
 	assert(0 <= qidx && qidx < dev->num_queues);
 
@@ -665,18 +710,30 @@ virtio_from_queue(struct virtio_device *dev, int qidx, void **data,
 	/* Make sure we see changes done by the host */
 	__insn_barrier();
 
-	/* The index from the host */
-	used_idx = vring->used->idx % q->num;
-
 	/* We already saw this one, nothing to do here */
-	if (q->last_used == used_idx)
-		return -1;
+	if (q->last_used == vring->used->idx) {
+		if (!dev->event_idx || q->intr_off)
+			return -1;
+
+		/* Ask for an interrupt only once the host uses the next
+		 * element, then check again in case it did so meanwhile.
+		 * This way, everything completed before we got here is
+		 * handled without any further interrupts.
+		 */
+		vring_used_event(vring) = q->last_used;
+
+		/* The store must be visible before we read used->idx again. */
+		__sync_synchronize();
+
+		if (q->last_used == vring->used->idx)
+			return -1;
+	}
 
 	/* Get the vring_used element */
-	uel = &q->vring.used->ring[q->last_used];
+	uel = &q->vring.used->ring[q->last_used % q->num];
 
 	/* Update the last used element */
-	q->last_used = (q->last_used + 1) % q->num;
+	q->last_used++;
 
 	/* index of the used element */
 	idx = uel->id % q->num;
@@ -754,6 +811,40 @@ virtio_irq_enable(struct virtio_device *dev)
 		panic("%s Unable to enable IRQ %d", dev->name, r);
 }
 
+void
+virtio_queue_intr(struct virtio_device *dev, int qidx, int enable)
+{
+	struct virtio_queue *q;
+	struct vring *vring;
+
+	assert(0 <= qidx && qidx < dev->num_queues);
+
+	q = &dev->queues[qidx];
+	vring = &q->vring;
+
+	if (q->intr_off == !enable)
+		return;
+
+	q->intr_off = !enable;
+
+	/* With EVENT_IDX, leaving the used event index where it is means the
+	 * host interrupts at most once more. Reenabling moves it up to the
+	 * current position; the caller has to check the queue afterwards.
+	 */
+	if (dev->event_idx) {
+		if (enable)
+			vring_used_event(vring) = q->last_used;
+	} else {
+		if (enable)
+			vring->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+		else
+			vring->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+	}
+
+	/* The caller reads used->idx next; the store must be visible first. */
+	__sync_synchronize();
+}
+
 void
 virtio_irq_disable(struct virtio_device *dev)
 {
@@ -763,18 +854,27 @@ virtio_irq_disable(struct virtio_device *dev)
 }
 
 static int
-wants_kick(struct virtio_queue *q)
+wants_kick(struct virtio_device *dev, struct virtio_queue *q, u16_t old_idx)
 {
 	assert(q != NULL);
+
+	/* With EVENT_IDX, the host tells us up to where it has looked at the
+	 * available ring. If it has not caught up with the previous element
+	 * yet, it is still busy and will see the new one without a kick.
+	 */
+	if (dev->event_idx)
+		return vring_need_event(vring_avail_event(&q->vring),
+		    q->vring.avail->idx, old_idx);
+
 	return !(q->vring.used->flags & VRING_USED_F_NO_NOTIFY);
 }
 
 static void
-kick_queue(struct virtio_device *dev, int qidx)
+kick_queue(struct virtio_device *dev, int qidx, u16_t old_idx)
 {
 	assert(0 <= qidx && qidx < dev->num_queues);
 
-	if (wants_kick(&dev->queues[qidx]))
+	if (wants_kick(dev, &dev->queues[qidx], old_idx))
 		virtio_write16(dev, VIRTIO_QNOTFIY_OFF, qidx);
 
 	return;
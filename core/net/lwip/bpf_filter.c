@@ -19,6 +19,7 @@
 
 #ifdef _MINIX_SYSTEM
 #include "lwip.h"
+#include "bpf_filter.h"
 
 /*
  * Obtain an unsigned 32-bit value in network byte order from the pbuf chain
@@ -87,7 +88,7 @@ bpf_get16_ext(const struct pbuf * pbuf, uint32_t k)
 	 */
 	if (k < (uint32_t)pbuf->len - 1) {
 		return ((uint32_t)(((u_char *)pbuf->payload)[k]) << 8) |
-		    (uint32_t)(((u_char *)pbuf->next->payload)[k + 1]);
+		    (uint32_t)(((u_char *)pbuf->payload)[k + 1]);
 	} else {
 		assert(pbuf->next != NULL);
 		return ((uint32_t)(((u_char *)pbuf->payload)[k]) << 8) |
@@ -559,3 +560,446 @@ bpf_validate(const struct bpf_insn * insns, int ninsns)
 	/* The program has passed all our basic tests. */
 	return 1;
 }
+
+#ifdef _MINIX_SYSTEM
+/*
+ * Pre-decoded operations.  Each BPF instruction is translated into one of
+ * these, so that the filter loop can dispatch on a dense range of values, and
+ * some of the work of the original instructions is done only once.
+ */
+enum {
+	BPFD_LD_W_ABS,
+	BPFD_LD_H_ABS,
+	BPFD_LD_B_ABS,
+	BPFD_LD_W_IND,
+	BPFD_LD_H_IND,
+	BPFD_LD_B_IND,
+	BPFD_LD_LEN,
+	BPFD_LD_IMM,
+	BPFD_LD_MEM,
+	BPFD_LDX_IMM,
+	BPFD_LDX_MEM,
+	BPFD_LDX_LEN,
+	BPFD_LDX_MSH,
+	BPFD_ST,
+	BPFD_STX,
+	BPFD_ADD_K,
+	BPFD_SUB_K,
+	BPFD_MUL_K,
+	BPFD_DIV_K,
+	BPFD_MOD_K,
+	BPFD_AND_K,
+	BPFD_OR_K,
+	BPFD_XOR_K,
+	BPFD_LSH_K,
+	BPFD_RSH_K,
+	BPFD_ADD_X,
+	BPFD_SUB_X,
+	BPFD_MUL_X,
+	BPFD_DIV_X,
+	BPFD_MOD_X,
+	BPFD_AND_X,
+	BPFD_OR_X,
+	BPFD_XOR_X,
+	BPFD_LSH_X,
+	BPFD_RSH_X,
+	BPFD_NEG,
+	BPFD_JA,
+	BPFD_JGT_K,
+	BPFD_JGE_K,
+	BPFD_JEQ_K,
+	BPFD_JSET_K,
+	BPFD_JGT_X,
+	BPFD_JGE_X,
+	BPFD_JEQ_X,
+	BPFD_JSET_X,
+	BPFD_RET_A,
+	BPFD_RET_K,
+	BPFD_TAX,
+	BPFD_TXA
+};
+
+/*
+ * For a validated BPF program 'insns', return the index of the instruction
+ * that is ultimately reached when jumping to index 'target', skipping any
+ * unconditional jumps.  Since all jumps go forward, this always terminates.
+ */
+static u_int
+bpf_decode_target(const struct bpf_insn * insns, u_int target)
+{
+
+	while (insns[target].code == BPF_JMP+BPF_JA)
+		target += insns[target].k + 1;
+
+	return target;
+}
+
+/*
+ * Translate the BPF program 'insns' of 'count' instructions, which MUST have
+ * passed a previous call to bpf_validate(), into the pre-decoded program
+ * 'prog', which must have room for 'count' pre-decoded instructions.  Jumps
+ * are resolved to direct pointers, chains of jumps are collapsed, and bounds
+ * for loads at absolute packet offsets are computed in advance.  Loads that
+ * can never succeed are turned into instructions that reject the packet.
+ * Instructions that are not reachable are translated as well, but harmlessly.
+ */
+void
+bpf_decode(const struct bpf_insn * insns, u_int count,
+	struct bpf_dinsn * prog)
+{
+	const struct bpf_insn *insn;
+	struct bpf_dinsn *dinsn;
+	u_int pc, size;
+	uint8_t op;
+
+	for (pc = 0; pc < count; pc++) {
+		insn = &insns[pc];
+		dinsn = &prog[pc];
+
+		dinsn->bd_k = insn->k;
+		dinsn->bd_end = 0;
+		dinsn->bd_jt = NULL;
+		dinsn->bd_jf = NULL;
+		size = 0;
+
+		switch (insn->code) {
+		case BPF_LD+BPF_W+BPF_ABS:	op = BPFD_LD_W_ABS; size = 4; break;
+		case BPF_LD+BPF_H+BPF_ABS:	op = BPFD_LD_H_ABS; size = 2; break;
+		case BPF_LD+BPF_B+BPF_ABS:	op = BPFD_LD_B_ABS; size = 1; break;
+		case BPF_LD+BPF_W+BPF_IND:	op = BPFD_LD_W_IND; break;
+		case BPF_LD+BPF_H+BPF_IND:	op = BPFD_LD_H_IND; break;
+		case BPF_LD+BPF_B+BPF_IND:	op = BPFD_LD_B_IND; break;
+		case BPF_LD+BPF_W+BPF_LEN:	op = BPFD_LD_LEN; break;
+		case BPF_LD+BPF_IMM:		op = BPFD_LD_IMM; break;
+		case BPF_LD+BPF_MEM:		op = BPFD_LD_MEM; break;
+		case BPF_LDX+BPF_IMM:		op = BPFD_LDX_IMM; break;
+		case BPF_LDX+BPF_MEM:		op = BPFD_LDX_MEM; break;
+		case BPF_LDX+BPF_LEN:		op = BPFD_LDX_LEN; break;
+		case BPF_LDX+BPF_B+BPF_MSH:	op = BPFD_LDX_MSH; break;
+		case BPF_ST:			op = BPFD_ST; break;
+		case BPF_STX:			op = BPFD_STX; break;
+		case BPF_ALU+BPF_ADD+BPF_K:	op = BPFD_ADD_K; break;
+		case BPF_ALU+BPF_SUB+BPF_K:	op = BPFD_SUB_K; break;
+		case BPF_ALU+BPF_MUL+BPF_K:	op = BPFD_MUL_K; break;
+		case BPF_ALU+BPF_DIV+BPF_K:	op = BPFD_DIV_K; break;
+		case BPF_ALU+BPF_MOD+BPF_K:	op = BPFD_MOD_K; break;
+		case BPF_ALU+BPF_AND+BPF_K:	op = BPFD_AND_K; break;
+		case BPF_ALU+BPF_OR+BPF_K:	op = BPFD_OR_K; break;
+		case BPF_ALU+BPF_XOR+BPF_K:	op = BPFD_XOR_K; break;
+		case BPF_ALU+BPF_LSH+BPF_K:	op = BPFD_LSH_K; break;
+		case BPF_ALU+BPF_RSH+BPF_K:	op = BPFD_RSH_K; break;
+		case BPF_ALU+BPF_ADD+BPF_X:	op = BPFD_ADD_X; break;
+		case BPF_ALU+BPF_SUB+BPF_X:	op = BPFD_SUB_X; break;
+		case BPF_ALU+BPF_MUL+BPF_X:	op = BPFD_MUL_X; break;
+		case BPF_ALU+BPF_DIV+BPF_X:	op = BPFD_DIV_X; break;
+		case BPF_ALU+BPF_MOD+BPF_X:	op = BPFD_MOD_X; break;
+		case BPF_ALU+BPF_AND+BPF_X:	op = BPFD_AND_X; break;
+		case BPF_ALU+BPF_OR+BPF_X:	op = BPFD_OR_X; break;
+		case BPF_ALU+BPF_XOR+BPF_X:	op = BPFD_XOR_X; break;
+		case BPF_ALU+BPF_LSH+BPF_X:	op = BPFD_LSH_X; break;
+		case BPF_ALU+BPF_RSH+BPF_X:	op = BPFD_RSH_X; break;
+		case BPF_ALU+BPF_NEG:		op = BPFD_NEG; break;
+		case BPF_JMP+BPF_JA:		op = BPFD_JA; break;
+		case BPF_JMP+BPF_JGT+BPF_K:	op = BPFD_JGT_K; break;
+		case BPF_JMP+BPF_JGE+BPF_K:	op = BPFD_JGE_K; break;
+		case BPF_JMP+BPF_JEQ+BPF_K:	op = BPFD_JEQ_K; break;
+		case BPF_JMP+BPF_JSET+BPF_K:	op = BPFD_JSET_K; break;
+		case BPF_JMP+BPF_JGT+BPF_X:	op = BPFD_JGT_X; break;
+		case BPF_JMP+BPF_JGE+BPF_X:	op = BPFD_JGE_X; break;
+		case BPF_JMP+BPF_JEQ+BPF_X:	op = BPFD_JEQ_X; break;
+		case BPF_JMP+BPF_JSET+BPF_X:	op = BPFD_JSET_X; break;
+		case BPF_RET+BPF_A:		op = BPFD_RET_A; break;
+		case BPF_RET+BPF_K:		op = BPFD_RET_K; break;
+		case BPF_MISC+BPF_TAX:		op = BPFD_TAX; break;
+		case BPF_MISC+BPF_TXA:		op = BPFD_TXA; break;
+		default:
+			/*
+			 * Only unreachable instructions can end up here.  Make
+			 * them reject the packet, as bpf_filter_ext() would.
+			 */
+			op = BPFD_RET_K;
+			dinsn->bd_k = 0;
+		}
+
+		/*
+		 * For absolute packet loads, precompute the end offset of the
+		 * load.  If that offset would wrap, the load always fails.
+		 */
+		if (size > 0) {
+			if (insn->k > UINT32_MAX - size) {
+				op = BPFD_RET_K;
+				dinsn->bd_k = 0;
+			} else
+				dinsn->bd_end = insn->k + size;
+		}
+
+		/*
+		 * Resolve jump targets.  A conditional jump with identical
+		 * targets is an unconditional jump.
+		 */
+		if (op == BPFD_JA)
+			dinsn->bd_jt = &prog[bpf_decode_target(insns,
+			    pc + insn->k + 1)];
+		else if (op >= BPFD_JGT_K && op <= BPFD_JSET_X) {
+			dinsn->bd_jt = &prog[bpf_decode_target(insns,
+			    pc + insn->jt + 1)];
+			dinsn->bd_jf = &prog[bpf_decode_target(insns,
+			    pc + insn->jf + 1)];
+
+			if (dinsn->bd_jt == dinsn->bd_jf)
+				op = BPFD_JA;
+		}
+
+		dinsn->bd_op = op;
+	}
+}
+
+/*
+ * Execute a pre-decoded BPF filter program on a packet.  This function is
+ * equivalent to bpf_filter_ext(), except that it takes a program produced by
+ * bpf_decode() rather than a BPF program.  If 'pc' is NULL, the packet is
+ * fully accepted.
+ */
+u_int
+bpf_filter_dec(const struct bpf_dinsn * pc, const struct pbuf * pbuf,
+	const u_char * packet, u_int total, u_int len)
+{
+	uint32_t k, a, x, mem[BPF_MEMWORDS];
+
+	/* An empty program accepts all packets. */
+	if (pc == NULL)
+		return UINT_MAX;
+
+	/* As in bpf_filter_ext(), we need not clear 'mem'. */
+	a = 0;
+	x = 0;
+
+	/* Execute the program. */
+	for (;;) {
+		k = pc->bd_k;
+
+		switch (pc->bd_op) {
+		case BPFD_LD_W_ABS:		/* A <- P[k:4] */
+			/* 'bd_end' has been checked for wrapping already. */
+			if (pc->bd_end <= len)
+				a = ((uint32_t)packet[k] << 24) |
+				    ((uint32_t)packet[k + 1] << 16) |
+				    ((uint32_t)packet[k + 2] << 8) |
+				    (uint32_t)packet[k + 3];
+			else if (pc->bd_end <= total)
+				a = bpf_get32_ext(pbuf, k);
+			else
+				return 0;
+			break;
+		case BPFD_LD_H_ABS:		/* A <- P[k:2] */
+			if (pc->bd_end <= len)
+				a = ((uint32_t)packet[k] << 8) |
+				    (uint32_t)packet[k + 1];
+			else if (pc->bd_end <= total)
+				a = bpf_get16_ext(pbuf, k);
+			else
+				return 0;
+			break;
+		case BPFD_LD_B_ABS:		/* A <- P[k:1] */
+			if (k < len)
+				a = (uint32_t)packet[k];
+			else if (k < total)
+				a = bpf_get8_ext(pbuf, k);
+			else
+				return 0;
+			break;
+		case BPFD_LD_W_IND:		/* A <- P[X+k:4] */
+			if (k + x < k)
+				return 0;
+			k += x;
+			if (len >= 3 && k < len - 3)
+				a = ((uint32_t)packet[k] << 24) |
+				    ((uint32_t)packet[k + 1] << 16) |
+				    ((uint32_t)packet[k + 2] << 8) |
+				    (uint32_t)packet[k + 3];
+			else if (total >= 3 && k < total - 3)
+				a = bpf_get32_ext(pbuf, k);
+			else
+				return 0;
+			break;
+		case BPFD_LD_H_IND:		/* A <- P[X+k:2] */
+			if (k + x < k)
+				return 0;
+			k += x;
+			if (len >= 1 && k < len - 1)
+				a = ((uint32_t)packet[k] << 8) |
+				    (uint32_t)packet[k + 1];
+			else if (total >= 1 && k < total - 1)
+				a = bpf_get16_ext(pbuf, k);
+			else
+				return 0;
+			break;
+		case BPFD_LD_B_IND:		/* A <- P[X+k:1] */
+			if (k + x < k)
+				return 0;
+			k += x;
+			if (k < len)
+				a = (uint32_t)packet[k];
+			else if (k < total)
+				a = bpf_get8_ext(pbuf, k);
+			else
+				return 0;
+			break;
+		case BPFD_LD_LEN:		/* A <- len */
+			a = total;
+			break;
+		case BPFD_LD_IMM:		/* A <- k */
+			a = k;
+			break;
+		case BPFD_LD_MEM:		/* A <- M[k] */
+			a = mem[k];
+			break;
+
+		case BPFD_LDX_IMM:		/* X <- k */
+			x = k;
+			break;
+		case BPFD_LDX_MEM:		/* X <- M[k] */
+			x = mem[k];
+			break;
+		case BPFD_LDX_LEN:		/* X <- len */
+			x = total;
+			break;
+		case BPFD_LDX_MSH:		/* X <- 4*(P[k:1]&0xf) */
+			if (k < len)
+				x = ((uint32_t)packet[k] & 0xf) << 2;
+			else if (k < total)
+				x = (bpf_get8_ext(pbuf, k) & 0xf) << 2;
+			else
+				return 0;
+			break;
+
+		case BPFD_ST:			/* M[k] <- A */
+			mem[k] = a;
+			break;
+		case BPFD_STX:			/* M[k] <- X */
+			mem[k] = x;
+			break;
+
+		case BPFD_ADD_K:		/* A <- A + k */
+			a += k;
+			break;
+		case BPFD_SUB_K:		/* A <- A - k */
+			a -= k;
+			break;
+		case BPFD_MUL_K:		/* A <- A * k */
+			a *= k;
+			break;
+		case BPFD_DIV_K:		/* A <- A / k */
+			a /= k;
+			break;
+		case BPFD_MOD_K:		/* A <- A % k */
+			a %= k;
+			break;
+		case BPFD_AND_K:		/* A <- A & k */
+			a &= k;
+			break;
+		case BPFD_OR_K:			/* A <- A | k */
+			a |= k;
+			break;
+		case BPFD_XOR_K:		/* A <- A ^ k */
+			a ^= k;
+			break;
+		case BPFD_LSH_K:		/* A <- A << k */
+			a <<= k;
+			break;
+		case BPFD_RSH_K:		/* A <- A >> k */
+			a >>= k;
+			break;
+		case BPFD_ADD_X:		/* A <- A + X */
+			a += x;
+			break;
+		case BPFD_SUB_X:		/* A <- A - X */
+			a -= x;
+			break;
+		case BPFD_MUL_X:		/* A <- A * X */
+			a *= x;
+			break;
+		case BPFD_DIV_X:		/* A <- A / X */
+			if (x == 0)
+				return 0;
+			a /= x;
+			break;
+		case BPFD_MOD_X:		/* A <- A % X */
+			if (x == 0)
+				return 0;
+			a %= x;
+			break;
+		case BPFD_AND_X:		/* A <- A & X */
+			a &= x;
+			break;
+		case BPFD_OR_X:			/* A <- A | X */
+			a |= x;
+			break;
+		case BPFD_XOR_X:		/* A <- A ^ X */
+			a ^= x;
+			break;
+		case BPFD_LSH_X:		/* A <- A << X */
+			if (x >= 32)
+				return 0;
+			a <<= x;
+			break;
+		case BPFD_RSH_X:		/* A <- A >> X */
+			if (x >= 32)
+				return 0;
+			a >>= x;
+			break;
+		case BPFD_NEG:			/* A <- -A */
+			a = -a;
+			break;
+
+		/* Jumps continue right away, bypassing the advance below. */
+		case BPFD_JA:			/* pc <- jt */
+			pc = pc->bd_jt;
+			continue;
+		case BPFD_JGT_K:		/* pc <- (A > k) ? jt : jf */
+			pc = (a > k) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JGE_K:		/* pc <- (A >= k) ? jt : jf */
+			pc = (a >= k) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JEQ_K:		/* pc <- (A == k) ? jt : jf */
+			pc = (a == k) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JSET_K:		/* pc <- (A & k) ? jt : jf */
+			pc = (a & k) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JGT_X:		/* pc <- (A > X) ? jt : jf */
+			pc = (a > x) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JGE_X:		/* pc <- (A >= X) ? jt : jf */
+			pc = (a >= x) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JEQ_X:		/* pc <- (A == X) ? jt : jf */
+			pc = (a == x) ? pc->bd_jt : pc->bd_jf;
+			continue;
+		case BPFD_JSET_X:		/* pc <- (A & X) ? jt : jf */
+			pc = (a & x) ? pc->bd_jt : pc->bd_jf;
+			continue;
+
+		case BPFD_RET_A:		/* accept A bytes */
+			return a;
+		case BPFD_RET_K:		/* accept K bytes */
+			return k;
+
+		case BPFD_TAX:			/* X <- A */
+			x = a;
+			break;
+		case BPFD_TXA:			/* A <- X */
+			a = x;
+			break;
+
+		default:			/* cannot happen */
+			return 0;
+		}
+
+		pc++;
+	}
+
+	/* NOTREACHED */
+}
+#endif /* _MINIX_SYSTEM */
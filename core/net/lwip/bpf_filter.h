@@ -0,0 +1,21 @@
+#ifndef MINIX_NET_LWIP_BPF_FILTER_H
+#define MINIX_NET_LWIP_BPF_FILTER_H
+
+struct pbuf;
+
+struct bpf_dinsn {			/* pre-decoded BPF instruction */
+	uint8_t bd_op;			/* decoded operation (BPFD_) */
+	uint32_t bd_k;			/* constant operand */
+	uint32_t bd_end;		/* end offset of absolute packet load */
+	const struct bpf_dinsn *bd_jt;	/* jump target, or target if true */
+	const struct bpf_dinsn *bd_jf;	/* jump target if false */
+};
+
+u_int bpf_filter_ext(const struct bpf_insn * pc, const struct pbuf * pbuf,
+	const u_char * packet, u_int total, u_int len);
+void bpf_decode(const struct bpf_insn * insns, u_int count,
+	struct bpf_dinsn * prog);
+u_int bpf_filter_dec(const struct bpf_dinsn * pc, const struct pbuf * pbuf,
+	const u_char * packet, u_int total, u_int len);
+
+#endif /* !MINIX_NET_LWIP_BPF_FILTER_H */
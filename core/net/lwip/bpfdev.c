@@ -21,6 +21,7 @@
 
 #include "lwip.h"
 #include "bpfdev.h"
+#include "bpf_filter.h"
 
 #include <minix/chardriver.h>
 #include <net/if.h>
@@ -63,6 +64,7 @@ static struct bpfdev {
 	size_t bpf_slen;		/* used part of store buffer */
 	size_t bpf_hlen;		/* used part of hold buffer */
 	struct bpf_insn *bpf_filter;	/* verified BPF filter, or NULL */
+	struct bpf_dinsn *bpf_prog;	/* pre-decoded filter, or NULL */
 	size_t bpf_filterlen;		/* length of filter, for munmap */
 	pid_t bpf_pid;			/* process ID of last using process */
 	clock_t bpf_timeout;		/* timeout for read calls (0 = none) */
@@ -233,6 +235,7 @@ bpfdev_close(devminor_t minor)
 			panic("munmap failed: %d", -errno);
 
 		bpf->bpf_filter = NULL;
+		bpf->bpf_prog = NULL;
 	}
 
 	/*
@@ -691,7 +694,10 @@ bpfdev_flush(struct bpfdev * bpf)
 
 /*
  * Install a filter program on the BPF device.  A new filter replaces any old
- * one.  A zero-sized filter simply clears a previous filter.  On success,
+ * one.  A zero-sized filter simply clears a previous filter.  The filter is
+ * validated and then translated into a pre-decoded program once, here, so that
+ * running it on each packet is cheaper.  The pre-decoded program is stored in
+ * the same memory mapping as the filter itself, right after it.  On success,
  * perform a flush and return OK.  On failure, return a negative error code
  * without making any modifications to the current filter.
  */
@@ -699,6 +705,7 @@ static int
 bpfdev_setfilter(struct bpfdev * bpf, endpoint_t endpt, cp_grant_id_t grant)
 {
 	struct bpf_insn *filter;
+	struct bpf_dinsn *prog;
 	unsigned int count;
 	size_t len;
 	int r;
@@ -710,7 +717,7 @@ bpfdev_setfilter(struct bpfdev * bpf, endpoint_t endpt, cp_grant_id_t grant)
 
 	if (count > BPF_MAXINSNS)
 		return EINVAL;
-	len = count * sizeof(struct bpf_insn);
+	len = count * (sizeof(struct bpf_insn) + sizeof(struct bpf_dinsn));
 
 	if (len > 0) {
 		if ((filter = (struct bpf_insn *)mmap(NULL, len,
@@ -720,7 +727,8 @@ bpfdev_setfilter(struct bpfdev * bpf, endpoint_t endpt, cp_grant_id_t grant)
 
 		if ((r = sys_safecopyfrom(endpt, grant,
 		    offsetof(struct minix_bpf_program, mbf_insns),
-		    (vir_bytes)filter, len)) != OK) {
+		    (vir_bytes)filter, count * sizeof(struct bpf_insn))) !=
+		    OK) {
 			(void)munmap(filter, len);
 
 			return r;
@@ -731,13 +739,20 @@ bpfdev_setfilter(struct bpfdev * bpf, endpoint_t endpt, cp_grant_id_t grant)
 
 			return EINVAL;
 		}
-	} else
+
+		prog = (struct bpf_dinsn *)&filter[count];
+
+		bpf_decode(filter, count, prog);
+	} else {
 		filter = NULL;
+		prog = NULL;
+	}
 
 	if (bpf->bpf_filter != NULL)
 		(void)munmap(bpf->bpf_filter, bpf->bpf_filterlen);
 
 	bpf->bpf_filter = filter;
+	bpf->bpf_prog = prog;
 	bpf->bpf_filterlen = len;
 
 	bpfdev_flush(bpf);
@@ -1130,7 +1145,7 @@ bpfdev_input(struct bpfdev_link * bpfl, const struct pbuf * pbuf)
 	 * packet should be stored and if so, how much of it.  If no filter is
 	 * set, all packets will be stored in their entirety.
 	 */
-	caplen = bpf_filter_ext(bpf->bpf_filter, pbuf, (u_char *)pbuf->payload,
+	caplen = bpf_filter_dec(bpf->bpf_prog, pbuf, (u_char *)pbuf->payload,
 	    pbuf->tot_len, pbuf->len);
 
 	if (caplen == 0)
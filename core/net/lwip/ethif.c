@@ -62,6 +62,8 @@
 #include "lwip/ethip6.h"
 #include "lwip/igmp.h"
 #include "lwip/mld6.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/tcp.h"
 
 #include <net/if_media.h>
 
@@ -424,6 +426,111 @@ ethif_can_recv(struct ethif * ethif)
 	return ifdev_is_up(&ethif->ethif_ifdev);
 }
 
+/*
+ * Determine whether the network driver should fill in the checksum of the
+ * given outgoing packet, which is the case for TCP segments generated by lwIP
+ * itself if TCP transmit checksum offloading is enabled.  lwIP marks those
+ * segments with PBUF_FLAG_TCP_CSUM, and leaves their checksum field zeroed.
+ * All other packets, including forwarded packets and packets injected through
+ * BPF, carry a complete checksum already and must be left untouched.  For an
+ * offloaded segment, store the pseudo-header checksum in the TCP header, since
+ * the driver expects it there, and return the offsets that are to be passed to
+ * the driver.  Otherwise, return zero offsets.  lwIP never fragments TCP
+ * segments or adds IPv6 extension headers to them, and it puts all headers in
+ * the first buffer of the chain.  The checks below are merely a safety net.
+ */
+static void
+ethif_get_csum(struct ethif * ethif, struct pbuf * pbuf, uint16_t * startp,
+	uint16_t * offp)
+{
+	struct eth_hdr *ethhdr;
+	struct ip_hdr *iphdr;
+	struct ip6_hdr *ip6hdr;
+	struct tcp_hdr *tcphdr;
+	ip4_addr_t src4, dst4;
+	ip6_addr_t src6, dst6;
+	size_t hlen, len;
+
+	*startp = *offp = 0;
+	iphdr = NULL;
+	ip6hdr = NULL;
+
+	if (!(ethif->ethif_active.nconf_caps & NDEV_CAP_CS_TCP_TX) ||
+	    !(pbuf->flags & PBUF_FLAG_TCP_CSUM))
+		return;
+
+	if (pbuf->len < SIZEOF_ETH_HDR)
+		return;
+
+	ethhdr = (struct eth_hdr *)pbuf->payload;
+
+	switch (lwip_ntohs(ethhdr->type)) {
+	case ETHTYPE_IP:
+		if (pbuf->len < SIZEOF_ETH_HDR + IP_HLEN)
+			return;
+
+		iphdr = (struct ip_hdr *)((char *)pbuf->payload +
+		    SIZEOF_ETH_HDR);
+		hlen = IPH_HL(iphdr) * 4;
+
+		if (IPH_PROTO(iphdr) != IP_PROTO_TCP || hlen < IP_HLEN ||
+		    (lwip_ntohs(IPH_OFFSET(iphdr)) & (IP_OFFMASK | IP_MF)) ||
+		    lwip_ntohs(IPH_LEN(iphdr)) < hlen + TCP_HLEN)
+			return;
+
+		len = lwip_ntohs(IPH_LEN(iphdr)) - hlen;
+
+		break;
+
+	case ETHTYPE_IPV6:
+		if (pbuf->len < SIZEOF_ETH_HDR + IP6_HLEN)
+			return;
+
+		ip6hdr = (struct ip6_hdr *)((char *)pbuf->payload +
+		    SIZEOF_ETH_HDR);
+		hlen = IP6_HLEN;
+
+		if (IP6H_NEXTH(ip6hdr) != IP6_NEXTH_TCP ||
+		    IP6H_PLEN(ip6hdr) < TCP_HLEN)
+			return;
+
+		len = IP6H_PLEN(ip6hdr);
+
+		break;
+
+	default:
+		return;
+	}
+
+	if (pbuf->len < SIZEOF_ETH_HDR + hlen + TCP_HLEN ||
+	    SIZEOF_ETH_HDR + hlen + len > pbuf->tot_len)
+		return;
+
+	tcphdr = (struct tcp_hdr *)((char *)pbuf->payload + SIZEOF_ETH_HDR +
+	    hlen);
+
+	/*
+	 * lwIP's pseudo-header routines return the complemented sum, with
+	 * zero bytes of payload included.  We need the plain sum instead.
+	 */
+	if (iphdr != NULL) {
+		ip4_addr_copy(src4, iphdr->src);
+		ip4_addr_copy(dst4, iphdr->dest);
+
+		tcphdr->chksum = (u16_t)~inet_chksum_pseudo_partial(pbuf,
+		    IP_PROTO_TCP, len, 0, &src4, &dst4);
+	} else {
+		ip6_addr_copy_from_packed(src6, ip6hdr->src);
+		ip6_addr_copy_from_packed(dst6, ip6hdr->dest);
+
+		tcphdr->chksum = (u16_t)~ip6_chksum_pseudo_partial(pbuf,
+		    IP6_NEXTH_TCP, len, 0, &src6, &dst6);
+	}
+
+	*startp = SIZEOF_ETH_HDR + hlen;
+	*offp = offsetof(struct tcp_hdr, chksum);
+}
+
 /*
  * Polling function, invoked after each message loop iteration.  Check whether
  * any configuration change or packets can be sent to the driver, and whether
@@ -434,6 +541,7 @@ ethif_poll(struct ifdev * ifdev)
 {
 	struct ethif *ethif = (struct ethif *)ifdev;
 	struct pbuf *pbuf, *pref;
+	uint16_t csum_start, csum_off;
 
 	/*
 	 * If a configuration request is desired, see if we can send it to the
@@ -460,7 +568,10 @@ ethif_poll(struct ifdev * ifdev)
 			else
 				pbuf = pref;
 
-			if (ndev_send(ethif->ethif_ndev, pbuf) == OK)
+			ethif_get_csum(ethif, pbuf, &csum_start, &csum_off);
+
+			if (ndev_send(ethif->ethif_ndev, pbuf, csum_start,
+			    csum_off) == OK)
 				ethif->ethif_snd.es_unsentp =
 				    pchain_end(pref);
 			else
@@ -646,6 +757,9 @@ ethif_output(struct ifdev * ifdev, struct pbuf * pbuf, struct netif * netif)
 		if (pbuf_copy(pcopy, pbuf) != ERR_OK)
 			panic("unexpected pbuf copy failure");
 
+		/* The copy still needs its checksum filled in, if at all. */
+		pcopy->flags |= pbuf->flags & PBUF_FLAG_TCP_CSUM;
+
 		if (padding > 0) {
 			/*
 			 * This restriction can be lifted if needed, but it
@@ -1072,25 +1186,21 @@ ethif_post_conf(struct ethif * ethif)
 
 	/*
 	 * Now that the driver configuration has changed, we know that the
-	 * new checksum settings will be applied to all sent and received
-	 * packets, and we can disable checksumming flags in netif as desired.
-	 * Enabling checksumming flags has already been done earlier on.
+	 * new checksum settings will be applied to all sent packets, and we
+	 * can disable checksumming flags in netif as desired.  Enabling
+	 * checksumming flags has already been done earlier on.  Receive
+	 * checksum verification is skipped on a per-packet basis only, as
+	 * reported by the driver; see ethif_received().
 	 */
 	if (nconf->nconf_set & NDEV_SET_CAPS) {
 		flags = ethif_get_netif(ethif)->chksum_flags;
 
 		if (nconf->nconf_caps & NDEV_CAP_CS_IP4_TX)
 			flags &= ~NETIF_CHECKSUM_GEN_IP;
-		if (nconf->nconf_caps & NDEV_CAP_CS_IP4_RX)
-			flags &= ~NETIF_CHECKSUM_CHECK_IP;
 		if (nconf->nconf_caps & NDEV_CAP_CS_UDP_TX)
 			flags &= ~NETIF_CHECKSUM_GEN_UDP;
-		if (nconf->nconf_caps & NDEV_CAP_CS_UDP_RX)
-			flags &= ~NETIF_CHECKSUM_CHECK_UDP;
 		if (nconf->nconf_caps & NDEV_CAP_CS_TCP_TX)
 			flags &= ~NETIF_CHECKSUM_GEN_TCP;
-		if (nconf->nconf_caps & NDEV_CAP_CS_TCP_RX)
-			flags &= ~NETIF_CHECKSUM_CHECK_TCP;
 
 		NETIF_SET_CHECKSUM_CTRL(ethif_get_netif(ethif), flags);
 	}
@@ -1335,13 +1445,17 @@ ethif_sent(struct ethif * ethif, int32_t result)
 /*
  * The ndev layer reports that the first buffer on the receive queue has been
  * filled with a packet of 'result' bytes, or if 'result' is negative, the
- * receive request has been aborted.
+ * receive request has been aborted.  The 'flags' field contains receive flags
+ * (NDEV_RXF_) as reported by the driver.
  */
 void
-ethif_received(struct ethif * ethif, int32_t result)
+ethif_received(struct ethif * ethif, int32_t result, uint32_t flags)
 {
 	struct pbuf *pbuf, *pwalk, **pnext;
+	struct netif *netif;
+	uint32_t caps;
 	size_t left;
+	u16_t chksum_flags;
 
 	/*
 	 * Start by removing the first buffer chain off the receive queue.  The
@@ -1398,9 +1512,28 @@ ethif_received(struct ethif * ethif, int32_t result)
 	 * Finally, hand off the packet to the layers above.  We go through
 	 * ifdev so that it can pass the packet to BPF devices and update
 	 * statistics and all that.
+	 *
+	 * If the driver has verified some of the packet's checksums, and the
+	 * corresponding receive checksum offloading is enabled, tell lwIP to
+	 * skip verifying those checksums.  lwIP has only per-netif flags for
+	 * this, but it processes the packet in full before ifdev_input()
+	 * returns, so we can set the flags for just this one packet.
 	 */
+	netif = ethif_get_netif(ethif);
+	chksum_flags = netif->chksum_flags;
+	caps = ethif->ethif_active.nconf_caps;
+
+	if ((flags & NDEV_RXF_CSUM_IP4) && (caps & NDEV_CAP_CS_IP4_RX))
+		netif->chksum_flags &= ~NETIF_CHECKSUM_CHECK_IP;
+	if ((flags & NDEV_RXF_CSUM_L4) && (caps & NDEV_CAP_CS_UDP_RX))
+		netif->chksum_flags &= ~NETIF_CHECKSUM_CHECK_UDP;
+	if ((flags & NDEV_RXF_CSUM_L4) && (caps & NDEV_CAP_CS_TCP_RX))
+		netif->chksum_flags &= ~NETIF_CHECKSUM_CHECK_TCP;
+
 	ifdev_input(&ethif->ethif_ifdev, pbuf, NULL /*netif*/,
 	    TRUE /*to_bpf*/);
+
+	netif->chksum_flags = chksum_flags;
 }
 
 /*
@@ -16,7 +16,7 @@ void ethif_remove(struct ethif * ethif);
 
 void ethif_configured(struct ethif * ethif, int32_t result);
 void ethif_sent(struct ethif * ethif, int32_t result);
-void ethif_received(struct ethif * ethif, int32_t result);
+void ethif_received(struct ethif * ethif, int32_t result, uint32_t flags);
 
 void ethif_status(struct ethif * ethif, uint32_t link, uint32_t media,
 	uint32_t oerror, uint32_t coll, uint32_t ierror, uint32_t iqdrop);
@@ -314,6 +314,12 @@ main(void)
 		 */
 		check_lwip_timer();
 
+		/*
+		 * Hand any send and receive requests queued up while handling
+		 * the previous message to the network drivers, in batches.
+		 */
+		ndev_flush();
+
 		if ((r = sef_receive_status(ANY, &m, &ipc_status)) != OK) {
 			if (r == EINTR)
 				continue;	/* sef_cancel() was called */
@@ -123,8 +123,4 @@ void ifconf_init(void);
 int ifconf_ioctl(struct sock * sock, unsigned long request,
 	const struct sockdriver_data * data, endpoint_t user_endpt);
 
-/* bpf_filter.c */
-u_int bpf_filter_ext(const struct bpf_insn * pc, const struct pbuf * pbuf,
-	const u_char * packet, u_int total, u_int len);
-
 #endif /* !MINIX_NET_LWIP_LWIP_H */
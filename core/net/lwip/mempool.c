@@ -69,34 +69,51 @@
  * 512 large buffers, combined with the buffer size of 512 plus the pbuf header
  * plus a bit of extra overhead, results in about 266 KB per slab.
  *
- * For small buffer allocations, there are two facilities.  First, there is a
+ * For smaller allocations, there are two facilities.  First, there is a
  * static pool of small buffers.  This pool currently provides 256 small-sized
  * buffers, mainly in order to allow packet headers to be produced even in low-
- * memory conditions.  In addition, small buffers may be formed by allocating
- * and then splitting up one large buffer.  The module is currently configured
- * to split one large buffer into four small buffers, which yields a small
- * buffer size of just over 100 bytes--enough for the packet headers while
- * leaving little slack on either side.
+ * memory conditions.  In addition, smaller buffers may be formed by allocating
+ * and then splitting up one large buffer.  There are two such size classes:
+ * the "small" class splits one large buffer into four small buffers, which
+ * yields a small buffer size of just over 100 bytes--enough for the packet
+ * headers while leaving little slack on either side.  The "medium" class
+ * splits one large buffer into two medium buffers of just over 250 bytes,
+ * which are used for allocations that are too large for a small buffer but
+ * would otherwise waste most of a large buffer: short datagrams, TCP segments
+ * resulting from small writes, and so on.  Each allocation is served from the
+ * smallest class that fits it.  With that, the large-buffer class is used only
+ * for allocations that actually need most of a large buffer, such as the
+ * individual buffers of longer pbuf chains.
  *
- * It is important to note that large and small buffer allocations are freed up
- * through the same function, with no information on the original allocation
- * size.  As a result, we have to distinguish between large and small buffers
- * using a unified system.  In particular, this module prepends each of its
- * allocations by a single pointer, which points to a header structure that is
- * at the very beginning of the slab that contains the allocated buffer.  That
- * header structure contains information about the type of slab (large or
- * small) as well as some accounting information used by both types.
+ * It is important to note that all buffer allocations are freed up through the
+ * same function, with no information on the original allocation size.  As a
+ * result, we have to distinguish between the buffer types using a unified
+ * system.  In particular, this module prepends each of its allocations by a
+ * single pointer, which points to a header structure that is at the very
+ * beginning of the slab that contains the allocated buffer.  That header
+ * structure contains information about the type of slab (large or split, and
+ * for split slabs, the size class) as well as some accounting information used
+ * by all types.
  *
  * For large-buffer slabs, this header is part of a larger structure with for
  * example the slab's list of free buffers.  This larger structure is then
  * followed by the actual buffers in the slab.
  *
- * For small-buffer slabs, the header is followed directly by the actual small
- * buffers.  Thus, when a large buffer is split up into four small buffers, the
- * data area of that large buffer consists of a small-type slab header and four
- * small buffers.  The large buffer itself is simply considered in use, as
- * though it was allocated for regular data.  This nesting approach saves a lot
- * of memory for small allocations, at the cost of a bit more computation.
+ * For split slabs, the header is followed directly by the actual small or
+ * medium buffers.  Thus, when a large buffer is split up into four small
+ * buffers, the data area of that large buffer consists of a split-type slab
+ * header and four small buffers.  The large buffer itself is simply considered
+ * in use, as though it was allocated for regular data.  This nesting approach
+ * saves a lot of memory for smaller allocations, at the cost of a bit more
+ * computation.  The small and medium buffers use the same structure; they
+ * differ only in the size of their data area, and thus the distance between
+ * the buffers in a split slab.
+ *
+ * For each buffer class, this module keeps track of the current and the peak
+ * number of buffers in use.  Those statistics, along with the usage statistics
+ * that lwIP keeps for each of its own object pools (which are not managed by
+ * this module, see above), are exported through the minix.lwip.mempool sysctl
+ * subtree, so that the pool limits can be tuned based on actual usage.
  *
  * It should be noted that all allocations should be (and are) pointer-aligned.
  * Normally lwIP would check for this, but we cannot tell lwIP the platform
@@ -108,6 +125,8 @@
 
 #include <sys/mman.h>
 
+#include "lwip/memp.h"
+
 /* Alignment to pointer sizes. */
 #define MEMPOOL_ALIGN_DOWN(s)	((s) & ~(sizeof(void *) - 1))
 #define MEMPOOL_ALIGN_UP(s)	MEMPOOL_ALIGN_DOWN((s) + sizeof(void *) - 1)
@@ -117,28 +136,41 @@
 #define MEMPOOL_LARGE_SIZE	\
     (MEMPOOL_ALIGN_UP(sizeof(struct pbuf)) + MEMPOOL_BUFSIZE)
 
+/*
+ * Split buffers: distance between the buffers in a split slab (that is, a
+ * large buffer split into the given number of buffers) and data area size.
+ */
+#define MEMPOOL_SPLIT_STRIDE(n)	\
+    MEMPOOL_ALIGN_DOWN((MEMPOOL_LARGE_SIZE - \
+     sizeof(struct mempool_header)) / (n))
+#define MEMPOOL_SPLIT_SIZE(n)	(MEMPOOL_SPLIT_STRIDE(n) - sizeof(void *))
+
 /* Small buffers: per-slab count and data area size. */
 #define MEMPOOL_SMALL_COUNT	4
-#define MEMPOOL_SMALL_SIZE	\
-    (MEMPOOL_ALIGN_DOWN(MEMPOOL_LARGE_SIZE / MEMPOOL_SMALL_COUNT) - \
-     sizeof(struct mempool_header))
+#define MEMPOOL_SMALL_SIZE	MEMPOOL_SPLIT_SIZE(MEMPOOL_SMALL_COUNT)
+
+/* Medium buffers: per-slab count and data area size. */
+#define MEMPOOL_MEDIUM_COUNT	2
+#define MEMPOOL_MEDIUM_SIZE	MEMPOOL_SPLIT_SIZE(MEMPOOL_MEDIUM_COUNT)
 
-/* Memory pool slab header, part of both small and large slabs. */
+/* Memory pool slab header, part of both split and large slabs. */
 struct mempool_header {
 	union {
 		struct {
 			uint8_t mhui_flags;
+			uint8_t mhui_class;
 			uint32_t mhui_inuse;
 		} mhu_info;
 		void *mhu_align;	/* force pointer alignment */
 	} mh_u;
 };
 #define mh_flags mh_u.mhu_info.mhui_flags
+#define mh_class mh_u.mhu_info.mhui_class
 #define mh_inuse mh_u.mhu_info.mhui_inuse
 
 /* Header flags. */
-#define MHF_SMALL	0x01	/* slab is for small buffers, not large ones */
-#define MHF_STATIC	0x02	/* small slab is statically allocated */
+#define MHF_SMALL	0x01	/* slab is for split buffers, not large ones */
+#define MHF_STATIC	0x02	/* split slab is statically allocated */
 #define MHF_MARKED	0x04	/* large empty slab is up for deallocation */
 
 /*
@@ -162,7 +194,11 @@ struct mempool_large_buf {
 #define mlb_next mlb_u.mlbu_free.mlbuf_next
 #define mlb_data mlb_u.mlbu_data
 
-/* Small buffer.  Same idea, different size. */
+/*
+ * Small or medium buffer.  Same idea, different size.  The data area size
+ * given here is that of the smallest class; medium buffers simply have a
+ * larger data area, and are spaced accordingly in their split slab.
+ */
 struct mempool_small_buf {
 	struct mempool_header *msb_header;
 	union {
@@ -198,33 +234,63 @@ static LIST_HEAD(, mempool_large_slab) mempool_partial_slabs;
 static LIST_HEAD(, mempool_large_slab) mempool_full_slabs;
 
 /*
- * A small slab, including header and small buffers.  We use unified free lists
- * for small buffers, and these small slabs are not part of any lists
- * themselves, so we need neither of the two fields from large slabs for that.
+ * A split slab consists of a header followed directly by the small or medium
+ * buffers of its class.  We use unified free lists for split buffers, and
+ * split slabs are not part of any lists themselves, so we need neither of the
+ * two list fields from large slabs for that.
  */
-struct mempool_small_slab {
-	struct mempool_header mss_header;		/* MUST be first */
-	struct mempool_small_buf mss_buf[MEMPOOL_SMALL_COUNT];
-};
+#define MEMPOOL_SPLIT_BUF(mh, mc, i) \
+	((struct mempool_small_buf *)((char *)(mh) + \
+	    sizeof(struct mempool_header) + (i) * (mc)->mc_stride))
 
 /*
- * The free lists for static small buffers (from the static pool, see below)
- * and dynamic small buffers (as obtained by splitting large buffers).
+ * The split buffer classes.  Each class has its own free list of dynamic
+ * buffers, that is, buffers obtained by splitting large buffers.  The classes
+ * must be ordered by increasing size.
  */
+#define MEMPOOL_CLASS_SMALL	0	/* small buffers */
+#define MEMPOOL_CLASS_MEDIUM	1	/* medium buffers */
+#define MEMPOOL_CLASSES		2
+
+static struct mempool_class {
+	unsigned int mc_count;	/* number of buffers per split slab */
+	size_t mc_stride;	/* distance between buffers in a split slab */
+	size_t mc_size;		/* size of the data area of each buffer */
+	TAILQ_HEAD(, mempool_small_buf) mc_freelist;	/* dynamic free list */
+	int mc_used;		/* buffers currently in use */
+	int mc_peak;		/* highest number of buffers ever in use */
+} mempool_class[MEMPOOL_CLASSES] = {
+	[MEMPOOL_CLASS_SMALL] = {
+		.mc_count = MEMPOOL_SMALL_COUNT,
+		.mc_stride = MEMPOOL_SPLIT_STRIDE(MEMPOOL_SMALL_COUNT),
+		.mc_size = MEMPOOL_SMALL_SIZE,
+	},
+	[MEMPOOL_CLASS_MEDIUM] = {
+		.mc_count = MEMPOOL_MEDIUM_COUNT,
+		.mc_stride = MEMPOOL_SPLIT_STRIDE(MEMPOOL_MEDIUM_COUNT),
+		.mc_size = MEMPOOL_MEDIUM_SIZE,
+	},
+};
+
+/* The free list for static small buffers (from the static pool, see below). */
 static TAILQ_HEAD(, mempool_small_buf) mempool_small_static_freelist;
-static TAILQ_HEAD(, mempool_small_buf) mempool_small_dynamic_freelist;
 
 /*
  * A static pool of small buffers.  Small buffers are somewhat more important
- * than large buffers, because they are used for packet headers.  The purpose
+ * than other buffers, because they are used for packet headers.  The purpose
  * of this static pool is to be able to make progress even if all large buffers
  * are allocated for data, typically in the case that the system is low on
- * memory.  Note that the number of static small buffers is the given number of
- * small slabs multiplied by MEMPOOL_SMALL_COUNT, hence the division.
+ * memory.  Each element of the pool is laid out exactly like a large buffer
+ * split into small buffers.  Note that the number of static small buffers is
+ * the given number of split slabs multiplied by MEMPOOL_SMALL_COUNT, hence the
+ * division.
  */
 #define MEMPOOL_SMALL_SLABS	(256 / MEMPOOL_SMALL_COUNT)
 
-static struct mempool_small_slab mempool_small_pool[MEMPOOL_SMALL_SLABS];
+static union {
+	char msp_data[MEMPOOL_LARGE_SIZE];
+	void *msp_align;		/* force pointer alignment */
+} mempool_small_pool[MEMPOOL_SMALL_SLABS];
 
 /*
  * The following setting (mempool_max_slabs) can be changed through sysctl(7).
@@ -239,10 +305,13 @@ static struct mempool_small_slab mempool_small_pool[MEMPOOL_SMALL_SLABS];
 
 static int mempool_max_slabs;	/* maximum number of large slabs */
 static int mempool_nr_slabs;	/* current number of large slabs */
+static int mempool_peak_slabs;	/* highest number of large slabs */
 
 static int mempool_nr_large;	/* current number of large buffers */
 static int mempool_used_large;	/* large buffers currently in use */
-static int mempool_used_small;	/* small buffers currently in use */
+static int mempool_peak_large;	/* highest number of large buffers in use */
+
+static int mempool_failed;	/* number of failed allocations */
 
 /*
  * Number of clock ticks between timer invocations.  The timer is used to
@@ -254,6 +323,47 @@ static minix_timer_t mempool_timer;
 
 static int mempool_defer_alloc;		/* allocation failed, defer next try */
 
+static ssize_t mempool_memp_stat(struct rmib_call *, struct rmib_node *,
+	struct rmib_oldp *, struct rmib_newp *);
+
+/*
+ * The CTL_MINIX MINIX_LWIP "mempool" "memp" subtree, with one node for each of
+ * lwIP's own object pools, named after the pool's identifier in lwIP.  Each of
+ * those nodes has the following children, in this order.  Dynamically
+ * numbered.
+ */
+#define MEMPOOL_MEMP_USED	0	/* objects currently in use */
+#define MEMPOOL_MEMP_PEAK	1	/* highest number of objects in use */
+#define MEMPOOL_MEMP_AVAIL	2	/* total number of objects */
+#define MEMPOOL_MEMP_FAIL	3	/* number of failed allocations */
+#define MEMPOOL_MEMP_FIELDS	4
+
+static struct rmib_node minix_lwip_memp_stat_table[MEMP_MAX]
+    [MEMPOOL_MEMP_FIELDS] = {
+#define LWIP_MEMPOOL(name,num,size,desc) [MEMP_##name] = {		\
+	[MEMPOOL_MEMP_USED]	= RMIB_FUNC(RMIB_RO | CTLTYPE_INT,	\
+				    sizeof(int), mempool_memp_stat, "used",   \
+				    "Current number of used objects"),	\
+	[MEMPOOL_MEMP_PEAK]	= RMIB_FUNC(RMIB_RO | CTLTYPE_INT,	\
+				    sizeof(int), mempool_memp_stat, "peak",   \
+				    "Highest number of used objects"),	\
+	[MEMPOOL_MEMP_AVAIL]	= RMIB_FUNC(RMIB_RO | CTLTYPE_INT,	\
+				    sizeof(int), mempool_memp_stat, "avail",  \
+				    "Total number of objects"),		\
+	[MEMPOOL_MEMP_FAIL]	= RMIB_FUNC(RMIB_RO | CTLTYPE_INT,	\
+				    sizeof(int), mempool_memp_stat, "fail",   \
+				    "Number of failed object allocations"),   \
+},
+#include "lwip/priv/memp_std.h"
+};
+
+static struct rmib_node minix_lwip_memp_table[] = {
+#define LWIP_MEMPOOL(name,num,size,desc) [MEMP_##name] =		\
+	RMIB_NODE(RMIB_RO, minix_lwip_memp_stat_table[MEMP_##name], #name, \
+	    "lwIP " desc " object pool"),
+#include "lwip/priv/memp_std.h"
+};
+
 /* The CTL_MINIX MINIX_LWIP "mempool" subtree.  Dynamically numbered. */
 static struct rmib_node minix_lwip_mempool_table[] = {
 	RMIB_INTPTR(RMIB_RW, &mempool_max_slabs, "slab_max",
@@ -270,10 +380,26 @@ static struct rmib_node minix_lwip_mempool_table[] = {
 	    "Current number of used large buffers"),
 	RMIB_INT(RMIB_RO, MEMPOOL_LARGE_SIZE, "large_size",
 	    "Byte size of a single large buffer"),
-	RMIB_INTPTR(RMIB_RO, &mempool_used_small, "small_used",
-	    "Current number of used small buffers"),
+	RMIB_INTPTR(RMIB_RO, &mempool_class[MEMPOOL_CLASS_SMALL].mc_used,
+	    "small_used", "Current number of used small buffers"),
 	RMIB_INT(RMIB_RO, MEMPOOL_SMALL_SIZE, "small_size",
 	    "Byte size of a single small buffer"),
+	RMIB_INTPTR(RMIB_RO, &mempool_peak_slabs, "slab_peak",
+	    "Highest number of memory slabs"),
+	RMIB_INTPTR(RMIB_RO, &mempool_peak_large, "large_peak",
+	    "Highest number of used large buffers"),
+	RMIB_INTPTR(RMIB_RO, &mempool_class[MEMPOOL_CLASS_SMALL].mc_peak,
+	    "small_peak", "Highest number of used small buffers"),
+	RMIB_INTPTR(RMIB_RO, &mempool_class[MEMPOOL_CLASS_MEDIUM].mc_used,
+	    "medium_used", "Current number of used medium buffers"),
+	RMIB_INTPTR(RMIB_RO, &mempool_class[MEMPOOL_CLASS_MEDIUM].mc_peak,
+	    "medium_peak", "Highest number of used medium buffers"),
+	RMIB_INT(RMIB_RO, MEMPOOL_MEDIUM_SIZE, "medium_size",
+	    "Byte size of a single medium buffer"),
+	RMIB_INTPTR(RMIB_RO, &mempool_failed, "failed",
+	    "Number of failed memory allocations"),
+	RMIB_NODE(RMIB_RO, minix_lwip_memp_table, "memp",
+	    "lwIP object pool statistics"),
 };
 
 static struct rmib_node minix_lwip_mempool_node =
@@ -281,31 +407,37 @@ static struct rmib_node minix_lwip_mempool_node =
 	"Memory pool settings");
 
 /*
- * Initialize the given "slab" of small buffers.  The slab may either come from
- * the statically allocated pool ('is_static' is TRUE) or a single large buffer
- * that we aim to chop up into small buffers.
+ * Initialize the given split slab of small or medium buffers, of the given
+ * class.  The slab may either come from the statically allocated pool
+ * ('is_static' is TRUE) or a single large buffer that we aim to chop up into
+ * smaller buffers.
  */
 static void
-mempool_prepare_small(struct mempool_small_slab * mss, int is_static)
+mempool_prepare_small(struct mempool_header * mh, unsigned int class,
+	int is_static)
 {
+	struct mempool_class *mc;
 	struct mempool_small_buf *msb;
 	unsigned int count;
 
-	mss->mss_header.mh_flags = MHF_SMALL | ((is_static) ? MHF_STATIC : 0);
-	mss->mss_header.mh_inuse = 0;
+	assert(class < MEMPOOL_CLASSES);
+	mc = &mempool_class[class];
+
+	mh->mh_flags = MHF_SMALL | ((is_static) ? MHF_STATIC : 0);
+	mh->mh_class = class;
+	mh->mh_inuse = 0;
 
-	msb = mss->mss_buf;
+	for (count = 0; count < mc->mc_count; count++) {
+		msb = MEMPOOL_SPLIT_BUF(mh, mc, count);
 
-	for (count = 0; count < MEMPOOL_SMALL_COUNT; count++, msb++) {
 		msb->msb_header = NULL;
-		msb->msb_header2 = &mss->mss_header;
+		msb->msb_header2 = mh;
 
 		if (is_static)
 			TAILQ_INSERT_HEAD(&mempool_small_static_freelist, msb,
 			    msb_next);
 		else
-			TAILQ_INSERT_HEAD(&mempool_small_dynamic_freelist, msb,
-			    msb_next);
+			TAILQ_INSERT_HEAD(&mc->mc_freelist, msb, msb_next);
 	}
 }
 
@@ -362,6 +494,7 @@ mempool_new_slab(void)
 
 	/* Initialize the new slab. */
 	mls->mls_header.mh_flags = 0;
+	mls->mls_header.mh_class = 0;
 	mls->mls_header.mh_inuse = 0;
 
 	mlb = mls->mls_buf;
@@ -379,6 +512,9 @@ mempool_new_slab(void)
 
 	mempool_nr_slabs++;
 	mempool_nr_large += MEMPOOL_LARGE_COUNT;
+
+	if (mempool_peak_slabs < mempool_nr_slabs)
+		mempool_peak_slabs = mempool_nr_slabs;
 }
 
 /*
@@ -437,41 +573,109 @@ mempool_tick(int arg __unused)
 	set_timer(&mempool_timer, MEMPOOL_TIMER_TICKS, mempool_tick, 0);
 }
 
+/*
+ * Retrieve one of the statistics of one of lwIP's own object pools, as kept by
+ * lwIP itself.  The node determines both the pool and the statistic.
+ */
+static ssize_t
+mempool_memp_stat(struct rmib_call * call __unused, struct rmib_node * node,
+	struct rmib_oldp * oldp, struct rmib_newp * newp __unused)
+{
+	struct stats_mem *stats;
+	unsigned int index;
+	int r, val;
+
+	index = node - &minix_lwip_memp_stat_table[0][0];
+	assert(index < MEMP_MAX * MEMPOOL_MEMP_FIELDS);
+
+	stats = lwip_stats.memp[index / MEMPOOL_MEMP_FIELDS];
+	assert(stats != NULL);
+
+	switch (index % MEMPOOL_MEMP_FIELDS) {
+	case MEMPOOL_MEMP_USED:
+		val = (int)stats->used;
+		break;
+	case MEMPOOL_MEMP_PEAK:
+		val = (int)stats->max;
+		break;
+	case MEMPOOL_MEMP_AVAIL:
+		val = (int)stats->avail;
+		break;
+	case MEMPOOL_MEMP_FAIL:
+		val = (int)stats->err;
+		break;
+	default:
+		panic("invalid memp statistic %u", index);
+	}
+
+	if (oldp != NULL) {
+		if ((r = rmib_copyout(oldp, 0, &val, sizeof(val))) < 0)
+			return r;
+	}
+
+	/* Return the length of the node. */
+	return sizeof(val);
+}
+
 /*
  * Initialize the memory pool module.
  */
 void
 mempool_init(void)
 {
-	unsigned int slot;
+	struct mempool_class *mc;
+	unsigned int slot, class;
 
 	/* These checks are for absolutely essential points. */
 	assert(sizeof(void *) == MEM_ALIGNMENT);
-	assert(sizeof(struct mempool_small_slab) <= MEMPOOL_LARGE_SIZE);
 	assert(offsetof(struct mempool_small_buf, msb_data) == sizeof(void *));
 	assert(offsetof(struct mempool_large_buf, mlb_data) == sizeof(void *));
 
+	for (class = 0; class < MEMPOOL_CLASSES; class++) {
+		mc = &mempool_class[class];
+
+		assert(sizeof(struct mempool_header) +
+		    mc->mc_count * mc->mc_stride <= MEMPOOL_LARGE_SIZE);
+		assert(mc->mc_stride == sizeof(void *) + mc->mc_size);
+		assert(mc->mc_size >= sizeof(struct mempool_small_buf) -
+		    sizeof(void *));
+		assert(class == 0 ||
+		    mc->mc_size > mempool_class[class - 1].mc_size);
+	}
+
 	/* Initialize module-local variables. */
 	LIST_INIT(&mempool_empty_slabs);
 	LIST_INIT(&mempool_partial_slabs);
 	LIST_INIT(&mempool_full_slabs);
 
 	TAILQ_INIT(&mempool_small_static_freelist);
-	TAILQ_INIT(&mempool_small_dynamic_freelist);
+
+	for (class = 0; class < MEMPOOL_CLASSES; class++) {
+		mc = &mempool_class[class];
+
+		TAILQ_INIT(&mc->mc_freelist);
+
+		mc->mc_used = 0;
+		mc->mc_peak = 0;
+	}
 
 	mempool_max_slabs = MEMPOOL_DEFAULT_MAX_SLABS;
 	mempool_nr_slabs = 0;
+	mempool_peak_slabs = 0;
 
 	mempool_nr_large = 0;
 	mempool_used_large = 0;
-	mempool_used_small = 0;
+	mempool_peak_large = 0;
+
+	mempool_failed = 0;
 
 	mempool_defer_alloc = FALSE;
 
 	/* Initialize the static pool of small buffers. */
 	for (slot = 0; slot < __arraycount(mempool_small_pool); slot++)
-		mempool_prepare_small(&mempool_small_pool[slot],
-		    TRUE /*is_static*/);
+		mempool_prepare_small(
+		    (struct mempool_header *)mempool_small_pool[slot].msp_data,
+		    MEMPOOL_CLASS_SMALL, TRUE /*is_static*/);
 
 	/*
 	 * Allocate one large slab.  The service needs at least one large slab
@@ -579,54 +783,61 @@ mempool_alloc_large(void)
 	assert(mempool_used_large < mempool_nr_large);
 	mempool_used_large++;
 
+	if (mempool_peak_large < mempool_used_large)
+		mempool_peak_large = mempool_used_large;
+
 	/* Return the block's data area. */
 	return (void *)mlb->mlb_data;
 }
 
 /*
- * Allocate a small buffer, either by taking one off a free list or by
- * allocating a large buffer and splitting it up in new free small buffers.  On
- * success, return a pointer to the data area of the small buffer.  This data
- * area is exactly MEMPOOL_SMALL_SIZE bytes in size.  If no small buffer could
- * be allocated, return NULL.
+ * Allocate a small or medium buffer of the given class, either by taking one
+ * off a free list or by allocating a large buffer and splitting it up in new
+ * free buffers of that class.  On success, return a pointer to the data area
+ * of the buffer.  This data area is exactly as large as the data size of the
+ * class.  If no buffer could be allocated, return NULL.
  */
 static void *
-mempool_alloc_small(void)
+mempool_alloc_small(unsigned int class)
 {
-	struct mempool_small_slab *mss;
+	struct mempool_class *mc;
 	struct mempool_small_buf *msb;
 	struct mempool_header *mh;
 
+	assert(class < MEMPOOL_CLASSES);
+	mc = &mempool_class[class];
+
 	/*
-	 * Find a free small block and take it off the free list.  Try the
-	 * static free list before the dynamic one, so that after a peak in
-	 * buffer usage we are likely to be able to free up the dynamic slabs
-	 * quickly.  If both lists are empty, try allocating a large block to
-	 * divvy up into small blocks.  If that fails, we are out of memory.
+	 * Find a free block and take it off the free list.  For small blocks,
+	 * try the static free list before the dynamic one, so that after a
+	 * peak in buffer usage we are likely to be able to free up the dynamic
+	 * slabs quickly.  If the lists are empty, try allocating a large block
+	 * to divvy up into blocks of the class.  If that fails, we are out of
+	 * memory.
 	 */
-	if (!TAILQ_EMPTY(&mempool_small_static_freelist)) {
+	if (class == MEMPOOL_CLASS_SMALL &&
+	    !TAILQ_EMPTY(&mempool_small_static_freelist)) {
 		msb = TAILQ_FIRST(&mempool_small_static_freelist);
 
 		TAILQ_REMOVE(&mempool_small_static_freelist, msb, msb_next);
 	} else {
-		if (TAILQ_EMPTY(&mempool_small_dynamic_freelist)) {
-			mss =
-			    (struct mempool_small_slab *)mempool_alloc_large();
+		if (TAILQ_EMPTY(&mc->mc_freelist)) {
+			mh = (struct mempool_header *)mempool_alloc_large();
 
-			if (mss == NULL)
+			if (mh == NULL)
 				return NULL; /* out of memory */
 
-			/* Initialize the small slab, including its blocks. */
-			mempool_prepare_small(mss, FALSE /*is_static*/);
+			/* Initialize the split slab, including its blocks. */
+			mempool_prepare_small(mh, class, FALSE /*is_static*/);
 		}
 
-		msb = TAILQ_FIRST(&mempool_small_dynamic_freelist);
+		msb = TAILQ_FIRST(&mc->mc_freelist);
 		assert(msb != NULL);
 
-		TAILQ_REMOVE(&mempool_small_dynamic_freelist, msb, msb_next);
+		TAILQ_REMOVE(&mc->mc_freelist, msb, msb_next);
 	}
 
-	/* Mark the small block as allocated, and return its data area. */
+	/* Mark the block as allocated, and return its data area. */
 	assert(msb != NULL);
 
 	assert(msb->msb_header == NULL);
@@ -635,10 +846,12 @@ mempool_alloc_small(void)
 	mh = msb->msb_header2;
 	msb->msb_header = mh;
 
-	assert(mh->mh_inuse < MEMPOOL_SMALL_COUNT);
+	assert(mh->mh_class == class);
+	assert(mh->mh_inuse < mc->mc_count);
 	mh->mh_inuse++;
 
-	mempool_used_small++;
+	if (++mc->mc_used > mc->mc_peak)
+		mc->mc_peak = mc->mc_used;
 
 	return (void *)msb->msb_data;
 }
@@ -649,6 +862,8 @@ mempool_alloc_small(void)
 void *
 mempool_malloc(size_t size)
 {
+	unsigned int class;
+	void *ptr;
 
 	/*
 	 * It is currently expected that there will be allocation attempts for
@@ -657,13 +872,26 @@ mempool_malloc(size_t size)
 	 * warnings here.  For now, refusing these excessive allocations should
 	 * not be a problem in practice.
 	 */
-	if (size > MEMPOOL_LARGE_SIZE)
+	if (size > MEMPOOL_LARGE_SIZE) {
+		mempool_failed++;
+
 		return NULL;
+	}
+
+	/* Use the smallest buffer class that can hold the allocation. */
+	for (class = 0; class < MEMPOOL_CLASSES; class++)
+		if (size <= mempool_class[class].mc_size)
+			break;
 
-	if (size <= MEMPOOL_SMALL_SIZE)
-		return mempool_alloc_small();
+	if (class < MEMPOOL_CLASSES)
+		ptr = mempool_alloc_small(class);
 	else
-		return mempool_alloc_large();
+		ptr = mempool_alloc_large();
+
+	if (ptr == NULL)
+		mempool_failed++;
+
+	return ptr;
 }
 
 /*
@@ -674,14 +902,14 @@ mempool_free(void * ptr)
 {
 	struct mempool_large_slab *mls;
 	struct mempool_large_buf *mlb;
-	struct mempool_small_slab *mss;
+	struct mempool_class *mc;
 	struct mempool_small_buf *msb;
 	struct mempool_header *mh;
 	unsigned int count;
 
 	/*
 	 * Get a pointer to the slab header, which is right before the data
-	 * area for both large and small buffers.  This pointer is NULL if the
+	 * area for all types of buffers.  This pointer is NULL if the
 	 * buffer is free, which would indicate that something is very wrong.
 	 */
 	ptr = (void *)((char *)ptr - sizeof(mh));
@@ -692,14 +920,17 @@ mempool_free(void * ptr)
 		panic("mempool_free called on unallocated object!");
 
 	/*
-	 * If the slab header says that the slab is for small buffers, deal
-	 * with that case first.  If we free up the last small buffer of a
-	 * dynamically allocated small slab, we also free up the entire small
-	 * slab, which is in fact the data area of a large buffer.
+	 * If the slab header says that the slab is a split slab, deal with
+	 * that case first.  If we free up the last buffer of a dynamically
+	 * allocated split slab, we also free up the entire split slab, which
+	 * is in fact the data area of a large buffer.
 	 */
 	if (mh->mh_flags & MHF_SMALL) {
+		assert(mh->mh_class < MEMPOOL_CLASSES);
+		mc = &mempool_class[mh->mh_class];
+
 		/*
-		 * Move the small buffer onto the appropriate small free list.
+		 * Move the buffer onto the appropriate free list.
 		 */
 		msb = (struct mempool_small_buf *)ptr;
 
@@ -708,46 +939,42 @@ mempool_free(void * ptr)
 
 		/*
 		 * Simple heuristic, unless the buffer is static: favor reuse
-		 * of small buffers in containers that are already in use
-		 * for other small buffers as well, for consolidation.
+		 * of buffers in containers that are already in use for
+		 * other buffers as well, for consolidation.
 		 */
 		if (mh->mh_flags & MHF_STATIC)
 			TAILQ_INSERT_HEAD(&mempool_small_static_freelist, msb,
 			    msb_next);
 		else if (mh->mh_inuse > 1)
-			TAILQ_INSERT_HEAD(&mempool_small_dynamic_freelist, msb,
-			    msb_next);
+			TAILQ_INSERT_HEAD(&mc->mc_freelist, msb, msb_next);
 		else
-			TAILQ_INSERT_TAIL(&mempool_small_dynamic_freelist, msb,
-			    msb_next);
+			TAILQ_INSERT_TAIL(&mc->mc_freelist, msb, msb_next);
 
 		assert(mh->mh_inuse > 0);
 		mh->mh_inuse--;
 
-		assert(mempool_used_small > 0);
-		mempool_used_small--;
+		assert(mc->mc_used > 0);
+		mc->mc_used--;
 
 		/*
-		 * If the small buffer is statically allocated, or it was not
-		 * the last allocated small buffer in its containing large
-		 * buffer, then we are done.
+		 * If the buffer is statically allocated, or it was not the
+		 * last allocated buffer in its containing large buffer, then
+		 * we are done.
 		 */
 		if (mh->mh_inuse > 0 || (mh->mh_flags & MHF_STATIC))
 			return;
 
 		/*
 		 * Otherwise, free the containing large buffer as well.  First,
-		 * remove all its small buffers from the free list.
+		 * remove all its buffers from the free list.
 		 */
-		mss = (struct mempool_small_slab *)mh;
-		msb = mss->mss_buf;
+		for (count = 0; count < mc->mc_count; count++) {
+			msb = MEMPOOL_SPLIT_BUF(mh, mc, count);
 
-		for (count = 0; count < MEMPOOL_SMALL_COUNT; count++, msb++) {
 			assert(msb->msb_header == NULL);
 			assert(msb->msb_header2 == mh);
 
-			TAILQ_REMOVE(&mempool_small_dynamic_freelist, msb,
-			    msb_next);
+			TAILQ_REMOVE(&mc->mc_freelist, msb, msb_next);
 		}
 
 		/* Then, fall through to the large-buffer free code. */
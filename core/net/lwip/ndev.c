@@ -58,6 +58,18 @@
  * to a configured number of entries, at driver initialization time.  This
  * would require that the initialization request also involve a memory grant.
  *
+ * Drivers that support it are given a descriptor ring in shared memory at
+ * initialization time.  For such drivers, send and receive requests are not
+ * sent right away.  Instead, their descriptors are stored in the ring, and
+ * all requests queued up since the last time are announced to the driver
+ * with a single message per queue, right before the main loop blocks waiting
+ * for the next message (see ndev_flush()).  The driver in turn stores the
+ * results in the ring and reports a range of completed requests with a single
+ * reply.  Since requests complete in order, the per-queue sequence numbers
+ * identify the requests and ring slots as before.  Configuration requests are
+ * not batched, but any batched send requests are flushed before them, so that
+ * the driver still sees the requests of the send queue in order.
+ *
  * If necessary, it would not be too much work to split off this module into
  * its own libndev library.  For now, there is no point in doing this and the
  * tighter coupling allows us to optimize just a little but (see pbuf usage).
@@ -88,6 +100,7 @@ struct ndev_queue {
 	uint32_t nq_head;		/* ID of oldest pending request */
 	uint8_t nq_count;		/* current nr of pending requests */
 	uint8_t nq_max;			/* maximum nr of pending requests */
+	uint8_t nq_unsent;		/* nr of requests not yet announced */
 	SIMPLEQ_HEAD(, ndev_req) nq_req; /* queue of pending requests */
 };
 
@@ -97,8 +110,12 @@ static struct ndev {
 	struct ethif *ndev_ethif;	/* ethif object, or NULL if init'ing */
 	struct ndev_queue ndev_sendq;	/* packet send and configure queue */
 	struct ndev_queue ndev_recvq;	/* packet receive queue */
+	cp_grant_id_t ndev_ring_grant;	/* grant for descriptor ring */
+	int ndev_ring;			/* is the descriptor ring in use? */
 } ndev_array[NR_NDEV];
 
+static struct ndev_ring ndev_ring[NR_NDEV];	/* shared descriptor rings */
+
 static ndev_id_t ndev_max;		/* highest driver count ever seen */
 
 /*
@@ -144,10 +161,11 @@ ndev_init(void)
 	 * concurrently.  Even though it is extremely unlikely that we will
 	 * ever need that many grants in practice, the alternative is runtime
 	 * dynamic memory (re)allocation which is something we prefer to avoid
-	 * altogether.  At time of writing, we end up preallocating 320 grants
-	 * using up a total of a bit under 9KB of memory.
+	 * altogether.  At time of writing, we end up preallocating 328 grants
+	 * (including one descriptor ring grant per driver) using up a total of
+	 * a bit under 9KB of memory.
 	 */
-	cpf_prealloc(NR_NREQ * NDEV_IOV_MAX);
+	cpf_prealloc(NR_NREQ * NDEV_IOV_MAX + NR_NDEV);
 
 
 	/*
@@ -190,6 +208,7 @@ ndev_queue_init(struct ndev_queue * nq)
 
 	nq->nq_count = 0;
 	nq->nq_max = 0;
+	nq->nq_unsent = 0;
 	SIMPLEQ_INIT(&nq->nq_req);
 }
 
@@ -246,6 +265,7 @@ ndev_queue_reset(struct ndev_queue * nq)
 	}
 
 	nq->nq_max = 0;
+	nq->nq_unsent = 0;
 }
 
 /*
@@ -317,7 +337,7 @@ ndev_queue_remove(struct ndev_queue * nq, int type, uint32_t seq)
 {
 	struct ndev_req *nreq;
 
-	if (nq->nq_count < 1 || nq->nq_head != seq)
+	if (nq->nq_count <= nq->nq_unsent || nq->nq_head != seq)
 		return FALSE;
 
 	assert(!SIMPLEQ_EMPTY(&nq->nq_req));
@@ -331,6 +351,82 @@ ndev_queue_remove(struct ndev_queue * nq, int type, uint32_t seq)
 	return TRUE;
 }
 
+/*
+ * Announce all requests that have been added to the given queue since the
+ * last time, to a driver that uses the descriptor ring.
+ */
+static void
+ndev_queue_flush(struct ndev * ndev, struct ndev_queue * nq, int type)
+{
+	message m;
+	int r;
+
+	if (nq->nq_unsent == 0)
+		return;
+
+	assert(ndev->ndev_ring);
+	assert(nq->nq_unsent <= nq->nq_count);
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = type;
+	m.m_ndev_netdriver_ring.id = nq->nq_head + nq->nq_count -
+	    nq->nq_unsent;
+	m.m_ndev_netdriver_ring.count = nq->nq_unsent;
+
+	if ((r = asynsend3(ndev->ndev_endpt, &m, AMF_NOREPLY)) != OK)
+		panic("asynsend to driver failed: %d", r);
+
+	nq->nq_unsent = 0;
+}
+
+/*
+ * Announce all send and receive requests that have been queued up for drivers
+ * using descriptor rings.  This function is called from the main loop, right
+ * before it blocks waiting for the next message.
+ */
+void
+ndev_flush(void)
+{
+	struct ndev *ndev;
+	ndev_id_t slot;
+
+	for (slot = 0, ndev = ndev_array; slot < ndev_max; slot++, ndev++) {
+		if (ndev->ndev_endpt == NONE || !ndev->ndev_ring)
+			continue;
+
+		ndev_queue_flush(ndev, &ndev->ndev_sendq, NDEV_SEND_RING);
+		ndev_queue_flush(ndev, &ndev->ndev_recvq, NDEV_RECV_RING);
+	}
+}
+
+/*
+ * Set up the descriptor ring of the given driver for use with its current
+ * endpoint, revoking any previous grant for it.  The ring remains unused until
+ * the driver indicates that it supports it.
+ */
+static void
+ndev_ring_setup(struct ndev * ndev, int create)
+{
+	ndev_id_t id;
+
+	if (GRANT_VALID(ndev->ndev_ring_grant) &&
+	    cpf_revoke(ndev->ndev_ring_grant) != 0)
+		panic("unable to revoke grant: %d", -errno);
+
+	ndev->ndev_ring = FALSE;
+	ndev->ndev_ring_grant = GRANT_INVALID;
+
+	if (!create)
+		return;
+
+	id = (ndev_id_t)(ndev - ndev_array);
+
+	/* Failure is not fatal: the ring is merely an optimization. */
+	ndev->ndev_ring_grant = cpf_grant_direct(ndev->ndev_endpt,
+	    (vir_bytes)&ndev_ring[id], sizeof(ndev_ring[id]),
+	    CPF_READ | CPF_WRITE);
+}
+
 /*
  * Send an initialization request to a driver.  If this is a new driver, the
  * ethif module does not get to know about the driver until it answers to this
@@ -347,6 +443,9 @@ ndev_send_init(struct ndev * ndev)
 	memset(&m, 0, sizeof(m));
 	m.m_type = NDEV_INIT;
 	m.m_ndev_netdriver_init.id = ndev->ndev_sendq.nq_head;
+	m.m_ndev_netdriver_init.ring_grant = ndev->ndev_ring_grant;
+	if (GRANT_VALID(ndev->ndev_ring_grant))
+		m.m_ndev_netdriver_init.ring_size = sizeof(struct ndev_ring);
 
 	if ((r = asynsend3(ndev->ndev_endpt, &m, AMF_NOREPLY)) != OK)
 		panic("asynsend to driver failed: %d", r);
@@ -389,6 +488,8 @@ ndev_up(const char * label, endpoint_t endpt)
 
 			ndev_array[slot].ndev_endpt = endpt;
 
+			ndev_ring_setup(&ndev_array[slot], TRUE /*create*/);
+
 			/* Attempt to resume communication. */
 			ndev_send_init(&ndev_array[slot]);
 
@@ -421,6 +522,9 @@ ndev_up(const char * label, endpoint_t endpt)
 	ndev_queue_init(&ndev->ndev_sendq);
 	ndev_queue_init(&ndev->ndev_recvq);
 
+	ndev->ndev_ring_grant = GRANT_INVALID;
+	ndev_ring_setup(ndev, TRUE /*create*/);
+
 	ndev_send_init(ndev);
 
 	ndev_pending++;
@@ -437,6 +541,8 @@ ndev_down(struct ndev * ndev)
 	ndev_queue_reset(&ndev->ndev_sendq);
 	ndev_queue_reset(&ndev->ndev_recvq);
 
+	ndev_ring_setup(ndev, FALSE /*create*/);
+
 	/*
 	 * If this ndev object had a corresponding ethif object, tell the ethif
 	 * layer that the device is really gone now.
@@ -598,6 +704,20 @@ ndev_init_reply(struct ndev * ndev, const message * m_ptr)
 		ndev->ndev_recvq.nq_max = max_recv;
 		ndev->ndev_recvq.nq_head++;
 
+		/*
+		 * Use the descriptor ring if the driver supports it.  The ring
+		 * limits the number of pending requests per queue.
+		 */
+		if (m_ptr->m_netdriver_ndev_init_reply.ring &&
+		    GRANT_VALID(ndev->ndev_ring_grant)) {
+			ndev->ndev_ring = TRUE;
+
+			if (ndev->ndev_sendq.nq_max > NDEV_RING_MAX)
+				ndev->ndev_sendq.nq_max = NDEV_RING_MAX;
+			if (ndev->ndev_recvq.nq_max > NDEV_RING_MAX)
+				ndev->ndev_recvq.nq_max = NDEV_RING_MAX;
+		}
+
 		memset(&hwaddr, 0, sizeof(hwaddr));
 		memcpy(hwaddr.nhwa_addr,
 		    m_ptr->m_netdriver_ndev_init_reply.hwaddr, hwaddr_len);
@@ -657,6 +777,10 @@ ndev_conf(ndev_id_t id, const struct ndev_conf * nconf)
 	    &seq)) == NULL)
 		return EBUSY;
 
+	/* Make sure that the driver gets to see any earlier sends first. */
+	if (ndev->ndev_ring)
+		ndev_queue_flush(ndev, &ndev->ndev_sendq, NDEV_SEND_RING);
+
 	memset(&m, 0, sizeof(m));
 	m.m_type = NDEV_CONF;
 	m.m_ndev_netdriver_conf.id = seq;
@@ -735,13 +859,18 @@ ndev_conf_reply(struct ndev * ndev, const message * m_ptr)
 
 /*
  * Construct a packet send or receive request and send it off to a network
- * driver.  The given pbuf chain may be part of a queue.  Return OK if the
- * request was successfully sent, or ENOMEM on grant allocation failure.
+ * driver, or, if the driver uses a descriptor ring, store it in the ring for
+ * ndev_flush() to announce later.  The given pbuf chain may be part of a
+ * queue.  Checksum offload information can be passed only through the ring.
+ * Return OK if the request was successfully sent or stored, or ENOMEM
+ * on grant allocation failure.
  */
 static int
 ndev_transfer(struct ndev * ndev, const struct pbuf * pbuf, int do_send,
-	uint32_t seq, struct ndev_req * nreq)
+	uint32_t seq, struct ndev_req * nreq, uint16_t csum_start,
+	uint16_t csum_off)
 {
+	struct ndev_desc *desc;
 	cp_grant_id_t grant;
 	message m;
 	unsigned int i;
@@ -752,6 +881,16 @@ ndev_transfer(struct ndev * ndev, const struct pbuf * pbuf, int do_send,
 	m.m_type = (do_send) ? NDEV_SEND : NDEV_RECV;
 	m.m_ndev_netdriver_transfer.id = seq;
 
+	if (ndev->ndev_ring) {
+		if (do_send)
+			desc = &ndev_ring[ndev - ndev_array].nr_send[seq %
+			    NDEV_RING_MAX];
+		else
+			desc = &ndev_ring[ndev - ndev_array].nr_recv[seq %
+			    NDEV_RING_MAX];
+	} else
+		desc = NULL;
+
 	left = pbuf->tot_len;
 
 	for (i = 0; left > 0; i++) {
@@ -768,8 +907,13 @@ ndev_transfer(struct ndev * ndev, const struct pbuf * pbuf, int do_send,
 			return ENOMEM;
 		}
 
-		m.m_ndev_netdriver_transfer.grant[i] = grant;
-		m.m_ndev_netdriver_transfer.len[i] = pbuf->len;
+		if (desc != NULL) {
+			desc->nd_grant[i] = grant;
+			desc->nd_len[i] = pbuf->len;
+		} else {
+			m.m_ndev_netdriver_transfer.grant[i] = grant;
+			m.m_ndev_netdriver_transfer.len[i] = pbuf->len;
+		}
 
 		nreq->nreq_grant[i] = grant;
 
@@ -778,8 +922,6 @@ ndev_transfer(struct ndev * ndev, const struct pbuf * pbuf, int do_send,
 		pbuf = pbuf->next;
 	}
 
-	m.m_ndev_netdriver_transfer.count = i;
-
 	/*
 	 * Unless the array is full, an invalid grant marks the end of the list
 	 * of invalid grants.
@@ -787,6 +929,18 @@ ndev_transfer(struct ndev * ndev, const struct pbuf * pbuf, int do_send,
 	if (i < __arraycount(nreq->nreq_grant))
 		nreq->nreq_grant[i] = GRANT_INVALID;
 
+	if (desc != NULL) {
+		desc->nd_count = i;
+		desc->nd_csum_start = csum_start;
+		desc->nd_csum_off = csum_off;
+
+		return OK;
+	}
+
+	assert(csum_start == 0);
+
+	m.m_ndev_netdriver_transfer.count = i;
+
 	if ((r = asynsend3(ndev->ndev_endpt, &m, AMF_NOREPLY)) != OK)
 		panic("asynsend to driver failed: %d", r);
 
@@ -794,16 +948,21 @@ ndev_transfer(struct ndev * ndev, const struct pbuf * pbuf, int do_send,
 }
 
 /*
- * Send a packet to the given network driver.  Return OK if the packet is sent
- * off to the driver, EBUSY if no (more) packets can be sent to the driver at
- * this time, or ENOMEM on grant allocation failure.
+ * Send a packet to the given network driver.  If 'csum_start' is nonzero, the
+ * driver is to fill in the TCP or UDP checksum of the packet, summing from
+ * offset 'csum_start' up to the end of the packet, and storing the result at
+ * offset 'csum_off' relative to the start.  This may be requested only if the
+ * corresponding checksum offload capability is enabled.  Return OK if the
+ * packet is sent off to the driver, EBUSY if no (more) packets can be sent to
+ * the driver at this time, or ENOMEM on grant allocation failure.
  *
  * The use of 'pbuf' in this interface is a bit ugly, but it saves us from
  * having to go through an intermediate representation (e.g. an iovec array)
  * for the data being sent.  The same applies to ndev_receive().
  */
 int
-ndev_send(ndev_id_t id, const struct pbuf * pbuf)
+ndev_send(ndev_id_t id, const struct pbuf * pbuf, uint16_t csum_start,
+	uint16_t csum_off)
 {
 	struct ndev *ndev;
 	struct ndev_req *nreq;
@@ -820,11 +979,15 @@ ndev_send(ndev_id_t id, const struct pbuf * pbuf)
 	    &seq)) == NULL)
 		return EBUSY;
 
-	if ((r = ndev_transfer(ndev, pbuf, TRUE /*do_send*/, seq, nreq)) != OK)
+	if ((r = ndev_transfer(ndev, pbuf, TRUE /*do_send*/, seq, nreq,
+	    csum_start, csum_off)) != OK)
 		return r;
 
 	ndev_queue_add(&ndev->ndev_sendq, nreq);
 
+	if (ndev->ndev_ring)
+		ndev->ndev_sendq.nq_unsent++;
+
 	return OK;
 }
 
@@ -896,11 +1059,14 @@ ndev_recv(ndev_id_t id, struct pbuf * pbuf)
 		return EBUSY;
 
 	if ((r = ndev_transfer(ndev, pbuf, FALSE /*do_send*/, seq,
-	    nreq)) != OK)
+	    nreq, 0, 0)) != OK)
 		return r;
 
 	ndev_queue_add(&ndev->ndev_recvq, nreq);
 
+	if (ndev->ndev_ring)
+		ndev->ndev_recvq.nq_unsent++;
+
 	return OK;
 }
 
@@ -923,7 +1089,66 @@ ndev_recv_reply(struct ndev * ndev, const message * m_ptr)
 	assert(ndev->ndev_ethif != NULL);
 
 	ethif_received(ndev->ndev_ethif,
-	    m_ptr->m_netdriver_ndev_reply.result);
+	    m_ptr->m_netdriver_ndev_reply.result, 0 /*flags*/);
+}
+
+/*
+ * The network device driver has sent a reply to a batch of send or receive
+ * requests announced through the descriptor ring.  The results, and for
+ * receive requests the receive flags, are in the ring.
+ */
+static void
+ndev_ring_reply(struct ndev * ndev, const message * m_ptr, int do_send)
+{
+	struct ndev_queue *nq;
+	const int32_t *results;
+	const uint32_t *flags;
+	uint32_t seq, count;
+	int32_t result;
+	int type;
+
+	if (!NDEV_ACTIVE(ndev) || !ndev->ndev_ring)
+		return;
+
+	seq = m_ptr->m_netdriver_ndev_ring_reply.id;
+	count = m_ptr->m_netdriver_ndev_ring_reply.count;
+
+	if (do_send) {
+		nq = &ndev->ndev_sendq;
+		results = ndev_ring[ndev - ndev_array].nr_send_result;
+		flags = NULL;
+		type = NDEV_SEND;
+	} else {
+		nq = &ndev->ndev_recvq;
+		results = ndev_ring[ndev - ndev_array].nr_recv_result;
+		flags = ndev_ring[ndev - ndev_array].nr_recv_flags;
+		type = NDEV_RECV;
+	}
+
+	/*
+	 * Process the completed requests in order, for as long as they match
+	 * the requests we were waiting for.  The ethif layer may queue new
+	 * requests from its callbacks, but those will not be announced to the
+	 * driver, and thus not be matched, until the next flush.
+	 */
+	for (; count > 0; seq++, count--) {
+		result = results[seq % NDEV_RING_MAX];
+
+		if (!ndev_queue_remove(nq, type, seq))
+			break;
+
+		assert(ndev->ndev_ethif != NULL);
+
+		if (do_send)
+			ethif_sent(ndev->ndev_ethif, result);
+		else
+			ethif_received(ndev->ndev_ethif, result,
+			    flags[seq % NDEV_RING_MAX]);
+
+		/* The callback may have caused the driver to be removed. */
+		if (!NDEV_ACTIVE(ndev) || !ndev->ndev_ring)
+			break;
+	}
 }
 
 /*
@@ -1011,6 +1236,16 @@ ndev_process(const message * m_ptr, int ipc_status)
 
 		break;
 
+	case NDEV_SEND_RING_REPLY:
+		ndev_ring_reply(ndev, m_ptr, TRUE /*do_send*/);
+
+		break;
+
+	case NDEV_RECV_RING_REPLY:
+		ndev_ring_reply(ndev, m_ptr, FALSE /*do_send*/);
+
+		break;
+
 	case NDEV_STATUS:
 		ndev_status(ndev, m_ptr);
 
@@ -24,9 +24,11 @@ struct ndev_conf {
 void ndev_init(void);
 void ndev_check(void);
 void ndev_process(const message * m_ptr, int ipc_status);
+void ndev_flush(void);
 
 int ndev_conf(ndev_id_t id, const struct ndev_conf * nconf);
-int ndev_send(ndev_id_t id, const struct pbuf * pbuf);
+int ndev_send(ndev_id_t id, const struct pbuf * pbuf, uint16_t csum_start,
+	uint16_t csum_off);
 int ndev_can_recv(ndev_id_t id);
 int ndev_recv(ndev_id_t id, struct pbuf * pbuf);
 
@@ -67,6 +67,7 @@
 #include "lwip.h"
 #include "ifaddr.h"
 #include "rttree.h"
+#include "rtdir.h"
 #include "rtsock.h"
 #include "route.h"
 #include "lldata.h"
@@ -126,6 +127,10 @@ struct route_entry {
 /* The total number of routing entries (IPv4 and IPv6 combined). */
 #define NR_ROUTE_ENTRY	128
 
+#if NR_ROUTE_ENTRY > RTDIR_MAX_ROUTES
+#error "The IPv4 routing table must be able to hold all routing entries"
+#endif
+
 static struct route_entry route_array[NR_ROUTE_ENTRY];	/* routing entries */
 
 static SIMPLEQ_HEAD(, route_entry) route_freelist;	/* free entry list */
@@ -262,6 +267,9 @@ route_init(void)
 
 	/* Reset the routing cache. */
 	rtcache_init();
+
+	/* Build the (empty) IPv4 routing table. */
+	rtdir_init(&route_tree[ROUTE_TREE_V4]);
 }
 
 /*
@@ -461,6 +469,9 @@ route_add(const ip_addr_t * addr, unsigned int prefix,
 			ip4_addr_copy(route->re_gw4, *ip_2_ip4(gateway));
 	}
 
+	if (tree == ROUTE_TREE_V4)
+		rtdir_add(&route->re_entry);
+
 	/* We have made routing changes. */
 	route_updated(tree);
 
@@ -582,7 +593,6 @@ route_miss_v6(const ip6_addr_t * ip6addr)
 static inline struct route_entry *
 route_lookup_v4(const ip4_addr_t * ip4addr)
 {
-	uint8_t rtaddr[ROUTE_ADDR_MAX];
 	struct route_entry *route;
 
 	/*
@@ -593,10 +603,7 @@ route_lookup_v4(const ip4_addr_t * ip4addr)
 	if (rtcache_lookup_v4(ip4addr, &route))
 		return route;
 
-	route_prepare_v4(ip4addr, rtaddr);
-
-	route = (struct route_entry *)
-	    rttree_lookup_match(&route_tree[ROUTE_TREE_V4], rtaddr);
+	route = (struct route_entry *)rtdir_lookup(&ip4addr->addr);
 
 	/* Cache the result, even if we found no route. */
 	rtcache_add_v4(ip4addr, route);
@@ -724,6 +731,9 @@ route_delete(struct route_entry * route, const struct rtsock_request * rtr)
 	/* Then actually delete the route. */
 	rttree_delete(&route_tree[tree], &route->re_entry);
 
+	if (tree == ROUTE_TREE_V4)
+		rtdir_delete(&route->re_entry);
+
 	SIMPLEQ_INSERT_HEAD(&route_freelist, route, re_next);
 
 	/* We have made routing changes. */
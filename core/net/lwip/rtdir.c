@@ -0,0 +1,291 @@
+/* LWIP service - rtdir.c - compiled IPv4 routing table */
+/*
+ * This module compiles the IPv4 routing tree into a multibit trie with a
+ * stride of eight bits, so that looking up a route on the packet path takes at
+ * most four table accesses rather than a bit-by-bit walk down the routing
+ * tree.  Each table slot holds either a route number (plus one, so that zero
+ * means "no route"), or the index of a lower-level table, flagged with
+ * RTDIR_CHUNK.  Routes with a prefix length that is not a multiple of the
+ * stride are expanded across all the slots they cover; a slot that is covered
+ * by several routes holds the most narrow one.  The table is updated along
+ * with the routing tree, which remains the authoritative source of routes.
+ * Lower-level tables are not freed when routes are deleted; instead, when they
+ * run out, the table is rebuilt from the routing tree.  There are enough
+ * lower-level tables for every route to use its own on each level, so that a
+ * rebuild always succeeds.
+ *
+ * This module depends on nothing but the routing tree, so that it can also be
+ * tested in isolation; see test/rtdir_test.c.
+ */
+
+#include "lwip.h"
+#include "rttree.h"
+#include "rtdir.h"
+
+#define RTDIR_STRIDE	8			/* bits per table level */
+#define RTDIR_SLOTS	(1 << RTDIR_STRIDE)	/* slots per table */
+#define RTDIR_LEVELS	(IP4_BITS / RTDIR_STRIDE)	/* table levels */
+#define RTDIR_CHUNKS	(RTDIR_MAX_ROUTES * (RTDIR_LEVELS - 1))	/* tables */
+
+#define RTDIR_NONE	0			/* slot value: no route */
+#define RTDIR_CHUNK	0x8000			/* slot flag: lower-level table */
+
+static struct rttree *rtdir_tree;		/* the IPv4 routing tree */
+
+static struct rttree_entry *rtdir_route[RTDIR_MAX_ROUTES]; /* routes by number */
+
+static uint16_t rtdir_top[RTDIR_SLOTS];		/* top-level table */
+static uint16_t rtdir_chunk[RTDIR_CHUNKS][RTDIR_SLOTS]; /* lower levels */
+static unsigned int rtdir_used;			/* # lower-level tables used */
+
+/*
+ * Return the table slot value for the given route.  If 'alloc' is set and the
+ * route does not have a number yet, give it one.  Return RTDIR_NONE if the
+ * route has no number.
+ */
+static uint16_t
+rtdir_value(struct rttree_entry * entry, int alloc)
+{
+	unsigned int num, free_num;
+
+	free_num = RTDIR_MAX_ROUTES;
+
+	for (num = 0; num < RTDIR_MAX_ROUTES; num++) {
+		if (rtdir_route[num] == entry)
+			return (uint16_t)num + 1;
+		if (rtdir_route[num] == NULL && free_num == RTDIR_MAX_ROUTES)
+			free_num = num;
+	}
+
+	if (!alloc)
+		return RTDIR_NONE;
+
+	if (free_num == RTDIR_MAX_ROUTES)
+		panic("out of IPv4 route numbers");
+
+	rtdir_route[free_num] = entry;
+
+	return (uint16_t)free_num + 1;
+}
+
+/*
+ * Return the prefix length of the route in the given table slot value, which
+ * must not be a lower-level table.  Return -1 if the slot has no route.
+ */
+static int
+rtdir_prefix(uint16_t value)
+{
+
+	assert(!(value & RTDIR_CHUNK));
+
+	if (value == RTDIR_NONE)
+		return -1;
+
+	return rttree_get_prefix(rtdir_route[value - 1]);
+}
+
+/*
+ * Update a range of 'count' slots starting at 'first' in the given table, and
+ * recursively in any lower-level tables within that range.  If 'old' is not
+ * RTDIR_NONE, replace all slots holding 'old' with 'value'.  Otherwise, put
+ * 'value' in all slots holding a route with a prefix length less than
+ * 'prefix'.
+ */
+static void
+rtdir_fill(uint16_t * table, unsigned int first, unsigned int count,
+	uint16_t value, int prefix, uint16_t old)
+{
+	unsigned int slot;
+	uint16_t cur;
+
+	for (slot = first; slot < first + count; slot++) {
+		cur = table[slot];
+
+		if (cur & RTDIR_CHUNK)
+			rtdir_fill(rtdir_chunk[cur & ~RTDIR_CHUNK], 0,
+			    RTDIR_SLOTS, value, prefix, old);
+		else if (old != RTDIR_NONE) {
+			if (cur == old)
+				table[slot] = value;
+		} else if (rtdir_prefix(cur) < prefix)
+			table[slot] = value;
+	}
+}
+
+/*
+ * Walk the table down to the level at which the given route is stored and
+ * return that level's table, as well as the range of slots covered by the
+ * route in 'first' and 'count'.  If 'alloc' is set, allocate lower-level
+ * tables along the way as needed.  Return NULL if a lower-level table was
+ * needed but none was available.
+ */
+static uint16_t *
+rtdir_walk(const struct rttree_entry * entry, int alloc, unsigned int * first,
+	unsigned int * count)
+{
+	const uint8_t *addr;
+	uint16_t *table, cur;
+	unsigned int level, prefix, slot;
+
+	addr = (const uint8_t *)rttree_get_addr(entry);
+	prefix = rttree_get_prefix(entry);
+	table = rtdir_top;
+
+	for (level = 0; prefix > (level + 1) * RTDIR_STRIDE; level++) {
+		cur = table[addr[level]];
+
+		if (!(cur & RTDIR_CHUNK)) {
+			if (!alloc || rtdir_used == RTDIR_CHUNKS)
+				return NULL;
+
+			/* Expand the covering route into the new table. */
+			for (slot = 0; slot < RTDIR_SLOTS; slot++)
+				rtdir_chunk[rtdir_used][slot] = cur;
+
+			cur = RTDIR_CHUNK | rtdir_used++;
+			table[addr[level]] = cur;
+		}
+
+		table = rtdir_chunk[cur & ~RTDIR_CHUNK];
+	}
+
+	*first = addr[level];
+	*count = 1 << ((level + 1) * RTDIR_STRIDE - prefix);
+
+	return table;
+}
+
+/*
+ * Add the given route to the table.  Return TRUE on success, or FALSE if no
+ * lower-level table was available for the route.
+ */
+static int
+rtdir_insert(struct rttree_entry * entry)
+{
+	uint16_t *table;
+	unsigned int first, count;
+
+	if ((table = rtdir_walk(entry, TRUE /*alloc*/, &first, &count)) ==
+	    NULL)
+		return FALSE;
+
+	rtdir_fill(table, first, count, rtdir_value(entry, TRUE /*alloc*/),
+	    rttree_get_prefix(entry), RTDIR_NONE);
+
+	return TRUE;
+}
+
+/*
+ * Rebuild the table from the routing tree, reclaiming any lower-level tables
+ * no longer in use.
+ */
+static void
+rtdir_rebuild(void)
+{
+	struct rttree_entry *entry;
+
+	memset(rtdir_route, 0, sizeof(rtdir_route));
+	memset(rtdir_top, 0, sizeof(rtdir_top));
+	rtdir_used = 0;
+
+	for (entry = NULL; (entry = rttree_enum(rtdir_tree, entry)) != NULL; )
+		if (!rtdir_insert(entry))
+			panic("out of IPv4 routing table chunks");
+}
+
+/*
+ * Initialize the table, for the given IPv4 routing tree.
+ */
+void
+rtdir_init(struct rttree * tree)
+{
+
+	rtdir_tree = tree;
+
+	rtdir_rebuild();
+}
+
+/*
+ * The given route has been added to the routing tree.  Update the table
+ * accordingly.
+ */
+void
+rtdir_add(struct rttree_entry * entry)
+{
+
+	if (!rtdir_insert(entry))
+		rtdir_rebuild();
+}
+
+/*
+ * The given route has been deleted from the routing tree.  Update the table
+ * accordingly, by replacing the route with the next most narrow route covering
+ * it, if any.
+ */
+void
+rtdir_delete(struct rttree_entry * entry)
+{
+	struct rttree_entry *cover;
+	uint8_t addr[IP4_BITS / NBBY], mask[IP4_BITS / NBBY];
+	const uint8_t *route_addr;
+	uint16_t *table, value, old;
+	unsigned int byte, first, count, prefix;
+
+	route_addr = (const uint8_t *)rttree_get_addr(entry);
+	value = RTDIR_NONE;
+
+	for (prefix = rttree_get_prefix(entry); prefix > 0; ) {
+		prefix--;
+
+		addr_make_netmask(mask, sizeof(mask), prefix);
+
+		for (byte = 0; byte < __arraycount(addr); byte++)
+			addr[byte] = route_addr[byte] & mask[byte];
+
+		if ((cover = rttree_lookup_exact(rtdir_tree, addr, prefix)) !=
+		    NULL) {
+			value = rtdir_value(cover, FALSE /*alloc*/);
+			assert(value != RTDIR_NONE);
+
+			break;
+		}
+	}
+
+	old = rtdir_value(entry, FALSE /*alloc*/);
+	assert(old != RTDIR_NONE);
+
+	table = rtdir_walk(entry, FALSE /*alloc*/, &first, &count);
+	assert(table != NULL);
+
+	rtdir_fill(table, first, count, value, 0, old);
+
+	rtdir_route[old - 1] = NULL;
+}
+
+/*
+ * Look up the most narrow matching route for the given IPv4 address, given as
+ * four bytes in network byte order.  Return the route if one exists at all, or
+ * NULL otherwise.
+ */
+struct rttree_entry *
+rtdir_lookup(const void * addr)
+{
+	const uint8_t *bytes;
+	unsigned int level;
+	uint16_t value;
+
+	bytes = (const uint8_t *)addr;
+
+	value = rtdir_top[bytes[0]];
+
+	for (level = 1; value & RTDIR_CHUNK; level++) {
+		assert(level < RTDIR_LEVELS);
+
+		value = rtdir_chunk[value & ~RTDIR_CHUNK][bytes[level]];
+	}
+
+	if (value == RTDIR_NONE)
+		return NULL;
+
+	return rtdir_route[value - 1];
+}
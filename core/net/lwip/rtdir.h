@@ -0,0 +1,12 @@
+#ifndef MINIX_NET_LWIP_RTDIR_H
+#define MINIX_NET_LWIP_RTDIR_H
+
+/* The maximum number of routes that the IPv4 routing table can hold. */
+#define RTDIR_MAX_ROUTES	128
+
+void rtdir_init(struct rttree * tree);
+void rtdir_add(struct rttree_entry * entry);
+void rtdir_delete(struct rttree_entry * entry);
+struct rttree_entry *rtdir_lookup(const void * addr);
+
+#endif /* !MINIX_NET_LWIP_RTDIR_H */
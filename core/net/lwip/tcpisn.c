@@ -8,6 +8,12 @@
  * Ideally, the secret should remain the same across system reboots; it is left
  * up to userland to take care of that.
  *
+ * The same hash also produces SYN cookies: when a listening socket's backlog
+ * overflows, lwIP answers further SYNs statelessly, using as ISN a hash of
+ * the connection and the current time period with a coarse MSS value mixed
+ * in, and recreates the connection only once the client's ACK proves it saw
+ * the SYN|ACK.  See lwip_hook_tcp_syncookie() below.
+ *
  * TODO: while this module provides the strongest possible implementation of
  * the algorithm, it is also quite heavyweight.  We should consider allowing
  * for a more configurable level of strength, perhaps with the possibility for
@@ -30,6 +36,38 @@
  */
 #define TCPISN_TUPLE_LENGTH	(16 * 2 + 2 * 2)
 
+/*
+ * For SYN cookies, the otherwise blank remainder of the block additionally
+ * holds the cookie time period, the client's ISN, and a tag byte that keeps
+ * cookie hashes disjoint from regular ISN hashes.  These fields are cleared
+ * again after use, so that the padding is zero for the ISN hook.
+ */
+#define TCPISN_COOKIE_OFFSET	(TCPISN_TUPLE_LENGTH + TCPISN_SECRET_LENGTH)
+#define TCPISN_COOKIE_LENGTH	(4 + 4 + 1)
+
+#if TCPISN_COOKIE_OFFSET + TCPISN_COOKIE_LENGTH > SHA256_BLOCK_LENGTH
+#error "TCP SYN cookie fields exceed remainder of hash block"
+#endif
+
+/*
+ * SYN cookie validity period, in seconds.  A cookie is accepted during the
+ * period in which it was generated and the period after that, so that its
+ * lifetime is between one and two periods.  lwIP relies on the upper bound.
+ */
+#define TCPISN_COOKIE_PERIOD	(LWIP_TCP_SYNCOOKIE_LIFETIME / 2)
+
+/*
+ * The MSS values that can be encoded in a SYN cookie.  The low three bits of
+ * a cookie select one of these; the client's MSS is rounded down to the
+ * nearest entry.  The values favor common Ethernet and tunnel path MTUs.
+ */
+#define TCPISN_MSS_BITS		3
+#define TCPISN_MSS_MASK		((1U << TCPISN_MSS_BITS) - 1)
+
+static const uint16_t tcpisn_mss_table[TCPISN_MSS_MASK + 1] = {
+	64, 256, 536, 1024, 1220, 1400, 1440, 1460
+};
+
 #if TCPISN_SECRET_LENGTH > (SHA256_BLOCK_LENGTH - TCPISN_TUPLE_LENGTH)
 #error "TCP ISN secret length exceeds remainder of hash block"
 #endif
@@ -130,23 +168,13 @@ tcpisn_secret(struct rmib_call * call __unused,
 }
 
 /*
- * Hook to generate an Initial Sequence Number (ISN) for a new TCP connection.
+ * Fill the TCP 4-tuple part of the hash input with the given addresses and
+ * port numbers.
  */
-uint32_t
-lwip_hook_tcp_isn(const ip_addr_t * local_ip, uint16_t local_port,
+static void
+tcpisn_set_tuple(const ip_addr_t * local_ip, uint16_t local_port,
 	const ip_addr_t * remote_ip, uint16_t remote_port)
 {
-	uint8_t output[SHA256_DIGEST_LENGTH] __aligned(4);
-	SHA256_CTX ctx;
-	clock_t realtime;
-	time_t boottime;
-	uint32_t isn;
-
-	if (!tcpisn_set) {
-		printf("LWIP: warning, no TCP ISN secret has been set\n");
-
-		tcpisn_set = TRUE;	/* print the warning only once */
-	}
 
 	if (IP_IS_V6(local_ip)) {
 		assert(IP_IS_V6(remote_ip));
@@ -171,13 +199,35 @@ lwip_hook_tcp_isn(const ip_addr_t * local_ip, uint16_t local_port,
 		memset(&tcpisn_input[16], 0, 10);
 		tcpisn_input[26] = 0xff;
 		tcpisn_input[27] = 0xff;
-		memcpy(&tcpisn_input[28], &ip_2_ip4(local_ip)->addr, 4);
+		memcpy(&tcpisn_input[28], &ip_2_ip4(remote_ip)->addr, 4);
 	}
 
 	tcpisn_input[32] = local_port >> 8;
 	tcpisn_input[33] = local_port & 0xff;
 	tcpisn_input[34] = remote_port >> 8;
 	tcpisn_input[35] = remote_port & 0xff;
+}
+
+/*
+ * Hook to generate an Initial Sequence Number (ISN) for a new TCP connection.
+ */
+uint32_t
+lwip_hook_tcp_isn(const ip_addr_t * local_ip, uint16_t local_port,
+	const ip_addr_t * remote_ip, uint16_t remote_port)
+{
+	uint8_t output[SHA256_DIGEST_LENGTH] __aligned(4);
+	SHA256_CTX ctx;
+	clock_t realtime;
+	time_t boottime;
+	uint32_t isn;
+
+	if (!tcpisn_set) {
+		printf("LWIP: warning, no TCP ISN secret has been set\n");
+
+		tcpisn_set = TRUE;	/* print the warning only once */
+	}
+
+	tcpisn_set_tuple(local_ip, local_port, remote_ip, remote_port);
 
 	/* The rest of the input (secret and padding) is already filled in. */
 
@@ -201,3 +251,99 @@ lwip_hook_tcp_isn(const ip_addr_t * local_ip, uint16_t local_port,
 	/* The result is the ISN to use for this connection. */
 	return isn;
 }
+
+/*
+ * Compute the raw SYN cookie hash for the given time period and client ISN.
+ * The 4-tuple must already have been filled in.
+ */
+static uint32_t
+tcpisn_cookie_hash(uint32_t period, uint32_t seqno)
+{
+	uint8_t output[SHA256_DIGEST_LENGTH] __aligned(4);
+	uint8_t *ptr;
+	SHA256_CTX ctx;
+	uint32_t hash;
+
+	ptr = &tcpisn_input[TCPISN_COOKIE_OFFSET];
+	memcpy(&ptr[0], &period, sizeof(period));
+	memcpy(&ptr[4], &seqno, sizeof(seqno));
+	ptr[8] = 1;
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, tcpisn_input, sizeof(tcpisn_input));
+	SHA256_Final(output, &ctx);
+
+	memset(ptr, 0, TCPISN_COOKIE_LENGTH);
+
+	memcpy(&hash, output, sizeof(hash));
+
+	return hash;
+}
+
+/*
+ * Return the current SYN cookie time period number.
+ */
+static uint32_t
+tcpisn_cookie_period(void)
+{
+	clock_t uptime;
+
+	(void)getuptime(&uptime, NULL, NULL);
+
+	return (uint32_t)(uptime / ((clock_t)TCPISN_COOKIE_PERIOD * sys_hz()));
+}
+
+/*
+ * Hook to generate a SYN cookie for a SYN that arrived on a listening socket
+ * whose backlog is full.  The SYN cookie is to be used as the ISN of the
+ * SYN|ACK response.  The given 'mss' is the effective MSS for sending to the
+ * client.  The cookie encodes that value rounded down to one of a few coarse
+ * steps, so that the connection can use it once the cookie comes back.  The
+ * MSS that we advertise to the client is unaffected by this.
+ */
+uint32_t
+lwip_hook_tcp_syncookie(const ip_addr_t * local_ip, uint16_t local_port,
+	const ip_addr_t * remote_ip, uint16_t remote_port, uint32_t seqno,
+	uint16_t mss)
+{
+	unsigned int idx;
+
+	for (idx = TCPISN_MSS_MASK; idx > 0; idx--)
+		if (tcpisn_mss_table[idx] <= mss)
+			break;
+
+	tcpisn_set_tuple(local_ip, local_port, remote_ip, remote_port);
+
+	return tcpisn_cookie_hash(tcpisn_cookie_period(), seqno) ^ idx;
+}
+
+/*
+ * Hook to check whether the given cookie, taken from the acknowledgment
+ * number of an ACK that arrived on a listening socket, is a SYN cookie that
+ * we handed out recently for the same 4-tuple and client ISN.  Return TRUE,
+ * with the encoded MSS stored in 'mss', if so.  Return FALSE otherwise.
+ */
+int
+lwip_hook_tcp_syncookie_check(const ip_addr_t * local_ip,
+	uint16_t local_port, const ip_addr_t * remote_ip, uint16_t remote_port,
+	uint32_t seqno, uint32_t cookie, uint16_t * mss)
+{
+	uint32_t period, diff;
+	unsigned int i;
+
+	tcpisn_set_tuple(local_ip, local_port, remote_ip, remote_port);
+
+	period = tcpisn_cookie_period();
+
+	for (i = 0; i < 2; i++) {
+		diff = cookie ^ tcpisn_cookie_hash(period - i, seqno);
+
+		if ((diff & ~TCPISN_MSS_MASK) == 0) {
+			*mss = tcpisn_mss_table[diff];
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
@@ -136,6 +136,8 @@ static const struct sockevent_ops tcpsock_ops;
 static unsigned int tcpsock_sendbufs;		/* # send buffers in use */
 static unsigned int tcpsock_recvbufs;		/* # receive buffers in use */
 
+int lwip_tcp_syncookies = 1;	/* sysctl(7); lwIP is patched to check this */
+
 /* A bunch of macros that are just for convenience. */
 #define tcpsock_get_id(tcp)	(SOCKID_TCP | (sockid_t)((tcp) - tcp_array))
 #define tcpsock_get_ipsock(tcp)	(&(tcp)->tcp_ipsock)
@@ -175,7 +177,11 @@ static struct rmib_node net_inet_tcp_table[] = {
 				    CTLFLAG_HIDDEN | CTLTYPE_STRING,
 				    TCPISN_SECRET_HEX_LENGTH, tcpisn_secret,
 				    "isn_secret",
-				    "TCP ISN secret (MINIX 3 specific)")
+				    "TCP ISN secret (MINIX 3 specific)"),
+/*+2*/	[TCPCTL_MAXID + 2]	= RMIB_INTPTR(RMIB_RW, &lwip_tcp_syncookies,
+				    "syncookies",
+				    "Use SYN cookies when a listen queue is full "
+				    "(MINIX 3 specific)"),
 };
 
 static struct rmib_node net_inet_tcp_node =
@@ -1995,6 +2001,15 @@ tcpsock_recv(struct sock * sock, const struct sockdriver_data * data,
 	size_t off, left;
 	int r;
 
+	/*
+	 * For a blocked MSG_WAITALL call, libsockevent asks for the rest of
+	 * the request, so that we copy out data in large chunks.  Do not let
+	 * such a call wait for more than half of the receive buffer, though:
+	 * beyond that point, the receive window would start to close.
+	 */
+	if ((flags & MSG_WAITALL) && min > tcpsock_get_rcvbuf(tcp) / 2)
+		min = tcpsock_get_rcvbuf(tcp) / 2;
+
 	/* See if we can receive at all, and if so, how much at most. */
 	if ((r = tcpsock_test_recv(sock, min, NULL)) != OK)
 		return r;
@@ -2670,6 +2685,7 @@ static void
 tcpsock_get_info(struct kinfo_pcb * ki, const void * ptr)
 {
 	const struct tcp_pcb *pcb = (const struct tcp_pcb *)ptr;
+	const struct tcp_pcb_listen *lpcb;
 	struct tcpsock *tcp;
 
 	/*
@@ -2718,6 +2734,16 @@ tcpsock_get_info(struct kinfo_pcb * ki, const void * ptr)
 		assert(tcp != NULL);
 		ki->ki_refs =
 		    (uint64_t)(uintptr_t)TAILQ_FIRST(&tcp->tcp_queue.tq_head);
+
+		/* Also report accept queue and SYN cookie statistics. */
+		lpcb = (const struct tcp_pcb_listen *)pcb;
+
+		ki->ki_qlen = lpcb->accepts_queued;
+		ki->ki_qlimit = lpcb->backlog;
+		ki->ki_syndrops = lpcb->syn_drops;
+		ki->ki_cookiesent = lpcb->syncookies_sent;
+		ki->ki_cookierecv = lpcb->syncookies_recv;
+		ki->ki_acceptdrops = lpcb->accept_drops;
 	} else {
 		if (tcp_nagle_disabled(pcb))
 			ki->ki_tflags |= NETBSD_TF_NODELAY;
@@ -0,0 +1,250 @@
+/* LWIP service - test/bpf_test.c - BPF filter test */
+/*
+ * This program checks the pre-decoded BPF filter of bpf_filter.c against the
+ * regular BPF filter in the same file.  It generates random programs, keeps
+ * those that pass validation, and runs both filters on random packets that are
+ * split up into random pbuf chains.  The results must be the same every time.
+ * Finally, it prints the cost of running both filters on a typical filter
+ * program, in nanoseconds per packet.
+ */
+
+#include <sys/time.h>
+#include <net/bpf.h>
+
+#include "host.h"
+#include "../bpf_filter.h"
+
+#define ITERATIONS	1000000		/* number of random programs */
+#define PACKETS		5		/* number of packets per program */
+#define MAX_INSNS	32		/* maximum program length */
+#define MAX_PACKET	200		/* maximum packet size */
+#define MAX_PBUFS	10		/* maximum number of pbufs per packet */
+#define BENCH_RUNS	10000000	/* number of filter runs to time */
+
+/* The instructions from which random programs are made up. */
+static const uint16_t codes[] = {
+	BPF_LD+BPF_W+BPF_ABS,	BPF_LD+BPF_H+BPF_ABS,	BPF_LD+BPF_B+BPF_ABS,
+	BPF_LD+BPF_W+BPF_IND,	BPF_LD+BPF_H+BPF_IND,	BPF_LD+BPF_B+BPF_IND,
+	BPF_LD+BPF_W+BPF_LEN,	BPF_LD+BPF_IMM,		BPF_LD+BPF_MEM,
+	BPF_LDX+BPF_IMM,	BPF_LDX+BPF_MEM,	BPF_LDX+BPF_LEN,
+	BPF_LDX+BPF_B+BPF_MSH,	BPF_ST,			BPF_STX,
+	BPF_ALU+BPF_ADD+BPF_K,	BPF_ALU+BPF_SUB+BPF_K,	BPF_ALU+BPF_MUL+BPF_K,
+	BPF_ALU+BPF_DIV+BPF_K,	BPF_ALU+BPF_MOD+BPF_K,	BPF_ALU+BPF_AND+BPF_K,
+	BPF_ALU+BPF_OR+BPF_K,	BPF_ALU+BPF_XOR+BPF_K,	BPF_ALU+BPF_LSH+BPF_K,
+	BPF_ALU+BPF_RSH+BPF_K,	BPF_ALU+BPF_ADD+BPF_X,	BPF_ALU+BPF_SUB+BPF_X,
+	BPF_ALU+BPF_MUL+BPF_X,	BPF_ALU+BPF_DIV+BPF_X,	BPF_ALU+BPF_MOD+BPF_X,
+	BPF_ALU+BPF_AND+BPF_X,	BPF_ALU+BPF_OR+BPF_X,	BPF_ALU+BPF_XOR+BPF_X,
+	BPF_ALU+BPF_LSH+BPF_X,	BPF_ALU+BPF_RSH+BPF_X,	BPF_ALU+BPF_NEG,
+	BPF_JMP+BPF_JA,		BPF_JMP+BPF_JGT+BPF_K,	BPF_JMP+BPF_JGE+BPF_K,
+	BPF_JMP+BPF_JEQ+BPF_K,	BPF_JMP+BPF_JSET+BPF_K,	BPF_JMP+BPF_JGT+BPF_X,
+	BPF_JMP+BPF_JGE+BPF_X,	BPF_JMP+BPF_JEQ+BPF_X,	BPF_JMP+BPF_JSET+BPF_X,
+	BPF_RET+BPF_A,		BPF_RET+BPF_K,		BPF_MISC+BPF_TAX,
+	BPF_MISC+BPF_TXA,	0xff /* invalid */
+};
+
+/* A typical filter: "ip and tcp dst port 80" on Ethernet. */
+static const struct bpf_insn bench_prog[] = {
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0x0800, 0, 8),
+	BPF_STMT(BPF_LD+BPF_B+BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 6, 0, 6),
+	BPF_STMT(BPF_LD+BPF_H+BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 0x1fff, 4, 0),
+	BPF_STMT(BPF_LDX+BPF_B+BPF_MSH, 14),
+	BPF_STMT(BPF_LD+BPF_H+BPF_IND, 16),
+	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 80, 0, 1),
+	BPF_STMT(BPF_RET+BPF_K, 262144),
+	BPF_STMT(BPF_RET+BPF_K, 0),
+};
+
+/*
+ * Return a random constant operand, biased toward values that make sense as
+ * packet offsets, memory word indices, shift counts, and edge cases.
+ */
+static uint32_t
+random_k(void)
+{
+
+	switch (random() % 6) {
+	case 0:
+		return random() % 80;
+	case 1:
+		return random() % 16;
+	case 2:
+		return UINT32_MAX - random() % 5;
+	case 3:
+		return random() % 4;
+	default:
+		return random() % (MAX_PACKET + 100);
+	}
+}
+
+/*
+ * Fill the given program with 'count' random instructions, the last of which
+ * is always a return instruction.
+ */
+static void
+random_prog(struct bpf_insn * prog, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		prog[i].code = codes[random() % __arraycount(codes)];
+		prog[i].k = random_k();
+		prog[i].jt = random() % 4;
+		prog[i].jf = random() % 4;
+		if (prog[i].code == BPF_JMP+BPF_JA)
+			prog[i].k = random() % 4;
+	}
+
+	prog[count - 1].code = BPF_RET+BPF_A;
+}
+
+/*
+ * Fill the given packet with 'total' random bytes, and split it up over a
+ * random chain of pbufs.  Every pbuf has at least one byte, unless the packet
+ * is empty.
+ */
+static void
+random_packet(u_char * packet, u_int total, struct pbuf * pbuf)
+{
+	unsigned int i, off, len;
+
+	for (i = 0; i < total; i++)
+		packet[i] = random();
+
+	off = 0;
+	for (i = 0; i < MAX_PBUFS; i++) {
+		if (i == MAX_PBUFS - 1 || off == total)
+			len = total - off;
+		else
+			len = 1 + random() % (total - off);
+
+		pbuf[i].payload = &packet[off];
+		pbuf[i].len = len;
+		pbuf[i].tot_len = total - off;
+		pbuf[i].next = NULL;
+		if (i > 0)
+			pbuf[i - 1].next = &pbuf[i];
+
+		off += len;
+		if (off == total)
+			break;
+	}
+}
+
+/*
+ * Return the current time in microseconds.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Print the cost of running the typical filter program on a TCP packet that
+ * it accepts, with both filters, with the packet in a single pbuf.
+ */
+static void
+bench(void)
+{
+	struct bpf_dinsn dprog[__arraycount(bench_prog)];
+	u_char packet[64];
+	struct pbuf pbuf;
+	unsigned long long t0, t1, t2;
+	unsigned int i, sum;
+
+	memset(packet, 0, sizeof(packet));
+	packet[12] = 0x08;		/* Ethernet type: IPv4 */
+	packet[14] = 0x45;		/* IPv4, header length 20 */
+	packet[23] = 6;			/* protocol: TCP */
+	packet[36] = 0;			/* TCP destination port 80 */
+	packet[37] = 80;
+
+	memset(&pbuf, 0, sizeof(pbuf));
+	pbuf.payload = packet;
+	pbuf.len = pbuf.tot_len = sizeof(packet);
+
+	if (!bpf_validate(bench_prog, __arraycount(bench_prog)))
+		panic("benchmark program does not validate");
+	bpf_decode(bench_prog, __arraycount(bench_prog), dprog);
+
+	sum = 0;
+	t0 = get_usecs();
+	for (i = 0; i < BENCH_RUNS; i++)
+		sum += bpf_filter_ext(bench_prog, &pbuf, packet,
+		    sizeof(packet), sizeof(packet));
+	t1 = get_usecs();
+	for (i = 0; i < BENCH_RUNS; i++)
+		sum -= bpf_filter_dec(dprog, &pbuf, packet, sizeof(packet),
+		    sizeof(packet));
+	t2 = get_usecs();
+
+	if (sum != 0)
+		panic("filter results differ");
+	if (bpf_filter_dec(dprog, &pbuf, packet, sizeof(packet),
+	    sizeof(packet)) == 0)
+		panic("benchmark packet not accepted");
+
+	printf("typical filter: regular %llu ns, pre-decoded %llu ns per "
+	    "packet\n", (t1 - t0) * 1000 / BENCH_RUNS,
+	    (t2 - t1) * 1000 / BENCH_RUNS);
+}
+
+int
+main(void)
+{
+	struct bpf_insn prog[MAX_INSNS];
+	struct bpf_dinsn dprog[MAX_INSNS];
+	u_char packet[MAX_PACKET];
+	struct pbuf pbuf[MAX_PBUFS];
+	unsigned int n, i, count, valid;
+	u_int total, r1, r2;
+
+	srandom(48);
+
+	valid = 0;
+
+	for (n = 0; n < ITERATIONS; n++) {
+		count = 2 + random() % (MAX_INSNS - 1);
+
+		random_prog(prog, count);
+
+		if (!bpf_validate(prog, count))
+			continue;
+		valid++;
+
+		bpf_decode(prog, count, dprog);
+
+		for (i = 0; i < PACKETS; i++) {
+			total = random() % MAX_PACKET;
+
+			random_packet(packet, total, pbuf);
+
+			r1 = bpf_filter_ext(prog, pbuf, packet, total,
+			    pbuf[0].len);
+			r2 = bpf_filter_dec(dprog, pbuf, packet, total,
+			    pbuf[0].len);
+
+			if (r1 != r2) {
+				fprintf(stderr, "mismatch at iteration %u: "
+				    "%u vs %u\n", n, r1, r2);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	if (valid < ITERATIONS / 100)
+		panic("too few valid programs (%u)", valid);
+
+	printf("bpf_filter: ok (%u programs)\n", valid);
+
+	bench();
+
+	return EXIT_SUCCESS;
+}
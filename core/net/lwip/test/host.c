@@ -0,0 +1,45 @@
+/* LWIP service - test/host.c - host support functions for module tests */
+
+#include <stdarg.h>
+
+#include "host.h"
+
+/*
+ * Report a fatal error and abort the test.
+ */
+void
+panic(const char * fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "panic: ");
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+
+	abort();
+}
+
+/*
+ * Create a network mask of 'addr_len' bytes with the first 'prefix' bits set.
+ * This is a copy of the function of the same name in addr.c, which cannot be
+ * built on the host as a whole.
+ */
+void
+addr_make_netmask(uint8_t * addr, socklen_t addr_len, unsigned int prefix)
+{
+	unsigned int byte, bit;
+
+	byte = prefix / NBBY;
+	bit = prefix % NBBY;
+
+	assert(byte + !!bit <= addr_len);
+
+	if (byte > 0)
+		memset(addr, 0xff, byte);
+	if (bit != 0)
+		addr[byte++] = (uint8_t)(0xff << (NBBY - bit));
+	if (byte < addr_len)
+		memset(&addr[byte], 0, addr_len - byte);
+}
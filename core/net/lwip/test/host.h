@@ -0,0 +1,62 @@
+/* LWIP service - test/host.h - host build environment for module tests */
+/*
+ * The module tests in this directory build selected source files of the LWIP
+ * service on the host, outside of the MINIX 3 build.  Those source files all
+ * include "lwip.h", which pulls in the whole service and the system headers
+ * of MINIX 3.  This file is force-included before each of them instead.  It
+ * claims the include guard of "lwip.h", and provides the few definitions that
+ * the tested modules really need, on top of the host's system headers.  Each
+ * test supplies any other functions that its module calls.
+ */
+
+#ifndef MINIX_NET_LWIP_TEST_HOST_H
+#define MINIX_NET_LWIP_TEST_HOST_H
+
+#define MINIX_NET_LWIP_LWIP_H	/* do not include the real lwip.h */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#ifndef __arraycount
+#define __arraycount(a)	(sizeof(a) / sizeof((a)[0]))
+#endif
+#ifndef __unused
+#define __unused	__attribute__((__unused__))
+#endif
+#ifndef __CTASSERT
+#define __CTASSERT(x)	_Static_assert(x, #x)
+#endif
+
+typedef uint32_t bitchunk_t;	/* as in MINIX 3's <sys/types.h> */
+
+#define OK		0
+#define TRUE		1
+#define FALSE		0
+
+#define IP4_BITS	32
+#define IP6_BITS	128
+
+/* The fields of lwIP's packet buffer structure, in the same order. */
+struct pbuf {
+	struct pbuf *next;
+	void *payload;
+	uint16_t tot_len;
+	uint16_t len;
+	uint8_t type;
+	uint8_t flags;
+	uint8_t ref;
+	uint8_t if_idx;
+};
+
+void panic(const char * fmt, ...) __attribute__((__noreturn__));
+void addr_make_netmask(uint8_t * addr, socklen_t addr_len,
+	unsigned int prefix);
+
+#endif /* !MINIX_NET_LWIP_TEST_HOST_H */
@@ -0,0 +1,33 @@
+/* LWIP service - test/lwip/memp.h - host stand-in for lwIP's memp.h */
+/*
+ * The memory pool module includes lwIP's memp.h only for the list of lwIP's
+ * own object pools and their statistics.  The real header pulls in all of
+ * lwIP's configuration, so for the module test this file takes its place.  It
+ * still uses lwIP's real list of pools, for whatever pools are enabled without
+ * any configuration.
+ */
+
+#ifndef MINIX_NET_LWIP_TEST_LWIP_MEMP_H
+#define MINIX_NET_LWIP_TEST_LWIP_MEMP_H
+
+typedef enum {
+#define LWIP_MEMPOOL(name,num,size,desc) MEMP_##name,
+#include "lwip/priv/memp_std.h"
+	MEMP_MAX
+} memp_t;
+
+/* The fields of lwIP's pool statistics structure that the module uses. */
+struct stats_mem {
+	uint16_t err;
+	uint16_t avail;
+	uint16_t used;
+	uint16_t max;
+};
+
+struct stats_ {
+	struct stats_mem *memp[MEMP_MAX];
+};
+
+extern struct stats_ lwip_stats;
+
+#endif /* !MINIX_NET_LWIP_TEST_LWIP_MEMP_H */
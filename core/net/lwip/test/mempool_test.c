@@ -0,0 +1,404 @@
+/* LWIP service - test/mempool_test.c - memory pool test */
+/*
+ * This program tests the memory pool module.  It performs a long series of
+ * random allocations and frees of all sizes, filling each buffer with a
+ * pattern that is checked when the buffer is freed, so that overlapping
+ * buffers are detected.  Afterwards, it checks the module's usage statistics,
+ * runs the pool out of large buffers, and lets the timer return the slabs that
+ * are no longer needed.  Finally, it prints the cost of an allocation and free
+ * for each buffer class.
+ *
+ * The module is included into this file rather than built separately, so that
+ * its statistics can be checked directly.  This file provides the few parts of
+ * the service and system that the module uses.
+ */
+
+#include <sys/queue.h>
+#include <sys/time.h>
+#include <stddef.h>
+#include <limits.h>
+
+#include "host.h"
+#include "lwip/memp.h"
+
+#define ITERATIONS	10000000	/* number of random operations */
+#define SLOTS		4096		/* maximum number of live buffers */
+#define BENCH_RUNS	10000000	/* number of allocations to time */
+
+/* From lwipopts.h, except for the alignment, which is that of the host. */
+#define MEMPOOL_BUFSIZE	512
+#define MEM_ALIGNMENT	sizeof(void *)
+
+#ifndef MAP_PREALLOC
+#define MAP_PREALLOC	0
+#endif
+
+#ifndef LIST_FOREACH_SAFE
+#define LIST_FOREACH_SAFE(var, head, field, tvar)			\
+	for ((var) = LIST_FIRST((head));				\
+	    (var) && ((tvar) = LIST_NEXT((var), field), 1);		\
+	    (var) = (tvar))
+#endif
+
+/* The timer, which the test fires by hand. */
+typedef struct {
+	void (*tmr_func)(int);
+} minix_timer_t;
+
+#define sys_hz()	100
+
+static void
+set_timer(minix_timer_t * tp, clock_t ticks __unused, void (*func)(int),
+	int arg __unused)
+{
+
+	tp->tmr_func = func;
+}
+
+/* Just enough of the remote MIB to declare and inspect the subtree. */
+struct rmib_call;
+struct rmib_oldp;
+struct rmib_newp;
+
+struct rmib_node {
+	uint32_t rnode_flags;
+	size_t rnode_size;
+	int rnode_int;
+	void *rnode_data;
+	void *rnode_cptr;
+	ssize_t (*rnode_func)(struct rmib_call *, struct rmib_node *,
+	    struct rmib_oldp *, struct rmib_newp *);
+	const char *rnode_name;
+	const char *rnode_desc;
+};
+
+#define CTLTYPE_INT	1
+#define RMIB_RO		0
+#define RMIB_RW		0
+
+#define RMIB_NODE(f,t,n,d)	{ .rnode_size = __arraycount(t),	\
+				  .rnode_cptr = t, .rnode_name = n,	\
+				  .rnode_desc = d }
+#define RMIB_FUNC(f,s,fp,n,d)	{ .rnode_flags = f, .rnode_size = s,	\
+				  .rnode_func = fp, .rnode_name = n,	\
+				  .rnode_desc = d }
+#define RMIB_INT(f,i,n,d)	{ .rnode_int = i, .rnode_name = n,	\
+				  .rnode_desc = d }
+#define RMIB_INTPTR(f,p,n,d)	{ .rnode_data = p, .rnode_name = n,	\
+				  .rnode_desc = d }
+
+static ssize_t
+rmib_copyout(struct rmib_oldp * oldp, size_t off, const void * ptr,
+	size_t len)
+{
+
+	memcpy((char *)oldp + off, ptr, len);
+
+	return len;
+}
+
+static struct rmib_node *registered;
+
+static void
+mibtree_register_lwip(struct rmib_node * node)
+{
+
+	registered = node;
+}
+
+struct stats_ lwip_stats;
+
+void mempool_init(void);
+unsigned int mempool_cur_buffers(void);
+unsigned int mempool_max_buffers(void);
+void *mempool_malloc(size_t size);
+void *mempool_calloc(size_t num, size_t size);
+void mempool_free(void * ptr);
+
+#include "../mempool.c"
+
+static void *slot_ptr[SLOTS];
+static size_t slot_size[SLOTS];
+
+/*
+ * Allocate a buffer of the given size for the given slot, and fill it with a
+ * pattern unique to the slot.  Return the result of the allocation.
+ */
+static void *
+alloc_slot(unsigned int slot, size_t size)
+{
+	unsigned char *ptr;
+	size_t i;
+
+	if ((ptr = mempool_malloc(size)) == NULL)
+		return NULL;
+
+	if ((uintptr_t)ptr % sizeof(void *) != 0)
+		panic("unaligned buffer %p", ptr);
+
+	for (i = 0; i < size; i++)
+		ptr[i] = (unsigned char)(slot + i);
+
+	slot_ptr[slot] = ptr;
+	slot_size[slot] = size;
+
+	return ptr;
+}
+
+/*
+ * Check the pattern of the buffer in the given slot, and free the buffer.
+ */
+static void
+free_slot(unsigned int slot)
+{
+	unsigned char *ptr;
+	size_t i;
+
+	ptr = slot_ptr[slot];
+
+	for (i = 0; i < slot_size[slot]; i++)
+		if (ptr[i] != (unsigned char)(slot + i))
+			panic("buffer in slot %u corrupted at offset %zu",
+			    slot, i);
+
+	mempool_free(ptr);
+
+	slot_ptr[slot] = NULL;
+}
+
+/*
+ * Check that no buffers are in use, and that the peak usage of each class is
+ * at least the given value.
+ */
+static void
+check_empty(int min_peak)
+{
+	unsigned int class;
+
+	for (class = 0; class < MEMPOOL_CLASSES; class++) {
+		if (mempool_class[class].mc_used != 0)
+			panic("class %u has buffers in use", class);
+		if (mempool_class[class].mc_peak < min_peak)
+			panic("class %u peak too low", class);
+	}
+
+	if (mempool_used_large != 0)
+		panic("large buffers in use");
+	if (mempool_peak_large < min_peak)
+		panic("large buffer peak too low");
+	if (!LIST_EMPTY(&mempool_partial_slabs) ||
+	    !LIST_EMPTY(&mempool_full_slabs))
+		panic("slabs in use");
+}
+
+/*
+ * Perform random allocations and frees, of sizes that cover all classes as
+ * well as excessive sizes, which must fail.
+ */
+static void
+test_random(void)
+{
+	unsigned int n, slot;
+	int excessive;
+	size_t size;
+
+	excessive = 0;
+
+	for (n = 0; n < ITERATIONS; n++) {
+		slot = random() % SLOTS;
+
+		if (slot_ptr[slot] != NULL) {
+			free_slot(slot);
+
+			continue;
+		}
+
+		size = random() % (MEMPOOL_LARGE_SIZE + 9);
+
+		if (alloc_slot(slot, size) == NULL) {
+			if (size <= MEMPOOL_LARGE_SIZE)
+				panic("allocation of %zu bytes failed", size);
+			excessive++;
+		} else if (size > MEMPOOL_LARGE_SIZE)
+			panic("excessive allocation succeeded");
+	}
+
+	for (slot = 0; slot < SLOTS; slot++)
+		if (slot_ptr[slot] != NULL)
+			free_slot(slot);
+
+	check_empty(SLOTS / 16);
+
+	if (mempool_failed != excessive)
+		panic("failure count %d, expected %d", mempool_failed,
+		    excessive);
+}
+
+/*
+ * Check the sysctl subtree, including one of the lwIP pool statistics.
+ */
+static void
+test_mib(void)
+{
+	struct rmib_node *node;
+	struct stats_mem stats;
+	int val;
+
+	if (registered != &minix_lwip_mempool_node)
+		panic("subtree not registered");
+
+	if (MEMP_MAX == 0)
+		return;
+
+	memset(&stats, 0, sizeof(stats));
+	stats.used = 3;
+	stats.max = 5;
+	stats.avail = 7;
+	stats.err = 11;
+	lwip_stats.memp[0] = &stats;
+
+	node = &minix_lwip_memp_stat_table[0][MEMPOOL_MEMP_PEAK];
+
+	if (node->rnode_func(NULL, node, (struct rmib_oldp *)&val,
+	    NULL) != sizeof(val) || val != 5)
+		panic("wrong pool statistic");
+
+	if (minix_lwip_memp_table[0].rnode_cptr !=
+	    minix_lwip_memp_stat_table[0])
+		panic("wrong pool node");
+
+	lwip_stats.memp[0] = NULL;
+}
+
+/*
+ * Let the timer free all but one slab, run the pool out of large buffers with
+ * a limit of two slabs, and check that the timer frees the second slab after
+ * everything is freed again.
+ */
+static void
+test_limit(void)
+{
+	unsigned int slot, count;
+
+	mempool_timer.tmr_func(0);
+	mempool_timer.tmr_func(0);
+	if (mempool_nr_slabs != 1)
+		panic("unused slabs not freed");
+
+	mempool_max_slabs = 2;
+
+	for (slot = 0; slot < SLOTS; slot++)
+		if (alloc_slot(slot, MEMPOOL_LARGE_SIZE) == NULL)
+			break;
+
+	count = slot;
+
+	if (count != 2 * MEMPOOL_LARGE_COUNT)
+		panic("got %u large buffers from two slabs", count);
+	if (mempool_nr_slabs != 2 || mempool_cur_buffers() != count)
+		panic("wrong slab count");
+
+	/* Small buffers must still be available from the static pool. */
+	if (alloc_slot(count, 1) == NULL)
+		panic("no static small buffer");
+	free_slot(count);
+
+	for (slot = 0; slot < count; slot++)
+		free_slot(slot);
+
+	check_empty(0);
+
+	mempool_timer.tmr_func(0);
+	if (mempool_nr_slabs != 2)
+		panic("slab freed too early");
+
+	mempool_timer.tmr_func(0);
+	if (mempool_nr_slabs != 1)
+		panic("unused slab not freed");
+
+	mempool_max_slabs = MEMPOOL_DEFAULT_MAX_SLABS;
+}
+
+/*
+ * Return the current time in microseconds.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Print the cost of allocating and freeing a buffer of each class, with a
+ * number of other buffers of the same class in use.
+ */
+static void
+bench(void)
+{
+	static const struct {
+		const char *name;
+		size_t size;
+	} classes[] = {
+		{ "small",	MEMPOOL_SMALL_SIZE },
+		{ "medium",	MEMPOOL_MEDIUM_SIZE },
+		{ "large",	MEMPOOL_LARGE_SIZE },
+	};
+	unsigned long long t0, t1;
+	unsigned int class, n, slot;
+	void *ptr;
+
+	for (class = 0; class < __arraycount(classes); class++) {
+		for (slot = 0; slot < SLOTS / 4; slot++)
+			slot_ptr[slot] = mempool_malloc(classes[class].size);
+
+		t0 = get_usecs();
+
+		for (n = 0; n < BENCH_RUNS; n++) {
+			slot = n % (SLOTS / 4);
+
+			mempool_free(slot_ptr[slot]);
+			ptr = mempool_malloc(classes[class].size);
+			if (ptr == NULL)
+				panic("allocation failed");
+			slot_ptr[slot] = ptr;
+		}
+
+		t1 = get_usecs();
+
+		for (slot = 0; slot < SLOTS / 4; slot++) {
+			mempool_free(slot_ptr[slot]);
+			slot_ptr[slot] = NULL;
+		}
+
+		printf("%s buffers (%zu bytes): %llu ns per free and "
+		    "allocation\n", classes[class].name, classes[class].size,
+		    (t1 - t0) * 1000 / BENCH_RUNS);
+	}
+}
+
+int
+main(void)
+{
+
+	srandom(49);
+
+	mempool_init();
+
+	test_random();
+
+	test_mib();
+
+	test_limit();
+
+	printf("mempool: ok (peak %d small, %d medium, %d large buffers)\n",
+	    mempool_class[MEMPOOL_CLASS_SMALL].mc_peak,
+	    mempool_class[MEMPOOL_CLASS_MEDIUM].mc_peak, mempool_peak_large);
+
+	bench();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/* LWIP service - test/rtdir_test.c - IPv4 routing table test */
+/*
+ * This program checks the compiled IPv4 routing table of rtdir.c against the
+ * routing tree of rttree.c, from which the table is compiled.  It adds and
+ * deletes random routes, with many overlapping prefixes, and after each change
+ * compares the results of looking up random addresses in both.  Finally, it
+ * fills the table up and prints the cost of a lookup in each, in nanoseconds.
+ */
+
+#include <sys/time.h>
+
+#include "host.h"
+#include "../rttree.h"
+#include "../rtdir.h"
+
+#define NR_ROUTES	RTDIR_MAX_ROUTES	/* number of test routes */
+#define ITERATIONS	200000		/* number of route changes */
+#define LOOKUPS		50		/* number of lookups per change */
+#define BENCH_LOOKUPS	10000000	/* number of lookups to time */
+
+static struct test_route {
+	struct rttree_entry tr_entry;		/* routing tree entry */
+	int tr_used;				/* is the route in use? */
+	uint8_t tr_addr[IP4_BITS / NBBY];	/* destination address */
+	uint8_t tr_mask[IP4_BITS / NBBY];	/* destination mask */
+} route[NR_ROUTES];
+
+static struct rttree tree;
+
+/*
+ * Return a random IPv4 address.  Most addresses are taken from a small part
+ * of the address space, so that routes overlap a lot.
+ */
+static void
+random_addr(uint8_t * addr)
+{
+	uint32_t val;
+
+	val = (uint32_t)random() ^ ((uint32_t)random() << 16);
+	if (random() % 4 != 0)
+		val &= 0x0f0f0fff;
+
+	memcpy(addr, &val, IP4_BITS / NBBY);
+}
+
+/*
+ * Return a random prefix length.
+ */
+static unsigned int
+random_prefix(void)
+{
+
+	switch (random() % 8) {
+	case 0:
+		return random() % (IP4_BITS + 1);
+	case 1:
+		return IP4_BITS;
+	case 2:
+		return (random() % 5) * NBBY;
+	default:
+		return NBBY + random() % (IP4_BITS - NBBY + 1);
+	}
+}
+
+/*
+ * Add route 'i' with a random destination.  Return 0 on success, or -1 if the
+ * routing tree already has a route for that destination.
+ */
+static int
+add_route(unsigned int i)
+{
+	struct test_route *tr = &route[i];
+	unsigned int byte, prefix;
+
+	prefix = random_prefix();
+	random_addr(tr->tr_addr);
+	addr_make_netmask(tr->tr_mask, sizeof(tr->tr_mask), prefix);
+	for (byte = 0; byte < sizeof(tr->tr_addr); byte++)
+		tr->tr_addr[byte] &= tr->tr_mask[byte];
+
+	if (rttree_add(&tree, &tr->tr_entry, tr->tr_addr,
+	    (prefix < IP4_BITS) ? tr->tr_mask : NULL, prefix) != OK)
+		return -1;
+
+	rtdir_add(&tr->tr_entry);
+	tr->tr_used = TRUE;
+
+	return 0;
+}
+
+/*
+ * Delete route 'i'.
+ */
+static void
+del_route(unsigned int i)
+{
+	struct test_route *tr = &route[i];
+
+	rttree_delete(&tree, &tr->tr_entry);
+	rtdir_delete(&tr->tr_entry);
+	tr->tr_used = FALSE;
+}
+
+/*
+ * Check that the routing table and the routing tree give the same route for
+ * the given address.
+ */
+static void
+check_lookup(const uint8_t * addr)
+{
+
+	if (rtdir_lookup(addr) != rttree_lookup_match(&tree, addr)) {
+		fprintf(stderr, "mismatch for %u.%u.%u.%u\n", addr[0],
+		    addr[1], addr[2], addr[3]);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Return the current time in microseconds.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Print the cost of looking up random addresses in the table and in the tree.
+ */
+static void
+bench(void)
+{
+	static uint8_t addrs[4096][IP4_BITS / NBBY];
+	unsigned long long t0, t1, t2;
+	uintptr_t sum;
+	unsigned int i, count;
+
+	for (i = count = 0; i < NR_ROUTES; i++)
+		if (route[i].tr_used || add_route(i) == 0)
+			count++;
+
+	for (i = 0; i < __arraycount(addrs); i++)
+		random_addr(addrs[i]);
+
+	sum = 0;
+	t0 = get_usecs();
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+		sum += (uintptr_t)rtdir_lookup(addrs[i % __arraycount(addrs)]);
+	t1 = get_usecs();
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+		sum -= (uintptr_t)rttree_lookup_match(&tree,
+		    addrs[i % __arraycount(addrs)]);
+	t2 = get_usecs();
+
+	if (sum != 0)
+		panic("lookup results differ");
+
+	printf("%u routes: table %llu ns, tree %llu ns per lookup\n", count,
+	    (t1 - t0) * 1000 / BENCH_LOOKUPS, (t2 - t1) * 1000 / BENCH_LOOKUPS);
+}
+
+int
+main(void)
+{
+	uint8_t addr[IP4_BITS / NBBY];
+	unsigned int n, i, k;
+
+	srandom(47);
+
+	rttree_init(&tree, IP4_BITS);
+	rtdir_init(&tree);
+
+	for (n = 0; n < ITERATIONS; n++) {
+		i = random() % NR_ROUTES;
+
+		if (!route[i].tr_used)
+			(void)add_route(i);
+		else
+			del_route(i);
+
+		for (k = 0; k < LOOKUPS; k++) {
+			random_addr(addr);
+			check_lookup(addr);
+		}
+
+		/* Also look up the route's own network and broadcast. */
+		if (route[i].tr_used) {
+			check_lookup(route[i].tr_addr);
+			for (k = 0; k < sizeof(addr); k++)
+				addr[k] = route[i].tr_addr[k] |
+				    ~route[i].tr_mask[k];
+			check_lookup(addr);
+		}
+	}
+
+	printf("rtdir: ok\n");
+
+	bench();
+
+	return EXIT_SUCCESS;
+}
@@ -10,6 +10,8 @@
 #include "vnode.h"
 #include "file.h"
 #include <sys/ioctl.h>
+#include <minix/partition.h>
+#include <sys/ioc_disk.h>
 
 /*
  * Perform the ioctl(2) system call.
@@ -33,6 +35,16 @@ do_ioctl(void)
 
 	switch (vp->v_mode & S_IFMT) {
 	case S_IFBLK:
+		/*
+		 * Requests that destroy data on the device are allowed only
+		 * on block devices opened for writing.
+		 */
+		if ((request == DIOCDISCARD || request == DIOCZERO) &&
+		    !(f->filp_mode & W_BIT)) {
+			r = EBADF;
+			break;
+		}
+
 		f->filp_ioctl_fp = fp;
 
 		r = bdev_ioctl(vp->v_sdev, who_e, request, arg);
@@ -1,6 +1,9 @@
 /* Test 72 - libminixfs unit test.
  *
- * Exercise the caching functionality of libminixfs in isolation.
+ * Exercise the caching functionality of libminixfs in isolation.  The fake
+ * asynchronous block device calls below hold on to requests until they are
+ * waited for, and then complete them in random order, so that the tests also
+ * cover keeping several transfers in flight at various I/O depths.
  */
 
 #define _MINIX_SYSTEM
@@ -35,6 +38,22 @@ static int curblocksize = -1;
 
 static char *writtenblocks[MAXBLOCKS];
 
+/* Asynchronous requests that have been issued but not yet completed. */
+#define MAXASYN	(LMFS_MAX_IODEPTH + 1)	/* one more, to catch overruns */
+
+static struct asyn {
+	int write;
+	bdev_id_t id;
+	u64_t pos;
+	iovec_t vec[NR_IOREQS];
+	int count;
+	bdev_callback_t callback;
+	bdev_param_t param;
+} asyn[MAXASYN];
+
+static unsigned int asyn_busy, asyn_max, asyn_total, asyn_refuse;
+static bdev_id_t asyn_next_id;
+
 /* Some functions used by testcache.c */
 
 int
@@ -161,6 +180,95 @@ bdev_scatter(dev_t dev, u64_t pos, iovec_t *vec, int count, int flags)
 	return tot;
 }
 
+static bdev_id_t
+bdev_vrdwt_asyn(int write, dev_t dev, u64_t pos, iovec_t *vec, int count,
+	bdev_callback_t callback, bdev_param_t param)
+{
+	struct asyn *ap;
+	unsigned int i;
+
+	assert(dev == MYDEV);
+	assert(count > 0 && count <= NR_IOREQS);
+
+	/* Now and then, pretend that the request cannot be queued. */
+	if (asyn_refuse > 0 && random() % asyn_refuse == 0)
+		return ENOMEM;
+
+	for (i = 0; i < MAXASYN; i++)
+		if (asyn[i].callback == NULL)
+			break;
+	if (i == MAXASYN) {
+		e(40);
+		return ENOMEM;
+	}
+
+	/* The caller may reuse the vector as soon as we return. */
+	ap = &asyn[i];
+	ap->write = write;
+	ap->id = asyn_next_id++;
+	ap->pos = pos;
+	memcpy(ap->vec, vec, sizeof(vec[0]) * count);
+	ap->count = count;
+	ap->callback = callback;
+	ap->param = param;
+
+	if (++asyn_busy > asyn_max)
+		asyn_max = asyn_busy;
+	asyn_total++;
+
+	return ap->id;
+}
+
+bdev_id_t
+bdev_gather_asyn(dev_t dev, u64_t pos, iovec_t *vec, int count, int flags,
+	bdev_callback_t callback, bdev_param_t param)
+{
+	return bdev_vrdwt_asyn(FALSE, dev, pos, vec, count, callback, param);
+}
+
+bdev_id_t
+bdev_scatter_asyn(dev_t dev, u64_t pos, iovec_t *vec, int count, int flags,
+	bdev_callback_t callback, bdev_param_t param)
+{
+	return bdev_vrdwt_asyn(TRUE, dev, pos, vec, count, callback, param);
+}
+
+int
+bdev_wait_asyn(bdev_id_t id)
+{
+	struct asyn *ap;
+	bdev_callback_t callback;
+	ssize_t r;
+	int i, found;
+
+	/* Complete pending requests in random order, up to the given one. */
+	do {
+		found = FALSE;
+		for (i = 0; i < MAXASYN; i++)
+			if (asyn[i].callback != NULL && asyn[i].id == id)
+				found = TRUE;
+		if (!found)
+			return EINVAL;
+
+		do {
+			ap = &asyn[random() % MAXASYN];
+		} while (ap->callback == NULL);
+
+		if (ap->write)
+			r = bdev_scatter(MYDEV, ap->pos, ap->vec, ap->count, 0);
+		else
+			r = bdev_gather(MYDEV, ap->pos, ap->vec, ap->count, 0);
+
+		callback = ap->callback;
+		ap->callback = NULL;
+		asyn_busy--;
+
+		callback(MYDEV, ap->id, ap->param, r);
+	} while (ap->id != id);
+
+	return OK;
+}
+
 ssize_t
 bdev_read(dev_t dev, u64_t pos, char *data, size_t count, int flags)
 {
@@ -252,6 +360,7 @@ main(int argc, char *argv[])
 {
 	size_t newblocksize;
 	int wss, cs, n = 0, p;
+	unsigned int depth;
 
 #define ITER 3
 #define BLOCKS 200
@@ -286,6 +395,28 @@ main(int argc, char *argv[])
 		}
 	}
 
+	/* Does the cache keep several transfers in flight, and no more than
+	 * allowed, also if some of them cannot be queued?
+	 */
+	lmfs_set_blocksize(PAGE_SIZE);
+	curblocksize = PAGE_SIZE;
+	for(depth = 1; depth <= LMFS_MAX_IODEPTH; depth *= 4) {
+		for(asyn_refuse = 0; asyn_refuse <= 8; asyn_refuse += 8) {
+			lmfs_set_iodepth(depth);
+			lmfs_buf_pool(BLOCKS / 4);
+			asyn_max = asyn_total = 0;
+			if(dotest(curblocksize, BLOCKS, ITER)) e(n);
+			lmfs_flushall();
+			if(asyn_busy != 0) e(n);
+			if(asyn_max > depth) e(n);
+			if(depth == 1 && asyn_total != 0) e(n);
+			if(depth > 1 && asyn_max < 2) e(n);
+			n++;
+		}
+	}
+	asyn_refuse = 0;
+	lmfs_set_iodepth(LMFS_DEF_IODEPTH);
+
 	quit();
 
 	return 0;
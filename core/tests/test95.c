@@ -0,0 +1,416 @@
+/* Test 95 - libtimers unit test.
+ *
+ * Exercise the timer wheel of libtimers in isolation: set, clear and expire
+ * timers at random, and compare the results against a plain reference list of
+ * expiry times.  Every timer must go off at the first processing time at or
+ * after its expiry time, and never before.  When run with the -b option, the
+ * program instead prints the cost of timer operations with up to 100000 timers
+ * on a single queue.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <minix/timers.h>
+
+#include "common.h"
+
+#define NR_TIMERS	128	/* number of timers in the randomized test */
+#define ITERATIONS	100000	/* number of random operations per subtest */
+
+static minix_timers_t tmrs;
+static minix_timer_t timer[NR_TIMERS];
+
+/*
+ * The reference list: whether each timer is set, the earliest time at which it
+ * may go off, and the time by which it must have gone off.  The two times are
+ * the same, except for timers set for a time that has already passed: those
+ * may go off right away, and must go off by the next clock tick.
+ */
+static int armed[NR_TIMERS];
+static clock_t earliest[NR_TIMERS];
+static clock_t expected[NR_TIMERS];
+
+static clock_t now;		/* current time of the simulated clock */
+static unsigned int fired;	/* number of watchdog calls so far */
+static int meddle;		/* may watchdog calls change other timers? */
+
+/*
+ * Return a random timeout, in clock ticks.  Mix short timeouts, timeouts that
+ * end up on the higher levels of the wheel, and timeouts beyond its range.
+ */
+static clock_t
+random_ticks(void)
+{
+
+	switch (random() % 8) {
+	case 0:
+		return 0;
+	case 1:
+	case 2:
+		return random() % 64;
+	case 3:
+	case 4:
+		return random() % 4096;
+	case 5:
+		return random() % (1 << 18);
+	case 6:
+		return random() % (1 << 24);
+	default:
+		return random() % (1 << 27);
+	}
+}
+
+/*
+ * Check that the queue agrees with the reference list, and that its head time
+ * is no later than the expiry time of any of its timers.
+ */
+static void
+check_queue(void)
+{
+	unsigned int i, count;
+
+	count = 0;
+
+	for (i = 0; i < NR_TIMERS; i++) {
+		if (!!tmr_is_set(&timer[i]) != armed[i]) e(0);
+
+		if (!armed[i])
+			continue;
+
+		if (!tmr_is_first(tmrs.tmrs_head, expected[i])) e(0);
+
+		count++;
+	}
+
+	if (tmrs.tmrs_count != count) e(0);
+}
+
+/*
+ * The watchdog function of all timers in the randomized test.  Check that the
+ * timer was not expected to go off any later, and sometimes set or clear
+ * another timer, as real watchdog functions do.
+ */
+static void
+watchdog(int arg)
+{
+	unsigned int i;
+
+	fired++;
+
+	if (arg < 0 || arg >= NR_TIMERS) e(0);
+	if (!armed[arg]) e(0);
+	if (tmr_is_set(&timer[arg])) e(0);
+
+	/* Going off early is just as bad as going off late. */
+	if (!tmr_is_first(earliest[arg], now)) e(0);
+
+	armed[arg] = FALSE;
+
+	if (!meddle)
+		return;
+
+	switch (random() % 4) {
+	case 0:
+		i = random() % NR_TIMERS;
+		earliest[i] = expected[i] = now + 1 + random() % 4096;
+		(void)tmrs_settimer(&tmrs, &timer[i], expected[i], now,
+		    watchdog, i, NULL, NULL);
+		armed[i] = TRUE;
+		break;
+	case 1:
+		i = random() % NR_TIMERS;
+		(void)tmrs_clrtimer(&tmrs, &timer[i], NULL, NULL);
+		armed[i] = FALSE;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Set timer 'i' from outside any watchdog function, to go off at absolute time
+ * 'exp_time', and update the reference list.
+ */
+static void
+set_timer_at(unsigned int i, clock_t exp_time)
+{
+	clock_t old_head, new_head;
+	unsigned int j;
+	int had_timers, r;
+
+	had_timers = FALSE;
+	for (j = 0; j < NR_TIMERS; j++)
+		if (armed[j])
+			had_timers = TRUE;
+
+	r = tmrs_settimer(&tmrs, &timer[i], exp_time, now, watchdog, i,
+	    &old_head, &new_head);
+	if (r != had_timers) e(0);
+
+	armed[i] = TRUE;
+	if (tmr_is_first(exp_time, now)) {
+		earliest[i] = now;
+		expected[i] = now + 1;
+	} else
+		earliest[i] = expected[i] = exp_time;
+
+	if (!tmr_is_first(new_head, expected[i])) e(0);
+}
+
+/*
+ * Advance the simulated clock to the given time, processing the queue at each
+ * of its head times along the way, as a caller with an alarm would.  Sometimes
+ * process the queue a bit late, as happens when an alarm is delayed.
+ */
+static void
+advance(clock_t target)
+{
+	clock_t head, span;
+	unsigned int i;
+	int r;
+
+	while (tmrs_has_expired(&tmrs, target)) {
+		/* A head time that has already passed is processed now. */
+		if (!tmr_is_first(tmrs.tmrs_head, now))
+			now = tmrs.tmrs_head;
+
+		span = target - now;
+		if (span > 0 && random() % 4 == 0)
+			now += random() % (span + 1);
+
+		r = tmrs_exptimers(&tmrs, now, &head);
+
+		/* No timer that is due may be left on the queue. */
+		for (i = 0; i < NR_TIMERS; i++)
+			if (armed[i] && tmr_is_first(expected[i], now)) e(0);
+
+		if (r != (tmrs.tmrs_count > 0)) e(0);
+		if (r && tmr_is_first(head, now)) e(0);
+
+		check_queue();
+	}
+
+	now = target;
+}
+
+/*
+ * Run a randomized test, starting at the given time.
+ */
+static void
+test_random(clock_t start_time)
+{
+	unsigned int i, n;
+
+	memset(&tmrs, 0, sizeof(tmrs));
+	for (i = 0; i < NR_TIMERS; i++) {
+		tmr_inittimer(&timer[i]);
+		armed[i] = FALSE;
+	}
+
+	now = start_time;
+	meddle = TRUE;
+
+	for (n = 0; n < ITERATIONS; n++) {
+		i = random() % NR_TIMERS;
+
+		switch (random() % 8) {
+		case 0:
+		case 1:
+		case 2:
+			set_timer_at(i, now + random_ticks());
+			break;
+		case 3:
+			set_timer_at(i, now - random() % 64);
+			break;
+		case 4:
+			(void)tmrs_clrtimer(&tmrs, &timer[i], NULL, NULL);
+			armed[i] = FALSE;
+			break;
+		default:
+			if (random() % 16 == 0)
+				advance(now + random_ticks());
+			else
+				advance(now + random() % 64);
+			break;
+		}
+
+		check_queue();
+	}
+
+	/* Let all remaining timers go off. */
+	meddle = FALSE;
+
+	while (tmrs.tmrs_count > 0)
+		advance(tmrs.tmrs_head);
+
+	if (tmrs.tmrs_count != 0) e(0);
+	for (i = 0; i < NR_TIMERS; i++)
+		if (armed[i]) e(0);
+}
+
+/*
+ * Test randomized operations on a timers queue.
+ */
+static void
+test95a(void)
+{
+
+	subtest = 1;
+
+	srandom(95);
+	fired = 0;
+
+	test_random(0);
+
+	/* Also cover the case that the clock wraps around. */
+	test_random((clock_t)0 - (1 << 25));
+
+	/* Make sure that the test did what it was supposed to do. */
+	if (fired < ITERATIONS / 16) e(0);
+}
+
+/*
+ * Test that a timer set on an empty queue does not hold back a timer set after
+ * it with an earlier expiry time.
+ */
+static void
+test95b(void)
+{
+	clock_t head;
+
+	subtest = 2;
+
+	memset(&tmrs, 0, sizeof(tmrs));
+	tmr_inittimer(&timer[0]);
+	tmr_inittimer(&timer[1]);
+	armed[0] = armed[1] = FALSE;
+
+	now = 100;
+	meddle = FALSE;
+
+	set_timer_at(0, 1100);
+	set_timer_at(1, 110);
+
+	if (tmrs.tmrs_head != 110) e(0);
+
+	advance(110);
+
+	if (armed[1]) e(0);
+	if (!armed[0]) e(0);
+
+	/* The first timer must not have moved either. */
+	(void)tmrs_exptimers(&tmrs, now, &head);
+	if (!tmr_is_first(head, 1100)) e(0);
+
+	advance(1100);
+
+	if (armed[0]) e(0);
+	if (tmrs.tmrs_count != 0) e(0);
+}
+
+/*
+ * Return the current time in microseconds, for the benchmark.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0) e(0);
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+bench_watchdog(int __unused arg)
+{
+
+	fired++;
+}
+
+/*
+ * Print the average cost of setting, moving, clearing and expiring timers on a
+ * queue with the given number of concurrent timers.
+ */
+static void
+bench(unsigned int count)
+{
+	minix_timer_t *tp;
+	unsigned long long t0, t1, t2, t3, t4, t5;
+	unsigned int i, calls;
+	clock_t head;
+
+	if ((tp = calloc(count, sizeof(*tp))) == NULL) e(0);
+
+	memset(&tmrs, 0, sizeof(tmrs));
+	for (i = 0; i < count; i++)
+		tmr_inittimer(&tp[i]);
+
+	now = 0;
+	fired = 0;
+	calls = 0;
+
+	t0 = get_usecs();
+
+	for (i = 0; i < count; i++)
+		(void)tmrs_settimer(&tmrs, &tp[i], 1 + random() % (1 << 20),
+		    now, bench_watchdog, i, NULL, NULL);
+
+	t1 = get_usecs();
+
+	for (i = 0; i < count; i++)
+		(void)tmrs_settimer(&tmrs, &tp[i], 1 + random() % (1 << 20),
+		    now, bench_watchdog, i, NULL, NULL);
+
+	t2 = get_usecs();
+
+	for (i = 0; i < count; i++)
+		(void)tmrs_clrtimer(&tmrs, &tp[i], NULL, NULL);
+
+	t3 = get_usecs();
+
+	for (i = 0; i < count; i++)
+		(void)tmrs_settimer(&tmrs, &tp[i], 1 + random() % (1 << 20),
+		    now, bench_watchdog, i, NULL, NULL);
+
+	t4 = get_usecs();
+
+	head = tmrs.tmrs_head;
+	while (tmrs_exptimers(&tmrs, head, &head))
+		calls++;
+
+	t5 = get_usecs();
+
+	if (fired != count) e(0);
+
+	printf("%6u timers: set %4llu ns, reset %4llu ns, clear %4llu ns, "
+	    "expire %4llu ns per timer (%u runs)\n", count,
+	    (t1 - t0) * 1000 / count, (t2 - t1) * 1000 / count,
+	    (t3 - t2) * 1000 / count, (t5 - t4) * 1000 / count, calls + 1);
+
+	free(tp);
+}
+
+int
+main(int argc, char ** argv)
+{
+	unsigned int count;
+
+	if (argc == 2 && !strcmp(argv[1], "-b")) {
+		srandom(95);
+
+		for (count = 1000; count <= 100000; count *= 10)
+			bench(count);
+
+		return 0;
+	}
+
+	start(95);
+
+	test95a();
+	test95b();
+
+	quit();
+}
@@ -0,0 +1,411 @@
+/* Test 96 - large directory test.
+ *
+ * Fill a directory with many entries, in random order, and check that each of
+ * them can be looked up, that names not in the directory cannot, and that
+ * reading the directory returns every entry exactly once.  Then remove and
+ * re-add entries and check again.  This is mainly meant to test file systems
+ * that index large directories, such as ext2 with dir_index; testext2.sh runs
+ * this test on such a file system.  The number of entries may be given as an
+ * argument.  When run with the -b option, the program instead prints the cost
+ * of lookups in a directory with 10000, 100000 and 1000000 entries, created in
+ * the given directory.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+#define NR_ENTRIES	3000	/* default number of directory entries */
+#define BIG_ENTRIES	20000	/* number of directory entries in big mode */
+#define MAX_LINKS	1000	/* maximum number of links per target file */
+#define LOOKUPS		100000	/* number of lookups per benchmark step */
+
+static const char *dir;		/* directory holding the entries */
+static ino_t *target_ino;	/* inode numbers of the link target files */
+static unsigned int links_per_target;
+
+/*
+ * Produce the name of entry 'i' in the given buffer.  The names vary in length
+ * so as to spread their hashes and fill directory blocks unevenly.
+ */
+static void
+get_name(char * buf, size_t size, unsigned int i)
+{
+	static const char pad[] = "abcdefghijklmnopqrstuvwxyz0123456789ABCD";
+
+	snprintf(buf, size, "%s/e%u-%.*s", dir, i,
+	    (int)(i % (sizeof(pad) - 1)), pad);
+}
+
+/*
+ * Return the entry number encoded in the given name, or -1 if the name is not
+ * that of an entry.
+ */
+static long
+get_index(const char * name)
+{
+	char *end;
+	long i;
+
+	if (name[0] != 'e')
+		return -1;
+
+	i = strtol(&name[1], &end, 10);
+	if (end == &name[1] || *end != '-')
+		return -1;
+
+	return i;
+}
+
+/*
+ * Prepare to create up to 'count' entries, with the link targets in the
+ * current directory and the entries in directory 'path', which is created.
+ */
+static void
+init_entries(const char * path, unsigned int count)
+{
+	long link_max;
+
+	dir = path;
+
+	if (mkdir(dir, 0755) != 0) e(0);
+
+	if ((link_max = pathconf(".", _PC_LINK_MAX)) < 2) e(0);
+	if (link_max > MAX_LINKS)
+		link_max = MAX_LINKS;
+	links_per_target = link_max - 1;
+
+	if ((target_ino = calloc(count / links_per_target + 1,
+	    sizeof(target_ino[0]))) == NULL) e(0);
+}
+
+/*
+ * Create entry 'i', as a hard link to one of the target files, so that a large
+ * directory does not need as many inodes.  Create the target file as needed.
+ */
+static void
+add_entry(unsigned int i)
+{
+	char name[PATH_MAX], target[32];
+	struct stat st;
+	unsigned int t;
+	int fd;
+
+	t = i / links_per_target;
+	snprintf(target, sizeof(target), "t%u", t);
+
+	if (target_ino[t] == 0) {
+		if ((fd = open(target, O_CREAT | O_RDWR, 0644)) < 0) e(0);
+		if (fstat(fd, &st) != 0) e(0);
+		if (close(fd) != 0) e(0);
+		target_ino[t] = st.st_ino;
+	}
+
+	get_name(name, sizeof(name), i);
+
+	if (link(target, name) != 0) e(0);
+}
+
+/*
+ * Remove entry 'i'.
+ */
+static void
+del_entry(unsigned int i)
+{
+	char name[PATH_MAX];
+
+	get_name(name, sizeof(name), i);
+
+	if (unlink(name) != 0) e(0);
+}
+
+/*
+ * Check whether entry 'i' can be looked up if and only if it should exist.
+ */
+static void
+check_entry(unsigned int i, int exists)
+{
+	char name[PATH_MAX];
+	struct stat st;
+
+	get_name(name, sizeof(name), i);
+
+	if (exists) {
+		if (lstat(name, &st) != 0) e(0);
+		if (st.st_ino != target_ino[i / links_per_target]) e(0);
+	} else {
+		if (lstat(name, &st) != -1) e(0);
+		if (errno != ENOENT) e(0);
+	}
+}
+
+/*
+ * Remove all target files.
+ */
+static void
+free_entries(unsigned int count)
+{
+	char target[32];
+	unsigned int t;
+
+	for (t = 0; t <= count / links_per_target; t++) {
+		if (target_ino[t] == 0)
+			continue;
+
+		snprintf(target, sizeof(target), "t%u", t);
+		if (unlink(target) != 0) e(0);
+	}
+
+	free(target_ino);
+	target_ino = NULL;
+}
+
+/*
+ * Return a random permutation of the numbers 0 to count - 1.
+ */
+static unsigned int *
+get_order(unsigned int count)
+{
+	unsigned int *order, i, j, tmp;
+
+	if ((order = malloc(count * sizeof(order[0]))) == NULL) e(0);
+
+	for (i = 0; i < count; i++)
+		order[i] = i;
+
+	for (i = count - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	return order;
+}
+
+/*
+ * Check that reading the directory returns each existing entry exactly once,
+ * and nothing else apart from "." and "..".
+ */
+static void
+check_readdir(unsigned int count, const char * present)
+{
+	struct dirent *dp;
+	char *seen;
+	DIR *dirp;
+	long i;
+
+	if ((seen = calloc(count, 1)) == NULL) e(0);
+
+	if ((dirp = opendir(dir)) == NULL) e(0);
+
+	while ((dp = readdir(dirp)) != NULL) {
+		if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, ".."))
+			continue;
+
+		i = get_index(dp->d_name);
+		if (i < 0 || (unsigned long)i >= count) {
+			e(0);
+			continue;
+		}
+
+		if (!present[i]) e(0);
+		if (seen[i]) e(0);
+		seen[i] = 1;
+	}
+
+	if (closedir(dirp) != 0) e(0);
+
+	for (i = 0; (unsigned long)i < count; i++)
+		if (present[i] && !seen[i]) e(0);
+
+	free(seen);
+}
+
+/*
+ * Check that exactly the present entries can be looked up, as well as a
+ * number of names that were never in the directory.
+ */
+static void
+check_all(unsigned int count, const char * present)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		check_entry(i, present[i]);
+
+	for (i = count; i < count + count / 4; i++)
+		check_entry(i, 0);
+
+	check_readdir(count, present);
+}
+
+/*
+ * Test filling, thinning out, refilling and emptying a large directory.
+ */
+static void
+test96a(unsigned int count)
+{
+	char name[PATH_MAX], *present;
+	unsigned int *order, i;
+
+	subtest = 1;
+
+	init_entries("d", count);
+
+	if ((present = calloc(count, 1)) == NULL) e(0);
+
+	/* Add all entries in random order. */
+	order = get_order(count);
+
+	for (i = 0; i < count; i++) {
+		add_entry(order[i]);
+		present[order[i]] = 1;
+
+		/* Spot-check the entries while the directory grows. */
+		if (i % 256 == 0)
+			check_entry(order[random() % (i + 1)], 1);
+	}
+
+	check_all(count, present);
+
+	/* Remove a random third of the entries. */
+	for (i = 0; i < count; i++) {
+		if (random() % 3 == 0) {
+			del_entry(i);
+			present[i] = 0;
+		}
+	}
+
+	check_all(count, present);
+
+	/* Adding an entry that already exists must fail. */
+	for (i = 0; i < count && !present[i]; i++);
+	if (i < count) {
+		get_name(name, sizeof(name), i);
+		if (link("t0", name) != -1) e(0);
+		if (errno != EEXIST) e(0);
+	}
+
+	/* Add the removed entries back, in the same order as before. */
+	for (i = 0; i < count; i++) {
+		if (!present[order[i]]) {
+			add_entry(order[i]);
+			present[order[i]] = 1;
+		}
+	}
+
+	check_all(count, present);
+
+	/* Remove all entries.  The directory must then be empty. */
+	for (i = 0; i < count; i++) {
+		del_entry(order[i]);
+		present[order[i]] = 0;
+	}
+
+	check_all(count, present);
+
+	if (rmdir(dir) != 0) e(0);
+
+	free(order);
+	free(present);
+	free_entries(count);
+}
+
+/*
+ * Return the current time in microseconds, for the benchmark.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0) e(0);
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Print the cost of creating entries in, and looking up entries in and names
+ * absent from, a directory that grows to the given number of entries.  The
+ * directory is created in the given path, and removed afterwards.
+ */
+static void
+bench(const char * path, unsigned int max)
+{
+	unsigned long long t0, t1, t2, t3;
+	unsigned int count, prev, i;
+
+	if (chdir(path) != 0) e(0);
+
+	init_entries("d96", max);
+
+	prev = 0;
+
+	for (count = 10000; count <= max; count *= 10) {
+		t0 = get_usecs();
+
+		for (i = prev; i < count; i++)
+			add_entry(i);
+
+		t1 = get_usecs();
+
+		for (i = 0; i < LOOKUPS; i++)
+			check_entry(random() % count, 1);
+
+		t2 = get_usecs();
+
+		for (i = 0; i < LOOKUPS; i++)
+			check_entry(count + random() % count, 0);
+
+		t3 = get_usecs();
+
+		printf("%7u entries: create %6llu ns, lookup %6llu ns, "
+		    "miss %6llu ns\n", count, (t1 - t0) * 1000 / (count - prev),
+		    (t2 - t1) * 1000 / LOOKUPS, (t3 - t2) * 1000 / LOOKUPS);
+
+		prev = count;
+	}
+
+	for (i = 0; i < prev; i++)
+		del_entry(i);
+
+	if (rmdir(dir) != 0) e(0);
+
+	free_entries(max);
+}
+
+int
+main(int argc, char ** argv)
+{
+	unsigned int count;
+
+	srandom(96);
+
+	if (argc >= 3 && !strcmp(argv[1], "-b")) {
+		count = (argc == 4) ? atoi(argv[3]) : 1000000;
+
+		bench(argv[2], count);
+
+		return 0;
+	}
+
+	start(96);
+
+	if (argc == 2)
+		count = atoi(argv[1]);
+	else
+		count = getenv(BIGVARNAME) ? BIG_ENTRIES : NR_ENTRIES;
+
+	test96a(count);
+
+	quit();
+}
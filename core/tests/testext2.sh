@@ -0,0 +1,72 @@
+#!/bin/sh
+
+# Shell script used to test the ext2 file system service.
+
+# The main purpose of this script is to test large directories, both indexed
+# (dir_index) and linear ones, on file systems created with newfs_ext2fs(8).
+# It runs the large directory test, test96, on each file system, and checks
+# the file system with fsck_ext2fs(8) afterwards.  The indexed file system has
+# 1 KB blocks, so that the test's directory needs two levels of index nodes.
+# The lookup benchmark of test96 can be run by hand on a file system prepared
+# in the same way, with "test96 -b <directory>".
+
+bomb() {
+  echo $*
+  cd ..
+  umount /dev/vnd0 >/dev/null 2>&1
+  vndconfig -u vnd0 >/dev/null 2>&1
+  rm -rf $TESTDIR
+  exit 1
+}
+
+PATH=/bin:/usr/bin:/sbin:/usr/sbin
+export PATH
+
+TESTDIR=DIR_EXT2
+export TESTDIR
+
+echo -n "Test ext2 "
+
+# We cannot run the test if vnd0 is in use.
+if vndconfig -l vnd0 >/dev/null 2>&1; then
+  if ! vndconfig -l vnd0 2>/dev/null | grep "not in use" >/dev/null; then
+    echo "vnd0 in use, skipping test" >&2
+    echo "ok"
+    exit 0
+  else
+    minix-service down vnd0
+  fi
+fi
+
+rm -rf $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+mkdir mnt
+
+# Create an ext2 file system with the given newfs_ext2fs(8) options, run the
+# large directory test on it with the given number of entries, and check it.
+run_test() {
+  dd if=/dev/zero of=image bs=4096 count=8192 2>/dev/null || bomb "out of space?"
+  vndconfig vnd0 image || bomb "unable to configure vnd0"
+  newfs_ext2fs -V 0 $1 /dev/vnd0 >/dev/null || bomb "unable to newfs vnd0"
+  mount -t ext2 /dev/vnd0 mnt >/dev/null || bomb "unable to mount vnd0"
+  (cd mnt && ../../test96 $2 >/dev/null) || bomb "test96 failed ($1)"
+  umount /dev/vnd0 >/dev/null || bomb "unable to unmount vnd0"
+  fsck_ext2fs -fn /dev/vnd0 >fsck.out 2>&1 || bomb "fsck failed ($1)"
+  grep "? no" fsck.out >/dev/null && bomb "file system damaged ($1)"
+  vndconfig -u vnd0 || bomb "unable to unconfigure vnd0"
+  rm -f image fsck.out
+}
+
+# An indexed directory, large enough to need two levels of index nodes.
+run_test "-O 1 -H -b 1024" 20000
+
+# A linear directory, on a file system without dir_index.
+run_test "-O 1 -b 4096" 3000
+
+cd ..
+rm -rf $TESTDIR
+
+echo "ok"
+exit 0
@@ -0,0 +1,62 @@
+#!/bin/sh
+
+# Shell script used to test the allocation of space on a full MFS file system.
+
+# The main purpose of this script is to test that the free inode and zone
+# counts kept by MFS, as reported by statvfs(2), agree with the bitmaps at all
+# times.  It runs tfill on a fresh, small file system, which fills it up, thins
+# it out, fills it up again and empties it, and checks the file system with
+# fsck.mfs(8) afterwards.  The allocation benchmark of tfill can be run by hand
+# on a larger file system prepared in the same way, with "tfill -b <directory>";
+# it prints the cost of creating a file as the file system fills up.
+
+bomb() {
+  echo $*
+  cd ..
+  umount /dev/vnd0 >/dev/null 2>&1
+  vndconfig -u vnd0 >/dev/null 2>&1
+  rm -rf $TESTDIR
+  exit 1
+}
+
+PATH=/bin:/usr/bin:/sbin:/usr/sbin
+export PATH
+
+TESTDIR=DIR_FILL
+export TESTDIR
+
+echo -n "Test fill "
+
+# We cannot run the test if vnd0 is in use.
+if vndconfig -l vnd0 >/dev/null 2>&1; then
+  if ! vndconfig -l vnd0 2>/dev/null | grep "not in use" >/dev/null; then
+    echo "vnd0 in use, skipping test" >&2
+    echo "ok"
+    exit 0
+  else
+    minix-service down vnd0
+  fi
+fi
+
+rm -rf $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+mkdir mnt
+
+dd if=/dev/zero of=image bs=4096 count=4096 2>/dev/null || bomb "out of space?"
+vndconfig vnd0 image || bomb "unable to configure vnd0"
+mkfs.mfs /dev/vnd0 || bomb "unable to mkfs vnd0"
+mount -t mfs /dev/vnd0 mnt >/dev/null || bomb "unable to mount vnd0"
+../tfill mnt || bomb "tfill failed"
+umount /dev/vnd0 >/dev/null || bomb "unable to unmount vnd0"
+fsck.mfs -a /dev/vnd0 >fsck.out 2>&1 || bomb "fsck failed"
+grep "FILE SYSTEM HAS BEEN MODIFIED" fsck.out >/dev/null && \
+  bomb "file system damaged"
+vndconfig -u vnd0 || bomb "unable to unconfigure vnd0"
+
+cd ..
+rm -rf $TESTDIR
+
+echo "ok"
+exit 0
@@ -0,0 +1,273 @@
+/* Tests and benchmark for file system space allocation.  Part of testfill.sh. */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+
+static char *buf;
+static size_t buf_size;
+
+/*
+ * Return the current time in microseconds.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0)
+		err(EXIT_FAILURE, "gettimeofday");
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+get_stat(const char * path, struct statvfs * st)
+{
+
+	if (statvfs(path, st) != 0)
+		err(EXIT_FAILURE, "statvfs");
+}
+
+/*
+ * Create file 'i' in the given directory, with 'size' bytes of data.  Return
+ * 0 on success.  Return -1 if the file system ran out of space, in which case
+ * no file is left behind.  Any other failure is fatal.
+ */
+static int
+add_file(const char * dir, unsigned int i, size_t size)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%u", dir, i);
+
+	if ((fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644)) < 0) {
+		if (errno == ENOSPC)
+			return -1;
+		err(EXIT_FAILURE, "open");
+	}
+
+	if (write(fd, buf, size) != (ssize_t)size) {
+		if (errno != ENOSPC)
+			err(EXIT_FAILURE, "write");
+
+		(void)close(fd);
+		if (unlink(path) != 0)
+			err(EXIT_FAILURE, "unlink");
+		return -1;
+	}
+
+	if (close(fd) != 0)
+		err(EXIT_FAILURE, "close");
+
+	return 0;
+}
+
+static void
+del_file(const char * dir, unsigned int i)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%u", dir, i);
+
+	if (unlink(path) != 0)
+		err(EXIT_FAILURE, "unlink");
+}
+
+/*
+ * Fill the file system that holds the given directory with single-block files,
+ * thin them out, fill it up again, and empty it.  The file system must not be
+ * used by anything else at the same time, because the free inode and block
+ * counts reported by statvfs(2) are checked throughout.  These counts and the
+ * allocation of free space must agree with each other at all times.
+ */
+static void
+test(const char * path)
+{
+	struct statvfs st0, st, prev;
+	char dir[PATH_MAX];
+	unsigned int i, count, freed, refilled;
+	char *present;
+
+	get_stat(path, &st0);
+
+	snprintf(dir, sizeof(dir), "%s/fill", path);
+	if (mkdir(dir, 0755) != 0)
+		err(EXIT_FAILURE, "mkdir");
+
+	buf_size = st0.f_frsize;
+	if ((buf = calloc(1, buf_size)) == NULL ||
+	    (present = calloc(st0.f_files, 1)) == NULL)
+		err(EXIT_FAILURE, "calloc");
+
+	/* Fill up the file system.  Each file takes exactly one inode. */
+	get_stat(path, &prev);
+
+	for (count = 0; add_file(dir, count, buf_size) == 0; count++) {
+		get_stat(path, &st);
+
+		if (st.f_ffree != prev.f_ffree - 1)
+			errx(EXIT_FAILURE, "free inode count off after create");
+		if (st.f_bfree >= prev.f_bfree)
+			errx(EXIT_FAILURE, "free block count off after create");
+
+		present[count] = 1;
+		prev = st;
+	}
+
+	if (count == 0)
+		errx(EXIT_FAILURE, "no files could be created");
+	if (prev.f_ffree != 0 && prev.f_bfree * prev.f_frsize > 2 * buf_size)
+		errx(EXIT_FAILURE, "out of space with %lu blocks free",
+		    (unsigned long)prev.f_bfree);
+
+	/* Free every other file, scattering free space across the maps. */
+	freed = 0;
+	for (i = 0; i < count; i += 2) {
+		del_file(dir, i);
+		present[i] = 0;
+		freed++;
+	}
+
+	get_stat(path, &st);
+	if (st.f_ffree != prev.f_ffree + freed)
+		errx(EXIT_FAILURE, "free inode count off after delete");
+
+	/* All that space must be found again. */
+	for (i = 0, refilled = 0; i < count; i++) {
+		if (present[i])
+			continue;
+		if (add_file(dir, i, buf_size) != 0)
+			break;
+		present[i] = 1;
+		refilled++;
+	}
+
+	if (refilled != freed)
+		errx(EXIT_FAILURE, "recreated %u of %u files", refilled, freed);
+
+	get_stat(path, &st);
+	if (st.f_ffree != prev.f_ffree || st.f_bfree != prev.f_bfree)
+		errx(EXIT_FAILURE, "free counts off after refill");
+
+	/* Empty the file system again.  All space must be back. */
+	for (i = 0; i < count; i++)
+		del_file(dir, i);
+
+	if (rmdir(dir) != 0)
+		err(EXIT_FAILURE, "rmdir");
+
+	get_stat(path, &st);
+	if (st.f_ffree != st0.f_ffree || st.f_bfree != st0.f_bfree)
+		errx(EXIT_FAILURE, "free counts off after emptying");
+
+	free(present);
+	free(buf);
+}
+
+/*
+ * Fill the file system that holds the given directory with files of the given
+ * size, and print the average cost of creating a file and of statvfs(2) at
+ * each tenth of the way.  Then remove all the files again.
+ */
+static void
+bench(const char * path, size_t size)
+{
+	unsigned long long t0, t1, t2, create[10], stats[10];
+	unsigned int count, files[10], level, i;
+	struct statvfs st0, st;
+	char dir[PATH_MAX];
+
+	get_stat(path, &st0);
+	if (st0.f_bfree == 0)
+		errx(EXIT_FAILURE, "file system is full");
+
+	snprintf(dir, sizeof(dir), "%s/fill", path);
+	if (mkdir(dir, 0755) != 0)
+		err(EXIT_FAILURE, "mkdir");
+
+	buf_size = size;
+	if ((buf = calloc(1, buf_size)) == NULL)
+		err(EXIT_FAILURE, "calloc");
+
+	memset(create, 0, sizeof(create));
+	memset(stats, 0, sizeof(stats));
+	memset(files, 0, sizeof(files));
+
+	for (count = 0; ; count++) {
+		t0 = get_usecs();
+
+		if (add_file(dir, count, buf_size) != 0)
+			break;
+
+		t1 = get_usecs();
+
+		get_stat(path, &st);
+
+		t2 = get_usecs();
+
+		level = (unsigned int)((st0.f_bfree - st.f_bfree) * 10 /
+		    st0.f_bfree);
+		if (level > 9)
+			level = 9;
+
+		create[level] += t1 - t0;
+		stats[level] += t2 - t1;
+		files[level]++;
+	}
+
+	printf("%u files of %zu bytes\n", count, size);
+
+	for (level = 0; level < 10; level++) {
+		if (files[level] == 0)
+			continue;
+
+		printf("%3u%%-%3u%% full: %7u files, create %6llu us, "
+		    "statvfs %4llu us\n", level * 10, level * 10 + 10,
+		    files[level], create[level] / files[level],
+		    stats[level] / files[level]);
+	}
+
+	t0 = get_usecs();
+
+	for (i = 0; i < count; i++)
+		del_file(dir, i);
+
+	t1 = get_usecs();
+
+	if (count > 0)
+		printf("delete %llu us per file\n", (t1 - t0) / count);
+
+	if (rmdir(dir) != 0)
+		err(EXIT_FAILURE, "rmdir");
+
+	free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+
+	if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "-b")) {
+		bench(argv[2], (argc == 4) ? atoi(argv[3]) * 1024 : 65536);
+
+		return EXIT_SUCCESS;
+	}
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s [-b] directory [kbytes]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	test(argv[1]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+/*
+ * File system I/O benchmark, in the spirit of fio(1).  It measures the file
+ * system and block cache rather than the device, which rawspeed(8) measures.
+ * It writes a test file sequentially, or reads it sequentially or at random,
+ * from one or more processes, and prints the throughput and the number of I/O
+ * calls per second.  Writes include the final fsync(2), so that the cost of
+ * writing back the dirty blocks is counted as well.  For reads to come from
+ * the device, remount the file system after writing the file.
+ *
+ * For example, to compare I/O depths on an ext2 file system:
+ *
+ *	mount -t ext2 -o iodepth=1 /dev/c0d1p0 /mnt
+ *	tfio -w -s 256 /mnt/file
+ *	umount /mnt && mount -t ext2 -o iodepth=1 /dev/c0d1p0 /mnt
+ *	tfio -r /mnt/file
+ *	umount /mnt && mount -t ext2 -o iodepth=1 /dev/c0d1p0 /mnt
+ *	tfio -R -j 4 /mnt/file
+ *
+ * and then the same with iodepth=4 and iodepth=16.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define DEF_BSIZE	(64 * 1024)	/* default I/O size */
+#define DEF_SIZE	(64 * 1024 * 1024)	/* default file size */
+#define MAX_JOBS	64		/* maximum number of processes */
+
+static enum { SEQ_WRITE, SEQ_READ, RAND_READ } mode = SEQ_READ;
+static size_t bsize = DEF_BSIZE;
+static off_t size = DEF_SIZE;
+static unsigned int count = 0;
+static unsigned int jobs = 1;
+
+/*
+ * Return the current time in microseconds.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0)
+		err(EXIT_FAILURE, "gettimeofday");
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Perform the I/O share of job 'job' out of 'jobs' on the given file, and
+ * return the number of I/O calls made.  Sequential jobs each take a contiguous
+ * part of the file; random jobs each read 'count' blocks from anywhere in it.
+ */
+static unsigned int
+run_job(const char * path, unsigned int job)
+{
+	char *buf;
+	off_t pos, end, nblocks;
+	unsigned int i, calls;
+	ssize_t r;
+	int fd;
+
+	if ((buf = malloc(bsize)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+
+	if ((fd = open(path, (mode == SEQ_WRITE) ? O_WRONLY : O_RDONLY)) < 0)
+		err(EXIT_FAILURE, "open");
+
+	calls = 0;
+	nblocks = size / bsize;
+
+	if (mode == RAND_READ) {
+		srandom(job + 1);
+
+		for (i = 0; i < count; i++) {
+			pos = (off_t)(random() % nblocks) * bsize;
+
+			if ((r = pread(fd, buf, bsize, pos)) < 0)
+				err(EXIT_FAILURE, "pread");
+			if ((size_t)r != bsize)
+				errx(EXIT_FAILURE, "short read");
+			calls++;
+		}
+	} else {
+		pos = nblocks * job / jobs * bsize;
+		end = nblocks * (job + 1) / jobs * bsize;
+
+		for (; pos < end; pos += bsize) {
+			if (mode == SEQ_WRITE)
+				r = pwrite(fd, buf, bsize, pos);
+			else
+				r = pread(fd, buf, bsize, pos);
+			if (r < 0)
+				err(EXIT_FAILURE, "I/O");
+			if ((size_t)r != bsize)
+				errx(EXIT_FAILURE, "short transfer");
+			calls++;
+		}
+
+		if (mode == SEQ_WRITE && fsync(fd) != 0)
+			err(EXIT_FAILURE, "fsync");
+	}
+
+	(void)close(fd);
+	free(buf);
+
+	return calls;
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: tfio [-w | -r | -R] [-b kbytes] [-s mbytes] "
+	    "[-n count] [-j jobs] file\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long long t0, t1;
+	unsigned int job, calls;
+	const char *path;
+	struct stat st;
+	pid_t pid;
+	int c, fd, status;
+
+	while ((c = getopt(argc, argv, "wrRb:s:n:j:")) != -1) {
+		switch (c) {
+		case 'w':
+			mode = SEQ_WRITE;
+			break;
+		case 'r':
+			mode = SEQ_READ;
+			break;
+		case 'R':
+			mode = RAND_READ;
+			break;
+		case 'b':
+			bsize = atoi(optarg) * 1024;
+			break;
+		case 's':
+			size = (off_t)atoi(optarg) * 1024 * 1024;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1 || bsize == 0 || jobs < 1 || jobs > MAX_JOBS)
+		usage();
+	path = argv[optind];
+
+	if (mode == SEQ_WRITE) {
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			err(EXIT_FAILURE, "open");
+		(void)close(fd);
+	} else {
+		if (stat(path, &st) != 0)
+			err(EXIT_FAILURE, "stat");
+		size = st.st_size;
+	}
+
+	if (size < (off_t)bsize)
+		errx(EXIT_FAILURE, "file smaller than I/O size");
+	if (count == 0)
+		count = size / bsize / jobs;
+
+	t0 = get_usecs();
+
+	if (jobs == 1)
+		calls = run_job(path, 0);
+	else {
+		for (job = 0; job < jobs; job++) {
+			if ((pid = fork()) < 0)
+				err(EXIT_FAILURE, "fork");
+			if (pid == 0)
+				exit(run_job(path, job) > 0 ? EXIT_SUCCESS :
+				    EXIT_FAILURE);
+		}
+
+		for (job = 0; job < jobs; job++) {
+			if (wait(&status) < 0)
+				err(EXIT_FAILURE, "wait");
+			if (!WIFEXITED(status) ||
+			    WEXITSTATUS(status) != EXIT_SUCCESS)
+				errx(EXIT_FAILURE, "job failed");
+		}
+
+		if (mode == RAND_READ)
+			calls = count * jobs;
+		else
+			calls = size / bsize;
+	}
+
+	t1 = get_usecs();
+
+	if (t1 == t0)
+		t1++;
+
+	printf("%s: %u x %zu bytes, %u jobs, %llu ms, %llu KB/s, %llu IOPS\n",
+	    (mode == SEQ_WRITE) ? "write" : (mode == SEQ_READ) ? "read" :
+	    "random read", calls, bsize, jobs, (t1 - t0) / 1000,
+	    (unsigned long long)calls * bsize * 1000 / 1024 * 1000 / (t1 - t0),
+	    (unsigned long long)calls * 1000000 / (t1 - t0));
+
+	return EXIT_SUCCESS;
+}
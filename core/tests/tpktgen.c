@@ -0,0 +1,239 @@
+/*
+ * Packet rate benchmark, in the spirit of pktgen.  In sender mode, it sends
+ * UDP packets of a given size to a given address as fast as it can, for a
+ * given number of seconds, and prints the number of packets sent per second.
+ * In receiver mode, it counts the packets that arrive on a given port, and
+ * prints the number of packets received per second and the number lost, based
+ * on the sequence numbers in the packets.  The receiver stops after having
+ * received no packets for a while.
+ *
+ * To measure the path between the TCP/IP service and a network driver, run the
+ * sender and the receiver on different machines, for example with MINIX 3 in
+ * QEMU with a virtio_net device and the receiver on the host (the program also
+ * builds on other systems):
+ *
+ *	host$ tpktgen -r 5000
+ *	minix# tpktgen -s -l 64 -t 10 10.0.2.2 5000
+ *
+ * and the other way around.  Traffic over the loopback interface does not pass
+ * through a network driver.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEF_LEN		64	/* default UDP payload size */
+#define MAX_LEN		1472	/* maximum UDP payload size without fragments */
+#define DEF_SECS	10	/* default time to send, in seconds */
+#define IDLE_SECS	2	/* receiver stops after this many idle seconds */
+
+static volatile sig_atomic_t done = 0;
+
+static void
+got_alarm(int sig)
+{
+
+	done = 1;
+}
+
+/*
+ * Return the current time in microseconds.
+ */
+static unsigned long long
+get_usecs(void)
+{
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0)
+		err(EXIT_FAILURE, "gettimeofday");
+
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Send packets of 'len' bytes to the given address and port for 'secs'
+ * seconds.  Each packet starts with its sequence number.
+ */
+static void
+sender(const char * host, unsigned short port, size_t len, unsigned int secs)
+{
+	struct sockaddr_in sin;
+	unsigned long long t0, t1;
+	unsigned int errors;
+	uint32_t seq;
+	char buf[MAX_LEN];
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &sin.sin_addr) != 1)
+		errx(EXIT_FAILURE, "invalid address: %s", host);
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		err(EXIT_FAILURE, "socket");
+
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		err(EXIT_FAILURE, "connect");
+
+	memset(buf, 0, sizeof(buf));
+
+	signal(SIGALRM, got_alarm);
+	alarm(secs);
+
+	t0 = get_usecs();
+
+	for (seq = 0, errors = 0; !done; ) {
+		memcpy(buf, &seq, sizeof(seq));
+
+		if (send(fd, buf, len, 0) < 0) {
+			/* Full send queues are part of the measurement. */
+			if (errno != ENOBUFS && errno != EAGAIN &&
+			    errno != EINTR)
+				err(EXIT_FAILURE, "send");
+			errors++;
+			continue;
+		}
+
+		seq++;
+	}
+
+	t1 = get_usecs();
+
+	printf("sent %u packets of %zu bytes in %llu ms: %llu packets/s "
+	    "(%u send failures)\n", seq, len, (t1 - t0) / 1000,
+	    (unsigned long long)seq * 1000000 / (t1 - t0), errors);
+
+	(void)close(fd);
+}
+
+/*
+ * Receive packets on the given port until none arrive for a while.
+ */
+static void
+receiver(unsigned short port)
+{
+	struct sockaddr_in sin;
+	struct timeval tv;
+	unsigned long long t0, t1;
+	uint32_t seq, next, count, lost;
+	char buf[MAX_LEN];
+	ssize_t r;
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		err(EXIT_FAILURE, "socket");
+
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		err(EXIT_FAILURE, "bind");
+
+	/* Wait for the first packet without a time limit. */
+	if ((r = recv(fd, buf, sizeof(buf), 0)) < 0)
+		err(EXIT_FAILURE, "recv");
+
+	t0 = t1 = get_usecs();
+
+	tv.tv_sec = IDLE_SECS;
+	tv.tv_usec = 0;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0)
+		err(EXIT_FAILURE, "setsockopt");
+
+	count = lost = 0;
+	next = 0;
+
+	for (;;) {
+		if ((size_t)r >= sizeof(seq)) {
+			memcpy(&seq, buf, sizeof(seq));
+
+			/* Late packets are not counted as lost twice. */
+			if (seq > next)
+				lost += seq - next;
+			if (seq >= next)
+				next = seq + 1;
+		}
+		count++;
+		t1 = get_usecs();
+
+		if ((r = recv(fd, buf, sizeof(buf), 0)) < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno != EINTR)
+				err(EXIT_FAILURE, "recv");
+		}
+	}
+
+	if (t1 == t0)
+		t1++;
+
+	printf("received %u packets in %llu ms: %llu packets/s "
+	    "(%u lost)\n", count, (t1 - t0) / 1000,
+	    (unsigned long long)count * 1000000 / (t1 - t0), lost);
+
+	(void)close(fd);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: tpktgen -s [-l length] [-t seconds] "
+	    "address port\n");
+	fprintf(stderr, "       tpktgen -r port\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int secs = DEF_SECS;
+	size_t len = DEF_LEN;
+	int c, send_mode = -1;
+
+	while ((c = getopt(argc, argv, "srl:t:")) != -1) {
+		switch (c) {
+		case 's':
+			send_mode = 1;
+			break;
+		case 'r':
+			send_mode = 0;
+			break;
+		case 'l':
+			len = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (len < sizeof(uint32_t) || len > MAX_LEN || secs == 0)
+		usage();
+
+	if (send_mode == 1 && argc == 2)
+		sender(argv[0], atoi(argv[1]), len, secs);
+	else if (send_mode == 0 && argc == 1)
+		receiver(atoi(argv[0]));
+	else
+		usage();
+
+	return EXIT_SUCCESS;
+}
@@ -13,6 +13,11 @@ block_ioctl_name(unsigned long req)
 	NAME(BIOCTRACEBUF);
 	NAME(BIOCTRACECTL);
 	NAME(BIOCTRACEGET);	/* big IOCTL, not printing argument */
+	NAME(BIOCTRACESTAT);	/* TODO: print argument */
+	NAME(BIOCPOLLCTL);
+	NAME(BIOCPOLLGET);	/* TODO: print argument */
+	NAME(BIOCSCHEDCTL);
+	NAME(BIOCSCHEDGET);	/* TODO: print argument */
 	NAME(DIOCSETP);
 	NAME(DIOCGETP);
 	NAME(DIOCEJECT);	/* no argument */
@@ -21,10 +26,17 @@ block_ioctl_name(unsigned long req)
 	NAME(DIOCFLUSH);	/* no argument */
 	NAME(DIOCGETWC);
 	NAME(DIOCSETWC);
+	NAME(DIOCDISCARD);
+	NAME(DIOCZERO);
 	NAME(FBDCADDRULE);
 	NAME(FBDCDELRULE);
 	NAME(FBDCGETRULE);
+	NAME(COWCOMMIT);
+	NAME(COWDISCARD);
+	NAME(COWGETSTAT);	/* TODO: print argument */
 	NAME(MIOCRAMSIZE);
+	NAME(MIOCRAMSPARSE);
+	NAME(MIOCRAMSTAT);	/* TODO: print argument */
 	NAME(MTIOCGET);		/* TODO: print argument */
 	NAME(MTIOCTOP);		/* TODO: print argument */
 	NAME(VNDIOCCLR);
@@ -71,6 +83,8 @@ block_ioctl_arg(struct trace_proc * proc, unsigned long req, void * ptr,
 	int dir)
 {
 	struct part_geom *part;
+	struct part_range *range;
+	struct ramdisk_sparse *sparse;
 	struct fbd_rule *rule;
 	struct vnd_ioctl *vnd;
 	struct vnd_user *vnu;
@@ -93,6 +107,23 @@ block_ioctl_arg(struct trace_proc * proc, unsigned long req, void * ptr,
 			put_field(proc, NULL, "BTCTL_START");
 		else if (!valuesonly && i == BTCTL_STOP)
 			put_field(proc, NULL, "BTCTL_STOP");
+		else if (!valuesonly && i == BTCTL_RING)
+			put_field(proc, NULL, "BTCTL_RING");
+		else
+			put_value(proc, NULL, "%d", i);
+		return IF_ALL;
+
+	case BIOCSCHEDCTL:
+		if (ptr == NULL)
+			return IF_OUT;
+
+		i = *(int *)ptr;
+		if (!valuesonly && i == BSCHED_OFF)
+			put_field(proc, NULL, "BSCHED_OFF");
+		else if (!valuesonly && i == BSCHED_ON)
+			put_field(proc, NULL, "BSCHED_ON");
+		else if (!valuesonly && i == BSCHED_RESET)
+			put_field(proc, NULL, "BSCHED_RESET");
 		else
 			put_value(proc, NULL, "%d", i);
 		return IF_ALL;
@@ -143,6 +174,15 @@ block_ioctl_arg(struct trace_proc * proc, unsigned long req, void * ptr,
 		put_value(proc, NULL, "%d", *(int *)ptr);
 		return IF_ALL;
 
+	case DIOCDISCARD:
+	case DIOCZERO:
+		if ((range = (struct part_range *)ptr) == NULL)
+			return IF_OUT;
+
+		put_value(proc, "base", "%"PRIu64, range->base);
+		put_value(proc, "size", "%"PRIu64, range->size);
+		return IF_ALL;
+
 	case FBDCDELRULE:
 		if (ptr == NULL)
 			return IF_OUT;
@@ -191,6 +231,14 @@ block_ioctl_arg(struct trace_proc * proc, unsigned long req, void * ptr,
 		put_value(proc, NULL, "%"PRIu32, *(u32_t *)ptr);
 		return IF_ALL;
 
+	case MIOCRAMSPARSE:
+		if ((sparse = (struct ramdisk_sparse *)ptr) == NULL)
+			return IF_OUT;
+
+		put_value(proc, "size", "%"PRIu64, sparse->size);
+		put_value(proc, "flags", "0x%"PRIx32, sparse->flags);
+		return IF_ALL;
+
 	case VNDIOCSET:
 		if ((vnd = (struct vnd_ioctl *)ptr) == NULL)
 			return IF_OUT | IF_IN;
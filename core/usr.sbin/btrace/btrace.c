@@ -7,6 +7,7 @@
 #include <sys/types.h>
 #include <minix/btrace.h>
 #include <minix/u64.h>
+#include <inttypes.h>
 #include <sys/ioctl.h>
 
 static btrace_entry buf[BTBUF_SIZE];
@@ -18,16 +19,24 @@ usage(void)
 	    "%s start <device> <nr_entries>\n"
 	    "%s stop <device> <file>\n"
 	    "%s reset <device>\n"
-	    "%s dump <file>\n",
-	    getprogname(), getprogname(), getprogname(), getprogname());
+	    "%s dump <file>\n"
+	    "%s ring <device> <nr_entries>\n"
+	    "%s read <device> <file> [interval]\n"
+	    "%s stat <device> [interval [count]]\n"
+	    "%s export <file>\n"
+	    "%s sched <device> on|off|reset|stats\n"
+	    "%s poll <device> on|off|reset|stats\n",
+	    getprogname(), getprogname(), getprogname(), getprogname(),
+	    getprogname(), getprogname(), getprogname(), getprogname(),
+	    getprogname(), getprogname());
 
 	exit(EXIT_FAILURE);
 }
 
 static void
-btrace_start(char * device, int nr_entries)
+btrace_start(char * device, int nr_entries, int ctl)
 {
-	int r, ctl, devfd;
+	int r, devfd;
 	size_t size;
 
 	if ((devfd = open(device, O_RDONLY)) < 0) {
@@ -41,7 +50,6 @@ btrace_start(char * device, int nr_entries)
 		exit(EXIT_FAILURE);
 	}
 
-	ctl = BTCTL_START;
 	if ((r = ioctl(devfd, BIOCTRACECTL, &ctl)) < 0) {
 		perror("ioctl(BIOCTRACECTL)");
 
@@ -102,6 +110,191 @@ btrace_stop(char * device, char * file)
 	close(devfd);
 }
 
+static void
+btrace_read(char * device, char * file, int interval)
+{
+	int r, devfd, outfd;
+	size_t size;
+
+	if ((devfd = open(device, O_RDONLY)) < 0) {
+		perror("device open");
+		exit(EXIT_FAILURE);
+	}
+
+	if ((outfd = open(file, O_CREAT | O_APPEND | O_WRONLY, 0600)) < 0) {
+		perror("file open");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Retrieve whatever the ring holds, and optionally keep doing so. */
+	for (;;) {
+		if ((r = ioctl(devfd, BIOCTRACEGET, buf)) < 0) {
+			perror("ioctl(BIOCTRACEGET)");
+			exit(EXIT_FAILURE);
+		}
+
+		if (r > 0) {
+			size = r * sizeof(buf[0]);
+			if ((r = write(outfd, (char *)buf, size)) != size) {
+				if (r < 0) perror("write");
+				else fputs("short write\n", stderr);
+				exit(EXIT_FAILURE);
+			}
+
+			continue;
+		}
+
+		if (interval == 0) break;
+
+		sleep(interval);
+	}
+
+	close(outfd);
+	close(devfd);
+}
+
+static u64_t
+hist_diff(const u32_t * cur, const u32_t * prev, u32_t * diff)
+{
+	u64_t total;
+	int i;
+
+	for (i = total = 0; i < BTHIST_BUCKETS; i++) {
+		diff[i] = cur[i] - prev[i];
+		total += diff[i];
+	}
+
+	return total;
+}
+
+static unsigned int
+hist_percentile(const u32_t * hist, u64_t total, unsigned int pct)
+{
+	u64_t sum;
+	int i;
+
+	/* Return the upper bound of the bucket holding the percentile. */
+	if (total == 0) return 0;
+
+	for (i = sum = 0; i < BTHIST_BUCKETS - 1; i++) {
+		sum += hist[i];
+		if (sum * 100 >= total * pct) break;
+	}
+
+	return 2U << i;
+}
+
+static void
+btrace_stat(char * device, int interval, int count)
+{
+	btrace_stats cur, prev;
+	u32_t lat[BTHIST_BUCKETS], wlat[BTHIST_BUCKETS];
+	u64_t dt, ops, total;
+	int i, r, devfd, line;
+
+	if ((devfd = open(device, O_RDONLY)) < 0) {
+		perror("device open");
+		exit(EXIT_FAILURE);
+	}
+
+	/* The first line covers the time since the trace was started, and
+	 * every following line covers one interval, as with iostat(8).
+	 */
+	memset(&prev, 0, sizeof(prev));
+
+	for (line = 0; count == 0 || line < count; line++) {
+		if (line > 0) sleep(interval);
+
+		if ((r = ioctl(devfd, BIOCTRACESTAT, &cur)) < 0) {
+			perror("ioctl(BIOCTRACESTAT)");
+			exit(EXIT_FAILURE);
+		}
+
+		if (line % 20 == 0)
+			printf("%8s %8s %10s %10s %6s %5s %8s %8s %8s %6s\n",
+			    "r/s", "w/s", "rkB/s", "wkB/s", "avgqu", "util",
+			    "await", "p50", "p99", "errs");
+
+		if ((dt = cur.time - prev.time) == 0) dt = 1;
+
+		ops = (cur.ops[0] - prev.ops[0]) + (cur.ops[1] - prev.ops[1]);
+
+		total = hist_diff(cur.latency[0], prev.latency[0], lat);
+		total += hist_diff(cur.latency[1], prev.latency[1], wlat);
+		for (i = 0; i < BTHIST_BUCKETS; i++)
+			lat[i] += wlat[i];
+
+		/* By Little's law, the mean service time is the mean number of
+		 * transfers in progress divided by the completion rate.
+		 */
+		printf("%8"PRIu64" %8"PRIu64" %10"PRIu64" %10"PRIu64
+		    " %6.2f %4"PRIu64"%% %8"PRIu64" %8u %8u %6"PRIu64"\n",
+		    (cur.ops[0] - prev.ops[0]) * 1000000 / dt,
+		    (cur.ops[1] - prev.ops[1]) * 1000000 / dt,
+		    (cur.bytes[0] - prev.bytes[0]) * 1000000 / 1024 / dt,
+		    (cur.bytes[1] - prev.bytes[1]) * 1000000 / 1024 / dt,
+		    (double)(cur.depth_time - prev.depth_time) / dt,
+		    (cur.busy - prev.busy) * 100 / dt,
+		    ops ? (cur.depth_time - prev.depth_time) / ops : 0,
+		    hist_percentile(lat, total, 50),
+		    hist_percentile(lat, total, 99),
+		    cur.errors - prev.errors);
+
+		fflush(stdout);
+
+		if (!cur.enabled) break;
+
+		prev = cur;
+	}
+
+	close(devfd);
+}
+
+static void
+btrace_export(char * file)
+{
+	static const char *names[] = {
+		"open", "close", "read", "write", "gather", "scatter", "ioctl"
+	};
+	btrace_entry *entry;
+	int i, r, infd;
+
+	if ((infd = open(file, O_RDONLY)) < 0) {
+		perror("open");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Print one line per completed request, in a format that is easily
+	 * turned into latency heatmaps and the like by other tools.
+	 */
+	printf("start_us,finish_us,latency_us,request,position,size,result\n");
+
+	for (;;) {
+		if ((r = read(infd, (char *)buf, sizeof(buf))) <= 0)
+			break;
+
+		r /= sizeof(buf[0]);
+
+		for (i = 0; i < r; i++) {
+			entry = &buf[i];
+
+			if (entry->result == BTRES_INPROGRESS ||
+			    entry->request >= __arraycount(names))
+				continue;
+
+			printf("%u,%u,%u,%s,%"PRIu64",%u,%d\n",
+			    entry->start_time, entry->finish_time,
+			    entry->finish_time - entry->start_time,
+			    names[entry->request], entry->position,
+			    entry->size, entry->result);
+		}
+	}
+
+	if (r < 0) perror("read");
+
+	close(infd);
+}
+
 static void
 btrace_reset(char * device)
 {
@@ -192,9 +385,113 @@ btrace_dump(char * file)
 	close(infd);
 }
 
+static void
+print_hist(const char * name, const u32_t * hist)
+{
+	int i;
+
+	printf("%s latency (usec):\n", name);
+
+	for (i = 0; i < BSCHED_BUCKETS; i++) {
+		if (hist[i] == 0) continue;
+
+		if (i < BSCHED_BUCKETS - 1)
+			printf("  < %10u: %u\n", 2U << i, hist[i]);
+		else
+			printf("  >=%10u: %u\n", 1U << i, hist[i]);
+	}
+}
+
+static void
+btrace_sched(char * device, char * cmd)
+{
+	bsched_stats stats;
+	int r, ctl, devfd;
+
+	if ((devfd = open(device, O_RDONLY)) < 0) {
+		perror("device open");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!strcmp(cmd, "stats")) {
+		if ((r = ioctl(devfd, BIOCSCHEDGET, &stats)) < 0) {
+			perror("ioctl(BIOCSCHEDGET)");
+			exit(EXIT_FAILURE);
+		}
+
+		printf("scheduling: %s\n", stats.enabled ? "on" : "off");
+		printf("queued: %u\n", stats.queued);
+		printf("dispatched: %"PRIu64"\n", stats.dispatched);
+		printf("merged: %"PRIu64"\n", stats.merged);
+		printf("expired: %"PRIu64"\n", stats.expired);
+
+		print_hist("queue wait", stats.wait);
+		print_hist("service", stats.service);
+	} else {
+		if (!strcmp(cmd, "on")) ctl = BSCHED_ON;
+		else if (!strcmp(cmd, "off")) ctl = BSCHED_OFF;
+		else if (!strcmp(cmd, "reset")) ctl = BSCHED_RESET;
+		else usage();
+
+		if ((r = ioctl(devfd, BIOCSCHEDCTL, &ctl)) < 0) {
+			perror("ioctl(BIOCSCHEDCTL)");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	close(devfd);
+}
+
+static void
+btrace_poll(char * device, char * cmd)
+{
+	bpoll_stats stats;
+	uint64_t total;
+	int r, ctl, devfd;
+
+	if ((devfd = open(device, O_RDONLY)) < 0) {
+		perror("device open");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!strcmp(cmd, "stats")) {
+		if ((r = ioctl(devfd, BIOCPOLLGET, &stats)) < 0) {
+			perror("ioctl(BIOCPOLLGET)");
+			exit(EXIT_FAILURE);
+		}
+
+		printf("polling: %s\n", stats.enabled ? "on" : "off");
+		printf("budget: %u us\n", stats.budget);
+		printf("rounds: %"PRIu64" (%"PRIu64" timed out)\n",
+		    stats.rounds, stats.timeouts);
+		printf("polls: %"PRIu64" (%"PRIu64" hits)\n", stats.polls,
+		    stats.hits);
+		printf("completions: %"PRIu64"\n", stats.completions);
+		printf("interrupts: %"PRIu64"\n", stats.intrs);
+
+		total = stats.completions + stats.intrs;
+		if (total > 0)
+			printf("poll/interrupt ratio: %"PRIu64"%%/%"PRIu64"%%\n",
+			    stats.completions * 100 / total,
+			    stats.intrs * 100 / total);
+	} else {
+		if (!strcmp(cmd, "on")) ctl = BPOLL_ON;
+		else if (!strcmp(cmd, "off")) ctl = BPOLL_OFF;
+		else if (!strcmp(cmd, "reset")) ctl = BPOLL_RESET;
+		else usage();
+
+		if ((r = ioctl(devfd, BIOCPOLLCTL, &ctl)) < 0) {
+			perror("ioctl(BIOCPOLLCTL)");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	close(devfd);
+}
+
 int main(int argc, char ** argv)
 {
-	int num;
+	int num, interval;
 
 	setprogname(argv[0]);
 
@@ -207,7 +504,39 @@ int main(int argc, char ** argv)
 
 		if (num <= 0) usage();
 
-		btrace_start(argv[2], num);
+		btrace_start(argv[2], num, BTCTL_START);
+
+	} else if (!strcmp(argv[1], "ring")) {
+		if (argc < 4) usage();
+
+		num = atoi(argv[3]);
+
+		if (num <= 0) usage();
+
+		btrace_start(argv[2], num, BTCTL_RING);
+
+	} else if (!strcmp(argv[1], "read")) {
+		if (argc < 4) usage();
+
+		num = (argc > 4) ? atoi(argv[4]) : 0;
+
+		if (num < 0) usage();
+
+		btrace_read(argv[2], argv[3], num);
+
+	} else if (!strcmp(argv[1], "stat")) {
+		interval = (argc > 3) ? atoi(argv[3]) : 0;
+		num = (argc > 4) ? atoi(argv[4]) : 0;
+
+		if (interval < 0 || num < 0) usage();
+
+		/* Without an interval, print a single line. */
+		if (interval == 0) num = 1;
+
+		btrace_stat(argv[2], interval, num);
+
+	} else if (!strcmp(argv[1], "export")) {
+		btrace_export(argv[2]);
 
 	} else if (!strcmp(argv[1], "stop")) {
 		if (argc < 4) usage();
@@ -220,6 +549,16 @@ int main(int argc, char ** argv)
 	} else if (!strcmp(argv[1], "dump")) {
 		btrace_dump(argv[2]);
 
+	} else if (!strcmp(argv[1], "sched")) {
+		if (argc < 4) usage();
+
+		btrace_sched(argv[2], argv[3]);
+
+	} else if (!strcmp(argv[1], "poll")) {
+		if (argc < 4) usage();
+
+		btrace_poll(argv[2], argv[3]);
+
 	} else
 		usage();
 
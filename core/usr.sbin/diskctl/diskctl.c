@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <minix/partition.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -15,7 +16,12 @@ usage(void)
 	    "supported commands:\n"
 	    "  getwcache           return write cache status\n"
 	    "  setwcache [on|off]  set write cache status\n"
-	    "  flush               flush write cache\n",
+	    "  flush               flush write cache\n"
+	    "  discard <off> <len> discard a byte range\n"
+	    "  zero <off> <len>    zero a byte range\n"
+	    "  commit              write back copy-on-write overlay\n"
+	    "  revert              throw away copy-on-write overlay\n"
+	    "  cowstat             show copy-on-write overlay status\n",
 	    getprogname());
 
 	exit(EXIT_FAILURE);
@@ -37,9 +43,24 @@ open_dev(const char * dev, int flags)
 	return fd;
 }
 
+static u64_t
+get_number(const char * str)
+{
+	unsigned long long val;
+	char *end;
+
+	val = strtoull(str, &end, 0);
+
+	if (*str == '\0' || *end != '\0') usage();
+
+	return (u64_t)val;
+}
+
 int
 main(int argc, char ** argv)
 {
+	struct part_range range;
+	struct cow_stat stat;
 	int fd, val;
 
 	setprogname(argv[0]);
@@ -98,6 +119,69 @@ main(int argc, char ** argv)
 
 		printf("write cache flushed\n");
 
+	} else if (!strcasecmp(argv[2], "discard") ||
+	    !strcasecmp(argv[2], "zero")) {
+		if (argc != 5) usage();
+
+		range.base = get_number(argv[3]);
+		range.size = get_number(argv[4]);
+
+		fd = open_dev(argv[1], O_WRONLY);
+
+		val = !strcasecmp(argv[2], "zero");
+
+		if (ioctl(fd, val ? DIOCZERO : DIOCDISCARD, &range) != 0) {
+			perror("ioctl");
+
+			return EXIT_FAILURE;
+		}
+
+		close(fd);
+
+		printf("range %s\n", val ? "zeroed" : "discarded");
+
+	} else if (!strcasecmp(argv[2], "commit") ||
+	    !strcasecmp(argv[2], "revert")) {
+		if (argc != 3) usage();
+
+		fd = open_dev(argv[1], O_WRONLY);
+
+		val = !strcasecmp(argv[2], "commit");
+
+		if (ioctl(fd, val ? COWCOMMIT : COWDISCARD, NULL) != 0) {
+			perror("ioctl");
+
+			return EXIT_FAILURE;
+		}
+
+		close(fd);
+
+		printf("overlay %s\n", val ? "committed" : "reverted");
+
+	} else if (!strcasecmp(argv[2], "cowstat")) {
+		if (argc != 3) usage();
+
+		fd = open_dev(argv[1], O_RDONLY);
+
+		if (ioctl(fd, COWGETSTAT, &stat) != 0) {
+			perror("ioctl");
+
+			return EXIT_FAILURE;
+		}
+
+		close(fd);
+
+		printf("size %llu, chunk size %u, %llu chunks in overlay\n",
+		    (unsigned long long)stat.size, stat.chunk,
+		    (unsigned long long)stat.used);
+		printf("read %llu bytes from base, %llu from overlay\n",
+		    (unsigned long long)stat.base_read,
+		    (unsigned long long)stat.over_read);
+		printf("wrote %llu bytes to overlay, %llu partial chunk fills\n",
+		    (unsigned long long)stat.over_write,
+		    (unsigned long long)stat.fills);
+		printf("%llu commits\n", (unsigned long long)stat.commits);
+
 	} else
 		usage();
 
@@ -34,6 +34,9 @@ void mke2fs(const char *, int, int);
 /* variables set up by front end. */
 extern int	Nflag;		/* run mkfs without writing file system */
 extern int	Oflag;		/* format as an 4.3BSD file system */
+#if defined(__minix)
+extern int	Hflag;		/* enable hashed directory indexes */
+#endif /* defined(__minix) */
 extern int	verbosity;	/* amount of printf() output */
 extern int64_t	fssize;		/* file system size */
 extern uint16_t	inodesize;	/* bytes per inode */
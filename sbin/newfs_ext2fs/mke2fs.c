@@ -398,6 +398,16 @@ mke2fs(const char *fsys, int fi, int fo)
 		sblock.e2fs.e2fs_features_incompat = EXT2F_INCOMPAT_FTYPE;
 		sblock.e2fs.e2fs_features_rocompat =
 		    EXT2F_ROCOMPAT_SPARSESUPER | EXT2F_ROCOMPAT_LARGEFILE;
+#if defined(__minix)
+		/*
+		 * The MINIX ext2 file system service maintains hashed
+		 * directory indexes.  Directories are converted to indexed
+		 * ones as they grow, so only the feature flag is needed.
+		 */
+		if (Hflag)
+			sblock.e2fs.e2fs_features_compat |=
+			    EXT2F_COMPAT_DIRHASHINDEX;
+#endif /* defined(__minix) */
 	}
 
 	sblock.e2fs.e2fs_ruid = geteuid();
@@ -113,6 +113,9 @@ static void usage(void) __dead;
 
 int	Nflag;			/* run without writing file system */
 int	Oflag = 0;		/* format as conservative REV0 by default */
+#if defined(__minix)
+int	Hflag = 0;		/* enable hashed directory indexes */
+#endif /* defined(__minix) */
 int	verbosity;		/* amount of printf() output */
 #define DEFAULT_VERBOSITY 3	/* 4 is traditional behavior of newfs(8) */
 int64_t fssize;			/* file system size */
@@ -157,7 +160,7 @@ main(int argc, char *argv[])
 #if !defined(__minix)
 	opstring = "D:FINO:S:V:Zb:f:i:l:m:n:s:v:";
 #else
-	opstring = "D:FINO:S:V:Zb:f:i:l:m:n:s:v:B:";
+	opstring = "D:FHINO:S:V:Zb:f:i:l:m:n:s:v:B:";
 #endif /* !defined(__minix) */
 	byte_sized = 0;
 	while ((ch = getopt(argc, argv, opstring)) != -1)
@@ -171,6 +174,11 @@ main(int argc, char *argv[])
 		case 'F':
 			Fflag = 1;
 			break;
+#if defined(__minix)
+		case 'H':
+			Hflag = 1;
+			break;
+#endif /* defined(__minix) */
 #if !defined(__minix)
 		case 'I':
 			Iflag = 1;
@@ -250,6 +258,11 @@ main(int argc, char *argv[])
 	if (argc != 1)
 		usage();
 
+#if defined(__minix)
+	if (Hflag && Oflag == 0)
+		errx(EXIT_FAILURE, "-H requires filesystem format 1 (-O 1)");
+#endif /* defined(__minix) */
+
 	memset(&sb, 0, sizeof(sb));
 #if !defined(__minix)
 	memset(&dkw, 0, sizeof(dkw));
@@ -506,6 +519,9 @@ static const char help_strings[] =
 	"\t-b bsize\tblock size\n"
 	"\t-D inodesize\tsize of an inode in bytes (128 or 256)\n"
 	"\t-F \t\tcreate file system image in regular file\n"
+#if defined(__minix)
+	"\t-H \t\tenable hashed directory indexes (dir_index)\n"
+#endif /* defined(__minix) */
 	"\t-f fsize\tfragment size\n"
 	"\t-I \t\tdo not check that the file system type is `Linux Ext2'\n"
 	"\t-i density\tnumber of bytes per inode\n"
@@ -71,6 +71,7 @@ struct ttysize {
 #include <sys/ioc_sound.h>	/* 's'			*/
 #include <sys/ioc_block.h>	/* 'b'			*/
 #include <sys/ioc_fbd.h>	/* 'B'			*/
+#include <sys/ioc_cow.h>	/* 'B'			*/
 #include <sys/ioc_fb.h>		/* 'V'			*/
 #include <dev/vndvar.h>		/* 'F'			*/
 #include <dev/i2c/i2c_io.h>
@@ -444,6 +444,14 @@ struct kinfo_pcb {
 	__uint64_t	ki_conn;	/* PTR: control block of peer */
 	__uint64_t	ki_refs;	/* PTR: referencing socket */
 	__uint64_t	ki_nextref;	/* PTR: link in refs list */
+#if defined(__minix)
+	__uint32_t	ki_qlen;	/* INT: listen: accept queue len */
+	__uint32_t	ki_qlimit;	/* INT: listen: accept queue limit */
+	__uint64_t	ki_syndrops;	/* U_LONG: listen: dropped SYNs */
+	__uint64_t	ki_cookiesent;	/* U_LONG: listen: SYN cookies sent */
+	__uint64_t	ki_cookierecv;	/* U_LONG: listen: SYN cookies recvd */
+	__uint64_t	ki_acceptdrops;	/* U_LONG: listen: accept overflows */
+#endif /* defined(__minix) */
 };
 
 #define ki_src ki_s._kis_src